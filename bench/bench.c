@@ -0,0 +1,81 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench.h"
+
+typedef int32_t (*benchFn) (uint32_t rounds);
+
+struct benchmark {
+    const char* name;
+    benchFn fn;
+};
+
+static struct benchmark benchmarks[] = {
+        {"search", searchBench},
+        {"encrypt", encryptBench},
+        {"crypto", cryptoBench},
+        {"json", jsonBench},
+        {"request", requestBench},
+        {"proto", protoBench},
+        {NULL, NULL}
+};
+
+double benchSeconds(void) {
+    ruTimeVal now;
+    ruGetTimeVal(&now);
+    return (double)now.sec + (double)now.usec / 1000000.0;
+}
+
+void benchReport(const char* name, uint64_t count, const char* unit,
+                 double secs) {
+    if (secs <= 0) secs = 0.000001;
+    printf("%-32s %10lu %-8s in %8.3fs %14.1f %s/s\n", name,
+           (unsigned long)count, unit, secs, (double)count / secs, unit);
+}
+
+int main ( int argc, char **argv ) {
+    const char* only = NULL;
+    uint32_t rounds = 1;
+    int32_t failed = 0;
+
+    ruSetLogger(ruStdErrLogSink, RU_LOG_WARN, NULL, false, false);
+    for (int i = 1; i < argc; i++) {
+        if (ruStrEquals(argv[i], "-v")) {
+            ruSetLogger(ruStdErrLogSink, RU_LOG_DBUG, NULL, false, false);
+        } else if (ruStrEquals(argv[i], "-r") && i+1 < argc) {
+            rounds = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            only = argv[i];
+        }
+    }
+    if (!rounds) rounds = 1;
+
+    for (struct benchmark* b = &benchmarks[0]; b->name; b++) {
+        if (only && !ruStrEquals(only, b->name)) continue;
+        printf("== %s\n", b->name);
+        int32_t ret = b->fn(rounds);
+        if (ret != RUE_OK) {
+            fprintf(stderr, "benchmark %s failed with %d\n", b->name, ret);
+            failed++;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef VACCINATOR_BENCH_H
+#define VACCINATOR_BENCH_H
+
+#define APPID "1Ha6xo2u{mRT18"
+
+#include <vaccinator.h>
+#include "../lib/lib.h"
+
+/* Only need to export C interface if used by C++ source code */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+// bench.c
+double benchSeconds(void);
+void benchReport(const char* name, uint64_t count, const char* unit,
+                 double secs);
+
+// benchmarks
+int32_t searchBench(uint32_t rounds);
+int32_t encryptBench(uint32_t rounds);
+int32_t cryptoBench(uint32_t rounds);
+int32_t jsonBench(uint32_t rounds);
+int32_t requestBench(uint32_t rounds);
+int32_t protoBench(uint32_t rounds);
+
+#ifdef __cplusplus
+}   /* extern "C" */
+#endif /* __cplusplus */
+
+#endif //VACCINATOR_BENCH_H
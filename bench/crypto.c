@@ -0,0 +1,92 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench.h"
+
+#define PAYLOAD 4096
+
+static void primitives(bool accelerated, uint32_t rounds) {
+    uint8_t key[32], iv[BLOCKSIZE], digest[32];
+    uint8_t data[PAYLOAD], b64[PAYLOAD * 2];
+    struct dv_aes_key ak;
+    size_t olen, blen = 0;
+    char name[64];
+    uint32_t loops = 2000 * rounds;
+    double start;
+
+    selectCryptoProvider(accelerated);
+    const struct dv_crypto_provider* cp = cryptoProvider();
+    memset(key, 0x42, sizeof(key));
+    memset(iv, 0, sizeof(iv));
+    memset(data, 0x17, sizeof(data));
+
+    cp->aesSetKey(&ak, key, MBEDTLS_AES_ENCRYPT);
+    start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        cp->aesCbc(&ak, MBEDTLS_AES_ENCRYPT, PAYLOAD, iv, data, data);
+    }
+    snprintf(name, sizeof(name), "aes-256-cbc encrypt %s", cp->aesName);
+    benchReport(name, (uint64_t)loops * PAYLOAD >> 20, "MB",
+                benchSeconds() - start);
+    cp->aesFree(&ak);
+
+    cp->aesSetKey(&ak, key, MBEDTLS_AES_DECRYPT);
+    start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        cp->aesCbc(&ak, MBEDTLS_AES_DECRYPT, PAYLOAD, iv, data, data);
+    }
+    snprintf(name, sizeof(name), "aes-256-cbc decrypt %s", cp->aesName);
+    benchReport(name, (uint64_t)loops * PAYLOAD >> 20, "MB",
+                benchSeconds() - start);
+    cp->aesFree(&ak);
+
+    start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        cp->sha256(data, PAYLOAD, digest);
+        data[0] = digest[0];
+    }
+    snprintf(name, sizeof(name), "sha256 %s", cp->shaName);
+    benchReport(name, (uint64_t)loops * PAYLOAD >> 20, "MB",
+                benchSeconds() - start);
+
+    start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        cp->b64Encode(b64, sizeof(b64), &blen, data, PAYLOAD);
+    }
+    snprintf(name, sizeof(name), "base64 encode %s", cp->b64Name);
+    benchReport(name, (uint64_t)loops * PAYLOAD >> 20, "MB",
+                benchSeconds() - start);
+
+    start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        cp->b64Decode(data, sizeof(data), &olen, b64, blen);
+    }
+    snprintf(name, sizeof(name), "base64 decode %s", cp->b64Name);
+    benchReport(name, (uint64_t)loops * PAYLOAD >> 20, "MB",
+                benchSeconds() - start);
+}
+
+int32_t cryptoBench(uint32_t rounds) {
+    primitives(false, rounds);
+    primitives(true, rounds);
+    printf("%s\n", dvCryptoInfo());
+    return RUE_OK;
+}
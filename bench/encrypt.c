@@ -0,0 +1,338 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench.h"
+
+#define MAX_THREADS 8
+
+// a typical small record
+static const char* record = "{\"firstname\":\"Johannes\",\"lastname\":"
+        "\"Müller-Lüdenscheidt\",\"street\":\"Hauptstraße 42a\",\"zip\":\"80331\","
+        "\"city\":\"München\"}";
+
+struct enc_job {
+    uint8_t key[32];
+    enum dvRecipe recipe;
+    uint32_t loops;
+    int32_t ret;
+};
+
+static void* encryptLoop(void* arg) {
+    struct enc_job* job = (struct enc_job*)arg;
+    char* cipher = NULL;
+    for (uint32_t i = 0; i < job->loops; i++) {
+        job->ret = dvAes256Enc(job->key, "18", record, job->recipe, &cipher);
+        ruFree(cipher);
+        if (job->ret != RUE_OK) break;
+    }
+    return NULL;
+}
+
+static int32_t encryptThreads(enum dvRecipe recipe, trans_bytes key,
+                              uint32_t rounds) {
+    struct enc_job jobs[MAX_THREADS];
+    ruThread tids[MAX_THREADS];
+    char name[64];
+    int32_t ret = RUE_OK;
+
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        uint64_t count = 0;
+        double start = benchSeconds();
+        for (int t = 0; t < threads; t++) {
+            memcpy(jobs[t].key, key, sizeof(jobs[t].key));
+            jobs[t].recipe = recipe;
+            jobs[t].loops = 40000 * rounds;
+            jobs[t].ret = RUE_OK;
+            tids[t] = ruThreadCreate(encryptLoop, &jobs[t]);
+        }
+        for (int t = 0; t < threads; t++) {
+            ruThreadJoin(tids[t], NULL);
+            if (jobs[t].ret != RUE_OK) ret = jobs[t].ret;
+            count += jobs[t].loops;
+        }
+        snprintf(name, sizeof(name), "%s %d threads",
+                 recipe == RECIPE_AES_GCM? "aes-256-gcm" : "aes-256-cbc",
+                 threads);
+        benchReport(name, count, "records", benchSeconds() - start);
+        if (ret != RUE_OK) break;
+    }
+    return ret;
+}
+
+// records per dvAes256EncMany call, like one chunk of a batch import
+#define BATCH 256
+
+static int32_t encryptBatch(bool many, trans_bytes key, uint32_t rounds) {
+    const char* records[BATCH];
+    char* ciphers[BATCH];
+    uint32_t loops = 150 * rounds;
+    int32_t ret = RUE_OK;
+
+    for (int i = 0; i < BATCH; i++) records[i] = record;
+    double start = benchSeconds();
+    for (uint32_t l = 0; l < loops && ret == RUE_OK; l++) {
+        if (many) {
+            ret = dvAes256EncMany(key, "18", records, BATCH, RECIPE_AES_CBC,
+                                  CODEC_PLAIN, NULL, ciphers);
+        } else {
+            for (int i = 0; i < BATCH && ret == RUE_OK; i++) {
+                ret = dvAes256Enc(key, "18", records[i], RECIPE_AES_CBC,
+                                  &ciphers[i]);
+            }
+        }
+        if (ret != RUE_OK) break;
+        for (int i = 0; i < BATCH; i++) ruFree(ciphers[i]);
+    }
+    benchReport(many? "aes-256-cbc dvAes256EncMany" : "aes-256-cbc dvAes256Enc",
+                (uint64_t)loops * BATCH, "records", benchSeconds() - start);
+    return ret;
+}
+
+/*
+ * A publish job: the key is derived from the password for every record, or
+ * taken from the context cache.
+ */
+static int32_t publishKeys(bool cached, dvctx ctx, uint32_t rounds) {
+    uint32_t loops = 20000 * rounds;
+    int32_t ret = RUE_OK;
+    char* cipher = NULL;
+    char* msg = NULL;
+    uint8_t key[32];
+    dvkey k = NULL;
+
+    double start = benchSeconds();
+    for (uint32_t i = 0; i < loops && ret == RUE_OK; i++) {
+        if (cached) {
+            ret = getSecretKey(ctx, "publish password", &k);
+            if (ret != RUE_OK) break;
+            ret = dvAes256EncKey(k, "", record, RECIPE_AES_CBC,
+                                 CODEC_PLAIN, NULL, &cipher);
+            if (ret == RUE_OK) {
+                ret = dvAes256DecKey(k, NULL, cipher, &msg, NULL);
+            }
+            putKey(ctx, k);
+        } else {
+            ret = mkKey("publish password", key, NULL);
+            if (ret != RUE_OK) break;
+            ret = dvAes256Enc(key, "", record, RECIPE_AES_CBC, &cipher);
+            if (ret == RUE_OK) ret = dvAes256Dec(key, cipher, &msg, NULL);
+        }
+        ruFree(cipher);
+        ruFree(msg);
+    }
+    benchReport(cached? "publish cached key" : "publish derived key",
+                loops, "records", benchSeconds() - start);
+    return ret;
+}
+
+// a record with history, typical of a care or customer file
+static const char* largeRecord = "{\"firstname\":\"Johannes\",\"lastname\":"
+        "\"Müller-Lüdenscheidt\",\"birthdate\":\"1961-04-12\",\"street\":"
+        "\"Hauptstraße 42a\",\"zip\":\"80331\",\"city\":\"München\","
+        "\"email\":\"johannes.mueller@example.com\",\"phone\":\"+49 89 1234567\","
+        "\"contacts\":[{\"name\":\"Maria Müller-Lüdenscheidt\",\"relation\":"
+        "\"spouse\",\"phone\":\"+49 89 1234568\"},{\"name\":\"Thomas "
+        "Müller-Lüdenscheidt\",\"relation\":\"son\",\"phone\":"
+        "\"+49 170 7654321\"}],\"notes\":[{\"date\":\"2021-02-03\",\"text\":"
+        "\"Patient reports mild headache, advised to return if symptoms "
+        "persist.\"},{\"date\":\"2021-05-17\",\"text\":\"Follow-up visit, "
+        "symptoms resolved, no further treatment required.\"},{\"date\":"
+        "\"2022-01-09\",\"text\":\"Annual check-up, blood pressure normal, "
+        "advised to return for the next annual check-up.\"}]}";
+
+/*
+ * Round trips the records with and without compression and reports the
+ * size of the recipes.
+ */
+static int32_t compressRecords(enum dvCodec codec, trans_bytes key,
+                               uint32_t rounds) {
+    const char* records[] = {record, largeRecord};
+    const char* names[] = {"small", "large"};
+    char name[64];
+    int32_t ret = RUE_OK;
+    struct dv_key k;
+    initKey(&k, key);
+    for (int r = 0; r < 2 && ret == RUE_OK; r++) {
+        uint32_t loops = 20000 * rounds;
+        rusize bytes = 0;
+        char* cipher = NULL;
+        char* msg = NULL;
+        double start = benchSeconds();
+        for (uint32_t i = 0; i < loops && ret == RUE_OK; i++) {
+            ret = dvAes256EncKey(&k, "18", records[r], RECIPE_AES_CBC, codec,
+                                 NULL, &cipher);
+            if (ret == RUE_OK) {
+                if (!i) bytes = strlen(cipher);
+                ret = dvAes256DecKey(&k, NULL, cipher, &msg, NULL);
+            }
+            ruFree(cipher);
+            ruFree(msg);
+        }
+        snprintf(name, sizeof(name), "%s %s %lu->%lu bytes",
+                 codec == CODEC_DEFLATE? "deflate" : "plain", names[r],
+                 (unsigned long)strlen(records[r]), (unsigned long)bytes);
+        benchReport(name, loops, "records", benchSeconds() - start);
+    }
+    clearKey(&k);
+    return ret;
+}
+
+// made up records of 200 to 800 bytes, like a customer or patient file
+#define CORPUS 1000
+// the first ones train the dictionary
+#define TRAINING 300
+
+static uint32_t corpusRand(uint32_t* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static char* corpusRecord(uint32_t* seed) {
+    static const char* first[] = {"Johannes", "Maria", "Thomas", "Anna",
+            "Stefan", "Katharina", "Michael", "Sabine", "Andreas", "Julia"};
+    static const char* last[] = {"Müller", "Schmidt", "Schneider", "Fischer",
+            "Weber", "Meyer", "Wagner", "Becker", "Schulz", "Hoffmann"};
+    static const char* streets[] = {"Hauptstraße", "Schulstraße", "Gartenweg",
+            "Bahnhofstraße", "Dorfstraße", "Bergstraße", "Lindenallee"};
+    static const char* cities[] = {"München", "Berlin", "Hamburg", "Köln",
+            "Frankfurt am Main", "Stuttgart", "Düsseldorf", "Leipzig"};
+    static const char* notes[] = {
+            "Patient reports mild headache, advised to return if symptoms "
+            "persist.",
+            "Follow-up visit, symptoms resolved, no further treatment "
+            "required.",
+            "Annual check-up, blood pressure normal.",
+            "Prescription renewed for another three months.",
+            "Referred to a specialist for further examination.",
+            "Vaccination given, next appointment in twelve months."};
+    const char* fn = first[corpusRand(seed) % 10];
+    const char* ln = last[corpusRand(seed) % 10];
+    ruString rec = ruStringNew("");
+    ruStringAppendf(rec, "{\"firstname\":\"%s\",\"lastname\":\"%s\","
+            "\"birthdate\":\"19%02u-%02u-%02u\",\"street\":\"%s %u\","
+            "\"zip\":\"%05u\",\"city\":\"%s\",\"email\":\"%s.%s@example.com\","
+            "\"phone\":\"+49 %u %u\",\"insurance\":\"A%09u\",\"notes\":[",
+            fn, ln, 40 + corpusRand(seed) % 60, 1 + corpusRand(seed) % 12,
+            1 + corpusRand(seed) % 28, streets[corpusRand(seed) % 7],
+            1 + corpusRand(seed) % 120, corpusRand(seed) % 100000,
+            cities[corpusRand(seed) % 8], fn, ln, 30 + corpusRand(seed) % 900,
+            corpusRand(seed) % 10000000, corpusRand(seed) % 1000000000);
+    uint32_t n = corpusRand(seed) % 6;
+    for (uint32_t i = 0; i < n; i++) {
+        ruStringAppendf(rec, "%s{\"date\":\"20%02u-%02u-%02u\",\"text\":\"%s\"}",
+                i? "," : "", 10 + corpusRand(seed) % 14,
+                1 + corpusRand(seed) % 12, 1 + corpusRand(seed) % 28,
+                notes[corpusRand(seed) % 6]);
+    }
+    ruStringAppend(rec, "]}");
+    char* out = ruStrDup(ruStringGetCString(rec));
+    ruStringFree(rec, false);
+    return out;
+}
+
+/*
+ * Round trips the records without, with plain and with dictionary compression
+ * and reports the size of the recipes.
+ */
+static int32_t dictionaryRecords(trans_bytes key, uint32_t rounds) {
+    char* corpus[CORPUS];
+    uint32_t seed = 42;
+    void* dict = NULL;
+    size_t dictLen = 0;
+    uint32_t id = 0;
+    dvCtx dc = NULL;
+    char name[64];
+    struct dv_key k;
+    rusize raw = 0;
+
+    for (int i = 0; i < CORPUS; i++) corpus[i] = corpusRecord(&seed);
+    for (int i = TRAINING; i < CORPUS; i++) raw += strlen(corpus[i]);
+    initKey(&k, key);
+    double start = benchSeconds();
+    int32_t ret = dvTrainDictionary((const char* const*)corpus, TRAINING, 4096,
+                                    &dict, &dictLen);
+    snprintf(name, sizeof(name), "train %lu byte dictionary",
+             (unsigned long)dictLen);
+    benchReport(name, TRAINING, "records", benchSeconds() - start);
+    if (ret == RUE_OK) ret = dvNew(&dc, "https://localhost/", APPID, NULL);
+    if (ret == RUE_OK) ret = dvAddDictionary(dc, dict, dictLen, &id);
+
+    for (int m = 0; m < 3 && ret == RUE_OK; m++) {
+        enum dvCodec codec = m? CODEC_DEFLATE : CODEC_PLAIN;
+        dvdict dt = m == 2? findDict(getDvCtx(dc)->dicts, id) : NULL;
+        uint32_t loops = 20 * rounds;
+        rusize bytes = 0;
+        char* cipher = NULL;
+        char* msg = NULL;
+        start = benchSeconds();
+        for (uint32_t l = 0; l < loops && ret == RUE_OK; l++) {
+            for (int i = TRAINING; i < CORPUS && ret == RUE_OK; i++) {
+                ret = dvAes256EncKey(&k, "18", corpus[i], RECIPE_AES_CBC,
+                                     codec, dt, &cipher);
+                if (ret == RUE_OK) {
+                    if (!l) bytes += strlen(cipher);
+                    ret = dvAes256DecKey(&k, getDvCtx(dc)->dicts, cipher, &msg,
+                                         NULL);
+                }
+                ruFree(cipher);
+                ruFree(msg);
+            }
+        }
+        snprintf(name, sizeof(name), "corpus %s %lu->%lu bytes",
+                 m == 2? "dict" : m? "deflate" : "plain",
+                 (unsigned long)raw, (unsigned long)bytes);
+        benchReport(name, (uint64_t)loops * (CORPUS - TRAINING), "records",
+                    benchSeconds() - start);
+    }
+
+    if (dc) dvFree(dc);
+    clearKey(&k);
+    ruFree(dict);
+    for (int i = 0; i < CORPUS; i++) ruFree(corpus[i]);
+    return ret;
+}
+
+int32_t encryptBench(uint32_t rounds) {
+    uint8_t key[32];
+    int32_t ret = mkKey(APPID, key, NULL);
+    if (ret != RUE_OK) return ret;
+
+    dvCtx dc = NULL;
+    ret = dvNew(&dc, "https://localhost/", APPID, NULL);
+    if (ret != RUE_OK) return ret;
+    ret = publishKeys(false, getDvCtx(dc), rounds);
+    if (ret == RUE_OK) ret = publishKeys(true, getDvCtx(dc), rounds);
+    dvFree(dc);
+    if (ret != RUE_OK) return ret;
+
+    ret = compressRecords(CODEC_PLAIN, key, rounds);
+    if (ret == RUE_OK) ret = compressRecords(CODEC_DEFLATE, key, rounds);
+    if (ret == RUE_OK) ret = dictionaryRecords(key, rounds);
+    if (ret != RUE_OK) return ret;
+
+    ret = encryptBatch(false, key, rounds);
+    if (ret != RUE_OK) return ret;
+    ret = encryptBatch(true, key, rounds);
+    if (ret != RUE_OK) return ret;
+    ret = encryptThreads(RECIPE_AES_CBC, key, rounds);
+    if (ret != RUE_OK) return ret;
+    return encryptThreads(RECIPE_AES_GCM, key, rounds);
+}
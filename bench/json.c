@@ -0,0 +1,103 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench.h"
+
+#define ENTRIES 1000
+#define CIPHER 600
+
+/*
+ * A get response like the vault sends it, with the slashes of the base64
+ * recipes escaped.
+ */
+static alloc_chars getResponse(ruList vids) {
+    ruString rs = ruStringNew("{\"status\": \"OK\", \"data\": {");
+    for (int i = 0; i < ENTRIES; i++) {
+        alloc_chars vid = ruDupPrintf("%032x", i);
+        ruStringAppendf(rs, "%s\"%s\": {\"status\": \"OK\", \"data\": "
+                        "\"aes-256-cbc:f7:%032x:", i? ", " : "", vid, i);
+        for (int c = 0; c < CIPHER; c++) {
+            ruStringAppend(rs, c % 32? "QkNE" : "a\\/+");
+        }
+        ruStringAppend(rs, "\"}");
+        ruListAppend(vids, vid);
+    }
+    ruStringAppend(rs, "}, \"uid\": \"bench\"}");
+    alloc_chars resp = ruStringGetCString(rs);
+    ruStringFree(rs, true);
+    return resp;
+}
+
+static void ruJsonParser(trans_chars resp, ruList vids, uint32_t loops) {
+    double start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        ruJson jsn = getJson(resp);
+        ruJson jdat = ruJsonKeyMap(jsn, "data", NULL);
+        ruIterator li = ruListIter(vids);
+        for (char* vid = ruIterNext(li, char*); vid;
+             vid = ruIterNext(li, char*)) {
+            ruJson jvd = ruJsonKeyMap(jdat, vid, NULL);
+            perm_chars status = ruJsonKeyStr(jvd, STATUS, NULL);
+            alloc_chars cipher = ruStrDup(ruJsonKeyStr(jvd, "data", NULL));
+            if (!status) fprintf(stderr, "no status for %s\n", vid);
+            ruFree(cipher);
+        }
+        ruJsonFree(jsn);
+    }
+    benchReport("get response ruJson", (uint64_t)loops * strlen(resp) >> 20,
+                "MB", benchSeconds() - start);
+}
+
+static void vaultParser(bool accelerated, trans_chars resp, uint32_t loops) {
+    char name[64];
+    rusize len = strlen(resp);
+    snprintf(name, sizeof(name), "get response vault %s",
+             selectJsonScanner(accelerated));
+    double start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        struct dv_vault_resp vr;
+        if (parseVaultResp(resp, len, &vr) != RUE_OK) return;
+        for (rusize e = 0; e < vr.entryCount; e++) {
+            alloc_chars cipher = jstrDup(&vr.entries[e].data);
+            if (!vr.entries[e].status.ptr) {
+                fprintf(stderr, "no status for entry %lu\n", (unsigned long)e);
+            }
+            ruFree(cipher);
+        }
+        freeVaultResp(&vr);
+    }
+    benchReport(name, (uint64_t)loops * len >> 20, "MB",
+                benchSeconds() - start);
+}
+
+int32_t jsonBench(uint32_t rounds) {
+    ruList vids = ruListNew(ruTypeStrFree());
+    alloc_chars resp = getResponse(vids);
+    uint32_t loops = 20 * rounds;
+
+    ruJsonParser(resp, vids, loops);
+    vaultParser(false, resp, loops);
+    vaultParser(true, resp, loops);
+
+    ruFree(resp);
+    ruListFree(vids);
+    return RUE_OK;
+}
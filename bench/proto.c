@@ -0,0 +1,189 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench.h"
+
+#define ENTRIES 1000
+// read from the socket in chunks of this size
+#define CHUNK 16384
+
+/*
+ * Compares a get response of protocol version 2 in JSON with the same
+ * response of version 3 in MessagePack, which carries the payload of the
+ * recipes as raw bytes. Both go through the scanner and are decrypted.
+ */
+
+struct mp_out {
+    alloc_chars buf;
+    rusize len;
+    rusize cap;
+};
+
+static void mpPut(struct mp_out* mo, const void* data, rusize len) {
+    if (mo->len + len > mo->cap) {
+        while (mo->len + len > mo->cap) mo->cap = mo->cap? mo->cap * 2 : 4096;
+        mo->buf = ruRealloc(mo->buf, mo->cap, char);
+    }
+    memcpy(mo->buf + mo->len, data, len);
+    mo->len += len;
+}
+
+static void mpSized(struct mp_out* mo, uint8_t fix, uint8_t fixMax,
+                    uint8_t w16, uint32_t n) {
+    uint8_t h[3];
+    if (fix && n <= fixMax) {
+        h[0] = (uint8_t)(fix | n);
+        mpPut(mo, h, 1);
+        return;
+    }
+    h[0] = w16;
+    h[1] = (uint8_t)(n >> 8);
+    h[2] = (uint8_t)n;
+    mpPut(mo, h, 3);
+}
+
+static void mpStr(struct mp_out* mo, const char* s, rusize len) {
+    mpSized(mo, 0xa0, 31, 0xda, (uint32_t)len);
+    mpPut(mo, s, len);
+}
+
+static void mpMap(struct mp_out* mo, uint32_t n) {
+    mpSized(mo, 0x80, 15, 0xde, n);
+}
+
+/*
+ * Adds the entry to both responses.
+ */
+static void addEntry(ruString js, struct mp_out* mo, trans_chars vid,
+                     trans_chars recipe, bool first) {
+    ruStringAppendf(js, "%s\"%s\": {\"status\": \"OK\", \"data\": \"",
+                    first? "" : ", ", vid);
+    // the vault escapes the slashes of the base64
+    for (perm_chars p = recipe; *p; p++) {
+        if (*p == '/') ruStringAppend(js, "\\");
+        ruStringAppendn(js, p, 1);
+    }
+    ruStringAppend(js, "\"}");
+
+    perm_chars payload = recipe;
+    for (int i = 0; i < 4; i++) payload = strchr(payload, ':') + 1;
+    rusize head = (rusize)(payload - recipe), plen = strlen(payload);
+    size_t olen = 0;
+    b64Decode(NULL, 0, &olen, (trans_bytes)payload, plen);
+    alloc_bytes raw = ruMalloc0(olen + 1, uint8_t);
+    b64Decode(raw, olen, &olen, (trans_bytes)payload, plen);
+    uint8_t bin[3] = {0xc5, (uint8_t)((head + olen) >> 8),
+                      (uint8_t)(head + olen)};
+    mpStr(mo, vid, strlen(vid));
+    mpMap(mo, 2);
+    mpStr(mo, STATUS, strlen(STATUS));
+    mpStr(mo, STATUS_OK, strlen(STATUS_OK));
+    mpStr(mo, "data", 4);
+    mpPut(mo, bin, sizeof(bin));
+    mpPut(mo, recipe, head);
+    mpPut(mo, raw, olen);
+    ruFree(raw);
+}
+
+static int32_t scanResponse(dvkey key, trans_chars resp, rusize len,
+                            const char* const* vids) {
+    ruMap data = NULL;
+    dvVidScanner vs = NULL;
+    int32_t ret = newVidScanner(key, NULL, vids, ENTRIES, false, NULL, &data,
+                                NULL, &vs);
+    for (rusize at = 0; ret == RUE_OK && at < len; at += CHUNK) {
+        ret = vidScannerFeed(vs, resp + at, len - at < CHUNK? len - at : CHUNK);
+    }
+    ret = vidScannerFinish(vs, ret);
+    if (ret == RUE_OK && ruMapSize(data, NULL) != ENTRIES) {
+        ret = DVE_PROTOCOL_ERROR;
+    }
+    freeVidScanner(vs);
+    ruMapFree(data);
+    return ret;
+}
+
+static int32_t timeResponse(const char* format, dvkey key, trans_chars resp,
+                            rusize len, const char* const* vids,
+                            uint32_t loops) {
+    char name[64];
+    int32_t ret = RUE_OK;
+    snprintf(name, sizeof(name), "get %s %lu bytes", format,
+             (unsigned long)len);
+    double start = benchSeconds();
+    for (uint32_t i = 0; i < loops && ret == RUE_OK; i++) {
+        ret = scanResponse(key, resp, len, vids);
+    }
+    benchReport(name, (uint64_t)loops * ENTRIES, "records",
+                benchSeconds() - start);
+    return ret;
+}
+
+int32_t protoBench(uint32_t rounds) {
+    uint8_t key[32];
+    struct dv_key k;
+    alloc_chars vids[ENTRIES];
+    struct mp_out mo;
+    int32_t ret = mkKey(APPID, key, NULL);
+    if (ret != RUE_OK) return ret;
+    initKey(&k, key);
+    memset(&mo, 0, sizeof(mo));
+    memset(vids, 0, sizeof(vids));
+
+    ruString js = ruStringNew("{\"status\": \"OK\", \"data\": {");
+    mpMap(&mo, 2);
+    mpStr(&mo, STATUS, strlen(STATUS));
+    mpStr(&mo, STATUS_OK, strlen(STATUS_OK));
+    mpStr(&mo, "data", 4);
+    mpMap(&mo, ENTRIES);
+    for (int i = 0; i < ENTRIES && ret == RUE_OK; i++) {
+        char* cipher = NULL;
+        alloc_chars record = ruDupPrintf(
+                "{\"name\": \"Customer %d\", \"street\": \"Main Street %d\", "
+                "\"city\": \"Springfield\", \"phone\": \"+1 555 %07d\", "
+                "\"email\": \"customer%d@example.com\", \"notes\": \"%0*d\"}",
+                i, i, i * 7, i, 100 + i % 300, i);
+        vids[i] = ruDupPrintf("%032x", i);
+        ret = dvAes256EncKey(&k, "18", record, RECIPE_AES_CBC, CODEC_PLAIN,
+                             NULL, &cipher);
+        if (ret == RUE_OK) addEntry(js, &mo, vids[i], cipher, !i);
+        ruFree(cipher);
+        ruFree(record);
+    }
+    ruStringAppend(js, "}}");
+
+    uint32_t loops = 20 * rounds;
+    if (ret == RUE_OK) {
+        ret = timeResponse("json", &k, ruStringGetCString(js),
+                           ruStringLen(js, NULL), (const char* const*)vids,
+                           loops);
+    }
+    if (ret == RUE_OK) {
+        ret = timeResponse("msgpack", &k, mo.buf, mo.len,
+                           (const char* const*)vids, loops);
+    }
+
+    for (int i = 0; i < ENTRIES; i++) ruFree(vids[i]);
+    ruStringFree(js, false);
+    ruFree(mo.buf);
+    clearKey(&k);
+    return ret;
+}
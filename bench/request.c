@@ -0,0 +1,80 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench.h"
+
+#define VIDS 10000
+
+static void jsonRequest(ruList vids, uint32_t loops) {
+    rusize bytes = 0;
+    double start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        dvKvList kvl = NULL;
+        alloc_chars body = NULL;
+        perm_chars str = NULL;
+        ruJson jrq = ruJsonStart(true);
+        ruJsonSetKeyInt(jrq, "version", PROTO_VERSION);
+        ruJsonSetKeyStr(jrq, "op", "get");
+        encodeWordList(vids, jrq, "vid");
+        ruJsonWrite(jrq, &str);
+        newKvList(&kvl, JSON_FIELD, str, 0);
+        kvListToString(kvl, &body);
+        bytes += strlen(body);
+        ruFree(body);
+        freeKvList(kvl);
+        ruJsonFree(jrq);
+    }
+    benchReport("get request ruJson", (uint64_t)bytes >> 20, "MB",
+                benchSeconds() - start);
+}
+
+static void wireRequest(dvctx ctx, ruList vids, uint32_t loops) {
+    rusize bytes = 0, len = 0;
+    double start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        struct dv_req rq;
+        newReq(ctx, &rq, "get");
+        reqAddList(&rq, "vid", vids);
+        reqBody(&rq, &len);
+        bytes += len;
+        freeReq(ctx, &rq);
+    }
+    benchReport("get request direct", (uint64_t)bytes >> 20, "MB",
+                benchSeconds() - start);
+}
+
+int32_t requestBench(uint32_t rounds) {
+    dvCtx dc = NULL;
+    int32_t ret = dvNew(&dc, "https://localhost/", APPID, NULL);
+    if (ret != RUE_OK) return ret;
+    ruList vids = ruListNew(ruTypeStrFree());
+    for (int i = 0; i < VIDS; i++) {
+        ruListAppend(vids, ruDupPrintf("%032x", i));
+    }
+    uint32_t loops = 50 * rounds;
+
+    jsonRequest(vids, loops);
+    wireRequest(getDvCtx(dc), vids, loops);
+
+    ruListFree(vids);
+    dvFree(dc);
+    return RUE_OK;
+}
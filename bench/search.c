@@ -0,0 +1,169 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench.h"
+#include <mbedtls/sha256.h>
+
+// typical index words of a name and address record
+static const char* words[] = {
+        "Johannes", "Müller-Lüdenscheidt", "Hauptstraße", "42a", "80331",
+        "München", "Bayern", "Deutschland", "john.doe@example.com",
+        "+49 89 1234567", "1970-01-01", "Schmidt", "Anna", "Lindenallee",
+        "Frankfurt am Main", "DE89370400440532013000", NULL
+};
+
+void hexify(trans_bytes ibuf, int ilen, alloc_bytes obuf);
+
+/*
+ * The search hash as it was before the reusable hasher: one snprintf and
+ * one sha256 over char + hex hash + key per character.
+ */
+static int32_t legacySearchHash(const char* word, const char* key, char** hash,
+                                bool indexing) {
+    char* term = ruUtf8ToLower(word);
+    rusize termLen = strlen(term);
+    rusize keyLen = strlen(key);
+    int32_t ret = RUE_OK;
+    rusize poolSz = 1 + 64 + keyLen + 1;
+    char *work = ruMalloc0(poolSz, char);
+    uint8_t sha2[32];
+    uint8_t encHash[65];
+    memcpy((void*)&encHash[0],
+           "f1748e9819664b324ae079a9ef22e33e9014ffce302561b9bf71a37916c1d2a3", 65);
+
+    rusize paddedLen = (termLen/16) * 16;
+    if (paddedLen < termLen) paddedLen += 16;
+    char* outHash = ruMalloc0((paddedLen * 2) + 1, char);
+    char *ptr = (char*)term;
+    char *optr = outHash;
+    rusize c = 0;
+
+    do {
+        uint8_t digest[32];
+        *work = *ptr;
+        snprintf(work + 1, poolSz - 1, "%s%s", &encHash[0], key);
+        if (mbedtls_sha256((trans_bytes)work, poolSz, digest, 0)) {
+            ret = RUE_GENERAL;
+            break;
+        }
+        if (indexing && c == 0) memcpy(sha2, digest, 32);
+        hexify(&digest[0], 32, &encHash[0]);
+        encHash[64] = '\0';
+        memcpy(optr, encHash, 2);
+        ptr++;
+        optr += 2;
+        if (c == termLen) ptr = (char*)&sha2[0];
+        c++;
+        if (!indexing && c == termLen) break;
+    } while(c < paddedLen);
+
+    *hash = outHash;
+    ruFree(term);
+    ruFree(work);
+    return ret;
+}
+
+int32_t searchBench(uint32_t rounds) {
+    int32_t ret = RUE_OK;
+    uint64_t count = 0;
+    uint32_t loops = 2000 * rounds;
+    char *want = NULL, *got = NULL;
+    double start;
+
+    // verify the output first
+    for (const char** w = &words[0]; *w; w++) {
+        for (int indexing = 0; indexing < 2; indexing++) {
+            legacySearchHash(*w, APPID, &want, indexing);
+            ret = dvSearchHash(*w, APPID, &got, indexing);
+            if (ret != RUE_OK || !ruStrEquals(want, got)) {
+                fprintf(stderr, "hash mismatch for '%s' wanted '%s' got '%s'\n",
+                        *w, want, got);
+                ret = RUE_GENERAL;
+            }
+            ruFree(want);
+            ruFree(got);
+            if (ret != RUE_OK) return ret;
+        }
+    }
+
+    start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        for (const char** w = &words[0]; *w; w++) {
+            legacySearchHash(*w, APPID, &got, true);
+            ruFree(got);
+            count++;
+        }
+    }
+    benchReport("legacy index words", count, "words", benchSeconds() - start);
+
+    count = 0;
+    start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        for (const char** w = &words[0]; *w; w++) {
+            dvSearchHash(*w, APPID, &got, true);
+            ruFree(got);
+            count++;
+        }
+    }
+    benchReport("dvSearchHash index words", count, "words", benchSeconds() - start);
+
+    count = 0;
+    start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        for (const char** w = &words[0]; *w; w++) {
+            dvSearchHash(*w, APPID, &got, false);
+            ruFree(got);
+            count++;
+        }
+    }
+    benchReport("dvSearchHash search words", count, "words", benchSeconds() - start);
+
+    // the batch must give the same hashes in the same order
+    rusize wordCnt = (sizeof(words) / sizeof(words[0])) - 1;
+    ruList batch = NULL;
+    ret = dvAddIndexWords(&batch, APPID, words, wordCnt);
+    if (ret != RUE_OK) return ret;
+    ruIterator li = ruListHead(batch, &ret);
+    for (const char** w = &words[0]; *w; w++) {
+        char* bh = ruIterNext(li, char*);
+        dvSearchHash(*w, APPID, &want, true);
+        if (!ruStrEquals(want, bh)) {
+            fprintf(stderr, "batch mismatch for '%s' wanted '%s' got '%s'\n",
+                    *w, want, bh);
+            ret = RUE_GENERAL;
+        }
+        ruFree(want);
+        if (ret != RUE_OK) break;
+    }
+    ruListFree(batch);
+    if (ret != RUE_OK) return ret;
+
+    count = 0;
+    start = benchSeconds();
+    for (uint32_t i = 0; i < loops; i++) {
+        batch = NULL;
+        dvAddIndexWords(&batch, APPID, words, wordCnt);
+        ruListFree(batch);
+        count += wordCnt;
+    }
+    benchReport("dvAddIndexWords index words", count, "words", benchSeconds() - start);
+    return ret;
+}
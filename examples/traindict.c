@@ -0,0 +1,132 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Trains a compression dictionary from sample records, one per line, and
+ * writes it to a file for dvAddDictionary.
+ *
+ * traindict <samples file> <dictionary file> [max size]
+ */
+#include <vaccinator.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define MAX_LINE 65536
+
+// size of the record compressed with the dictionary or without if dict is NULL
+static size_t packedSize(const char* rec, const void* dict, size_t dictLen) {
+    unsigned char out[MAX_LINE + 1024];
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK) return 0;
+    if (dict) deflateSetDictionary(&zs, dict, (uInt)dictLen);
+    zs.next_in = (Bytef*)rec;
+    zs.avail_in = (uInt)strlen(rec);
+    zs.next_out = out;
+    zs.avail_out = sizeof(out);
+    deflate(&zs, Z_FINISH);
+    size_t len = zs.total_out;
+    deflateEnd(&zs);
+    return len;
+}
+
+int main ( int argc, char **argv ) {
+    int ret = RUE_OK;
+    FILE* in = NULL;
+    FILE* out = NULL;
+    char** samples = NULL;
+    size_t count = 0, cap = 0, maxLen = 4096, dictLen = 0;
+    void* dict = NULL;
+    char line[MAX_LINE];
+
+    do {
+        if (argc < 3) {
+            printf("usage: %s <samples file> <dictionary file> [max size]\n",
+                   argv[0]);
+            ret = RUE_PARAMETER_NOT_SET;
+            break;
+        }
+        if (argc > 3) maxLen = (size_t)strtoul(argv[3], NULL, 10);
+
+        in = fopen(argv[1], "r");
+        if (!in) {
+            printf("failed to open '%s'\n", argv[1]);
+            ret = RUE_CANT_OPEN_FILE;
+            break;
+        }
+        while (fgets(line, sizeof(line), in)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (!*line) continue;
+            if (count == cap) {
+                size_t grown = cap? cap * 2 : 256;
+                char** more = realloc(samples, grown * sizeof(char*));
+                if (!more) {
+                    printf("out of memory after %lu samples\n",
+                           (unsigned long)count);
+                    ret = RUE_OUT_OF_MEMORY;
+                    break;
+                }
+                samples = more;
+                cap = grown;
+            }
+            samples[count++] = ruStrDup(line);
+        }
+        if (ret != RUE_OK) break;
+
+        ret = dvTrainDictionary((const char* const*)samples, count, maxLen,
+                                &dict, &dictLen);
+        if (ret != RUE_OK) {
+            printf("training failed ec [%d] %s\n", ret, dvLastError());
+            break;
+        }
+
+        out = fopen(argv[2], "wb");
+        if (!out || fwrite(dict, 1, dictLen, out) != dictLen) {
+            printf("failed to write '%s'\n", argv[2]);
+            ret = RUE_CANT_WRITE;
+            break;
+        }
+
+        // how the samples fare
+        size_t raw = 0, plain = 0, packed = 0;
+        for (size_t i = 0; i < count; i++) {
+            raw += strlen(samples[i]);
+            plain += packedSize(samples[i], NULL, 0);
+            packed += packedSize(samples[i], dict, dictLen);
+        }
+        printf("%lu byte dictionary from %lu samples\n",
+               (unsigned long)dictLen, (unsigned long)count);
+        printf("average sample %lu bytes, deflated %lu, with dictionary %lu\n",
+               (unsigned long)(raw / count), (unsigned long)(plain / count),
+               (unsigned long)(packed / count));
+
+    } while (false);
+
+    if (in) fclose(in);
+    if (out) fclose(out);
+    for (size_t i = 0; i < count; i++) ruFree(samples[i]);
+    free(samples);
+    ruFree(dict);
+
+    return ret;
+}
@@ -50,6 +50,61 @@
  * \n
  * \b data = "aes-256-cbc:" + \b cs + ":" + \b ivhex + ":b:" + \b payload
  *
+ * When \ref DV_CIPHER_RECIPE is set to \b aes-256-gcm, the \b payload is
+ * authenticated by the AES-GCM tag instead:
+ *
+ * \b ivbytes = randomBytes ( 12 ) \n
+ * \b ivhex = hexencode ( \b ivbytes ) \n
+ * \n
+ * \b cipherbytes , \b tagbytes = aes256gcm ( \b ivbytes , \ref pid ) \n
+ * \b payload = base64 (\b cipherbytes + \b tagbytes ) \n
+ * \n
+ * \b data = "aes-256-gcm:" + \b cs + ":" + \b ivhex + ":b:" + \b payload
+ *
+ * When \ref DV_COMPRESSION is set to \b deflate, the \ref pid is zlib
+ * compressed (RFC 1950) before it is encrypted and the codec \b b becomes
+ * \b z:
+ *
+ * \b zbytes = zlib ( \ref pid ) \n
+ * \b data = "aes-256-cbc:" + \b cs + ":" + \b ivhex + ":z:" + \b payload
+ * of \b zbytes \n
+ *
+ * A \ref pid shorter than 128 bytes or one that does not shrink by at least
+ * 16 bytes is stored with codec \b b as before.
+ *
+ * With a dictionary selected by \ref dvUseDictionary, zlib is given it as
+ * preset dictionary and the codec names it by its zlib id, which is the
+ * adler32 checksum of the dictionary in 8 lowercase hex digits:
+ *
+ * \b zbytes = zlib ( \b dict , \ref pid ) \n
+ * \b codec = "z." + hex ( adler32 ( \b dict ) ) \n
+ * \b data = "aes-256-cbc:" + \b cs + ":" + \b ivhex + ":" + \b codec + ":"
+ * + \b payload of \b zbytes \n
+ *
+ * Then a \ref pid longer than 16 bytes is compressed as well, as long as
+ * that saves 16 bytes.
+ *
+ * A record added with \ref dvAddFields is stored as a field envelope. Its
+ * field names are encrypted into an index together with a random envelope id,
+ * and each value is encrypted on its own as above, prefixed by that id and
+ * its position. A field moved, dropped or taken from another envelope is thus
+ * rejected. The vault still sees the number of fields and the size of each
+ * value, and like any record it can return an older envelope of the same
+ * \ref vid as a whole. Field names must not contain \b = or \b ,
+ * characters:
+ *
+ * \b idhex = hexencode ( randomBytes ( 16 ) ) \n
+ * \b index = \b data of ( \b idhex + "," + \b name0 + "," + \b name1 ... )
+ * \n
+ * \b fieldN = \b data of ( \b idhex + ":" + \b N + "=" + \b valueN ) with
+ * \b N counting from 0 \n
+ * \b data = "fields:" + \b cs + ":" + \b index + "," + \b field0 + ","
+ * + \b field1 ... \n
+ *
+ * Reading a single field decrypts the index and that field only.
+ * Decrypting the envelope as a whole returns the fields as JSON object of
+ * strings.
+ *
  *
  * \subsection usage Example Usage
  * This usage example can also be found under examples/datause.c:
@@ -203,6 +258,56 @@ DVAPI int32_t dvAddIndexWord(ruList* indexWords, const char* appId, const char*
  */
 DVAPI int32_t dvAddSearchWord(ruList* searchWords, const char* appId, const char* word);
 
+/**
+ * Adds the given words as \ref iwd terms to the referenced \ref ruList in the
+ * given order. The result is the same as calling \ref dvAddIndexWord for each
+ * word, but the words are hashed in lockstep which is considerably faster for
+ * the many index words of a record.
+ * @param indexWords Pointer to an \ref ruList that the \ref iwd terms will be
+ *                    added to. This list will be created if NULL, otherwise
+ *                    the given terms will be added to the list present. The list
+ *                    must be freed with \ref ruListFree when done with it.
+ * @param appId The \ref appid to use for term hashing.
+ * @param words Array of \ref iwd under which data should be found via
+ *              \ref dvSearch.
+ * @param count Number of entries in words.
+ * @return \ref RUE_OK on success or an error code. Nothing is added on error.
+ */
+DVAPI int32_t dvAddIndexWords(ruList* indexWords, const char* appId,
+                              const char* const* words, size_t count);
+
+/**
+ * Encrypts a \ref pid record into the cipher recipe \ref dvAdd would send,
+ * honoring \ref DV_CIPHER_RECIPE and \ref DV_COMPRESSION of the context.
+ * The result is sent later on with \ref dvAddCipher or \ref dvUpdateCipher,
+ * so that encryption can run on worker threads or in a batch job while the
+ * request threads only do I/O. It may be called from several threads at
+ * once as long as the context properties are not changed meanwhile.
+ * @param dc The \ref dvCtx to work with.
+ * @param data The \ref pid data to encrypt.
+ * @param cipherText Where the cipher recipe will be stored. Free it with
+ *                   \ref ruFree when done with it.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvEncryptRecord(dvCtx dc, const char* data, char** cipherText);
+
+/**
+ * Encrypts many \ref pid records for the \ref vault at once. Every result is
+ * the same cipher recipe \ref dvAdd would send for the record, using the
+ * \ref appid and the \ref DV_CIPHER_RECIPE of the context. With the default
+ * aes-256-cbc recipe several records are encrypted in lockstep, which is
+ * considerably faster for batch imports than encrypting one at a time.
+ * @param dc The \ref dvCtx to work with.
+ * @param data Array of the \ref pid records to encrypt.
+ * @param count Number of entries in data.
+ * @param cipherTexts Array of count entries receiving the cipher recipes.
+ *                    Free each with \ref ruFree when done with it. Nothing is
+ *                    returned on error.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvEncryptMany(dvCtx dc, const char* const* data, size_t count,
+                            char** cipherTexts);
+
 /**
  * Creates a new \ref pid entry in the \ref vault.
  * @param dc The \ref dvCtx to work with.
@@ -229,6 +334,79 @@ DVAPI int32_t dvAdd(dvCtx dc, const char* data,
 DVAPI int32_t dvUpdate(dvCtx dc, const char* vid, const char* data,
                        ruList indexWords);
 
+/**
+ * Creates a new \ref pid entry in the \ref vault from named fields, which
+ * are encrypted one by one into a field envelope, see \ref payload. Single
+ * fields are then read with \ref dvGetField and with \ref DV_LAZY_DECRYPT
+ * set only those are decrypted. \ref dvGetVid returns the record as JSON
+ * object of the fields.
+ * @param dc The \ref dvCtx to work with.
+ * @param names Array of the unique field names.
+ * @param values Array of the field values.
+ * @param count Number of fields.
+ * @param indexWords Optional \ref iwd terms under which this data should be
+ *                    found via \ref dvSearch. Use NULL for none.
+ * @param vid Where the corresponding \ref vid for the given data
+ *            will be stored on success. Free this with \ref ruFree when done
+ *            with it.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvAddFields(dvCtx dc, const char* const* names,
+                          const char* const* values, size_t count,
+                          ruList indexWords, char** vid);
+
+/**
+ * Replaces an existing \ref pid entry in the \ref vault with a field
+ * envelope like \ref dvAddFields.
+ * @param dc The \ref dvCtx to work with.
+ * @param vid The \ref vid whose data to update.
+ * @param names Array of the unique field names.
+ * @param values Array of the field values.
+ * @param count Number of fields.
+ * @param indexWords Optional \ref iwd terms under which this data should be
+ *                   found via \ref dvSearch. Use NULL for none.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvUpdateFields(dvCtx dc, const char* vid,
+                             const char* const* names,
+                             const char* const* values, size_t count,
+                             ruList indexWords);
+
+/**
+ * Like \ref dvAdd with a cipher recipe made by \ref dvEncryptRecord or
+ * \ref dvEncryptMany. Nothing is encrypted on the calling thread.
+ * @param dc The \ref dvCtx to work with.
+ * @param cipherText The cipher recipe to store.
+ * @param data Optional, the \ref pid the recipe holds, which is written to
+ *             the cache. Use NULL to not cache the entry.
+ * @param indexWords Optional \ref iwd terms under which this data should be
+ *                    found via \ref dvSearch. Use NULL for none.
+ * @param vid Where the corresponding \ref vid for the given data
+ *            will be stored on success. Free this with \ref ruFree when done
+ *            with it.
+ * @return \ref RUE_OK on success, \ref RUE_INVALID_PARAMETER if cipherText
+ *         is no cipher recipe or another error code.
+ */
+DVAPI int32_t dvAddCipher(dvCtx dc, const char* cipherText, const char* data,
+                          ruList indexWords, char** vid);
+
+/**
+ * Like \ref dvUpdate with a cipher recipe made by \ref dvEncryptRecord or
+ * \ref dvEncryptMany. Nothing is encrypted on the calling thread.
+ * @param dc The \ref dvCtx to work with.
+ * @param vid The \ref vid whose data to update.
+ * @param cipherText The cipher recipe to store.
+ * @param data Optional, the \ref pid the recipe holds, which is written to
+ *             the cache. Use NULL to remove the entry from the cache instead.
+ * @param indexWords Optional \ref iwd terms under which this data should be
+ *                   found via \ref dvSearch. Use NULL for none.
+ * @return \ref RUE_OK on success, \ref RUE_INVALID_PARAMETER if cipherText
+ *         is no cipher recipe or another error code.
+ */
+DVAPI int32_t dvUpdateCipher(dvCtx dc, const char* vid,
+                             const char* cipherText, const char* data,
+                             ruList indexWords);
+
 /**
  * Retrieves a \ref vidMap for the given list of \ref vid entries.
  * @param dc The \ref dvCtx to work with.
@@ -249,9 +427,148 @@ DVAPI int32_t dvGet(dvCtx dc, ruList vids, ruMap* vidMap);
  *            copied and must not be freed. It is freed along with the vidMap.
  * @return The status code of the associated \ref vidMap entry or
  *         \ref RUE_PARAMETER_NOT_SET etc for missing/invalid parameters.
+ *         With \ref DV_LAZY_DECRYPT this includes the outcome of decrypting
+ *         the entry.
  */
 DVAPI int32_t dvGetVid(ruMap vidMap, const char* vid, char** pid);
 
+/**
+ * Opaque pointer to the results of \ref dvGetSet.
+ */
+typedef void* dvResultSet;
+
+/**
+ * Like \ref dvGet but stores the results in one block of memory instead of a
+ * \ref vidMap with separately allocated entries. The entries are in the order
+ * of the given \ref vid entries and are decrypted right away,
+ * \ref DV_LAZY_DECRYPT does not apply.
+ * @param dc The \ref dvCtx to work with.
+ * @param vids An \ref ruList of \ref vid entries to retrieve.
+ * @param rs Where the result set will be stored. Free it with
+ *           \ref dvResultSetFree when done with it.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvGetSet(dvCtx dc, ruList vids, dvResultSet* rs);
+
+/**
+ * Like \ref dvGetSet but takes an array of \ref vid entries, so no
+ * \ref ruList needs to be built. Entry i of the result set belongs to
+ * vids[i].
+ * @param dc The \ref dvCtx to work with.
+ * @param vids Array of the \ref vid entries to retrieve.
+ * @param count Number of entries in vids.
+ * @param rs Where the result set will be stored. Free it with
+ *           \ref dvResultSetFree when done with it.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvGetMany(dvCtx dc, const char* const* vids, size_t count,
+                        dvResultSet* rs);
+
+/**
+ * Returns the number of entries of the given result set, which is the number
+ * of \ref vid entries it was requested with.
+ * @param rs The \ref dvResultSet to query.
+ * @return The number of entries or 0 for an invalid result set.
+ */
+DVAPI size_t dvResultSetSize(dvResultSet rs);
+
+/**
+ * Retrieves the entry at the given position of the result set.
+ * @param rs The \ref dvResultSet to query.
+ * @param idx Position of the entry, the position of its \ref vid in the
+ *            requested list.
+ * @param vid Optional, where to store the \ref vid of the entry.
+ * @param pid Optional, where to store the \ref pid data of the entry. This
+ *            data is freed along with the result set.
+ * @return The status code of the entry like \ref dvGetVid, or
+ *         \ref RUE_INVALID_PARAMETER when idx is out of range.
+ */
+DVAPI int32_t dvResultSetAt(dvResultSet rs, size_t idx, const char** vid,
+                            const char** pid);
+
+/**
+ * Retrieves the entry of the given \ref vid from the result set.
+ * @param rs The \ref dvResultSet to query.
+ * @param vid \ref vid entry to retrieve.
+ * @param pid Optional, where to store the \ref pid data of the entry. This
+ *            data is freed along with the result set.
+ * @return The status code of the entry like \ref dvGetVid, or
+ *         \ref RUE_FILE_NOT_FOUND when the vid was not requested.
+ */
+DVAPI int32_t dvResultSetGet(dvResultSet rs, const char* vid,
+                             const char** pid);
+
+/**
+ * Frees the given result set along with all its entries.
+ * @param rs The \ref dvResultSet to free.
+ */
+DVAPI void dvResultSetFree(dvResultSet rs);
+
+/**
+ * Interface of a function that copies a cached \ref pid into storage of the
+ * caller. It reads the same cache as the KvStore given to \ref dvNew, which
+ * is where the library keeps the \ref pid data it encrypted or received.
+ * Unlike the get function of a KvStore it must not allocate, so that
+ * \ref dvGetCached serves cache hits without a single heap allocation.
+ * @param readCtx The context given to \ref dvSetCacheReader.
+ * @param vid The \ref vid to look up.
+ * @param buf Where to copy the \ref pid to. It needs no terminator.
+ * @param bufLen Size of buf.
+ * @param len Where to store the length of the \ref pid, also when it does
+ *            not fit.
+ * @return \ref RUE_OK when the \ref pid was copied, \ref RUE_FILE_NOT_FOUND
+ *         when the \ref vid is not cached or \ref RUE_OVERFLOW when buf is
+ *         too small.
+ */
+typedef int32_t (*dvCacheReadFn) (void* readCtx, const char* vid, char* buf,
+                                  size_t bufLen, size_t* len);
+
+/**
+ * Sets the function \ref dvGetCached reads the cache with.
+ * @param dc The \ref dvCtx to work with.
+ * @param readFn The \ref dvCacheReadFn to call or NULL to read the KvStore.
+ * @param readCtx An optional context that will be passed into the
+ *                \ref dvCacheReadFn as the \b readCtx parameter.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvSetCacheReader(dvCtx dc, dvCacheReadFn readFn, void* readCtx);
+
+/**
+ * Copies the cached \ref pid of the given \ref vid into the given buffer
+ * without asking the \ref vault. With a \ref dvCacheReadFn set this makes
+ * no heap allocation, otherwise the KvStore hands out a copy that is freed
+ * again. Entries that are not cached are fetched with \ref dvGet or
+ * \ref dvGetMany.
+ * @param dc The \ref dvCtx to work with.
+ * @param vid The \ref vid to look up.
+ * @param buf Where to copy the \ref pid to, with a terminating null byte.
+ * @param bufLen Size of buf.
+ * @param len Optional, where to store the length of the \ref pid without
+ *            the terminator, also on \ref RUE_OVERFLOW.
+ * @return \ref RUE_OK on success, \ref RUE_FILE_NOT_FOUND when the
+ *         \ref vid is not cached, \ref RUE_OVERFLOW when buf is too small
+ *         or another error code.
+ */
+DVAPI int32_t dvGetCached(dvCtx dc, const char* vid, char* buf, size_t bufLen,
+                          size_t* len);
+
+/**
+ * Retrieves one field of the \ref pid for given \ref vid from the given
+ * \ref vidMap. If the entry is a field envelope that has not been decrypted
+ * yet, see \ref DV_LAZY_DECRYPT, only this field is decrypted. Otherwise the
+ * field is taken from the JSON object the \ref pid holds.
+ * @param vidMap The \ref vidMap to retrieve the value from.
+ * @param vid \ref vid entry to retrieve.
+ * @param name The name of the field.
+ * @param value Where to store the value. This data should be copied and
+ *              must not be freed. It is freed along with the vidMap.
+ * @return \ref RUE_OK on success, \ref RUE_FILE_NOT_FOUND if the entry has
+ *         no such field, the status code of the entry if that is not OK or
+ *         another error code.
+ */
+DVAPI int32_t dvGetField(ruMap vidMap, const char* vid, const char* name,
+                         char** value);
+
 /**
  * Retrieves an \ref ruList of \ref vid entries that matched the given \ref swd
  * entries.
@@ -266,6 +583,186 @@ DVAPI int32_t dvGetVid(ruMap vidMap, const char* vid, char** pid);
  */
 DVAPI int32_t dvSearch(dvCtx dc, ruList searchWords, ruList* vids);
 
+/**
+ * Interface of a function receiving the \ref vid entries of a search.
+ * @param usrCtx Opaque context given along with the function.
+ * @param vid The next \ref vid. Only valid during the call.
+ * @return \ref RUE_OK to continue or an error code to stop the search.
+ */
+typedef int32_t (*dvVidFn) (void* usrCtx, const char* vid);
+
+/**
+ * Like \ref dvSearch but hands the \ref vid entries to a function one by one
+ * instead of collecting them, so broad searches take no more memory than a
+ * response. With \ref DV_SEARCH_PAGE_SIZE set the \ref vault is asked for
+ * the results a page at a time. A \ref vault that hands out the same page
+ * token twice fails the search with \ref DVE_PROTOCOL_ERROR.
+ * @param dc The \ref dvCtx to work with.
+ * @param searchWords An \ref ruList of previously in \ref dvAddSearchWord
+ *                    specified \ref swd terms to query. These terms are ANDed.
+ * @param vidFn The \ref dvVidFn to call with each found \ref vid.
+ * @param usrCtx Opaque context passed to vidFn.
+ * @return \ref RUE_OK on success, the error code vidFn stopped the search with
+ *         or another error code.
+ */
+DVAPI int32_t dvSearchEach(dvCtx dc, ruList searchWords, dvVidFn vidFn,
+                           void* usrCtx);
+
+/**
+ * Opaque pointer to a type-ahead search session.
+ */
+typedef void* dvSearchSession;
+
+/**
+ * Creates a type-ahead search session for the \ref appid of the given context.
+ * The session is meant for a search box that searches on every keystroke.
+ * It keeps the \ref swd hash chain of the last word, so typing another
+ * character only costs one more hash step. It also keeps the \ref vid results
+ * of every \ref swd seen. Backspacing and retyping are then served locally.
+ * Results are not refreshed, so start a new session when the \ref vault data
+ * may have changed.
+ * @param dc The \ref dvCtx to search with. It must outlive the session.
+ * @param ss Where the new session will be stored. Free it with
+ *           \ref dvSearchSessionFree when done with it.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvSearchSessionNew(dvCtx dc, dvSearchSession* ss);
+
+/**
+ * Searches for the current content of the search box. This returns the same
+ * as \ref dvSearch with the \ref swd of the given word.
+ * @param ss The \ref dvSearchSession to search with.
+ * @param word The complete word as currently typed.
+ * @param vids Where the \ref ruList of \ref vid results will be stored. The
+ *             given entries will be added if the list is already present.
+ *             It stays NULL when nothing was found. Free it with
+ *             \ref ruListFree when no longer needed.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvSearchSessionFind(dvSearchSession ss, const char* word,
+                                  ruList* vids);
+
+/**
+ * Frees the given type-ahead search session.
+ * @param ss The \ref dvSearchSession to free.
+ */
+DVAPI void dvSearchSessionFree(dvSearchSession ss);
+
+/**
+ * Interface of a function receiving the output of a stream.
+ * @param usrCtx Opaque context given along with the function.
+ * @param data The next chunk of output. Only valid during the call.
+ * @param len Length of the chunk.
+ * @return \ref RUE_OK to continue or an error code to abort the stream.
+ */
+typedef int32_t (*dvWriteFn) (void* usrCtx, const void* data, size_t len);
+
+/**
+ * Interface of a function delivering the input of a stream.
+ * @param usrCtx Opaque context given along with the function.
+ * @param buf Where to write the next chunk of input.
+ * @param size Size of buf.
+ * @param len Where the number of bytes written will be stored. Store 0 at the
+ *            end of the input.
+ * @return \ref RUE_OK to continue or an error code to abort the stream.
+ */
+typedef int32_t (*dvReadFn) (void* usrCtx, void* buf, size_t size, size_t* len);
+
+/**
+ * Opaque pointer to an encryption or decryption stream.
+ */
+typedef void* dvCryptStream;
+
+/**
+ * Creates a stream that encrypts \ref pid data given in chunks to the cipher
+ * recipe \ref dvAdd would send, using the \ref appid and the
+ * \ref DV_CIPHER_RECIPE of the context. The recipe is passed to the writer in
+ * chunks as well, so memory use does not depend on the size of the data.
+ * @param dc The \ref dvCtx to work with.
+ * @param writer The \ref dvWriteFn receiving the cipher recipe.
+ * @param writeCtx Optional context passed to the writer.
+ * @param cs Where the new stream will be stored. Free it with
+ *           \ref dvCryptStreamFree when done with it.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvEncryptStreamNew(dvCtx dc, dvWriteFn writer, void* writeCtx,
+                                 dvCryptStream* cs);
+
+/**
+ * Creates a stream that decrypts a cipher recipe given in chunks and passes
+ * the \ref pid data to the writer in chunks.
+ * @remark The data is authenticated by \ref dvCryptStreamFinish only. Data
+ *         written before must be discarded if it does not return \ref RUE_OK.
+ * @param dc The \ref dvCtx to work with.
+ * @param writer The \ref dvWriteFn receiving the \ref pid data.
+ * @param writeCtx Optional context passed to the writer.
+ * @param cs Where the new stream will be stored. Free it with
+ *           \ref dvCryptStreamFree when done with it.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvDecryptStreamNew(dvCtx dc, dvWriteFn writer, void* writeCtx,
+                                 dvCryptStream* cs);
+
+/**
+ * Feeds the next chunk of input to the stream.
+ * @param cs The \ref dvCryptStream to work with.
+ * @param data The next chunk of \ref pid data or cipher recipe.
+ * @param len Length of the chunk.
+ * @return \ref RUE_OK on success or an error code. The stream is unusable
+ *         after an error.
+ */
+DVAPI int32_t dvCryptStreamUpdate(dvCryptStream cs, const void* data,
+                                  size_t len);
+
+/**
+ * Ends the input, writes the remaining output and checks the integrity of
+ * decrypted data.
+ * @param cs The \ref dvCryptStream to work with.
+ * @return \ref RUE_OK on success, \ref DVE_INVALID_CREDENTIALS if decrypted
+ *         data failed the check or another error code.
+ */
+DVAPI int32_t dvCryptStreamFinish(dvCryptStream cs);
+
+/**
+ * Frees the given stream.
+ * @param cs The \ref dvCryptStream to free.
+ */
+DVAPI void dvCryptStreamFree(dvCryptStream cs);
+
+/**
+ * Like \ref dvAdd for large \ref pid data such as scanned documents. The data
+ * is read, encrypted and uploaded in chunks, so memory use does not depend on
+ * its size. The data is not put into the cache.
+ * @param dc The \ref dvCtx to work with.
+ * @param reader The \ref dvReadFn delivering the \ref pid data.
+ * @param readCtx Optional context passed to the reader.
+ * @param indexWords Optional \ref iwd terms under which this data should be
+ *                    found via \ref dvSearch. Use NULL for none.
+ * @param vid Where the corresponding \ref vid for the given data
+ *            will be stored on success. Free this with \ref ruFree when done
+ *            with it.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvAddStream(dvCtx dc, dvReadFn reader, void* readCtx,
+                          ruList indexWords, char** vid);
+
+/**
+ * Like \ref dvGet for a single large \ref pid entry. The cipher recipe is
+ * decrypted while it is downloaded and the data is passed to the writer in
+ * chunks.
+ * @remark The data is authenticated once the download is complete. Data
+ *         written before must be discarded if this does not return
+ *         \ref RUE_OK.
+ * @param dc The \ref dvCtx to work with.
+ * @param vid The \ref vid of the entry to retrieve.
+ * @param writer The \ref dvWriteFn receiving the \ref pid data.
+ * @param writeCtx Optional context passed to the writer.
+ * @return \ref RUE_OK on success, \ref RUE_FILE_NOT_FOUND if the \ref vault
+ *         does not know the \ref vid or another error code.
+ */
+DVAPI int32_t dvGetStream(dvCtx dc, const char* vid, dvWriteFn writer,
+                          void* writeCtx);
+
 /**
  * Deletes given list of \ref vid entries from the \ref vault.
  * @param dc The \ref dvCtx to work with.
@@ -274,6 +771,15 @@ DVAPI int32_t dvSearch(dvCtx dc, ruList searchWords, ruList* vids);
  */
 DVAPI int32_t dvDelete(dvCtx dc, ruList vids);
 
+/**
+ * Like \ref dvDelete but takes an array of \ref vid entries.
+ * @param dc The \ref dvCtx to work with.
+ * @param vids Array of the \ref vid entries to be deleted.
+ * @param count Number of entries in vids.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvDeleteMany(dvCtx dc, const char* const* vids, size_t count);
+
 /*
  * Wipes data of given \ref vid from the local cache.
  * @param ctx The \ref dvCtx to work with.
@@ -290,6 +796,15 @@ DVAPI int32_t dvDelete(dvCtx dc, ruList vids);
  */
 DVAPI int32_t dvWipe(dvCtx dc, ruList vids);
 
+/**
+ * Like \ref dvWipe but takes an array of \ref vid entries.
+ * @param dc The \ref dvCtx to work with.
+ * @param vids Array of the \ref vid entries to be wiped.
+ * @param count Number of entries in vids.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvWipeMany(dvCtx dc, const char* const* vids, size_t count);
+
 /**
  * A function that generates a list of \ref iwd entries based on the given \ref pid.
  * @param usrCtx Opaque context to be passed to the function.
@@ -310,7 +825,8 @@ typedef int32_t (*dvIndexCb) (void* usrCtx, const char* vid,
  *
  * This may be needed if a user's \ref appid has been changed as a result of a
  * compromise due to a leakage. Be sure to iterate over the returned
- * \ref vidMap.
+ * \ref vidMap. Records stored by \ref dvAddFields are re-encrypted as a
+ * whole, their fields remain readable with \ref dvGetField.
  * @param dc The \ref dvCtx with the old \ref appid to work with.
  * @param newId The new \ref appid to re-encrypt each \ref pid entry with.
  * @param vids The list of \ref vid entries that need re-encrypting.
@@ -332,6 +848,29 @@ typedef int32_t (*dvIndexCb) (void* usrCtx, const char* vid,
 DVAPI int32_t dvChangeAppId(dvCtx dc, const char* newId, ruList vids,
                             ruMap* vidMap, dvIndexCb indexCb, void* indexCtx);
 
+/**
+ * Like \ref dvChangeAppId but takes an array of \ref vid entries and stores
+ * the status of each entry in a caller provided array instead of a
+ * \ref vidMap.
+ * @param dc The \ref dvCtx with the old \ref appid to work with.
+ * @param newId The new \ref appid to re-encrypt each \ref pid entry with.
+ * @param vids Array of the \ref vid entries that need re-encrypting.
+ * @param count Number of entries in vids.
+ * @param stati Array of count entries receiving the status of each
+ *              \ref vid, \ref RUE_OK once it is re-encrypted. The stati are
+ *              undefined on error.
+ * @param indexCb An optional \ref dvIndexCb to call to set \ref iwd terms of
+ *                each re-encrypted \ref pid entry.
+ * @param indexCtx An optional context that will be passed into \b indexCb
+ *                 as the \b usrCtx parameter.
+ * @return \ref RUE_OK on success or an error code. Total success is only
+ *              provided when all stati are \ref RUE_OK.
+ */
+DVAPI int32_t dvChangeAppIdMany(dvCtx dc, const char* newId,
+                                const char* const* vids, size_t count,
+                                int32_t* stati, dvIndexCb indexCb,
+                                void* indexCtx);
+
 /**
  * @}
  */
@@ -591,6 +1130,19 @@ DVAPI int32_t dvSetPostCb(dvCtx dc, dvPostCb callback, void* cbCtx);
  */
 DVAPI const char* dvVersion(void);
 
+/**
+ * \brief Returns which crypto implementations are in use.
+ *
+ * AES-CBC, SHA-256 and base64 are picked on first use according to the CPU
+ * features found at runtime, falling back to the Mbed TLS implementations.
+ * The result is a line of the form
+ * `aes-cbc=aes-ni sha256=sha-ni base64=table cpu=aes-ni,sha-ni,avx2`, meant
+ * for logs and bug reports.
+ * \return Description of the selection. This string is static and must not be
+ *         freed.
+ */
+DVAPI const char* dvCryptoInfo(void);
+
 /**
  * \brief Constants used to set \ref dvclient context parameters.
  */
@@ -626,6 +1178,47 @@ enum dvCtxOpt {
      * general log level is at \ref RU_LOG_VERB.
      */
     DV_CURL_LOGGING,
+    /**
+     * The cipher recipe new and updated \ref pid data is encrypted with. This
+     * is either \b aes-256-cbc which is the default or \b aes-256-gcm. Data
+     * is always decrypted with the recipe it was encrypted with. See
+     * \ref payload for the details.
+     */
+    DV_CIPHER_RECIPE,
+    /**
+     * Set to \b deflate to compress new and updated \ref pid data before it
+     * is encrypted. NULL or \b 0 turns it off, which is the default. See
+     * \ref dvUseDictionary for small records.
+     * Compressed data is decompressed automatically no matter this setting.
+     * Note that the size of compressed data depends on its content, so the
+     * length of a \ref payload tells more about the \ref pid. Do not turn it
+     * on if attackers may mix their input with secrets in the same \ref pid.
+     */
+    DV_COMPRESSION,
+    /**
+     * When set to non 0, \ref dvGet and \ref dvGetPublished leave the
+     * returned \ref pid encrypted in the \ref vidMap. \ref dvGetVid decrypts
+     * an entry on first access and keeps the result, so entries that are
+     * never looked at cost no decryption. Such a \ref vidMap must be freed
+     * before its \ref dvCtx and must not be read by several threads at once.
+     */
+    DV_LAZY_DECRYPT,
+    /**
+     * The number of \ref vid entries a \ref vault search response should
+     * hold at most. The rest is fetched with further requests that continue
+     * where the previous page ended. NULL or \b 0, the default, asks for all
+     * results at once. A \ref vault that does not page ignores it.
+     */
+    DV_SEARCH_PAGE_SIZE,
+    /**
+     * When set to non 0, the \ref vault is asked once whether it answers
+     * get and search requests in MessagePack, protocol version 3, instead of
+     * JSON. Such responses carry the \ref payload as raw bytes and need no
+     * unescaping, so they are smaller and faster to read. A \ref vault
+     * that does not offer it keeps getting version 2 requests. Off by
+     * default.
+     */
+    DV_BINARY_PROTOCOL,
     /**
      * \cond noworry Not used */
     DV_NO_CTX_OP = ~0
@@ -643,6 +1236,53 @@ enum dvCtxOpt {
  */
 DVAPI int dvSetProp(dvCtx dc, enum dvCtxOpt opt, const char* value);
 
+/**
+ * \brief Builds a compression dictionary from sample \ref pid records.
+ *
+ * Small records of the same shape hardly compress on their own. A dictionary
+ * holding what they have in common makes up for that. It is made of the
+ * parts found in the most samples, so use a few hundred records typical of
+ * the data to be stored.
+ * @remark The dictionary contains parts of the samples. Treat it like the
+ *         samples themselves or train it on made up records.
+ * @param samples The sample records.
+ * @param count Number of samples, at least 2.
+ * @param maxLen Maximum size of the dictionary. A few kilobytes is plenty for
+ *               small records, more than 32768 bytes are of no use.
+ * @param dict Where the dictionary will be stored. Free with ruFree.
+ * @param dictLen Where its length will be stored.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvTrainDictionary(const char* const* samples, size_t count,
+                                size_t maxLen, void** dict, size_t* dictLen);
+
+/**
+ * \brief Registers a compression dictionary with the context.
+ *
+ * \ref pid data compressed with a dictionary can only be decrypted by a
+ * context the dictionary is registered with. Dictionaries must therefore be
+ * kept for as long as such data exists. Register them before the context is
+ * used by several threads.
+ * @param dc The \ref dvCtx to register the dictionary with.
+ * @param dict The dictionary as made by \ref dvTrainDictionary. It is copied.
+ * @param len Its length.
+ * @param id Optional, where the id of the dictionary will be stored. It is
+ *           the zlib adler32 of the dictionary, so it is the same everywhere.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvAddDictionary(dvCtx dc, const void* dict, size_t len,
+                              uint32_t* id);
+
+/**
+ * \brief Selects the dictionary new and updated \ref pid data is compressed
+ * with when \ref DV_COMPRESSION is on.
+ * @param dc The \ref dvCtx to work with.
+ * @param id The id of a dictionary registered with \ref dvAddDictionary or 0
+ *           to compress without one.
+ * @return \ref RUE_OK on success or an error code.
+ */
+DVAPI int32_t dvUseDictionary(dvCtx dc, uint32_t id);
+
 /**
  * \brief Returns an English textual representation of the last error this thread
  * generated.
@@ -0,0 +1,295 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+#include <mbedtls/platform_util.h>
+
+#ifdef DV_X86_SIMD
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+#define AES_ROUNDS 14
+
+DV_TARGET("aes,sse2")
+static __m128i expandEven(__m128i k, __m128i assist) {
+    assist = _mm_shuffle_epi32(assist, 0xff);
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    return _mm_xor_si128(k, assist);
+}
+
+DV_TARGET("aes,sse2")
+static __m128i expandOdd(__m128i k, __m128i assist) {
+    assist = _mm_shuffle_epi32(assist, 0xaa);
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    return _mm_xor_si128(k, assist);
+}
+
+// aeskeygenassist takes the round constant as an immediate
+#define EXPAND_EVEN(i, rcon) \
+    rk[i] = expandEven(rk[i-2], _mm_aeskeygenassist_si128(rk[i-1], rcon));
+#define EXPAND(i, rcon) EXPAND_EVEN(i, rcon) \
+    rk[i+1] = expandOdd(rk[i-1], _mm_aeskeygenassist_si128(rk[i], 0));
+
+/**
+ * Expands an AES-256 key for use with #aesniCbc.
+ * @param ak The key structure to fill.
+ * @param key The 32 byte key.
+ * @param mode MBEDTLS_AES_ENCRYPT or MBEDTLS_AES_DECRYPT
+ * @return RUE_OK
+ */
+DV_TARGET("aes,sse2")
+int32_t aesniSetKey(dvAesKey ak, trans_bytes key, int mode) {
+    __m128i rk[AES_ROUNDS + 1];
+    __m128i* out = (__m128i*)ak->rk;
+
+    rk[0] = _mm_loadu_si128((const __m128i*)key);
+    rk[1] = _mm_loadu_si128((const __m128i*)(key + 16));
+    EXPAND(2, 0x01)
+    EXPAND(4, 0x02)
+    EXPAND(6, 0x04)
+    EXPAND(8, 0x08)
+    EXPAND(10, 0x10)
+    EXPAND(12, 0x20)
+    EXPAND_EVEN(14, 0x40)
+
+    if (mode == MBEDTLS_AES_ENCRYPT) {
+        for (int i = 0; i <= AES_ROUNDS; i++) {
+            _mm_storeu_si128(out + i, rk[i]);
+        }
+    } else {
+        // the equivalent inverse cipher runs the schedule backwards
+        _mm_storeu_si128(out, rk[AES_ROUNDS]);
+        for (int i = 1; i < AES_ROUNDS; i++) {
+            _mm_storeu_si128(out + i, _mm_aesimc_si128(rk[AES_ROUNDS - i]));
+        }
+        _mm_storeu_si128(out + AES_ROUNDS, rk[0]);
+    }
+    mbedtls_platform_zeroize(rk, sizeof(rk));
+    return RUE_OK;
+}
+
+DV_TARGET("aes,sse2")
+static void cbcEnc(const __m128i* rk, rusize blocks, alloc_bytes iv,
+                   trans_bytes in, alloc_bytes out) {
+    __m128i b = _mm_loadu_si128((const __m128i*)iv);
+    while (blocks--) {
+        b = _mm_xor_si128(b, _mm_loadu_si128((const __m128i*)in));
+        b = _mm_xor_si128(b, rk[0]);
+        for (int r = 1; r < AES_ROUNDS; r++) {
+            b = _mm_aesenc_si128(b, rk[r]);
+        }
+        b = _mm_aesenclast_si128(b, rk[AES_ROUNDS]);
+        _mm_storeu_si128((__m128i*)out, b);
+        in += BLOCKSIZE;
+        out += BLOCKSIZE;
+    }
+    _mm_storeu_si128((__m128i*)iv, b);
+}
+
+/*
+ * CBC decryption has no chaining dependency, so 4 blocks go through the
+ * pipeline at once. All ciphertext of a group is read before the group is
+ * written, which keeps in place operation intact.
+ */
+DV_TARGET("aes,sse2")
+static void cbcDec(const __m128i* rk, rusize blocks, alloc_bytes iv,
+                   trans_bytes in, alloc_bytes out) {
+    __m128i prev = _mm_loadu_si128((const __m128i*)iv);
+    __m128i c0, c1, c2, c3, b0, b1, b2, b3;
+    int r;
+
+    for (; blocks >= 4; blocks -= 4) {
+        c0 = _mm_loadu_si128((const __m128i*)in);
+        c1 = _mm_loadu_si128((const __m128i*)(in + 16));
+        c2 = _mm_loadu_si128((const __m128i*)(in + 32));
+        c3 = _mm_loadu_si128((const __m128i*)(in + 48));
+        b0 = _mm_xor_si128(c0, rk[0]);
+        b1 = _mm_xor_si128(c1, rk[0]);
+        b2 = _mm_xor_si128(c2, rk[0]);
+        b3 = _mm_xor_si128(c3, rk[0]);
+        for (r = 1; r < AES_ROUNDS; r++) {
+            b0 = _mm_aesdec_si128(b0, rk[r]);
+            b1 = _mm_aesdec_si128(b1, rk[r]);
+            b2 = _mm_aesdec_si128(b2, rk[r]);
+            b3 = _mm_aesdec_si128(b3, rk[r]);
+        }
+        b0 = _mm_xor_si128(_mm_aesdeclast_si128(b0, rk[AES_ROUNDS]), prev);
+        b1 = _mm_xor_si128(_mm_aesdeclast_si128(b1, rk[AES_ROUNDS]), c0);
+        b2 = _mm_xor_si128(_mm_aesdeclast_si128(b2, rk[AES_ROUNDS]), c1);
+        b3 = _mm_xor_si128(_mm_aesdeclast_si128(b3, rk[AES_ROUNDS]), c2);
+        _mm_storeu_si128((__m128i*)out, b0);
+        _mm_storeu_si128((__m128i*)(out + 16), b1);
+        _mm_storeu_si128((__m128i*)(out + 32), b2);
+        _mm_storeu_si128((__m128i*)(out + 48), b3);
+        prev = c3;
+        in += 64;
+        out += 64;
+    }
+    for (; blocks; blocks--) {
+        c0 = _mm_loadu_si128((const __m128i*)in);
+        b0 = _mm_xor_si128(c0, rk[0]);
+        for (r = 1; r < AES_ROUNDS; r++) {
+            b0 = _mm_aesdec_si128(b0, rk[r]);
+        }
+        b0 = _mm_xor_si128(_mm_aesdeclast_si128(b0, rk[AES_ROUNDS]), prev);
+        _mm_storeu_si128((__m128i*)out, b0);
+        prev = c0;
+        in += BLOCKSIZE;
+        out += BLOCKSIZE;
+    }
+    _mm_storeu_si128((__m128i*)iv, prev);
+}
+
+/**
+ * AES-256-CBC on AES-NI with the semantics of mbedtls_aes_crypt_cbc, the IV
+ * is updated for continuation.
+ * @param ak Key set up with #aesniSetKey for the same mode.
+ * @param mode MBEDTLS_AES_ENCRYPT or MBEDTLS_AES_DECRYPT
+ * @param len Length of the data, a multiple of 16.
+ * @param iv 16 byte IV.
+ * @param in Input data.
+ * @param out Output buffer, may equal in.
+ * @return 0 or MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH
+ */
+DV_TARGET("aes,sse2")
+int32_t aesniCbc(dvAesKey ak, int mode, rusize len, alloc_bytes iv,
+                 trans_bytes in, alloc_bytes out) {
+    __m128i rk[AES_ROUNDS + 1];
+    if (len % BLOCKSIZE) return MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH;
+
+    for (int i = 0; i <= AES_ROUNDS; i++) {
+        rk[i] = _mm_loadu_si128((const __m128i*)(ak->rk + i * 16));
+    }
+    if (mode == MBEDTLS_AES_ENCRYPT) {
+        cbcEnc(rk, len / BLOCKSIZE, iv, in, out);
+    } else {
+        cbcDec(rk, len / BLOCKSIZE, iv, in, out);
+    }
+    mbedtls_platform_zeroize(rk, sizeof(rk));
+    return 0;
+}
+
+// enough independent messages to hide the aesenc latency
+#define CBC_LANES 8
+#define EACH_LANE(X) X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7)
+#define LANE_LOAD(l) b[l] = _mm_xor_si128(_mm_xor_si128(b[l], \
+        _mm_loadu_si128((const __m128i*)pos[l])), rk[0]);
+#define LANE_ROUND(l) b[l] = _mm_aesenc_si128(b[l], k);
+#define LANE_STORE(l) b[l] = _mm_aesenclast_si128(b[l], k); \
+        _mm_storeu_si128((__m128i*)pos[l], b[l]); \
+        pos[l] += step[l];
+
+/**
+ * Encrypts many CBC messages in place, advancing #CBC_LANES of them in
+ * lockstep. Between refills all lanes run branch free, idle lanes encrypt a
+ * scratch block.
+ * @param ak Key set up with #aesniSetKey for encryption.
+ * @param streams The messages, their IVs are updated like with #aesniCbc.
+ * @param count Number of messages.
+ * @return 0 or MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH
+ */
+DV_TARGET("aes,sse2")
+int32_t aesniCbcEncMany(dvAesKey ak, struct dv_cbc_stream* streams,
+                        size_t count) {
+    __m128i rk[AES_ROUNDS + 1];
+    __m128i b[CBC_LANES], k;
+    struct dv_cbc_stream* lane[CBC_LANES];
+    alloc_bytes pos[CBC_LANES];
+    rusize left[CBC_LANES], step[CBC_LANES], run;
+    uint8_t scratch[BLOCKSIZE] = {0};
+    size_t next = 0;
+    int l, r, active = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (streams[i].len % BLOCKSIZE) {
+            return MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH;
+        }
+    }
+    for (r = 0; r <= AES_ROUNDS; r++) {
+        rk[r] = _mm_loadu_si128((const __m128i*)(ak->rk + r * 16));
+    }
+    for (l = 0; l < CBC_LANES; l++) {
+        lane[l] = NULL;
+        pos[l] = scratch;
+        step[l] = 0;
+        b[l] = _mm_setzero_si128();
+    }
+
+    do {
+        // hand out messages to idle lanes
+        for (l = 0; l < CBC_LANES; l++) {
+            if (lane[l]) continue;
+            while (next < count && !streams[next].len) next++;
+            if (next == count) continue;
+            lane[l] = &streams[next++];
+            pos[l] = lane[l]->data;
+            step[l] = BLOCKSIZE;
+            left[l] = lane[l]->len / BLOCKSIZE;
+            b[l] = _mm_loadu_si128((const __m128i*)lane[l]->iv);
+            active++;
+        }
+        if (!active) break;
+
+        // run until the first lane is done
+        run = 0;
+        for (l = 0; l < CBC_LANES; l++) {
+            if (lane[l] && (!run || left[l] < run)) run = left[l];
+        }
+        for (rusize n = 0; n < run; n++) {
+            EACH_LANE(LANE_LOAD)
+            for (r = 1; r < AES_ROUNDS; r++) {
+                k = rk[r];
+                EACH_LANE(LANE_ROUND)
+            }
+            k = rk[AES_ROUNDS];
+            EACH_LANE(LANE_STORE)
+        }
+
+        for (l = 0; l < CBC_LANES; l++) {
+            if (!lane[l]) continue;
+            left[l] -= run;
+            if (!left[l]) {
+                _mm_storeu_si128((__m128i*)lane[l]->iv, b[l]);
+                lane[l] = NULL;
+                pos[l] = scratch;
+                step[l] = 0;
+                active--;
+            }
+        }
+    } while (true);
+
+    mbedtls_platform_zeroize(rk, sizeof(rk));
+    mbedtls_platform_zeroize(scratch, sizeof(scratch));
+    return 0;
+}
+
+void aesniFree(dvAesKey ak) {
+    if (!ak) return;
+    mbedtls_platform_zeroize(ak->rk, sizeof(ak->rk));
+}
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+#include <mbedtls/base64.h>
+
+static const char b64Chars[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 0xff marks characters outside the alphabet, '=' included
+static const uint8_t b64Values[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff,   62, 0xff, 0xff, 0xff,   63,
+      52,   53,   54,   55,   56,   57,   58,   59,
+      60,   61, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff,    0,    1,    2,    3,    4,    5,    6,
+       7,    8,    9,   10,   11,   12,   13,   14,
+      15,   16,   17,   18,   19,   20,   21,   22,
+      23,   24,   25, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff,   26,   27,   28,   29,   30,   31,   32,
+      33,   34,   35,   36,   37,   38,   39,   40,
+      41,   42,   43,   44,   45,   46,   47,   48,
+      49,   50,   51, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+/**
+ * Table driven base64 encoder with the semantics of mbedtls_base64_encode.
+ * @param dst Output buffer or NULL to query the size.
+ * @param dlen Size of dst.
+ * @param olen Receives the encoded length, or the required buffer size
+ *             including the terminator if dst is too small.
+ * @param src Data to encode.
+ * @param slen Length of src.
+ * @return 0 or MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL
+ */
+int b64Encode(alloc_bytes dst, size_t dlen, size_t* olen, trans_bytes src,
+              size_t slen) {
+    if (!slen) {
+        *olen = 0;
+        return 0;
+    }
+    size_t n = (slen + 2) / 3 * 4;
+    if (!dst || dlen < n + 1) {
+        *olen = n + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    alloc_bytes p = dst;
+    size_t i, full = slen - slen % 3;
+    for (i = 0; i < full; i += 3) {
+        uint32_t v = (uint32_t)src[i] << 16 | (uint32_t)src[i+1] << 8 | src[i+2];
+        *p++ = b64Chars[v >> 18];
+        *p++ = b64Chars[(v >> 12) & 0x3f];
+        *p++ = b64Chars[(v >> 6) & 0x3f];
+        *p++ = b64Chars[v & 0x3f];
+    }
+    if (i < slen) {
+        uint32_t v = (uint32_t)src[i] << 16;
+        if (i + 1 < slen) v |= (uint32_t)src[i+1] << 8;
+        *p++ = b64Chars[v >> 18];
+        *p++ = b64Chars[(v >> 12) & 0x3f];
+        *p++ = i + 1 < slen? b64Chars[(v >> 6) & 0x3f] : '=';
+        *p++ = '=';
+    }
+    *p = '\0';
+    *olen = (size_t)(p - dst);
+    return 0;
+}
+
+/*
+ * Returns the decoded size of canonical base64, padded to a multiple of 4
+ * without white space, or -1 for anything else.
+ */
+static long canonicalSize(trans_bytes src, size_t slen) {
+    if (slen % 4) return -1;
+    size_t pad = 0;
+    if (src[slen-1] == '=') {
+        pad = src[slen-2] == '='? 2 : 1;
+    }
+    for (size_t i = 0; i < slen - pad; i++) {
+        if (b64Values[src[i]] == 0xff) return -1;
+    }
+    return (long)(slen / 4 * 3 - pad);
+}
+
+/**
+ * Table driven base64 decoder with the semantics of mbedtls_base64_decode.
+ * Input that is not canonical, such as white space or line breaks, is handed
+ * to Mbed TLS.
+ * @param dst Output buffer or NULL to query the size.
+ * @param dlen Size of dst.
+ * @param olen Receives the decoded length, or the required size if dst is too
+ *             small.
+ * @param src Base64 to decode.
+ * @param slen Length of src.
+ * @return 0 or an MBEDTLS_ERR_BASE64_* error
+ */
+int b64Decode(alloc_bytes dst, size_t dlen, size_t* olen, trans_bytes src,
+              size_t slen) {
+    if (!slen) {
+        *olen = 0;
+        return 0;
+    }
+    long size = canonicalSize(src, slen);
+    if (size < 0) {
+        return mbedtls_base64_decode(dst, dlen, olen, src, slen);
+    }
+    if (!dst || dlen < (size_t)size) {
+        *olen = (size_t)size;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    alloc_bytes p = dst;
+    size_t i, last = slen - 4;
+    for (i = 0; i < last; i += 4) {
+        uint32_t v = (uint32_t)b64Values[src[i]] << 18 |
+                     (uint32_t)b64Values[src[i+1]] << 12 |
+                     (uint32_t)b64Values[src[i+2]] << 6 |
+                     b64Values[src[i+3]];
+        *p++ = (uint8_t)(v >> 16);
+        *p++ = (uint8_t)(v >> 8);
+        *p++ = (uint8_t)v;
+    }
+    // the final quantum may be padded
+    uint32_t v = (uint32_t)b64Values[src[i]] << 18 |
+                 (uint32_t)b64Values[src[i+1]] << 12;
+    *p++ = (uint8_t)(v >> 16);
+    if (src[i+2] != '=') {
+        v |= (uint32_t)b64Values[src[i+2]] << 6;
+        *p++ = (uint8_t)(v >> 8);
+        if (src[i+3] != '=') {
+            v |= b64Values[src[i+3]];
+            *p++ = (uint8_t)v;
+        }
+    }
+    *olen = (size_t)(p - dst);
+    return 0;
+}
@@ -0,0 +1,495 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+#include <zlib.h>
+#include <mbedtls/platform_util.h>
+
+// texts shorter than this are not compressed without a dictionary
+#define DEFLATE_MIN 128
+// the part of the deflate window zlib keeps free for lookahead
+#define ZLIB_LOOKAHEAD 262
+
+// names of the enum dvCodec entries as used in the recipe
+static const char* codecNames[] = {"b", "z"};
+
+/**
+ * Writes the recipe name of a codec, z.[hex dictionary id] when a dictionary
+ * is used.
+ * @param codec The codec.
+ * @param dictId The dictionary id or 0.
+ * @param out Buffer of at least #CODEC_NAME_SIZE bytes.
+ * @return Length of the name.
+ */
+rusize codecName(enum dvCodec codec, uint32_t dictId, char* out) {
+    if (codec == CODEC_DEFLATE && dictId) {
+        return (rusize)sprintf(out, "%s.%08x", codecNames[codec], dictId);
+    }
+    return (rusize)sprintf(out, "%s", codecNames[codec]);
+}
+
+/**
+ * Parses the codec field of a recipe.
+ * @param name The field.
+ * @param len Its length.
+ * @param codec Where the codec will be stored.
+ * @param dictId Where the dictionary id or 0 will be stored.
+ * @return RUE_OK on success
+ */
+int32_t findCodec(const char* name, rusize len, enum dvCodec* codec,
+                  uint32_t* dictId) {
+    *dictId = 0;
+    if (len == CODEC_NAME_SIZE - 1 && !memcmp(name, "z.", 2)) {
+        uint32_t id = 0;
+        for (rusize i = 2; i < len; i++) {
+            char c = name[i];
+            id <<= 4;
+            if (c >= '0' && c <= '9') id |= (uint32_t)(c - '0');
+            else if (c >= 'a' && c <= 'f') id |= (uint32_t)(c - 'a' + 10);
+            else return RUE_INVALID_PARAMETER;
+        }
+        if (!id) return RUE_INVALID_PARAMETER;
+        *dictId = id;
+        *codec = CODEC_DEFLATE;
+        return RUE_OK;
+    }
+    for (int i = 0; i < (int)(sizeof(codecNames) / sizeof(codecNames[0])); i++) {
+        if (len == strlen(codecNames[i]) && !memcmp(name, codecNames[i], len)) {
+            *codec = (enum dvCodec)i;
+            return RUE_OK;
+        }
+    }
+    return RUE_INVALID_PARAMETER;
+}
+
+/**
+ * Looks up a registered dictionary.
+ * @param dicts The dictionaries of the context.
+ * @param id The id to look for.
+ * @return The dictionary or NULL if it is not registered.
+ */
+dvdict findDict(dvdict dicts, uint32_t id) {
+    for (; dicts; dicts = dicts->next) {
+        if (dicts->id == id) return dicts;
+    }
+    return NULL;
+}
+
+void freeDicts(dvdict dicts) {
+    while (dicts) {
+        dvdict next = dicts->next;
+        ruFree(dicts->data);
+        ruFree(dicts);
+        dicts = next;
+    }
+}
+
+static voidpf zAlloc(voidpf opaque, uInt items, uInt size) {
+    return ruMallocSize(items, size);
+}
+
+static void zFree(voidpf opaque, voidpf address) {
+    ruFree(address);
+}
+
+/**
+ * Deflates the given text if that makes it smaller.
+ * @param str The text to compress.
+ * @param len Length of the text.
+ * @param dict The dictionary to compress with or NULL.
+ * @param out Where the compressed bytes will be stored. NULL if compression
+ *            did not pay off. Free with ruFree.
+ * @param outLen Where their length will be stored.
+ * @return RUE_OK on success
+ */
+int32_t deflateText(const char* str, rusize len, dvdict dict,
+                    alloc_bytes* out, rusize* outLen) {
+    if (!str || !out || !outLen) return RUE_PARAMETER_NOT_SET;
+    *out = NULL;
+    // short records rarely save a block without a dictionary, the attempt
+    // costs more than the encryption
+    if (len < (dict? BLOCKSIZE + 1 : DEFLATE_MIN)) return RUE_OK;
+
+    // a window no larger than the dictionary and the text, setting up the
+    // default 32k window and hash table costs more than compressing a record
+    rusize span = len + (dict? dict->len + ZLIB_LOOKAHEAD : 0);
+    int bits = 9;
+    while (bits < 15 && ((rusize)1 << bits) < span) bits++;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    zs.zalloc = zAlloc;
+    zs.zfree = zFree;
+    int r = deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, bits,
+                         bits - 6, Z_DEFAULT_STRATEGY);
+    if (r != Z_OK) {
+        dvSetError("Failed setting up compression. EC: %d", r);
+        return RUE_GENERAL;
+    }
+    if (dict) {
+        r = deflateSetDictionary(&zs, dict->data, (uInt)dict->len);
+        if (r != Z_OK) {
+            deflateEnd(&zs);
+            dvSetError("Failed setting the dictionary. EC: %d", r);
+            return RUE_GENERAL;
+        }
+    }
+    uLong blen = deflateBound(&zs, (uLong)len);
+    alloc_bytes buf = ruMalloc0(blen, uint8_t);
+    zs.next_in = (Bytef*)str;
+    zs.avail_in = (uInt)len;
+    zs.next_out = buf;
+    zs.avail_out = (uInt)blen;
+    r = deflate(&zs, Z_FINISH);
+    blen = zs.total_out;
+    deflateEnd(&zs);
+    if (r != Z_STREAM_END) {
+        mbedtls_platform_zeroize(buf, blen);
+        ruFree(buf);
+        dvSetError("Failed compressing the data. EC: %d", r);
+        return RUE_GENERAL;
+    }
+    if (blen + BLOCKSIZE > len) {
+        mbedtls_platform_zeroize(buf, blen);
+        ruFree(buf);
+        return RUE_OK;
+    }
+    *out = buf;
+    *outLen = blen;
+    return RUE_OK;
+}
+
+/**
+ * Sets up decompression for \ref inflateChunk.
+ * @param dict The dictionary the data was compressed with or NULL.
+ * @param zs Where the new inflater will be stored. Free with \ref freeInflater.
+ * @return RUE_OK on success
+ */
+int32_t newInflater(dvdict dict, struct z_stream_s** zs) {
+    z_stream* z = ruMalloc0(1, z_stream);
+    z->zalloc = zAlloc;
+    z->zfree = zFree;
+    // the allocators ignore it, so it holds the dictionary
+    z->opaque = dict;
+    int r = inflateInit(z);
+    if (r != Z_OK) {
+        ruFree(z);
+        dvSetError("Failed setting up decompression. EC: %d", r);
+        return RUE_GENERAL;
+    }
+    *zs = z;
+    return RUE_OK;
+}
+
+/**
+ * Inflates the next chunk of compressed bytes to the writer.
+ * @param zs The inflater.
+ * @param data The compressed bytes.
+ * @param len Their length.
+ * @param writer Receives the text in pieces.
+ * @param writeCtx Context passed to the writer.
+ * @param last Whether this is the end of the data, which must then be
+ *             complete.
+ * @return RUE_OK on success
+ */
+int32_t inflateChunk(struct z_stream_s* zs, trans_bytes data, rusize len,
+                     dvWriteFn writer, void* writeCtx, bool last) {
+    uint8_t out[4096];
+    int r = Z_OK;
+    int32_t ret = RUE_OK;
+    zs->next_in = (Bytef*)data;
+    zs->avail_in = (uInt)len;
+    do {
+        zs->next_out = out;
+        zs->avail_out = sizeof(out);
+        r = inflate(zs, Z_NO_FLUSH);
+        if (r == Z_NEED_DICT) {
+            dvdict dict = zs->opaque;
+            if (!dict || dict->id != zs->adler) {
+                dvSetError("Data needs dictionary %08lx", zs->adler);
+                ret = DVE_PROTOCOL_ERROR;
+                break;
+            }
+            r = inflateSetDictionary(zs, dict->data, (uInt)dict->len);
+            if (r != Z_OK) break;
+            r = inflate(zs, Z_NO_FLUSH);
+        }
+        if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) break;
+        if (zs->avail_out < sizeof(out)) {
+            ret = writer(writeCtx, out, sizeof(out) - zs->avail_out);
+            if (ret != RUE_OK) break;
+        }
+    } while (r == Z_OK && !zs->avail_out);
+    mbedtls_platform_zeroize(out, sizeof(out));
+    if (ret != RUE_OK) return ret;
+
+    if (r == Z_STREAM_END && zs->avail_in) {
+        dvSetError("Data after the compressed stream");
+        return DVE_PROTOCOL_ERROR;
+    }
+    if ((r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) ||
+        (last && r != Z_STREAM_END)) {
+        dvSetError("Failed decompressing the data. EC: %d", r);
+        return DVE_PROTOCOL_ERROR;
+    }
+    return RUE_OK;
+}
+
+void freeInflater(struct z_stream_s* zs) {
+    if (!zs) return;
+    inflateEnd(zs);
+    ruFree(zs);
+}
+
+/*
+ * Collects inflated text
+ */
+struct text_buf {
+    char* text;
+    rusize len;
+    rusize size;
+};
+
+static int32_t textWriter(void* ctx, const void* data, size_t len) {
+    struct text_buf* tb = ctx;
+    if (tb->len + len + 1 > tb->size) {
+        rusize size = (tb->len + len + 1) * 2;
+        char* text = ruMalloc0(size, char);
+        memcpy(text, tb->text, tb->len);
+        mbedtls_platform_zeroize(tb->text, tb->size);
+        ruFree(tb->text);
+        tb->text = text;
+        tb->size = size;
+    }
+    memcpy(tb->text + tb->len, data, len);
+    tb->len += len;
+    return RUE_OK;
+}
+
+/**
+ * Inflates the given bytes.
+ * @param data The compressed bytes.
+ * @param len Their length.
+ * @param dict The dictionary the data was compressed with or NULL.
+ * @param text Where the terminated text will be stored. Free with ruFree.
+ * @return RUE_OK on success
+ */
+int32_t inflateText(trans_bytes data, rusize len, dvdict dict, char** text) {
+    if (!data || !text) return RUE_PARAMETER_NOT_SET;
+    struct z_stream_s* zs = NULL;
+    int32_t ret = newInflater(dict, &zs);
+    if (ret != RUE_OK) return ret;
+    // text usually shrinks to a third or less
+    struct text_buf tb = {NULL, 0, len * 4 + 64};
+    tb.text = ruMalloc0(tb.size, char);
+    ret = inflateChunk(zs, data, len, textWriter, &tb, true);
+    freeInflater(zs);
+    if (ret != RUE_OK) {
+        mbedtls_platform_zeroize(tb.text, tb.size);
+        ruFree(tb.text);
+        return ret;
+    }
+    tb.text[tb.len] = '\0';
+    *text = tb.text;
+    return RUE_OK;
+}
+
+// length of the byte sequences the trainer counts
+#define TRAIN_DMER 8
+// length of the segments a dictionary is made of
+#define TRAIN_SEGMENT 64
+// zlib uses no more of a dictionary than its largest window
+#define DICT_MAX (32 * 1024)
+
+/*
+ * A byte sequence seen while training with the number of samples it is in
+ */
+struct dmer_slot {
+    uint64_t key;
+    uint32_t freq;
+    uint32_t last;      /* the last sample it was seen in + 1 */
+};
+
+static uint64_t dmerKey(trans_bytes p) {
+    uint64_t key = 0;
+    memcpy(&key, p, TRAIN_DMER);
+    return key;
+}
+
+static uint32_t dmerSlot(struct dmer_slot* table, uint32_t mask,
+                         uint64_t key) {
+    uint32_t i = (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    while (table[i].last && table[i].key != key) i = (i + 1) & mask;
+    table[i].key = key;
+    return i;
+}
+
+/*
+ * Picks the segment whose byte sequences are in the most samples and were not
+ * picked before.
+ */
+static uint64_t bestSegment(const rusize* starts, size_t count,
+                            const uint32_t* slots,
+                            const struct dmer_slot* table, rusize* pos,
+                            rusize* len) {
+    uint64_t best = 0;
+    for (size_t i = 0; i < count; i++) {
+        rusize base = starts[i], l = starts[i + 1] - base;
+        if (l < TRAIN_DMER) continue;
+        rusize seg = l < TRAIN_SEGMENT? l : TRAIN_SEGMENT;
+        uint64_t sum = 0;
+        for (rusize q = 0; q + TRAIN_DMER <= seg; q++) {
+            sum += table[slots[base + q]].freq;
+        }
+        for (rusize p = 0; p + seg <= l; p++) {
+            if (p) {
+                sum += table[slots[base + p + seg - TRAIN_DMER]].freq;
+                sum -= table[slots[base + p - 1]].freq;
+            }
+            if (sum > best) {
+                best = sum;
+                *pos = base + p;
+                *len = seg;
+            }
+        }
+    }
+    return best;
+}
+
+DVAPI int32_t dvTrainDictionary(const char* const* samples, size_t count,
+                                size_t maxLen, void** dict, size_t* dictLen) {
+    if (!samples || !dict || !dictLen) return RUE_PARAMETER_NOT_SET;
+    if (count < 2 || maxLen < TRAIN_SEGMENT) return RUE_INVALID_PARAMETER;
+    if (maxLen > DICT_MAX) maxLen = DICT_MAX;
+
+    size_t i;
+    rusize total = 0;
+    for (i = 0; i < count; i++) {
+        if (!samples[i]) return RUE_PARAMETER_NOT_SET;
+        total += strlen(samples[i]);
+    }
+    uint32_t size = 1024;
+    while (size < total * 2) size *= 2;
+    uint32_t mask = size - 1;
+
+    rusize* starts = ruMalloc0(count + 1, rusize);
+    alloc_bytes all = ruMalloc0(total + 1, uint8_t);
+    uint32_t* slots = ruMalloc0(total + 1, uint32_t);
+    struct dmer_slot* table = ruMalloc0(size, struct dmer_slot);
+    // segments picked, best first
+    rusize maxPicks = maxLen / TRAIN_DMER + 1, picks = 0, used = 0;
+    rusize* pickPos = ruMalloc0(maxPicks, rusize);
+    rusize* pickLen = ruMalloc0(maxPicks, rusize);
+
+    // count in how many samples every sequence is
+    for (i = 0; i < count; i++) {
+        rusize l = strlen(samples[i]);
+        starts[i + 1] = starts[i] + l;
+        memcpy(all + starts[i], samples[i], l);
+        for (rusize q = 0; q + TRAIN_DMER <= l; q++) {
+            uint32_t s = dmerSlot(table, mask, dmerKey(all + starts[i] + q));
+            if (table[s].last != i + 1) {
+                table[s].freq++;
+                table[s].last = (uint32_t)(i + 1);
+            }
+            slots[starts[i] + q] = s;
+        }
+    }
+    // sequences of a single sample don't help
+    for (uint32_t s = 0; s < size; s++) {
+        if (table[s].freq < 2) table[s].freq = 0;
+    }
+
+    while (used < maxLen && picks < maxPicks) {
+        rusize pos = 0, len = 0;
+        if (!bestSegment(starts, count, slots, table, &pos, &len)) break;
+        // what has been picked scores no more
+        for (rusize q = 0; q + TRAIN_DMER <= len; q++) {
+            table[slots[pos + q]].freq = 0;
+        }
+        if (len > maxLen - used) len = maxLen - used;
+        pickPos[picks] = pos;
+        pickLen[picks++] = len;
+        used += len;
+    }
+
+    int32_t ret = RUE_OK;
+    if (!used) {
+        dvSetError("The samples have nothing in common");
+        ret = RUE_INVALID_PARAMETER;
+    } else {
+        // deflate reaches the end of the dictionary cheapest, the best last
+        alloc_bytes out = ruMalloc0(used, uint8_t);
+        rusize off = used;
+        for (rusize p = 0; p < picks; p++) {
+            off -= pickLen[p];
+            memcpy(out + off, all + pickPos[p], pickLen[p]);
+        }
+        *dict = out;
+        *dictLen = used;
+    }
+
+    mbedtls_platform_zeroize(all, total);
+    ruFree(all);
+    ruFree(starts);
+    ruFree(slots);
+    ruFree(table);
+    ruFree(pickPos);
+    ruFree(pickLen);
+    return ret;
+}
+
+DVAPI int32_t dvAddDictionary(dvCtx dc, const void* dict, size_t len,
+                              uint32_t* id) {
+    if (!dc || !dict) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx || !len) return RUE_INVALID_PARAMETER;
+
+    // the id zlib puts in the data, never 0
+    uint32_t did = (uint32_t)adler32(adler32(0L, Z_NULL, 0), dict, (uInt)len);
+    if (!findDict(ctx->dicts, did)) {
+        dvdict d = ruMalloc0(1, struct dv_dict);
+        d->id = did;
+        d->data = ruMalloc0(len, uint8_t);
+        memcpy(d->data, dict, len);
+        d->len = len;
+        d->next = ctx->dicts;
+        ctx->dicts = d;
+    }
+    if (id) *id = did;
+    return RUE_OK;
+}
+
+DVAPI int32_t dvUseDictionary(dvCtx dc, uint32_t id) {
+    if (!dc) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+    if (!id) {
+        ctx->dict = NULL;
+        return RUE_OK;
+    }
+    dvdict d = findDict(ctx->dicts, id);
+    if (!d) {
+        dvSetError("Dictionary %08x is not registered", id);
+        return RUE_INVALID_PARAMETER;
+    }
+    ctx->dict = d;
+    return RUE_OK;
+}
@@ -23,8 +23,11 @@
 #include <mbedtls/aes.h>
 #include <mbedtls/base64.h>
 #include <mbedtls/cipher.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/gcm.h>
 #include <mbedtls/md.h>
-#include <mbedtls/sha256.h>
+#include <mbedtls/platform_util.h>
 
 void getPaddedEnd(const char* str, alloc_bytes last, rusize lastLen);
 
@@ -40,11 +43,11 @@ static int32_t ascii2uc (const char c, alloc_bytes uc) {
     return RUE_OK;
 }
 
-static int32_t unhexify(const char *str, size_t *neededLen,
+static int32_t unhexify(const char *str, rusize strLen, size_t *neededLen,
                         size_t oLen, alloc_bytes oPtr) {
     uint8_t uc, uc2;
     int32_t ret;
-    *neededLen = strlen(str );
+    *neededLen = strLen;
 
     /* Must be even number of bytes. */
     if (( *neededLen ) & 1 ) {
@@ -56,7 +59,7 @@ static int32_t unhexify(const char *str, size_t *neededLen,
         return RUE_OUT_OF_MEMORY;
     }
 
-    while (*str != 0) {
+    for (perm_chars end = str + strLen; str < end;) {
         ret = ascii2uc(*(str++), &uc);
         if (ret != RUE_OK) return ret;
 
@@ -69,317 +72,618 @@ static int32_t unhexify(const char *str, size_t *neededLen,
 }
 
 static int sha256(const char* str, rusize len, alloc_bytes digest) {
-    return mbedtls_sha256((alloc_bytes)str, len, digest,0);
+    cryptoProvider()->sha256((trans_bytes)str, len, digest);
+    return 0;
 }
 
-static int32_t mkIv(alloc_bytes iv, rusize len) {
-    if (len < BLOCKSIZE) return RUE_OUT_OF_MEMORY;
-    if (!iv) return RUE_PARAMETER_NOT_SET;
+/*
+ * Compares a MAC or tag in a time that does not depend on where it differs.
+ */
+bool macEquals(trans_bytes a, trans_bytes b, rusize len) {
+    uint8_t diff = 0;
+    for (rusize i = 0; i < len; i++) diff |= a[i] ^ b[i];
+    return !diff;
+}
+
+/*
+ * Every thread draws its IVs from its own CTR-DRBG, so generating them needs no
+ * locking. One DRBG call fills the pool with as many IVs as a single request
+ * may produce. The pool is wiped and freed when its thread exits.
+ */
+#define IV_POOL_SIZE MBEDTLS_CTR_DRBG_MAX_REQUEST
+struct dv_iv_pool {
+    bool seeded;
+    uint32_t gen;       /* forkGen when seeded, a forked child must reseed */
+    rusize next;        /* offset of the next unused IV in pool */
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    uint8_t pool[IV_POOL_SIZE];
+};
+static RU_THREAD_LOCAL struct dv_iv_pool* ivPool;
+
+// hands the pool of an exiting thread to freeIvPool
+#ifdef _WIN32
+static DWORD ivPoolKey;
+#else
+static pthread_key_t ivPoolKey;
+#endif
+static bool ivPoolKeyed = false;
+static dvOnceFlag ivPoolOnce = DV_ONCE_INIT;
+
+// counts the forks of the process, the child bumps it
+static uint32_t forkGen = 0;
+
+#ifndef _WIN32
+static void forkedChild(void) {
+    forkGen++;
+}
+#endif
+
+static void freeIvPool(void* pool) {
+    struct dv_iv_pool* ip = pool;
+    if (!ip) return;
+    if (ip->seeded) {
+        mbedtls_ctr_drbg_free(&ip->drbg);
+        mbedtls_entropy_free(&ip->entropy);
+    }
+    mbedtls_platform_zeroize(ip, sizeof(struct dv_iv_pool));
+    ruFree(ip);
+}
 
-    // we just use a timestamp and a counter in case we're really quick
-    static uint32_t threadcounter = 0;
-    ruTimeVal now;
-    const char* seedForm = "%010u.%05u.%03u";
-    // seedlen '1650466778.042061.001'
-    //         0----5----0----5----0-2 22 with \0
-    #define seedLen 22
-    char seed[seedLen];
-    // just enough room here
-    uint8_t digest[MBEDTLS_MD_MAX_SIZE];
-
-    ruGetTimeVal(&now);
-    threadcounter = (threadcounter + 1) % 1000;
-    snprintf(&seed[0], seedLen, seedForm,
-             now.sec, now.usec, threadcounter);
-//    ruVerbLogf("seed: %s", seed);
-
-    int r = mbedtls_sha256((alloc_bytes) seed, strlen(seed),
-                           digest , 0);
+#ifdef _WIN32
+static void WINAPI freeIvPoolFls(PVOID pool) {
+    freeIvPool(pool);
+}
+#endif
+
+static void mkIvPoolKey(void) {
+#ifdef _WIN32
+    ivPoolKey = FlsAlloc(freeIvPoolFls);
+    ivPoolKeyed = ivPoolKey != FLS_OUT_OF_INDEXES;
+#else
+    ivPoolKeyed = !pthread_key_create(&ivPoolKey, freeIvPool);
+    if (pthread_atfork(NULL, NULL, forkedChild)) {
+        ruWarnLog("forked children may not reseed their IV pools");
+    }
+#endif
+    if (!ivPoolKeyed) ruWarnLog("IV pools will not be freed on thread exit");
+}
+
+static void setIvPool(struct dv_iv_pool* ip) {
+    ivPool = ip;
+    if (!ivPoolKeyed) return;
+#ifdef _WIN32
+    FlsSetValue(ivPoolKey, ip);
+#else
+    pthread_setspecific(ivPoolKey, ip);
+#endif
+}
+
+/*
+ * Frees the IV pool of the calling thread. The next IV comes from a newly
+ * seeded one.
+ */
+void freeThreadIvPool(void) {
+    struct dv_iv_pool* ip = ivPool;
+    if (!ip) return;
+    setIvPool(NULL);
+    freeIvPool(ip);
+}
+
+static int32_t seedIvPool(struct dv_iv_pool* ip) {
+    if (ip->seeded) {
+        mbedtls_ctr_drbg_free(&ip->drbg);
+        mbedtls_entropy_free(&ip->entropy);
+        ip->seeded = false;
+    }
+    mbedtls_entropy_init(&ip->entropy);
+    mbedtls_ctr_drbg_init(&ip->drbg);
+    int r = mbedtls_ctr_drbg_seed(&ip->drbg, mbedtls_entropy_func, &ip->entropy,
+                                  (trans_bytes)myName, strlen(myName));
     if (r) {
-        dvSetError("Failed getting digest. PSA status: %d", r);
+        dvSetError("Failed seeding the IV generator. EC: %d", r);
+        mbedtls_ctr_drbg_free(&ip->drbg);
+        mbedtls_entropy_free(&ip->entropy);
         return RUE_GENERAL;
     }
-    memcpy(iv, digest, BLOCKSIZE);
+    ip->seeded = true;
+    ip->gen = forkGen;
+    ip->next = IV_POOL_SIZE;
     return RUE_OK;
 }
 
-static int32_t dvB64Decode(const char* b64, alloc_bytes* data, rusize* len) {
+int32_t mkIv(alloc_bytes iv, rusize len) {
+    if (len < BLOCKSIZE) return RUE_OUT_OF_MEMORY;
+    if (!iv) return RUE_PARAMETER_NOT_SET;
+
+    struct dv_iv_pool* ip = ivPool;
+    if (!ip) {
+        dvOnce(&ivPoolOnce, mkIvPoolKey);
+        ip = ruMalloc0(1, struct dv_iv_pool);
+        setIvPool(ip);
+    }
+    if (!ip->seeded || ip->gen != forkGen) {
+        int32_t ret = seedIvPool(ip);
+        if (ret != RUE_OK) return ret;
+    }
+    if (ip->next >= IV_POOL_SIZE) {
+        int r = mbedtls_ctr_drbg_random(&ip->drbg, ip->pool, IV_POOL_SIZE);
+        if (r) {
+            dvSetError("Failed generating IVs. EC: %d", r);
+            return RUE_GENERAL;
+        }
+        ip->next = 0;
+    }
+    memcpy(iv, &ip->pool[ip->next], BLOCKSIZE);
+    // an IV is never handed out twice
+    memset(&ip->pool[ip->next], 0, BLOCKSIZE);
+    ip->next += BLOCKSIZE;
+    return RUE_OK;
+}
+
+/*
+ * Decodes into a buffer with room for a terminator, so the payload can be
+ * decrypted in place and returned as text.
+ */
+static int32_t dvB64Decode(const char* b64, rusize b64Len, alloc_bytes* data,
+                           rusize* len) {
     if (!b64 || !data || !len) return RUE_PARAMETER_NOT_SET;
 
-    size_t dlen = 0, olen = 0, ilen = strlen(b64);
+    size_t dlen = 0, olen = 0;
 
-    int r = mbedtls_base64_decode(NULL, dlen, &olen,
-                                  (trans_bytes)b64, ilen);
+    const struct dv_crypto_provider* cp = cryptoProvider();
+    int r = cp->b64Decode(NULL, dlen, &olen, (trans_bytes)b64, b64Len);
     if (r != MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL) {
-        dvSetError("mbedtls_base64_decode returned %d instread of %d",
+        dvSetError("base64 decode returned %d instread of %d",
                    r, MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL);
         return RUE_GENERAL;
     }
     dlen = olen;
-    alloc_bytes out = ruMalloc0(dlen, uint8_t);
-    r = mbedtls_base64_decode((alloc_bytes)out, dlen, &olen,
-                              (trans_bytes)b64, ilen);
+    alloc_bytes out = ruMalloc0(dlen + 1, uint8_t);
+    r = cp->b64Decode((alloc_bytes)out, dlen, &olen, (trans_bytes)b64, b64Len);
     if (r) {
-        dvSetError("mbedtls_base64_decode failed: %d", r);
+        dvSetError("base64 decode failed: %d", r);
         ruFree(out);
         return RUE_GENERAL;
     }
     *data = out;
-    *len = dlen;
+    *len = olen;
     return RUE_OK;
 }
 
-static int32_t aesEnc(trans_bytes key, const char* str, alloc_bytes startIv, alloc_bytes cipher,
-               int32_t* outLen) {
-    int32_t len = (int32_t)strlen(str);
-    int32_t blocks = len / BLOCKSIZE;
-    int32_t outsz = (blocks+1) * BLOCKSIZE + MACSIZE;
+/*
+ * Size of the CBC plaintext of a text of the given length: the text, its
+ * pkcs#7 padding and the encrypted mac.
+ */
+static rusize cbcSize(rusize len) {
+    return (len / BLOCKSIZE + 1) * BLOCKSIZE + MACSIZE;
+}
+
+/*
+ * Lays out the CBC plaintext of str into buf, which must hold cbcSize bytes.
+ */
+static void cbcPlain(const char* str, rusize len, alloc_bytes buf) {
+    uint8_t pad = (uint8_t)(BLOCKSIZE - len % BLOCKSIZE);
+    memcpy(buf, str, len);
+    memset(buf + len, pad, pad);
+    sha256(str, len, buf + len + pad);
+}
+
+static int32_t aesEnc(dvkey key, const char* str, rusize len,
+                      alloc_bytes startIv, alloc_bytes cipher,
+                      int32_t* outLen) {
+    int32_t outsz = (int32_t)cbcSize(len);
     if (*outLen < outsz) {
         *outLen = outsz;
         return RUE_OUT_OF_MEMORY;
     }
-    uint8_t mac[MACSIZE];
     uint8_t iv[BLOCKSIZE];
-    uint8_t last[BLOCKSIZE];
-    mbedtls_aes_context ac;
+    dvAesKey ak = keySchedule(key, MBEDTLS_AES_ENCRYPT);
+    if (!ak) return RUE_GENERAL;
 
-    getPaddedEnd(str, last, sizeof(last));
-    int r, ret = RUE_GENERAL;
-
-    r = mkIv(iv, BLOCKSIZE);
+    int r = mkIv(iv, BLOCKSIZE);
     if (r != RUE_OK) return r;
     memcpy(startIv, iv, BLOCKSIZE);
 
-    alloc_bytes out = cipher;
-    do {
-        r = sha256(str, strlen(str), mac);
-        if (r) {
-            dvSetError("Failed getting mac. PSA status: %d", r);
-            ret = RUE_GENERAL;
-            break;
-        }
-
-        mbedtls_aes_init(&ac);
-
-        r = mbedtls_aes_setkey_enc(&ac, key, KEYBITS);
-        if (r) {
-            dvSetError("Failed setting crypto key. EC: %d", r);
-            ret = RUE_GENERAL;
-            break;
-        }
-        r = mbedtls_aes_crypt_cbc(&ac, MBEDTLS_AES_ENCRYPT,
-                                  blocks * BLOCKSIZE, iv,
-                                  (trans_bytes)str, out);
-        if (r) {
-            dvSetError("Failed encrypting the payload. EC: %d", r);
-            ret = RUE_GENERAL;
-            break;
-        }
-        out += (blocks * BLOCKSIZE);
-        r = mbedtls_aes_crypt_cbc(&ac, MBEDTLS_AES_ENCRYPT,
-                                  BLOCKSIZE, iv,
-                                  last, out);
-        if (r) {
-            dvSetError("Failed encrypting the last block. EC: %d", r);
-            ret = RUE_GENERAL;
-            break;
-        }
-
-        out += BLOCKSIZE;
-        r = mbedtls_aes_crypt_cbc(&ac, MBEDTLS_AES_ENCRYPT,
-                                  MACSIZE, iv,
-                                  mac, out);
-        if (r) {
-            dvSetError("Failed encrypting the mac blocks. EC: %d", r);
-            ret = RUE_GENERAL;
-            break;
-        }
-        // all good
-        ret = RUE_OK;
-    } while (false);
-
-    mbedtls_aes_free(&ac);
-    return ret;
+    cbcPlain(str, len, cipher);
+    r = cryptoProvider()->aesCbc(ak, MBEDTLS_AES_ENCRYPT, outsz, iv, cipher,
+                                 cipher);
+    if (r) {
+        dvSetError("Failed encrypting the payload. EC: %d", r);
+        return RUE_GENERAL;
+    }
+    return RUE_OK;
 }
 
-static int32_t aesDec(trans_bytes key, trans_bytes cipher, rusize cipherLen,
-               alloc_bytes startIv, char** text) {
+/*
+ * Decrypts data in place. On success it holds the terminated text of textLen
+ * bytes.
+ */
+static int32_t aesDec(dvkey key, alloc_bytes data, rusize cipherLen,
+                      alloc_bytes startIv, rusize* textLen) {
 
-    if (!key || !cipher || !cipherLen || !startIv || !text) {
+    if (!key || !data || !cipherLen || !startIv) {
         return RUE_PARAMETER_NOT_SET;
     }
+    if (cipherLen < BLOCKSIZE + MACSIZE || cipherLen % BLOCKSIZE) {
+        dvSetError("Invalid payload size %d", (int)cipherLen);
+        return DVE_PROTOCOL_ERROR;
+    }
 
     int r, ret = RUE_GENERAL;
-    mbedtls_aes_context ac;
+    dvAesKey ak = NULL;
     uint8_t mac[MACSIZE];
 
-    // free
-    alloc_bytes out = NULL;
-
     do {
         // setup
-        mbedtls_aes_init(&ac);
-        r = mbedtls_aes_setkey_dec(&ac, key, KEYBITS);
-        if (r) {
-            dvSetError("Failed setting crypto key. EC: %d", r);
+        ak = keySchedule(key, MBEDTLS_AES_DECRYPT);
+        if (!ak) {
             ret = RUE_GENERAL;
             break;
         }
         // decrypt
-        out = ruMalloc0(cipherLen, uint8_t);
-        r = mbedtls_aes_crypt_cbc(&ac, MBEDTLS_AES_DECRYPT,
-                                  cipherLen, startIv,
-                                  cipher, out);
+        r = cryptoProvider()->aesCbc(ak, MBEDTLS_AES_DECRYPT, cipherLen,
+                                     startIv, data, data);
         if (r) {
             dvSetError("Failed decrypting the payload. EC: %d", r);
             ret = RUE_GENERAL;
             break;
         }
         // get mac start
-        alloc_bytes cmac = out + cipherLen - MACSIZE;
+        alloc_bytes cmac = data + cipherLen - MACSIZE;
         // strip padding
         alloc_bytes ptr = cmac-1;
         uint8_t pad = *ptr;
-        if (pad > 16) {
+        if (!pad || pad > BLOCKSIZE) {
             dvSetError("Invalid padding after decryption");
             ret = DVE_INVALID_CREDENTIALS;
             break;
         }
-        while (pad) {
-            pad--;
-            *ptr = '\0';
-            ptr--;
-        }
+        rusize tlen = cipherLen - MACSIZE - pad;
         // calculate mac
-        r = sha256((const char*)out, strlen((const char*)out), mac);
+        r = sha256((const char*)data, tlen, mac);
         if (r) {
             dvSetError("Failed getting mac. PSA status: %d", r);
             ret = RUE_GENERAL;
             break;
         }
         // check mac
-        if (memcmp(mac, cmac, MACSIZE) != 0) {
+        if (!macEquals(mac, cmac, MACSIZE)) {
             dvSetError("MAC mismatch");
             ret = DVE_INVALID_CREDENTIALS;
             break;
         }
+        // all good, terminate after the text
+        memset(data + tlen, 0, cipherLen - tlen);
+        *textLen = tlen;
+        ret = RUE_OK;
+    } while (false);
+
+    return ret;
+}
+
+static int32_t gcmEnc(dvkey key, const char* str, rusize len, alloc_bytes iv,
+                      alloc_bytes cipher, int32_t* outLen) {
+    // no padding, just the tag
+    int32_t outsz = (int32_t)len + GCM_TAGSIZE;
+    if (*outLen < outsz) {
+        *outLen = outsz;
+        return RUE_OUT_OF_MEMORY;
+    }
+    mbedtls_gcm_context gc;
+    int r, ret = RUE_GENERAL;
+
+    r = mkIv(iv, BLOCKSIZE);
+    if (r != RUE_OK) return r;
+
+    mbedtls_gcm_init(&gc);
+    do {
+        r = mbedtls_gcm_setkey(&gc, MBEDTLS_CIPHER_ID_AES, key->key, KEYBITS);
+        if (r) {
+            dvSetError("Failed setting crypto key. EC: %d", r);
+            break;
+        }
+        r = mbedtls_gcm_crypt_and_tag(&gc, MBEDTLS_GCM_ENCRYPT, len,
+                                      iv, GCM_IVSIZE, NULL, 0,
+                                      (trans_bytes)str, cipher,
+                                      GCM_TAGSIZE, cipher + len);
+        if (r) {
+            dvSetError("Failed encrypting the payload. EC: %d", r);
+            break;
+        }
         // all good
-        *text = (char*)out;
-        out = NULL;
         ret = RUE_OK;
     } while (false);
 
-    ruFree(out);
-    mbedtls_aes_free(&ac);
+    mbedtls_gcm_free(&gc);
     return ret;
 }
 
-void hexify(trans_bytes ibuf, int ilen, alloc_bytes obuf) {
-    uint8_t l, h;
+/*
+ * Decrypts data in place. On success it holds the terminated text of textLen
+ * bytes.
+ */
+static int32_t gcmDec(dvkey key, alloc_bytes data, rusize cipherLen,
+                      trans_bytes iv, rusize* textLen) {
 
-    while(ilen != 0 ) {
-        h = *ibuf / 16;
-        l = *ibuf % 16;
+    if (!key || !data || !iv) return RUE_PARAMETER_NOT_SET;
+    if (cipherLen < GCM_TAGSIZE) {
+        dvSetError("Payload is shorter than the tag");
+        return DVE_PROTOCOL_ERROR;
+    }
 
-        if( h < 10 ) {
-            *obuf++ = '0' + h;
-        } else {
-            *obuf++ = 'a' + h - 10;
+    int r, ret = RUE_GENERAL;
+    mbedtls_gcm_context gc;
+    rusize len = cipherLen - GCM_TAGSIZE;
+
+    mbedtls_gcm_init(&gc);
+    do {
+        r = mbedtls_gcm_setkey(&gc, MBEDTLS_CIPHER_ID_AES, key->key, KEYBITS);
+        if (r) {
+            dvSetError("Failed setting crypto key. EC: %d", r);
+            break;
+        }
+        r = mbedtls_gcm_auth_decrypt(&gc, len, iv, GCM_IVSIZE, NULL, 0,
+                                     data + len, GCM_TAGSIZE, data, data);
+        if (r == MBEDTLS_ERR_GCM_AUTH_FAILED) {
+            dvSetError("Tag mismatch");
+            ret = DVE_INVALID_CREDENTIALS;
+            break;
         }
+        if (r) {
+            dvSetError("Failed decrypting the payload. EC: %d", r);
+            break;
+        }
+        // all good, terminate after the text
+        memset(data + len, 0, GCM_TAGSIZE);
+        *textLen = len;
+        ret = RUE_OK;
+    } while (false);
 
-        if( l < 10 ) {
-            *obuf++ = '0' + l;
-        } else {
-            *obuf++ = 'a' + l - 10;
+    mbedtls_gcm_free(&gc);
+    return ret;
+}
+
+// names of the enum dvRecipe entries
+static const char* recipeNames[] = {"aes-256-cbc", "aes-256-gcm"};
+
+int32_t findRecipe(const char* name, rusize len, enum dvRecipe* recipe) {
+    if (!name || !recipe) return RUE_PARAMETER_NOT_SET;
+    for (int i = 0; i < (int)(sizeof(recipeNames) / sizeof(recipeNames[0])); i++) {
+        if (strlen(recipeNames[i]) == len &&
+            strncmp(name, recipeNames[i], len) == 0) {
+            *recipe = (enum dvRecipe)i;
+            return RUE_OK;
         }
+    }
+    return RUE_INVALID_PARAMETER;
+}
 
+static const char hexChars[] = "0123456789abcdef";
+
+void hexify(trans_bytes ibuf, int ilen, alloc_bytes obuf) {
+    while(ilen != 0 ) {
+        *obuf++ = hexChars[*ibuf >> 4];
+        *obuf++ = hexChars[*ibuf & 0x0f];
         ++ibuf;
         ilen--;
     }
 }
 
-int32_t dvSearchHash(const char* word, const char* key, char** hash, bool indexing) {
-    if (!word || !key || !hash) return RUE_PARAMETER_NOT_SET;
+/******************************************************************************/
+/*                             Search Hashing                                 */
+/******************************************************************************/
+// the running encoded hash every search hash chain starts with
+static const char* searchHashSeed =
+        "f1748e9819664b324ae079a9ef22e33e9014ffce302561b9bf71a37916c1d2a3";
 
-    char* term = ruUtf8ToLower(word);
-    rusize termLen = strlen(term);
+int32_t initSearchHasher(dvSearchHasher sh, const char* key) {
+    if (!sh || !key) return RUE_PARAMETER_NOT_SET;
     rusize keyLen = strlen(key);
+    if (!keyLen) return RUE_INVALID_PARAMETER;
+
+    // message is char + hex hash + key + \0 followed by the sha256 padding
+    rusize msgLen = 1 + 64 + keyLen + 1;
+    // padding needs room for the 0x80 marker and the 64 bit length
+    sh->blocks = (msgLen + 1 + 8 + 63) / 64;
+    rusize bufLen = sh->blocks * 64;
+    if (bufLen <= sizeof(sh->local)) {
+        sh->msg = &sh->local[0];
+        memset(sh->msg, 0, bufLen);
+    } else {
+        sh->msg = ruMalloc0(bufLen, uint8_t);
+    }
+    // the key and the padding never change so they're only laid out once
+    memcpy(sh->msg + 65, key, keyLen);
+    sh->msg[msgLen] = 0x80;
+    uint64_t bits = (uint64_t)msgLen * 8;
+    alloc_bytes len = sh->msg + bufLen;
+    for (int i = 0; i < 8; i++) {
+        *--len = (uint8_t)(bits >> (i * 8));
+    }
+    memcpy(sh->msg + 1, searchHashSeed, 64);
+    return RUE_OK;
+}
 
-    if (!termLen || !keyLen) {
-        ruFree(term);
-        return RUE_INVALID_PARAMETER;
+void searchHashStep(dvSearchHasher sh, uint8_t c, alloc_bytes digest) {
+    uint32_t state[8];
+    memcpy(state, sha256H0, sizeof(state));
+    sh->msg[0] = c;
+    sha256Blocks(state, sh->msg, sh->blocks);
+    sha256StateDigest(state, digest);
+    // the encoded hash goes right back into the message for the next step
+    hexify(digest, 32, sh->msg + 1);
+}
+
+void searchHashResume(dvSearchHasher sh, trans_bytes prev) {
+    if (!prev) prev = (trans_bytes)searchHashSeed;
+    memcpy(sh->msg + 1, prev, 64);
+}
+
+void freeSearchHasher(dvSearchHasher sh) {
+    if (!sh || !sh->msg) return;
+    // this holds the app-id
+    memset(sh->msg, 0, sh->blocks * 64);
+    if (sh->msg != &sh->local[0]) {
+        ruFree(sh->msg);
     }
+    sh->msg = NULL;
+}
 
-    int d = 0;
-    // integer and our return code as needed
-    int32_t ret;
-    // need room 4  char + hash +  key   + \0
-    rusize poolSz =   1  +  64  + keyLen +  1;
-    // our work area
-    char *work = ruMalloc0(poolSz, char);
-    // initial hash and running encoded hash
-    char *sha = "f1748e9819664b324ae079a9ef22e33e9014ffce302561b9bf71a37916c1d2a3";
-    uint8_t sha2[32];
-    uint8_t encHash[65];
-    memcpy((void*)&encHash[0], sha, 65);
+/*
+ * Returns the character hashed in the given chain step. The terminator gets
+ * hashed as well, followed by the padding bytes when indexing.
+ */
+static uint8_t searchHashChar(const char* term, rusize termLen, trans_bytes pad,
+                              rusize c) {
+    if (c < termLen) return (uint8_t)term[c];
+    if (c == termLen) return 0;
+    return pad[c - termLen - 1];
+}
 
+static rusize searchHashSteps(rusize termLen, bool indexing) {
+    // if we're searching no need for padding
+    if (!indexing) return termLen;
     // term is padded to the next 16 byte boundary
-    rusize paddedLen = (termLen/16) * 16;
-    // unless we were mod 0 we'll have to append
-    if (paddedLen < termLen) paddedLen += 16;
-    // output is double paddedLen for hex encoding + terminator
-    rusize outLen = (paddedLen * 2) + 1;
-    // where our result goes
-    char* outHash = ruMalloc0(outLen, char);
-
-    char *ptr = (char*)term;
+    return ((termLen + 15) / 16) * 16;
+}
+
+int32_t searchHashTerm(dvSearchHasher sh, const char* term, char** hash,
+                       bool indexing) {
+    if (!sh || !term || !hash) return RUE_PARAMETER_NOT_SET;
+    rusize termLen = strlen(term);
+    if (!termLen) return RUE_INVALID_PARAMETER;
+
+    rusize steps = searchHashSteps(termLen, indexing);
+    // output is double the steps for hex encoding + terminator
+    char* outHash = ruMalloc0((steps * 2) + 1, char);
     char *optr = outHash;
+    uint8_t digest[32];
+    // digest of the first character used as random padding
+    uint8_t sha2[32];
 
-    if (d) ruVerbLogf("term: '%s' key: '%s'", term, key);
+    memcpy(sh->msg + 1, searchHashSeed, 64);
+    for (rusize c = 0; c < steps; c++) {
+        searchHashStep(sh, searchHashChar(term, termLen, sha2, c), digest);
+        if (c == 0) memcpy(sha2, digest, 32);
+        *optr++ = (char)sh->msg[1];
+        *optr++ = (char)sh->msg[2];
+    }
+    *hash = outHash;
+    return RUE_OK;
+}
 
-    char *work2 = work + 1;
-    rusize poolSz2 = poolSz - 1;
-    rusize c = 0;
+/**
+ * Holds the progress of one term in the batched search hash chains
+ */
+struct search_lane {
+    rusize idx;         /* index of the term and its hash */
+    char* term;         /* the lower cased term */
+    rusize termLen;
+    rusize steps;       /* number of chain steps for this term */
+    rusize c;           /* the current step */
+    alloc_bytes msg;    /* this lane's message buffer */
+    char* out;          /* the hash being built */
+    uint8_t sha2[32];   /* digest of the first character used as padding */
+};
+
+int32_t searchHashTerms(const char* key, const char* const* terms, rusize count,
+                        char** hashes, bool indexing) {
+    if (!key || !terms || !hashes) return RUE_PARAMETER_NOT_SET;
+    for (rusize i = 0; i < count; i++) {
+        if (!terms[i]) return RUE_PARAMETER_NOT_SET;
+        if (!*terms[i]) return RUE_INVALID_PARAMETER;
+    }
 
-    do {
-        uint8_t digest[32];
-        // separating the character out to allow hashing \0
-        *work = *ptr;
-        snprintf(work2, poolSz2, "%s%s", &encHash[0], key);
-        if (d) ruVerbLogf("work: %x + '%s'", (uint8_t)*work, work2);
-        ret = sha256(work, poolSz, digest);
-        if (ret) {
-            dvSetError("Failed getting digest. PSA status: %d", ret);
-            ret = RUE_GENERAL;
-            break;
+    struct dv_search_hasher sh;
+    int32_t ret = initSearchHasher(&sh, key);
+    if (ret != RUE_OK) return ret;
+
+    struct search_lane lanes[SHA256_LANES];
+    uint32_t states[SHA256_LANES * 8];
+    trans_bytes data[SHA256_LANES];
+    uint8_t digest[32];
+    rusize bufLen = sh.blocks * 64;
+    alloc_bytes msgs = ruMalloc0(bufLen * SHA256_LANES, uint8_t);
+    rusize next = 0;
+    int active = 0, l;
+
+    // every lane starts out with the laid out key and padding
+    for (l = 0; l < SHA256_LANES; l++) {
+        lanes[l].msg = msgs + (l * bufLen);
+        memcpy(lanes[l].msg, sh.msg, bufLen);
+    }
+    freeSearchHasher(&sh);
+
+    while (true) {
+        // feed idle lanes with the next terms
+        for (; active < SHA256_LANES && next < count; active++, next++) {
+            struct search_lane* sl = &lanes[active];
+            sl->idx = next;
+            sl->term = ruUtf8ToLower(terms[next]);
+            sl->termLen = strlen(sl->term);
+            sl->steps = searchHashSteps(sl->termLen, indexing);
+            sl->c = 0;
+            sl->out = ruMalloc0((sl->steps * 2) + 1, char);
+            memcpy(sl->msg + 1, searchHashSeed, 64);
         }
-        if (indexing && c == 0) {
-            // this is the first character so copy the digest for our random padding
-            memcpy(sha2, digest, 32);
+        if (!active) break;
+
+        // advance all active chains by one step
+        for (l = 0; l < active; l++) {
+            struct search_lane* sl = &lanes[l];
+            sl->msg[0] = searchHashChar(sl->term, sl->termLen, sl->sha2, sl->c);
+            memcpy(&states[l*8], sha256H0, sizeof(sha256H0));
+            data[l] = sl->msg;
         }
-        hexify((trans_bytes) &digest[0], 32, &encHash[0]);
-        encHash[64] = '\0';
-        if (d) ruVerbLogf("hash: ' %s '", encHash);
-        memcpy(optr, encHash, 2);
-        ptr++;
-        optr += 2;
-        if (c == termLen) {
-            // move our pointer to continue with the sha after the terminator
-            ptr = (char*)&sha2[0];
+        sha256BlocksLanes(states, data, active, bufLen / 64);
+
+        for (l = 0; l < active; l++) {
+            struct search_lane* sl = &lanes[l];
+            sha256StateDigest(&states[l*8], digest);
+            hexify(digest, 32, sl->msg + 1);
+            if (sl->c == 0) memcpy(sl->sha2, digest, 32);
+            sl->out[sl->c * 2] = (char)sl->msg[1];
+            sl->out[sl->c * 2 + 1] = (char)sl->msg[2];
+            sl->c++;
         }
-        c++;
-        // if we're searching no need for padding
-        if (!indexing && c == termLen) break;
-    } while(c < paddedLen);
 
-    if (ret == RUE_OK) {
-        *hash = outHash;
-        outHash = NULL;
+        // retire finished chains, the last active lane takes their place
+        for (l = 0; l < active;) {
+            struct search_lane* sl = &lanes[l];
+            if (sl->c < sl->steps) {
+                l++;
+                continue;
+            }
+            hashes[sl->idx] = sl->out;
+            ruFree(sl->term);
+            active--;
+            if (l != active) {
+                struct search_lane tmp = *sl;
+                *sl = lanes[active];
+                lanes[active] = tmp;
+            }
+        }
     }
-    ruFree(term);
-    ruFree(work);
-    ruFree(outHash);
 
+    // these held the app-id
+    memset(msgs, 0, bufLen * SHA256_LANES);
+    ruFree(msgs);
+    return RUE_OK;
+}
+
+int32_t dvSearchHash(const char* word, const char* key, char** hash, bool indexing) {
+    if (!word || !key || !hash) return RUE_PARAMETER_NOT_SET;
+
+    struct dv_search_hasher sh;
+    int32_t ret = initSearchHasher(&sh, key);
+    if (ret != RUE_OK) return ret;
+
+    char* term = ruUtf8ToLower(word);
+    ret = searchHashTerm(&sh, term, hash, indexing);
+
+    freeSearchHasher(&sh);
+    ruFree(term);
     return ret;
 }
 
@@ -441,171 +745,497 @@ void getPaddedEnd(const char* str, alloc_bytes last, rusize lastLen) {
     memcpy(last, str+(blocks*BLOCKSIZE), mod);
 }
 
-int32_t dvAes256Enc(trans_bytes key, const char* cs, const char* str, char** cipherText) {
+static int32_t recipeEnc(enum dvRecipe recipe, dvkey key, const char* str,
+                         rusize len, alloc_bytes iv, alloc_bytes cipher,
+                         int32_t* outLen) {
+    if (recipe == RECIPE_AES_GCM) {
+        return gcmEnc(key, str, len, iv, cipher, outLen);
+    }
+    return aesEnc(key, str, len, iv, cipher, outLen);
+}
+
+/**
+ * Writes the recipe:cs:iv:encoding: start of a cipher recipe.
+ * @param recipe The recipe used.
+ * @param codec How the plaintext was encoded before encryption.
+ * @param dictId The compression dictionary or 0.
+ * @param cs The checksum, may be NULL.
+ * @param iv The IV of the recipe.
+ * @param out Buffer of at least #RECIPE_HEAD_SIZE bytes.
+ * @return Length of the terminated string written.
+ */
+rusize recipeHead(enum dvRecipe recipe, enum dvCodec codec, uint32_t dictId,
+                  const char* cs, trans_bytes iv, char* out) {
+    rusize ivLen = recipe == RECIPE_AES_GCM? GCM_IVSIZE : BLOCKSIZE;
+    char* p = out;
+    // recipe:cs:
+    p += sprintf(p, "%s:%.2s:", recipeNames[recipe], cs? cs : "");
+    // iv
+    hexify(iv, (int)ivLen, (alloc_bytes)p);
+    p += ivLen*2;
+    // :encoding:
+    *p++ = ':';
+    p += codecName(codec, dictId, p);
+    p += sprintf(p, ":");
+    return (rusize)(p - out);
+}
+
+/*
+ * Formats recipe:cs:iv:encoding:payload from the encrypted payload.
+ */
+static int32_t encodeRecipe(enum dvRecipe recipe, enum dvCodec codec,
+                            uint32_t dictId, const char* cs, trans_bytes iv,
+                            trans_bytes cipher, rusize ciphsz,
+                            char** cipherText) {
+    rusize dlen = 0;
+    rusize blen = 0;  // payload base64 encoded set at run time
+    const struct dv_crypto_provider* cp = cryptoProvider();
+
+    // base64 encoded cipher text
+    int32_t ret = cp->b64Encode(NULL, dlen, &blen, NULL, ciphsz);
+    if (ret != MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL) {
+        dvSetError("base64 encode returned %d instread of %d",
+                   ret, MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL);
+        return RUE_GENERAL;
+    }
+    // set what we learned
+    dlen = blen;
+    // alloc output for recipe:cs:iv:encoding:payload
+    char *out = ruMalloc0(RECIPE_HEAD_SIZE+dlen, char);
+    char *p = out + recipeHead(recipe, codec, dictId, cs, iv, out);
+    // payload
+    ret = cp->b64Encode((alloc_bytes)p, dlen, &blen, cipher, ciphsz);
+    if (ret) {
+        dvSetError("base64 encode failed: %d", ret);
+        ruFree(out);
+        return RUE_GENERAL;
+    }
+    p+= dlen;
+    // redundant terminator
+    *p = '\0';
+    *cipherText = out;
+    return RUE_OK;
+}
+
+/**
+ * Like #dvAes256Enc with a prepared key.
+ * @param codec CODEC_DEFLATE to compress the text first. Texts that do not
+ *              shrink by at least a block are stored as they are.
+ * @param dict The dictionary to compress with or NULL.
+ */
+int32_t dvAes256EncKey(dvkey key, const char* cs, const char* str,
+                       enum dvRecipe recipe, enum dvCodec codec,
+                       dvdict dict, char** cipherText) {
     int32_t ret, ciphsz = 0;
     uint8_t iv[BLOCKSIZE];
     // cipher bytes
     alloc_bytes cipher = NULL;
-    // for cipherText
-    char *out = NULL;
+    // compressed text
+    alloc_bytes packed = NULL;
+    rusize len, packedLen = 0;
 
     if (!key || !str || !cipherText) return RUE_PARAMETER_NOT_SET;
-
-    // recipe:cs:iv:encoding:payload recipe start aes-256-cbc:f7:[16]:b:
-    int32_t prelen = 18 // aes-256-cbc:dd::b: recipe:cs::encoding:
-            + (BLOCKSIZE*2) // iv * 2 because hex encoding
-            + 1;        // teminator \0
-    rusize dlen = 0;
-    rusize blen = 0;  // payload base64 encoded set at run time
+    if (recipe != RECIPE_AES_CBC && recipe != RECIPE_AES_GCM) {
+        return RUE_INVALID_PARAMETER;
+    }
+    len = strlen(str);
 
     do {
         ruVerbLogf("looking to encrypt '%s'", str);
-        // get length estimates
-        // cipher text
-        ret = aesEnc(key, str, iv, NULL, &ciphsz);
-        if (ret != RUE_OUT_OF_MEMORY) {
-            break;
+        if (codec == CODEC_DEFLATE) {
+            ret = deflateText(str, len, dict, &packed, &packedLen);
+            if (ret != RUE_OK) break;
+            if (packed) {
+                str = (const char*)packed;
+                len = packedLen;
+            } else {
+                codec = CODEC_PLAIN;
+            }
         }
-        // base64 encoded cipher text
-        ret = mbedtls_base64_encode(NULL, dlen, &blen, NULL, ciphsz);
-        if (ret != MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL) {
-            dvSetError("mbedtls_base64_encode returned %d instread of %d",
-                       ret, MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL);
-            ret = RUE_GENERAL;
+        // get length estimate of the cipher text
+        ret = recipeEnc(recipe, key, str, len, iv, NULL, &ciphsz);
+        if (ret != RUE_OUT_OF_MEMORY) {
             break;
         }
-
         // do it!
         // alloc cipher bytes
-        cipher = ruMalloc0(ciphsz, uint8_t);
-        ret = aesEnc(key, str, iv, cipher, &ciphsz);
+        cipher = scratchAlloc(ciphsz);
+        ret = recipeEnc(recipe, key, str, len, iv, cipher, &ciphsz);
         if (ret != RUE_OK) {
             break;
         }
-        // set what we learned
-        dlen = blen;
-        // alloc output for recipe:cs:iv:encoding:payload
-        char *p = out = ruMalloc0(prelen+dlen, char);
-        // recipe:cs:
-        sprintf(p, "aes-256-cbc:%s:", cs? cs : "");
-        p += strlen(out);
-        // iv
-        hexify((trans_bytes) iv, BLOCKSIZE, (alloc_bytes ) p);
-        p += BLOCKSIZE*2;
-        // :encoding:
-        sprintf(p, ":b:");
-        p += 3;
-        // payload
-        ret = mbedtls_base64_encode((alloc_bytes)p, dlen, &blen,
-                                    cipher, ciphsz);
-        if (ret) {
-            dvSetError("mbedtls_base64_encode failed: %d", ret);
-            ret = RUE_GENERAL;
-            break;
-        }
-        p+= dlen;
-        // redundant terminator
-        *p = '\0';
-        // all good
-        *cipherText = out;
-        out = NULL;
-        // for readability, it is already 0
-        ret = RUE_OK;
+        ret = encodeRecipe(recipe, codec, codec == CODEC_DEFLATE && dict?
+                           dict->id : 0, cs, iv, cipher, ciphsz, cipherText);
     } while(false);
 
-    ruFree(cipher);
-    ruFree(out);
+    if (packed) {
+        mbedtls_platform_zeroize(packed, packedLen);
+        ruFree(packed);
+    }
+    scratchFree(cipher);
     return ret;
 }
 
-int32_t dvAes256Dec(trans_bytes key, const char* cipherRecipe, char** data, char* cs) {
-    int32_t ret = RUE_GENERAL;
-    uint8_t iv[BLOCKSIZE];
-
-    if (!key || !cipherRecipe || !data) return RUE_PARAMETER_NOT_SET;
+int32_t dvAes256Enc(trans_bytes key, const char* cs, const char* str,
+                    enum dvRecipe recipe, char** cipherText) {
+    if (!key) return RUE_PARAMETER_NOT_SET;
+    struct dv_key k;
+    initKey(&k, key);
+    int32_t ret = dvAes256EncKey(&k, cs, str, recipe, CODEC_PLAIN, NULL,
+                                 cipherText);
+    clearKey(&k);
+    return ret;
+}
 
-    // free
-    ruList rPieces = NULL;
-    alloc_bytes cipher = NULL;
-    char* msg = NULL;
+/*
+ * A text of dvAes256EncMany, compressed when that pays off
+ */
+struct dv_enc_text {
+    perm_chars str;
+    rusize len;
+    enum dvCodec codec;
+    alloc_bytes packed;
+};
 
-    do {
-        // recipe:cs:iv:encoding:payload
-        // aes-256-cbc:18:835cc...c20:b:YOB4WAENU9TmlIykp1VV0w==
-        ruVerbLogf("looking at cipher recipe '%s'", cipherRecipe);
-        // sanity check
-        if (!ruStrStartsWith(cipherRecipe, "aes-256-cbc:", NULL)) {
-            dvSetError("recipe '%s' is incompatible", cipherRecipe);
-            ret = DVE_PROTOCOL_ERROR;
-            break;
-        }
-        // split it
-        rPieces = ruStrSplit(cipherRecipe, ":", 5);
-        if (!rPieces) {
-            dvSetError("failed splitting recipe '%s'", cipherRecipe);
-            ret = DVE_PROTOCOL_ERROR;
-            break;
+/**
+ * Encrypts many texts like #dvAes256EncKey. The CBC recipe advances several
+ * messages in lockstep on the AES pipeline.
+ * @param key The 32 byte key.
+ * @param cs The checksum to put in the recipes.
+ * @param strs The texts to encrypt.
+ * @param count Number of texts.
+ * @param recipe The recipe to use.
+ * @param codec CODEC_DEFLATE to compress the texts that shrink first.
+ * @param dict The dictionary to compress with or NULL.
+ * @param cipherTexts Array of count entries receiving the recipe strings,
+ *                    which must be freed by the caller. Nothing is returned on
+ *                    error.
+ * @return RUE_OK on success
+ */
+int32_t dvAes256EncMany(trans_bytes key, const char* cs,
+                        const char* const* strs, size_t count,
+                        enum dvRecipe recipe, enum dvCodec codec,
+                        dvdict dict, char** cipherTexts) {
+    if (!key || !strs || !cipherTexts) return RUE_PARAMETER_NOT_SET;
+    if (recipe != RECIPE_AES_CBC && recipe != RECIPE_AES_GCM) {
+        return RUE_INVALID_PARAMETER;
+    }
+    size_t i, done = 0;
+    int32_t ret = RUE_OK;
+    for (i = 0; i < count; i++) {
+        if (!strs[i]) return RUE_PARAMETER_NOT_SET;
+        cipherTexts[i] = NULL;
+    }
+    if (recipe == RECIPE_AES_GCM) {
+        struct dv_key k;
+        initKey(&k, key);
+        for (done = 0; done < count; done++) {
+            ret = dvAes256EncKey(&k, cs, strs[done], recipe, codec, dict,
+                                 &cipherTexts[done]);
+            if (ret != RUE_OK) break;
         }
-        if (cs) {
-            // get the checksum
-            char *checksum = ruListIdx(rPieces, 1, char*, &ret);
-            if (ret != RUE_OK) {
-                dvSetError("failed getting cs from recipe ec:%d", ret);
-                break;
+        clearKey(&k);
+    } else {
+        const struct dv_crypto_provider* cp = cryptoProvider();
+        struct dv_aes_key ak;
+        struct dv_cbc_stream* streams = ruMalloc0(count, struct dv_cbc_stream);
+        struct dv_enc_text* texts = ruMalloc0(count, struct dv_enc_text);
+        // start IV followed by the running IV of every message
+        alloc_bytes ivs = ruMalloc0(count * 2 * BLOCKSIZE, uint8_t);
+        alloc_bytes buf = NULL;
+        rusize total = 0;
+        for (i = 0; i < count && ret == RUE_OK; i++) {
+            struct dv_enc_text* t = &texts[i];
+            t->str = strs[i];
+            t->len = strlen(strs[i]);
+            t->codec = CODEC_PLAIN;
+            if (codec == CODEC_DEFLATE) {
+                ret = deflateText(t->str, t->len, dict, &t->packed, &t->len);
+                if (ret != RUE_OK) break;
+                if (t->packed) {
+                    t->str = (perm_chars)t->packed;
+                    t->codec = CODEC_DEFLATE;
+                } else {
+                    t->len = strlen(strs[i]);
+                }
             }
-            memcpy(cs, checksum, 2);
-        }
-        // get the iv
-        char *hexIv = ruListIdx(rPieces, 2, char*, &ret);
-        if (ret != RUE_OK) {
-            dvSetError("failed getting iv from recipe ec:%d", ret);
-            break;
+            streams[i].len = cbcSize(t->len);
+            total += streams[i].len;
         }
-        rusize nl = BLOCKSIZE;
-        ret = unhexify(hexIv, &nl, BLOCKSIZE, iv);
-        if (ret != RUE_OK) {
-            dvSetError("failed to unhexify iv '%s' ec:%d", iv, ret);
-            break;
-        }
-        // get and verify the codec
-        char *codec = ruListIdx(rPieces, 3, char*, &ret);
-        if (ret != RUE_OK) {
-            dvSetError("failed getting codec from recipe ec:%d", ret);
-            break;
+        if (ret == RUE_OK) buf = ruMalloc0(total, uint8_t);
+        total = 0;
+        for (i = 0; i < count && ret == RUE_OK; i++) {
+            alloc_bytes iv = ivs + i * 2 * BLOCKSIZE;
+            ret = mkIv(iv, BLOCKSIZE);
+            memcpy(iv + BLOCKSIZE, iv, BLOCKSIZE);
+            streams[i].iv = iv + BLOCKSIZE;
+            streams[i].data = buf + total;
+            cbcPlain(texts[i].str, texts[i].len, streams[i].data);
+            total += streams[i].len;
         }
-        if (!ruStrEquals(codec, "b")) {
-            dvSetError("invalid codec '%s' in recipe", codec);
-            ret = DVE_PROTOCOL_ERROR;
-            break;
+        do {
+            if (ret != RUE_OK) break;
+            ret = cp->aesSetKey(&ak, key, MBEDTLS_AES_ENCRYPT);
+            if (ret == RUE_OK) {
+                ret = cp->aesCbcEncMany(&ak, streams, count);
+            }
+            cp->aesFree(&ak);
+            if (ret) {
+                dvSetError("Failed encrypting the payloads. EC: %d", ret);
+                ret = RUE_GENERAL;
+                break;
+            }
+            for (done = 0; done < count; done++) {
+                enum dvCodec tc = texts[done].codec;
+                ret = encodeRecipe(recipe, tc, tc == CODEC_DEFLATE && dict?
+                                   dict->id : 0, cs,
+                                   ivs + done * 2 * BLOCKSIZE,
+                                   streams[done].data, streams[done].len,
+                                   &cipherTexts[done]);
+                if (ret != RUE_OK) break;
+            }
+        } while (false);
+        for (i = 0; i < count; i++) {
+            if (!texts[i].packed) continue;
+            mbedtls_platform_zeroize(texts[i].packed, texts[i].len);
+            ruFree(texts[i].packed);
         }
-        // decode
-        char* b64 = ruListIdx(rPieces, 4, char*, &ret);
-        if (ret != RUE_OK) {
-            dvSetError("failed getting payload from recipe ec:%d", ret);
-            break;
+        if (buf) mbedtls_platform_zeroize(buf, total);
+        ruFree(buf);
+        ruFree(ivs);
+        ruFree(texts);
+        ruFree(streams);
+    }
+    if (ret != RUE_OK) {
+        for (i = 0; i < done; i++) {
+            ruFree(cipherTexts[i]);
         }
-        rusize clen = 0;
-        ret = dvB64Decode(b64, &cipher, &clen);
+    }
+    return ret;
+}
+
+/*
+ * A field of a cipher recipe, pointing into the recipe string
+ */
+struct recipe_field {
+    perm_chars start;
+    rusize len;
+};
+
+// recipe:cs:iv:encoding:payload
+#define RECIPE_FIELDS 5
+
+static int32_t splitRecipe(const char* cipherRecipe,
+                           struct recipe_field* fields) {
+    perm_chars p = cipherRecipe;
+    for (int i = 0; i < RECIPE_FIELDS - 1; i++) {
+        perm_chars colon = strchr(p, ':');
+        if (!colon) return DVE_PROTOCOL_ERROR;
+        fields[i].start = p;
+        fields[i].len = colon - p;
+        p = colon + 1;
+    }
+    fields[RECIPE_FIELDS - 1].start = p;
+    fields[RECIPE_FIELDS - 1].len = strlen(p);
+    return RUE_OK;
+}
+
+/**
+ * Checks a cipher recipe and extracts its parts.
+ * @param cipherRecipe The recipe:cs:iv:encoding:payload string.
+ * @param recipe Where the recipe will be stored.
+ * @param iv Buffer of BLOCKSIZE bytes receiving the IV.
+ * @param cs Optional buffer of 2 bytes receiving the checksum.
+ * @param codec Where the payload codec will be stored.
+ * @param dictId Where the compression dictionary id or 0 will be stored.
+ * @param payload Where the start of the encoded payload will be stored.
+ * @param payloadLen Where the length of the encoded payload will be stored.
+ * @return RUE_OK on success
+ */
+int32_t parseRecipe(const char* cipherRecipe, enum dvRecipe* recipe,
+                    alloc_bytes iv, char* cs, enum dvCodec* codec,
+                    uint32_t* dictId, perm_chars* payload, rusize* payloadLen) {
+    struct recipe_field fld[RECIPE_FIELDS];
+    // recipe:cs:iv:encoding:payload
+    // aes-256-cbc:18:835cc...c20:b:YOB4WAENU9TmlIykp1VV0w==
+    ruVerbLogf("looking at cipher recipe '%s'", cipherRecipe);
+    // split it
+    int32_t ret = splitRecipe(cipherRecipe, fld);
+    if (ret != RUE_OK) {
+        dvSetError("failed splitting recipe '%s'", cipherRecipe);
+        return ret;
+    }
+    // sanity check
+    if (findRecipe(fld[0].start, fld[0].len, recipe) != RUE_OK) {
+        dvSetError("recipe '%s' is incompatible", cipherRecipe);
+        return DVE_PROTOCOL_ERROR;
+    }
+    rusize ivLen = *recipe == RECIPE_AES_GCM? GCM_IVSIZE : BLOCKSIZE;
+    if (cs) {
+        // get the checksum, published data has none
+        memcpy(cs, fld[1].start, fld[1].len < 2? fld[1].len : 2);
+    }
+    // get the iv
+    rusize nl = BLOCKSIZE;
+    ret = unhexify(fld[2].start, fld[2].len, &nl, BLOCKSIZE, iv);
+    if (ret != RUE_OK) {
+        dvSetError("failed to unhexify iv '%.*s' ec:%d",
+                   (int)fld[2].len, fld[2].start, ret);
+        return ret;
+    }
+    if (nl != ivLen) {
+        dvSetError("iv '%.*s' has the wrong size for the recipe",
+                   (int)fld[2].len, fld[2].start);
+        return DVE_PROTOCOL_ERROR;
+    }
+    // verify the codec
+    if (findCodec(fld[3].start, fld[3].len, codec, dictId) != RUE_OK) {
+        dvSetError("invalid codec '%.*s' in recipe",
+                   (int)fld[3].len, fld[3].start);
+        return DVE_PROTOCOL_ERROR;
+    }
+    *payload = fld[4].start;
+    *payloadLen = fld[4].len;
+    return RUE_OK;
+}
+
+/*
+ * Decrypts the decoded payload of a recipe in place. On success msg becomes
+ * the text unless it had to be inflated.
+ */
+static int32_t decryptPayload(dvkey key, dvdict dict, enum dvRecipe recipe,
+                              enum dvCodec codec, alloc_bytes iv,
+                              alloc_bytes* msg, rusize clen, char** data) {
+    rusize tlen = 0;
+    int32_t ret;
+    if (recipe == RECIPE_AES_GCM) {
+        ret = gcmDec(key, *msg, clen, iv, &tlen);
+    } else {
+        ret = aesDec(key, *msg, clen, iv, &tlen);
+    }
+    if (ret != RUE_OK) {
+        dvSetError("failed decrypting payload from recipe ec:%d", ret);
+        return ret;
+    }
+    if (codec == CODEC_DEFLATE) {
+        return inflateText(*msg, tlen, dict, data);
+    }
+    *data = (char*)*msg;
+    *msg = NULL;
+    return RUE_OK;
+}
+
+static int32_t recipeDict(dvdict dicts, uint32_t dictId, dvdict* dict) {
+    *dict = NULL;
+    if (!dictId) return RUE_OK;
+    *dict = findDict(dicts, dictId);
+    if (!*dict) {
+        dvSetError("Dictionary %08x is not registered", dictId);
+        return RUE_FILE_NOT_FOUND;
+    }
+    return RUE_OK;
+}
+
+/**
+ * Like #dvAes256Dec with a prepared key. A field envelope is decrypted into
+ * a JSON object of its fields.
+ * @param dicts The dictionaries compressed data may need.
+ */
+int32_t dvAes256DecKey(dvkey key, dvdict dicts, const char* cipherRecipe,
+                       char** data, char* cs) {
+    int32_t ret = RUE_GENERAL;
+    uint8_t iv[BLOCKSIZE];
+    enum dvRecipe recipe;
+    enum dvCodec codec;
+    uint32_t dictId = 0;
+    dvdict dict = NULL;
+    perm_chars payload = NULL;
+    rusize payloadLen = 0;
+
+    if (!key || !cipherRecipe || !data) return RUE_PARAMETER_NOT_SET;
+    if (isEnvelope(cipherRecipe)) {
+        return decryptEnvelope(key, dicts, cipherRecipe, data, cs);
+    }
+
+    // free
+    alloc_bytes msg = NULL;
+    rusize clen = 0;
+
+    do {
+        ret = parseRecipe(cipherRecipe, &recipe, iv, cs, &codec, &dictId,
+                          &payload, &payloadLen);
+        if (ret != RUE_OK) break;
+        ret = recipeDict(dicts, dictId, &dict);
+        if (ret != RUE_OK) break;
+        // decode, the plaintext is decrypted right in this buffer
+        ret = dvB64Decode(payload, payloadLen, &msg, &clen);
         if (ret != RUE_OK) {
             dvSetError("failed decoding payload from recipe ec:%d", ret);
             break;
         }
-        // decrypt
-        ret = aesDec(key, cipher, clen, iv, &msg);
-        if (ret != RUE_OK) {
-            dvSetError("failed decrypting payload from recipe ec:%d", ret);
-            break;
-        }
-        // all good
-        *data = msg;
-        msg = NULL;
-        ret = RUE_OK;
-
+        ret = decryptPayload(key, dict, recipe, codec, iv, &msg, clen, data);
     } while(false);
 
-    ruFree(msg);
-    ruFree(cipher);
-    ruListFree(rPieces);
+    if (msg) {
+        memset(msg, 0, clen);
+        ruFree(msg);
+    }
+    return ret;
+}
 
+/**
+ * Like #dvAes256DecKey for a recipe whose payload is given as raw bytes
+ * instead of base64, as binary vault responses carry it.
+ * @param recipe The recipe:cs:iv:encoding: head followed by the payload.
+ * @param len Length of the recipe.
+ */
+int32_t dvAes256DecRaw(dvkey key, dvdict dicts, trans_bytes recipe,
+                       rusize len, char** data, char* cs) {
+    uint8_t iv[BLOCKSIZE];
+    char head[RECIPE_HEAD_SIZE];
+    enum dvRecipe rcp;
+    enum dvCodec codec;
+    uint32_t dictId = 0;
+    dvdict dict = NULL;
+    perm_chars payload = NULL;
+    rusize payloadLen = 0, headLen = 0;
+    int colons = 0;
+
+    if (!key || !recipe || !data) return RUE_PARAMETER_NOT_SET;
+    // the head ends after the colon before the payload
+    while (headLen < len && headLen < sizeof(head) - 1 &&
+           colons < RECIPE_FIELDS - 1) {
+        if (recipe[headLen++] == ':') colons++;
+    }
+    if (colons < RECIPE_FIELDS - 1) {
+        dvSetError("binary recipe has no valid head");
+        return DVE_PROTOCOL_ERROR;
+    }
+    memcpy(head, recipe, headLen);
+    head[headLen] = '\0';
+    int32_t ret = parseRecipe(head, &rcp, iv, cs, &codec, &dictId, &payload,
+                              &payloadLen);
+    if (ret != RUE_OK) return ret;
+    ret = recipeDict(dicts, dictId, &dict);
+    if (ret != RUE_OK) return ret;
+
+    // decrypted in a copy, the response stays as it is
+    rusize clen = len - headLen;
+    alloc_bytes msg = ruMalloc0(clen + 1, uint8_t);
+    memcpy(msg, recipe + headLen, clen);
+    ret = decryptPayload(key, dict, rcp, codec, iv, &msg, clen, data);
+    if (msg) {
+        memset(msg, 0, clen);
+        ruFree(msg);
+    }
+    return ret;
+}
+
+int32_t dvAes256Dec(trans_bytes key, const char* cipherRecipe, char** data, char* cs) {
+    if (!key) return RUE_PARAMETER_NOT_SET;
+    struct dv_key k;
+    initKey(&k, key);
+    int32_t ret = dvAes256DecKey(&k, NULL, cipherRecipe, data, cs);
+    clearKey(&k);
     return ret;
 }
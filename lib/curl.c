@@ -182,6 +182,70 @@ static rusize responseWriter( char *ptr, rusize size, rusize nmemb,
     return len;
 }
 
+/*
+ * Feeds the form fields and then the url encoded value of the streamed field
+ * to curl.
+ */
+struct upload_ctx {
+    struct dv_req_io* io;
+    perm_chars prefix;      /* escaped post fields and field= */
+    rusize prefixLen;
+    rusize prefixPos;
+    char raw[STREAM_CHUNK];
+    char enc[STREAM_CHUNK * 3];
+    rusize encLen;
+    rusize encPos;
+    bool eof;
+};
+
+static rusize uriEncode(trans_chars in, rusize len, char* out) {
+    static const char hex[] = "0123456789ABCDEF";
+    char* o = out;
+    for (rusize i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)in[i];
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.' ||
+            c == '~') {
+            *o++ = (char)c;
+        } else {
+            *o++ = '%';
+            *o++ = hex[c >> 4];
+            *o++ = hex[c & 0xf];
+        }
+    }
+    return (rusize)(o - out);
+}
+
+/* curl reader function */
+static rusize uploadReader(char *ptr, rusize size, rusize nmemb,
+                           void *userdata) {
+    struct upload_ctx* uc = userdata;
+    rusize room = size * nmemb, len = 0;
+    if (uc->prefixPos < uc->prefixLen) {
+        len = uc->prefixLen - uc->prefixPos;
+        if (len > room) len = room;
+        memcpy(ptr, uc->prefix + uc->prefixPos, len);
+        uc->prefixPos += len;
+        return len;
+    }
+    if (uc->encPos == uc->encLen) {
+        if (uc->eof) return 0;
+        rusize got = uc->io->read(uc->io->readCtx, uc->raw, sizeof(uc->raw));
+        if (got == CURL_READFUNC_ABORT) return got;
+        if (!got || got > sizeof(uc->raw)) {
+            uc->eof = true;
+            return 0;
+        }
+        uc->encLen = uriEncode(uc->raw, got, uc->enc);
+        uc->encPos = 0;
+    }
+    len = uc->encLen - uc->encPos;
+    if (len > room) len = room;
+    memcpy(ptr, uc->enc + uc->encPos, len);
+    uc->encPos += len;
+    return len;
+}
+
 /* curl debug function */
 static int debug_callback (CURL *h, curl_infotype type, char *str, rusize len,
                            void *userdata) {
@@ -236,6 +300,28 @@ static int debug_callback (CURL *h, curl_infotype type, char *str, rusize len,
  */
 int32_t doRequest(dvctx ctx, const char* url, dvKvList postData, char** result,
               rusize* resultLen ) {
+    if (!result) return RUE_PARAMETER_NOT_SET;
+    return doStreamRequest(ctx, url, postData, NULL, result, resultLen);
+}
+
+/**
+ * Like \ref doRequest but optionally streams the request or the response.
+ * \param [in] ctx An initialized toolkit context
+ * \param [in] url The url to post the data to
+ * \param [in] postData The data to post
+ * \param [in] io Optional. With a read function the value of its field is
+ *                 posted in chunks after postData, using chunked transfer
+ *                 encoding. With a write function the response body goes
+ *                 there instead of result. A body is posted before postData.
+ * \param [out] result The body of the response without the headers unless
+ *                     io has a write function. Must be freed by caller
+ * \param [out] resultLen Optional. Where the length of the result will be
+ *                        stored.
+ * \return A \ref rferrors status of the operation.
+ */
+int32_t doStreamRequest(dvctx ctx, const char* url, dvKvList postData,
+                        struct dv_req_io* io, char** result,
+                        rusize* resultLen) {
     CURL* h;
     CURLcode ret;
     bool isSSL = true;
@@ -246,10 +332,15 @@ int32_t doRequest(dvctx ctx, const char* url, dvKvList postData, char** result,
     char* escapedPost = NULL;
     char* proxyAuth = NULL;
     dvKvList kvl = NULL;
+    struct upload_ctx* upload = NULL;
     struct dv_hdr_ctx hdrCtx;
     memset(&hdrCtx, 0, sizeof(struct dv_hdr_ctx));
+    bool readIo = io && io->read;
+    bool writeIo = io && io->write;
 
-    if (!ctx || !url || !result) return RUE_PARAMETER_NOT_SET;
+    if (!ctx || !url || (!result && !writeIo)) return RUE_PARAMETER_NOT_SET;
+    if (readIo && !io->field) return RUE_PARAMETER_NOT_SET;
+    if (readIo && io->body) return RUE_INVALID_PARAMETER;
     if (dvctxType != ctx->type) return RUE_INVALID_PARAMETER;
 
     if (postData && dvKvListType != postData->type ) {
@@ -343,18 +434,22 @@ int32_t doRequest(dvctx ctx, const char* url, dvKvList postData, char** result,
         ret = curl_easy_setopt(h, CURLOPT_URL, url);
         CURL_CHECK_BREAK(CURLOPT_URL)
 
+        /* the size of a streamed body is not known up front */
+        if (readIo) {
+            curlHdrCb(&hdrCtx, "Transfer-Encoding", "chunked");
+        }
         /* run the callbacks */
         if (ctx->hdrCb) {
             ctx->hdrCb(ctx->hdrCtx, curlHdrCb, &hdrCtx);
-            if (hdrCtx.chunk) {
-                ret = curl_easy_setopt(h, CURLOPT_HTTPHEADER, hdrCtx.chunk);
-                CURL_CHECK_BREAK(CURLOPT_CONNECTTIMEOUT)
-                // HTTPS over a proxy makes a separate CONNECT to the proxy, so
-                // tell libcurl to not send the custom headers to the proxy.
-                // Keep them separate!
-                curl_easy_setopt(h, CURLOPT_HEADEROPT, CURLHEADER_SEPARATE);
-                CURL_CHECK_BREAK(CURLOPT_HEADEROPT)
-            }
+        }
+        if (hdrCtx.chunk) {
+            ret = curl_easy_setopt(h, CURLOPT_HTTPHEADER, hdrCtx.chunk);
+            CURL_CHECK_BREAK(CURLOPT_CONNECTTIMEOUT)
+            // HTTPS over a proxy makes a separate CONNECT to the proxy, so
+            // tell libcurl to not send the custom headers to the proxy.
+            // Keep them separate!
+            curl_easy_setopt(h, CURLOPT_HEADEROPT, CURLHEADER_SEPARATE);
+            CURL_CHECK_BREAK(CURLOPT_HEADEROPT)
         }
         if (ctx->postCb) {
             if (!postData) {
@@ -376,9 +471,45 @@ int32_t doRequest(dvctx ctx, const char* url, dvKvList postData, char** result,
                 break;
             }
             ruVerbLogf("Set cURL postfields with %s values.", escapedPost);
+        }
+        if (io && io->body && escapedPost) {
+            // the callback fields follow the prepared body
+            char* all = ruDupPrintf("%s&%s", io->body, escapedPost);
+            ruFree(escapedPost);
+            escapedPost = all;
+        }
+        if (readIo) {
+            /* the fields go first, the streamed one follows */
+            char* prefix = ruDupPrintf("%s%s%s=", escapedPost? escapedPost : "",
+                                       escapedPost? "&" : "", io->field);
+            ruFree(escapedPost);
+            escapedPost = prefix;
+            upload = ruMalloc0(1, struct upload_ctx);
+            upload->io = io;
+            upload->prefix = escapedPost;
+            upload->prefixLen = strlen(escapedPost);
+
+            ret = curl_easy_setopt(h, CURLOPT_POST, 1L);
+            CURL_CHECK_BREAK(CURLOPT_POST)
+
+            ret = curl_easy_setopt(h, CURLOPT_READFUNCTION, uploadReader);
+            CURL_CHECK_BREAK(CURLOPT_READFUNCTION)
+
+            ret = curl_easy_setopt(h, CURLOPT_READDATA, upload);
+            CURL_CHECK_BREAK(CURLOPT_READDATA)
+
+        } else if (escapedPost) {
             ret = curl_easy_setopt(h, CURLOPT_POSTFIELDS, escapedPost);
             CURL_CHECK_BREAK(CURLOPT_POSTFIELDS)
 
+        } else if (io && io->body) {
+            // posted without a copy
+            ret = curl_easy_setopt(h, CURLOPT_POSTFIELDSIZE, (long)io->bodyLen);
+            CURL_CHECK_BREAK(CURLOPT_POSTFIELDSIZE)
+
+            ret = curl_easy_setopt(h, CURLOPT_POSTFIELDS, io->body);
+            CURL_CHECK_BREAK(CURLOPT_POSTFIELDS)
+
         } else {
             ruVerbLog("Dont set cURL POST data, because it is empty.");
         }
@@ -387,13 +518,22 @@ int32_t doRequest(dvctx ctx, const char* url, dvKvList postData, char** result,
         ret = curl_easy_setopt(h, CURLOPT_CONNECTTIMEOUT, ctx->curlTimeout);
         CURL_CHECK_BREAK(CURLOPT_CONNECTTIMEOUT)
 
-        /* return result with exec */
-        ret = curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, responseWriter);
-        CURL_CHECK_BREAK(CURLOPT_WRITEFUNCTION)
+        if (writeIo) {
+            ret = curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, io->write);
+            CURL_CHECK_BREAK(CURLOPT_WRITEFUNCTION)
 
-        response = ruBufferNew (1024*64);
-        ret = curl_easy_setopt(h, CURLOPT_WRITEDATA, response);
-        CURL_CHECK_BREAK(CURLOPT_WRITEDATA)
+            ret = curl_easy_setopt(h, CURLOPT_WRITEDATA, io->writeCtx);
+            CURL_CHECK_BREAK(CURLOPT_WRITEDATA)
+
+        } else {
+            /* return result with exec */
+            ret = curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, responseWriter);
+            CURL_CHECK_BREAK(CURLOPT_WRITEFUNCTION)
+
+            response = ruBufferNew (1024*64);
+            ret = curl_easy_setopt(h, CURLOPT_WRITEDATA, response);
+            CURL_CHECK_BREAK(CURLOPT_WRITEDATA)
+        }
 
         ret = curl_easy_perform(h);
         if (ret) {
@@ -423,6 +563,7 @@ int32_t doRequest(dvctx ctx, const char* url, dvKvList postData, char** result,
     }
     ruFree(escapedPost);
     ruFree(proxyAuth);
+    ruFree(upload);
 
     // if there was a header callback
     if(hdrCtx.headers) ruListFree(hdrCtx.headers);
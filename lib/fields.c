@@ -0,0 +1,336 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+#include <mbedtls/platform_util.h>
+
+// fields:cs:index,field,field with the index holding id,name,name
+#define ENVELOPE_NAME "fields:"
+#define ENVELOPE_NAME_LEN 7
+#define FIELD_SEP ','
+#define FIELD_EQ '='
+// the random id in hex that ties the fields to their envelope
+#define ENVELOPE_ID_LEN (2 * BLOCKSIZE)
+
+bool isEnvelope(const char* cipherRecipe) {
+    return cipherRecipe &&
+           !strncmp(cipherRecipe, ENVELOPE_NAME, ENVELOPE_NAME_LEN);
+}
+
+static int32_t checkFieldName(const char* name) {
+    if (!name) return RUE_PARAMETER_NOT_SET;
+    if (!*name || strchr(name, FIELD_EQ) || strchr(name, FIELD_SEP)) {
+        dvSetError("field name '%s' is empty or contains '%c' or '%c'",
+                   name, FIELD_EQ, FIELD_SEP);
+        return RUE_INVALID_PARAMETER;
+    }
+    return RUE_OK;
+}
+
+/**
+ * Encrypts the fields of a record one by one into a field envelope. The
+ * names go into an encrypted index together with a random id, and every
+ * field is encrypted with that id and its position, so that the vault can
+ * neither swap, drop nor mix in fields of other envelopes.
+ * @param key The key to encrypt with.
+ * @param cs The checksum to put in the envelope and its recipes.
+ * @param fields The names and values of the record.
+ * @param recipe The recipe to encrypt the fields with.
+ * @param codec The codec to encode the fields with.
+ * @param dict The compression dictionary or NULL.
+ * @param envelope Where the envelope will be stored.
+ * @param plain Optional, where the record as JSON object will be stored, which
+ *              is what decrypting the envelope as a whole returns.
+ * @return RUE_OK on success
+ */
+int32_t encodeFields(dvkey key, const char* cs, const struct dv_fields* fields,
+                     enum dvRecipe recipe, enum dvCodec codec, dvdict dict,
+                     char** envelope, char** plain) {
+    if (!key || !fields || !fields->names || !fields->values || !envelope) {
+        return RUE_PARAMETER_NOT_SET;
+    }
+    if (!fields->count) return RUE_INVALID_PARAMETER;
+    int32_t ret = RUE_OK;
+    rusize i, j;
+    for (i = 0; i < fields->count && ret == RUE_OK; i++) {
+        ret = checkFieldName(fields->names[i]);
+        if (ret == RUE_OK && !fields->values[i]) ret = RUE_PARAMETER_NOT_SET;
+        for (j = 0; j < i && ret == RUE_OK; j++) {
+            if (ruStrEquals(fields->names[i], fields->names[j])) {
+                dvSetError("field name '%s' is given twice", fields->names[i]);
+                ret = RUE_INVALID_PARAMETER;
+            }
+        }
+    }
+    if (ret != RUE_OK) return ret;
+
+    uint8_t idBytes[BLOCKSIZE];
+    char id[ENVELOPE_ID_LEN + 1];
+    ret = mkIv(idBytes, sizeof(idBytes));
+    if (ret != RUE_OK) return ret;
+    hexify(idBytes, BLOCKSIZE, (alloc_bytes)id);
+    id[ENVELOPE_ID_LEN] = '\0';
+
+    // to free
+    ruString out = ruStringNew(ENVELOPE_NAME);
+    ruString index = ruStringNew(id);
+    ruJson jsn = NULL;
+    alloc_chars text = NULL;
+    alloc_chars cipher = NULL;
+
+    ruStringAppendf(out, "%.2s:", cs? cs : "");
+    for (i = 0; i < fields->count; i++) {
+        ruStringAppendf(index, "%c%s", FIELD_SEP, fields->names[i]);
+    }
+    ret = dvAes256EncKey(key, cs, ruStringGetCString(index), recipe, codec,
+                         dict, &cipher);
+    if (ret == RUE_OK) ruStringAppend(out, cipher);
+    ruFree(cipher);
+    for (i = 0; i < fields->count && ret == RUE_OK; i++) {
+        text = ruDupPrintf("%s:%d%c%s", id, (int)i, FIELD_EQ,
+                           fields->values[i]);
+        ret = dvAes256EncKey(key, cs, text, recipe, codec, dict, &cipher);
+        mbedtls_platform_zeroize(text, strlen(text));
+        ruFree(text);
+        if (ret != RUE_OK) break;
+        ruStringAppendf(out, "%c%s", FIELD_SEP, cipher);
+        ruFree(cipher);
+    }
+    if (ret == RUE_OK && plain) {
+        jsn = ruJsonStart(false);
+        for (i = 0; i < fields->count && ret == RUE_OK; i++) {
+            ret = ruJsonSetKeyStr(jsn, fields->names[i], fields->values[i]);
+        }
+        perm_chars str = NULL;
+        if (ret == RUE_OK) ret = ruJsonWrite(jsn, &str);
+        if (ret == RUE_OK) *plain = ruStrDup(str);
+    }
+    ruJsonFree(jsn);
+    ruStringFree(index, false);
+    if (ret == RUE_OK) {
+        *envelope = ruStringGetCString(out);
+        ruStringFree(out, true);
+    } else {
+        ruStringFree(out, false);
+    }
+    return ret;
+}
+
+/*
+ * Copies the next recipe of the envelope.
+ * @param p Where to continue, updated to the recipe after.
+ * @param recipe Where the recipe will be stored.
+ * @return RUE_OK on success, RUE_FILE_NOT_FOUND at the end.
+ */
+static int32_t nextRecipe(perm_chars* p, alloc_chars* recipe) {
+    if (!**p) return RUE_FILE_NOT_FOUND;
+    perm_chars end = strchr(*p, FIELD_SEP);
+    if (!end) end = *p + strlen(*p);
+    if (end == *p) {
+        dvSetError("invalid field in envelope");
+        return DVE_PROTOCOL_ERROR;
+    }
+    *recipe = ruStrNDup(*p, (rusize)(end - *p));
+    *p = *end? end + 1 : end;
+    return RUE_OK;
+}
+
+/*
+ * Decrypts the index of the envelope. It holds the id followed by the
+ * names, each behind a FIELD_SEP.
+ * @param p The start of the envelope after its checksum, updated to the
+ *          first field.
+ * @param index Where the index will be stored.
+ * @param count Where the number of fields will be stored.
+ */
+static int32_t envelopeIndex(dvkey key, dvdict dicts, perm_chars* p,
+                             alloc_chars* index, rusize* count) {
+    alloc_chars recipe = NULL;
+    int32_t ret = nextRecipe(p, &recipe);
+    if (ret == RUE_FILE_NOT_FOUND) ret = DVE_PROTOCOL_ERROR;
+    if (ret == RUE_OK) ret = dvAes256DecKey(key, dicts, recipe, index, NULL);
+    ruFree(recipe);
+    if (ret != RUE_OK) return ret;
+    rusize n = 0;
+    for (perm_chars c = *index; *c; c++) {
+        if (*c == FIELD_SEP) n++;
+    }
+    if (strlen(*index) <= ENVELOPE_ID_LEN ||
+        (*index)[ENVELOPE_ID_LEN] != FIELD_SEP) {
+        dvSetError("invalid field envelope index");
+        ruFree(*index);
+        return DVE_PROTOCOL_ERROR;
+    }
+    *count = n;
+    return RUE_OK;
+}
+
+/*
+ * Decrypts a field recipe and verifies that it is field pos of the envelope
+ * with the given id.
+ */
+static int32_t decryptField(dvkey key, dvdict dicts, trans_chars recipe,
+                            trans_chars id, rusize pos, char** value) {
+    char tag[ENVELOPE_ID_LEN + 24];
+    alloc_chars text = NULL;
+    int32_t ret = dvAes256DecKey(key, dicts, recipe, &text, NULL);
+    if (ret != RUE_OK) return ret;
+    int tagLen = snprintf(tag, sizeof(tag), "%.*s:%d%c", ENVELOPE_ID_LEN, id,
+                          (int)pos, FIELD_EQ);
+    if (strncmp(text, tag, (size_t)tagLen)) {
+        dvSetError("field %d holds data of another field or envelope",
+                   (int)pos);
+        ret = DVE_PROTOCOL_ERROR;
+    } else {
+        *value = ruStrDup(text + tagLen);
+    }
+    mbedtls_platform_zeroize(text, strlen(text));
+    ruFree(text);
+    return ret;
+}
+
+/*
+ * Returns the start of the recipes of the envelope.
+ */
+static int32_t envelopeFields(const char* envelope, char* cs,
+                              perm_chars* fields) {
+    perm_chars p = envelope + ENVELOPE_NAME_LEN;
+    perm_chars colon = strchr(p, ':');
+    if (!colon || colon - p > 2) {
+        dvSetError("invalid field envelope");
+        return DVE_PROTOCOL_ERROR;
+    }
+    if (cs) memcpy(cs, p, (size_t)(colon - p));
+    *fields = colon + 1;
+    return RUE_OK;
+}
+
+/*
+ * Checks that the envelope holds one recipe per name of the index.
+ */
+static int32_t countFields(perm_chars p, rusize count) {
+    rusize n = *p? 1 : 0;
+    for (; *p; p++) {
+        if (*p == FIELD_SEP) n++;
+    }
+    if (n != count) {
+        dvSetError("envelope holds %d instead of %d fields", (int)n,
+                   (int)count);
+        return DVE_PROTOCOL_ERROR;
+    }
+    return RUE_OK;
+}
+
+/**
+ * Decrypts the named field of an envelope only. Besides the field just the
+ * index gets decrypted.
+ * @param key The key to decrypt with.
+ * @param dicts The dictionaries compressed fields may need.
+ * @param envelope The field envelope.
+ * @param name The name of the field.
+ * @param value Where the value of the field will be stored.
+ * @return RUE_OK on success, RUE_FILE_NOT_FOUND if there is no such field.
+ */
+int32_t decryptEnvelopeField(dvkey key, dvdict dicts, const char* envelope,
+                             const char* name, char** value) {
+    if (!key || !envelope || !name || !value) return RUE_PARAMETER_NOT_SET;
+    perm_chars p = NULL;
+    rusize count = 0, pos = 0, len = strlen(name);
+    alloc_chars index = NULL;
+    alloc_chars recipe = NULL;
+    int32_t ret = envelopeFields(envelope, NULL, &p);
+    if (ret == RUE_OK) ret = envelopeIndex(key, dicts, &p, &index, &count);
+    if (ret == RUE_OK) ret = countFields(p, count);
+    if (ret != RUE_OK) {
+        ruFree(index);
+        return ret;
+    }
+    // find the position of the name
+    ret = RUE_FILE_NOT_FOUND;
+    perm_chars n = index + ENVELOPE_ID_LEN;
+    for (; *n; pos++) {
+        n++;
+        perm_chars end = strchr(n, FIELD_SEP);
+        if (!end) end = n + strlen(n);
+        if ((rusize)(end - n) == len && !memcmp(n, name, len)) {
+            ret = RUE_OK;
+            break;
+        }
+        n = end;
+    }
+    for (rusize i = 0; ret == RUE_OK && i <= pos; i++) {
+        ret = nextRecipe(&p, &recipe);
+        if (ret == RUE_OK && i == pos) {
+            ret = decryptField(key, dicts, recipe, index, pos, value);
+        }
+        ruFree(recipe);
+    }
+    ruFree(index);
+    return ret;
+}
+
+/**
+ * Decrypts all fields of an envelope into a JSON object.
+ * @param key The key to decrypt with.
+ * @param dicts The dictionaries compressed fields may need.
+ * @param envelope The field envelope.
+ * @param data Where the JSON object will be stored.
+ * @param cs Optional buffer of 2 bytes receiving the checksum.
+ * @return RUE_OK on success
+ */
+int32_t decryptEnvelope(dvkey key, dvdict dicts, const char* envelope,
+                        char** data, char* cs) {
+    if (!key || !envelope || !data) return RUE_PARAMETER_NOT_SET;
+    perm_chars p = NULL;
+    rusize count = 0;
+    alloc_chars index = NULL;
+    alloc_chars recipe = NULL;
+    alloc_chars value = NULL;
+    ruJson jsn = NULL;
+    int32_t ret = envelopeFields(envelope, cs, &p);
+    if (ret == RUE_OK) ret = envelopeIndex(key, dicts, &p, &index, &count);
+    if (ret == RUE_OK) ret = countFields(p, count);
+    if (ret == RUE_OK) jsn = ruJsonStart(false);
+    // the names follow the id, each after a separator
+    char* name = ret == RUE_OK? index + ENVELOPE_ID_LEN + 1 : NULL;
+    for (rusize i = 0; ret == RUE_OK && i < count; i++) {
+        char* end = strchr(name, FIELD_SEP);
+        if (end) *end = '\0';
+        ret = nextRecipe(&p, &recipe);
+        if (ret == RUE_OK) {
+            ret = decryptField(key, dicts, recipe, index, i, &value);
+        }
+        ruFree(recipe);
+        if (ret != RUE_OK) break;
+        ret = ruJsonSetKeyStr(jsn, name, value);
+        mbedtls_platform_zeroize(value, strlen(value));
+        ruFree(value);
+        if (end) name = end + 1;
+    }
+    if (ret == RUE_OK) {
+        perm_chars str = NULL;
+        ret = ruJsonWrite(jsn, &str);
+        if (ret == RUE_OK) *data = ruStrDup(str);
+    }
+    ruJsonFree(jsn);
+    ruFree(index);
+    return ret;
+}
@@ -30,130 +30,238 @@ ruJson getJson(trans_chars json) {
     return jsn;
 }
 
-int32_t parseStatus(ruJson jsn, bool* invalidRequest) {
-    int32_t ret = RUE_PARAMETER_NOT_SET;
-    if (!jsn) return ret;
+/*
+ * Maps the status of a response to an error code. codeRet tells whether the
+ * response included a code.
+ */
+static int32_t checkStatus(perm_chars status, int32_t codeRet, int64_t code,
+                           perm_chars desc, bool* invalidRequest) {
+    int32_t ret;
     if (invalidRequest) *invalidRequest = true;
 
-    perm_chars strVal = ruJsonKeyStr(jsn, STATUS, &ret);
-    if (!strVal) {
+    if (!status) {
         ruCritLog("no status specified");
         return DVE_PROTOCOL_ERROR;
     }
-    if (ruStrEquals(STATUS_OK, strVal)) {
+    if (ruStrEquals(STATUS_OK, status)) {
         // status: OK
         return RUE_OK;
     }
 
     /* not ok get the error code */
-    int32_t code = (int32_t)ruJsonKeyInt(jsn, "code", &ret);
-    if (ret != RUE_OK) {
+    if (codeRet != RUE_OK) {
         ruCritLog("status not ok and no ec set");
         ret = DVE_PROTOCOL_ERROR;
     } else {
-        ret = code;
+        ret = (int32_t)code;
     }
-    perm_chars desc = ruJsonKeyStr(jsn, "desc", NULL);
     if (desc) {
         dvSetError(desc);
     }
-    if (ruStrEquals(STATUS_INVALID, strVal)) {
+    if (ruStrEquals(STATUS_INVALID, status)) {
         ruVerbLogf("status was invalid. EC: %d", ret);
         if (invalidRequest) *invalidRequest = true;
         return ret;
     }
-    if (ruStrEquals(STATUS_ERROR, strVal)) {
-        ruCritLogf("status was of unknown type: '%s'", strVal);
+    if (ruStrEquals(STATUS_ERROR, status)) {
+        ruCritLogf("status was of unknown type: '%s'", status);
     }
     return ret;
 }
 
-int32_t parseVidData(alloc_bytes key, ruJson jsn, ruList vids, bool recode,
-                     ruMap* data) {
-    int32_t ret = RUE_OK;
-    if (!jsn || !vids || !data) return RUE_PARAMETER_NOT_SET;
+int32_t parseStatus(ruJson jsn, bool* invalidRequest) {
+    int32_t ret = RUE_PARAMETER_NOT_SET;
+    if (!jsn) return ret;
+    perm_chars status = ruJsonKeyStr(jsn, STATUS, &ret);
+    int64_t code = ruJsonKeyInt(jsn, "code", &ret);
+    return checkStatus(status, ret, code, ruJsonKeyStr(jsn, "desc", NULL),
+                       invalidRequest);
+}
 
-    ruVerbLog("Starting");
-    ruJson jdat = ruJsonKeyMap(jsn, "data", NULL);
-    if (!jdat) {
-        ruWarnLog("response did not include data key");
-        return DVE_PROTOCOL_ERROR;
+/*
+ * Like parseStatus for a response parsed with parseVaultResp.
+ */
+int32_t vaultRespStatus(const struct dv_vault_resp* vr, bool* invalidRequest) {
+    if (!vr) return RUE_PARAMETER_NOT_SET;
+    alloc_chars status = jstrScratch(&vr->status);
+    alloc_chars desc = jstrScratch(&vr->desc);
+    int32_t ret = checkStatus(status, vr->hasCode? RUE_OK : RUE_FILE_NOT_FOUND,
+                              vr->code, desc, invalidRequest);
+    scratchFree(desc);
+    scratchFree(status);
+    return ret;
+}
+
+/*
+ * The requested vids, each is removed when its entry is seen.
+ */
+static ruMap newWantSet(const char* const* vids, rusize count) {
+    ruMap want = ruMapNew(ruTypeStrRef(), NULL);
+    for (rusize i = 0; i < count; i++) {
+        ruMapPut(want, vids[i], NULL);
     }
+    return want;
+}
+
+static bool wantEntry(ruMap want, perm_chars vid) {
+    if (ruMapRemove(want, vid, NULL) == RUE_OK) return true;
+    ruWarnLogf("response included unrequested or repeated entry '%s'", vid);
+    return false;
+}
 
+static void warnMissing(ruMap want, const char* const* vids, rusize count) {
+    if (!ruMapSize(want, NULL)) return;
+    for (rusize i = 0; i < count; i++) {
+        if (ruMapHas(want, vids[i], NULL)) {
+            ruWarnLogf("response did not include entry for '%s'", vids[i]);
+        }
+    }
+}
+
+/*
+ * Adds the get result of one entry of the data object to the map, which
+ * takes over vid, or to the result set when given. With a rawLen cipher is
+ * a recipe with a binary payload, which is always decrypted right away.
+ */
+static int32_t parseVidEntry(dvkey key, dvdict dicts, alloc_chars vid,
+                             perm_chars nodeValue, perm_chars cipher,
+                             rusize rawLen, bool recode,
+                             struct dv_lazy_key* lazy, ruMap* data,
+                             dvresults rs) {
+    int32_t ret = RUE_OK, status = RUE_OK;
     char *msg = NULL;
     dvGetRes gr = NULL;
-    ruIterator li = ruListIter(vids);
-    for (char* vid = ruIterNext(li, char*); vid; vid = ruIterNext(li, char*)) {
-        ruJson jvd = ruJsonKeyMap(jdat, vid, NULL);
-        if (!jvd) {
-            ruWarnLogf("response did not include entry for '%s'", vid);
-            continue;
-        }
-        perm_chars nodeValue = ruJsonKeyStr(jvd, STATUS, NULL);
-        if (!nodeValue) {
-            ruCritLogf("no status specified for entry '%s'", vid);
-            ret = DVE_PROTOCOL_ERROR;
-            break;
-        }
 
-        if (!*data) {
-            *data = ruMapNew(ruTypeStrFree(),
-                                 ruTypePtr(freeGetRes));
-        }
+    if (!nodeValue) {
+        ruCritLogf("no status specified for entry '%s'", vid);
+        ruFree(vid);
+        return DVE_PROTOCOL_ERROR;
+    }
 
-        if (ruStrEquals(STATUS_NOT_FOUND, nodeValue)) {
-            ruVerbLogf("status for entry '%s' id not found", vid);
-            ret = ruMapPut(*data, ruStrDup(vid),
-                           newGetRes(NULL, RUE_FILE_NOT_FOUND));
-            if (ret != RUE_OK) {
-                ruCritLogf("failed adding entry '%s' to map", vid);
-                break;
-            }
-            continue;
-        }
-        if (!ruStrEquals(STATUS_OK, nodeValue)) {
-            ruWarnLogf("status for entry '%s' was '%s'", vid, nodeValue);
-            ret = DVE_PROTOCOL_ERROR;
-            break;
-        }
+    if (!rs && !*data) {
+        *data = ruMapNew(ruTypeStrFree(),
+                             ruTypePtr(freeGetRes));
+    }
 
-        perm_chars cipher = ruJsonKeyStr(jvd, "data", NULL);
+    if (ruStrEquals(STATUS_NOT_FOUND, nodeValue)) {
+        ruVerbLogf("status for entry '%s' id not found", vid);
+        status = RUE_FILE_NOT_FOUND;
+    } else if (!ruStrEquals(STATUS_OK, nodeValue)) {
+        ruWarnLogf("status for entry '%s' was '%s'", vid, nodeValue);
+        ruFree(vid);
+        return DVE_PROTOCOL_ERROR;
+    } else {
         if (!cipher) {
             ruCritLogf("no data specified for entry '%s'", vid);
-            continue;
+            ruFree(vid);
+            return RUE_OK;
         }
-        gr = NULL;
-        char rcs[3];
-        memset(rcs, 0, sizeof(rcs));
-        msg = NULL;
-        ret = dvAes256Dec(key, cipher, &msg, &rcs[0]);
-        if (ret == DVE_INVALID_CREDENTIALS) {
-            if (recode) {
-                // store the checksum
-                gr = newGetRes(ruStrDup(&rcs[0]), ret);
+        if (lazy && !rs && !rawLen) {
+            // decrypted by dvGetVid
+            gr = newGetRes(NULL, RUE_OK);
+            gr->recipe = ruStrDup(cipher);
+            gr->lazy = lazy;
+            lazy->refs++;
+        } else {
+            char rcs[3];
+            memset(rcs, 0, sizeof(rcs));
+            if (rawLen) {
+                status = dvAes256DecRaw(key, dicts, (trans_bytes)cipher,
+                                        rawLen, &msg, &rcs[0]);
             } else {
-                gr = newGetRes(NULL, ret);
+                status = dvAes256DecKey(key, dicts, cipher, &msg, &rcs[0]);
             }
-        } else {
-            if (ret != RUE_OK) {
-                ruWarnLogf("failed decrypting entry '%s' ec: %d", vid, ret);
-                break;
+            if (status == DVE_INVALID_CREDENTIALS) {
+                // store the checksum
+                if (recode) msg = ruStrDup(&rcs[0]);
+            } else if (status != RUE_OK) {
+                ruWarnLogf("failed decrypting entry '%s' ec: %d", vid, status);
+                ruFree(msg);
+                ruFree(vid);
+                return status;
             }
-            gr = newGetRes(msg, RUE_OK);
-            msg = NULL;
         }
+    }
+    if (rs) {
+        // the set keeps a copy in its arena
+        ret = resultSetPut(rs, vid, status, msg);
         ruFree(msg);
-        ret = ruMapPut(*data, ruStrDup(vid), gr);
-        if (ret != RUE_OK) {
-            ruCritLogf("failed adding entry '%s' to map", vid);
-            break;
+        ruFree(vid);
+        return ret;
+    }
+    if (!gr) gr = newGetRes(msg, status);
+    ret = ruMapPut(*data, vid, gr);
+    if (ret != RUE_OK) {
+        ruCritLogf("failed adding entry '%s' to map", vid);
+        freeGetRes(gr);
+        ruFree(vid);
+    }
+    return ret;
+}
+
+/*
+ * Decodes the entries of a parsed get response in the order they come.
+ * Entries that were not requested are skipped.
+ */
+static int32_t parseVaultEntries(dvkey key, dvdict dicts,
+                                 const struct dv_vault_resp* vr, ruMap want,
+                                 bool recode, struct dv_lazy_key* lazy,
+                                 ruMap* data, dvresults rs) {
+    int32_t ret = RUE_OK;
+    for (rusize i = 0; i < vr->entryCount && ret == RUE_OK; i++) {
+        const struct dv_vault_entry* e = &vr->entries[i];
+        alloc_chars vid = jstrDup(&e->vid);
+        if (!vid || !wantEntry(want, vid)) {
+            ruFree(vid);
+            continue;
+        }
+        alloc_chars status = jstrScratch(&e->status);
+        if (e->raw) {
+            // the payload is used right from the response
+            ret = parseVidEntry(key, dicts, vid, status,
+                                e->data.len? e->data.ptr : NULL, e->data.len,
+                                recode, lazy, data, rs);
+        } else {
+            alloc_chars cipher = jstrScratch(&e->data);
+            ret = parseVidEntry(key, dicts, vid, status, cipher, 0, recode,
+                                lazy, data, rs);
+            scratchFree(cipher);
         }
-        gr = NULL;
+        scratchFree(status);
     }
+    return ret;
+}
+
+/*
+ * Decodes the entries of a get response in the order they come. Entries
+ * that were not requested are skipped.
+ */
+int32_t parseVidData(dvkey key, dvdict dicts, trans_chars response,
+                     rusize len, const char* const* vids, rusize count,
+                     bool recode, struct dv_lazy_key* lazy, ruMap* data) {
+    int32_t ret = RUE_OK;
+    if (!response || !vids || !data) return RUE_PARAMETER_NOT_SET;
 
+    ruVerbLog("Starting");
+    struct dv_vault_resp vr;
+    ret = parseVaultResp(response, len, &vr);
+    if (ret != RUE_OK) return ret;
+    ruMap want = NULL;
+    do {
+        if (!vr.hasData) {
+            ruWarnLog("response did not include data key");
+            ret = DVE_PROTOCOL_ERROR;
+            break;
+        }
+        want = newWantSet(vids, count);
+        ret = parseVaultEntries(key, dicts, &vr, want, recode, lazy, data,
+                                NULL);
+        if (ret == RUE_OK) warnMissing(want, vids, count);
+    } while (false);
+
+    ruMapFree(want);
+    freeVaultResp(&vr);
     // clean up
-    if (gr) freeGetRes(gr);
-    ruFree(msg);
     if (ret != RUE_OK) {
         if(*data) {
             ruMapFree(*data);
@@ -164,32 +272,236 @@ int32_t parseVidData(alloc_bytes key, ruJson jsn, ruList vids, bool recode,
     return ret;
 }
 
-int32_t parseSearchData(ruJson jsn, ruList* vids) {
-    if (!jsn || !vids) return RUE_PARAMETER_NOT_SET;
+/*
+ * Parses a get response as it arrives. Every entry of the data object is
+ * decrypted as soon as its object is complete and its bytes are released.
+ * The rest of the response is small and parsed at the end. A MessagePack
+ * response is collected as it is and parsed at the end as a whole.
+ */
+struct dv_vid_scanner {
+    dvkey key;
+    dvdict dicts;
+    bool recode;
+    struct dv_lazy_key* lazy;
+    const char* const* vids;
+    rusize count;
+    ruMap want;             /* the requested vids not seen yet */
+    ruMap* data;
+    dvresults rs;           /* set instead of data */
+    ruString skeleton;      /* the response with an empty data object */
+    ruString entry;         /* the entry object being received */
+    ruString name;          /* the last key at the top or data level */
+    alloc_chars vid;        /* of the entry being received */
+    uint32_t depth;
+    bool inStr;
+    bool inName;
+    bool escaped;
+    bool inData;
+    bool inEntry;
+    char lastToken;         /* last structural char outside of strings */
+    int32_t ret;            /* why the download was aborted */
+    bool started;           /* the first byte was seen */
+    bool binary;            /* the response is MessagePack */
+    alloc_bytes bin;        /* the binary response so far */
+    rusize binLen;
+    rusize binCap;
+};
 
-    ruVerbLog("Starting");
-    ruJson jvids = ruJsonKeyArray(jsn, "vids", NULL);
-    if (!jvids) {
-        ruWarnLog("response did not include vids key");
-        return DVE_PROTOCOL_ERROR;
-    }
-    rusize i, last = ruJsonArrayLen(vids, NULL);
-    ruVerbLogf("number of vids: %d" , (int)last);
+int32_t newVidScanner(dvkey key, dvdict dicts, const char* const* vids,
+                      rusize count, bool recode, struct dv_lazy_key* lazy,
+                      ruMap* data, dvresults rs, dvVidScanner* scanner) {
+    if (!vids || !(data || rs) || !scanner) return RUE_PARAMETER_NOT_SET;
+    dvVidScanner vs = scratchAlloc(sizeof(struct dv_vid_scanner));
+    vs->key = key;
+    vs->dicts = dicts;
+    vs->recode = recode;
+    vs->lazy = lazy;
+    vs->data = data;
+    vs->rs = rs;
+    vs->vids = vids;
+    vs->count = count;
+    vs->want = newWantSet(vids, count);
+    vs->skeleton = ruStringNew("");
+    vs->entry = ruStringNew("");
+    vs->name = ruStringNew("");
+    *scanner = vs;
+    return RUE_OK;
+}
+
+static int32_t scanEntry(dvVidScanner vs) {
     int32_t ret = RUE_OK;
-    for (i = 0; i < last; i++) {
-        perm_chars vid = ruJsonIdxStr(vids, i, NULL);
-        if (!vid) {
-            ruWarnLog("array entry was no string");
+    if (wantEntry(vs->want, vs->vid)) {
+        struct dv_vault_resp vr;
+        ret = parseVaultResp(ruStringGetCString(vs->entry),
+                             ruStringLen(vs->entry, NULL), &vr);
+        if (ret != RUE_OK) return ret;
+        alloc_chars status = jstrScratch(&vr.status);
+        alloc_chars cipher = jstrScratch(&vr.data);
+        // the map takes over the vid
+        ret = parseVidEntry(vs->key, vs->dicts, vs->vid, status, cipher, 0,
+                            vs->recode, vs->lazy, vs->data, vs->rs);
+        vs->vid = NULL;
+        scratchFree(cipher);
+        scratchFree(status);
+        freeVaultResp(&vr);
+    }
+    ruStringReset(vs->entry);
+    ruFree(vs->vid);
+    return ret;
+}
+
+/*
+ * Appends the bytes from mark up to end to where they belong.
+ */
+static void scanFlush(dvVidScanner vs, trans_chars ptr, rusize mark,
+                      rusize end) {
+    if (end <= mark) return;
+    if (vs->inEntry) {
+        ruStringAppendn(vs->entry, ptr + mark, end - mark);
+    } else if (!vs->inData) {
+        ruStringAppendn(vs->skeleton, ptr + mark, end - mark);
+    }
+}
+
+int32_t vidScannerFeed(dvVidScanner vs, trans_chars ptr, rusize len) {
+    if (!vs || !ptr) return RUE_PARAMETER_NOT_SET;
+    if (vs->ret != RUE_OK) return vs->ret;
+    if (!vs->started && len) {
+        vs->started = true;
+        vs->binary = isMsgpack(ptr, len);
+    }
+    if (vs->binary) {
+        if (vs->binLen + len > vs->binCap) {
+            rusize cap = vs->binCap? vs->binCap : 4096;
+            while (cap < vs->binLen + len) cap *= 2;
+            vs->bin = scratchRealloc(vs->bin, vs->binCap, cap);
+            vs->binCap = cap;
+        }
+        memcpy(vs->bin + vs->binLen, ptr, len);
+        vs->binLen += len;
+        return RUE_OK;
+    }
+    rusize i, mark = 0;
+    for (i = 0; i < len; i++) {
+        char c = ptr[i];
+        if (vs->inStr) {
+            if (vs->escaped) {
+                vs->escaped = false;
+            } else if (c == '\\') {
+                vs->escaped = true;
+            } else if (c == '"') {
+                vs->inStr = false;
+                continue;
+            }
+            if (vs->inName) ruStringAppendn(vs->name, &c, 1);
             continue;
         }
-        if (!*vids) {
-            *vids = ruListNew(ruTypeStrFree());
+        switch (c) {
+            case '"':
+                vs->inStr = true;
+                // keys of the top and data objects
+                vs->inName = !vs->inEntry && (vs->lastToken == '{' ||
+                                              vs->lastToken == ',');
+                if (vs->inName) ruStringReset(vs->name);
+                break;
+            case '{':
+            case '[':
+                vs->depth++;
+                if (c == '{' && vs->lastToken == ':' && !vs->inEntry) {
+                    perm_chars name = ruStringGetCString(vs->name);
+                    if (vs->depth == 2 && !vs->inData &&
+                        ruStrEquals(name, "data")) {
+                        // drop the entries from the skeleton
+                        scanFlush(vs, ptr, mark, i + 1);
+                        vs->inData = true;
+                        mark = i + 1;
+                    } else if (vs->depth == 3 && vs->inData) {
+                        vs->vid = ruStrDup(name);
+                        vs->inEntry = true;
+                        mark = i;
+                    }
+                }
+                break;
+            case '}':
+            case ']':
+                if (!vs->depth) {
+                    dvSetError("Unbalanced response");
+                    vs->ret = DVE_PROTOCOL_ERROR;
+                    return vs->ret;
+                }
+                vs->depth--;
+                if (vs->inEntry && vs->depth == 2) {
+                    scanFlush(vs, ptr, mark, i + 1);
+                    mark = i + 1;
+                    vs->inEntry = false;
+                    vs->ret = scanEntry(vs);
+                    if (vs->ret != RUE_OK) return vs->ret;
+                } else if (vs->inData && vs->depth == 1) {
+                    vs->inData = false;
+                    mark = i;
+                }
+                break;
         }
-        ret = ruListAppend(*vids, ruStrDup(vid));
-        if (ret != RUE_OK) {
-            ruCritLogf("failed adding entry '%s' to list", vid);
-            break;
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            vs->lastToken = c;
+        }
+    }
+    scanFlush(vs, ptr, mark, len);
+    return RUE_OK;
+}
+
+rusize vidScannerWrite(char* ptr, rusize size, rusize nmemb, void* userdata) {
+    rusize len = size * nmemb;
+    if (vidScannerFeed((dvVidScanner)userdata, ptr, len) != RUE_OK) return 0;
+    return len;
+}
+
+/*
+ * Checks the rest of the response once the request given by ret is done.
+ * The map is freed on error like parseVidData does.
+ */
+int32_t vidScannerFinish(dvVidScanner vs, int32_t ret) {
+    if (!vs) return RUE_PARAMETER_NOT_SET;
+    // why the scanner aborted the request
+    if (vs->ret != RUE_OK) ret = vs->ret;
+    if (ret == RUE_OK && (vs->depth || vs->inStr)) {
+        dvSetError("Response ended prematurely");
+        ret = DVE_PROTOCOL_ERROR;
+    }
+    if (ret == RUE_OK) {
+        struct dv_vault_resp vr;
+        if (vs->binary) {
+            ret = parseVaultResp((trans_chars)vs->bin, vs->binLen, &vr);
+        } else {
+            ret = parseVaultResp(ruStringGetCString(vs->skeleton),
+                                 ruStringLen(vs->skeleton, NULL), &vr);
+        }
+        if (ret == RUE_OK) ret = vaultRespStatus(&vr, NULL);
+        if (ret == RUE_OK && !vr.hasData) {
+            ruWarnLog("response did not include data key");
+            ret = DVE_PROTOCOL_ERROR;
+        }
+        if (ret == RUE_OK && vs->binary) {
+            ret = parseVaultEntries(vs->key, vs->dicts, &vr, vs->want,
+                                    vs->recode, vs->lazy, vs->data, vs->rs);
         }
+        freeVaultResp(&vr);
+        if (ret == RUE_OK) warnMissing(vs->want, vs->vids, vs->count);
+    }
+    if (ret != RUE_OK && vs->data && *vs->data) {
+        ruMapFree(*vs->data);
+        *vs->data = NULL;
     }
     return ret;
 }
+
+void freeVidScanner(dvVidScanner vs) {
+    if (!vs) return;
+    ruMapFree(vs->want);
+    ruStringFree(vs->skeleton, false);
+    ruStringFree(vs->entry, false);
+    ruStringFree(vs->name, false);
+    ruFree(vs->vid);
+    scratchFree(vs->bin);
+    scratchFree(vs);
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+#include <mbedtls/platform_util.h>
+
+/*
+ * Publish passwords and foreign app-ids are used over and over again, so the
+ * context keeps their keys with both AES schedules ready. Entries are found
+ * by the derived key, which is the digest of the secret.
+ */
+
+void initKey(dvkey k, trans_bytes key) {
+    memset(k, 0, sizeof(struct dv_key));
+    memcpy(k->key, key, sizeof(k->key));
+}
+
+/**
+ * Returns the schedule of the given key for the given direction, preparing
+ * it on first use.
+ * @param k The key to work with.
+ * @param mode MBEDTLS_AES_ENCRYPT or MBEDTLS_AES_DECRYPT.
+ * @return The schedule or NULL on failure.
+ */
+dvAesKey keySchedule(dvkey k, int mode) {
+    bool enc = mode == MBEDTLS_AES_ENCRYPT;
+    bool* ready = enc? &k->encReady : &k->decReady;
+    struct dv_aes_key* ak = enc? &k->enc : &k->dec;
+    if (*ready) return ak;
+    int r = cryptoProvider()->aesSetKey(ak, k->key, mode);
+    if (r) {
+        dvSetError("Failed setting crypto key. EC: %d", r);
+        return NULL;
+    }
+    *ready = true;
+    return ak;
+}
+
+void clearKey(dvkey k) {
+    const struct dv_crypto_provider* cp = cryptoProvider();
+    if (k->encReady) cp->aesFree(&k->enc);
+    if (k->decReady) cp->aesFree(&k->dec);
+    mbedtls_platform_zeroize(k, sizeof(struct dv_key));
+}
+
+static int32_t prepareKey(dvkey k, trans_bytes key) {
+    initKey(k, key);
+    if (!keySchedule(k, MBEDTLS_AES_ENCRYPT) ||
+        !keySchedule(k, MBEDTLS_AES_DECRYPT)) {
+        clearKey(k);
+        return RUE_GENERAL;
+    }
+    return RUE_OK;
+}
+
+/**
+ * Looks the key up in the cache of the context, preparing it if needed.
+ * Release it with \ref putKey.
+ * @param ctx The context to work with.
+ * @param key The 32 byte key.
+ * @param k Where the prepared key will be stored.
+ * @return RUE_OK on success
+ */
+int32_t getKey(dvctx ctx, trans_bytes key, dvkey* k) {
+    if (!ctx || !key || !k) return RUE_PARAMETER_NOT_SET;
+    int32_t ret = RUE_OK;
+    dvkey victim = NULL;
+
+    ruMutexLock(ctx->keyMutex);
+    do {
+        for (int i = 0; i < KEY_CACHE_SIZE; i++) {
+            dvkey e = &ctx->keys[i];
+            if (e->cached && !memcmp(e->key, key, sizeof(e->key))) {
+                victim = e;
+                break;
+            }
+            // keys in use stay put, otherwise take a free or the oldest slot
+            if (e->refs) continue;
+            if (!victim || !e->cached ||
+                (victim->cached && e->lastUse < victim->lastUse)) {
+                victim = e;
+            }
+        }
+        if (!victim) {
+            // all in use, hand out a key of its own
+            victim = ruMalloc0(1, struct dv_key);
+            ret = prepareKey(victim, key);
+            if (ret != RUE_OK) ruFree(victim);
+            break;
+        }
+        if (!victim->cached || memcmp(victim->key, key, sizeof(victim->key))) {
+            clearKey(victim);
+            ret = prepareKey(victim, key);
+            if (ret != RUE_OK) break;
+            victim->cached = true;
+        }
+        victim->refs++;
+        victim->lastUse = ++ctx->keyTick;
+    } while (false);
+    ruMutexUnlock(ctx->keyMutex);
+
+    if (ret == RUE_OK) *k = victim;
+    return ret;
+}
+
+/**
+ * Like \ref getKey for the key derived from a publish password or app-id.
+ * @param ctx The context to work with.
+ * @param secret The password or app-id.
+ * @param k Where the prepared key will be stored.
+ * @return RUE_OK on success
+ */
+int32_t getSecretKey(dvctx ctx, const char* secret, dvkey* k) {
+    uint8_t key[32];
+    int32_t ret = mkKey(secret, key, NULL);
+    if (ret == RUE_OK) ret = getKey(ctx, key, k);
+    mbedtls_platform_zeroize(key, sizeof(key));
+    return ret;
+}
+
+void putKey(dvctx ctx, dvkey k) {
+    if (!ctx || !k) return;
+    if (!k->cached) {
+        clearKey(k);
+        ruFree(k);
+        return;
+    }
+    ruMutexLock(ctx->keyMutex);
+    k->refs--;
+    ruMutexUnlock(ctx->keyMutex);
+}
+
+void freeKeyCache(dvctx ctx) {
+    if (!ctx->keys) return;
+    for (int i = 0; i < KEY_CACHE_SIZE; i++) {
+        clearKey(&ctx->keys[i]);
+    }
+    ruFree(ctx->keys);
+    ctx->keyMutex = ruMutexFree(ctx->keyMutex);
+}
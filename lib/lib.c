@@ -62,7 +62,7 @@ static int32_t setIntOrDefault(const char* value, int64_t defaultNum,
     return RUE_OK;
 }
 
-static int32_t encodeWordList(ruList wordLst, ruJson jsn, trans_chars key) {
+int32_t encodeWordList(ruList wordLst, ruJson jsn, trans_chars key) {
     bool started = false;
     int32_t ret;
     ruIterator li = ruListHead(wordLst, &ret);
@@ -84,74 +84,111 @@ static int32_t encodeWordList(ruList wordLst, ruJson jsn, trans_chars key) {
     return ret;
 }
 
-static int32_t dvPost(dvCtx dc, const char* data, char** vid, ruList indexWords,
-                      const char* passwd, int durationDays) {
+/*
+ * Encrypts data or, when fields are given, the field envelope of the record.
+ * For the cache plain is set to the record as the vault returns it.
+ */
+static int32_t encryptPid(dvctx ctx, dvkey key, const char* cs,
+                          const char* data, const struct dv_fields* fields,
+                          char** cipher, char** plain) {
+    if (fields) {
+        return encodeFields(key, cs, fields, ctx->recipe, ctx->codec,
+                            ctx->dict, cipher, plain);
+    }
+    return dvAes256EncKey(key, cs, data, ctx->recipe, ctx->codec,
+                          ctx->dict, cipher);
+}
+
+/*
+ * Sanity checks a cipher recipe made by dvEncryptRecord.
+ */
+static int32_t checkCipher(const char* cipherText) {
+    if (isEnvelope(cipherText)) return RUE_OK;
+    uint8_t iv[BLOCKSIZE];
+    enum dvRecipe recipe;
+    enum dvCodec codec;
+    uint32_t dictId;
+    perm_chars payload = NULL;
+    rusize payloadLen = 0;
+    int32_t ret = parseRecipe(cipherText, &recipe, iv, NULL, &codec, &dictId,
+                              &payload, &payloadLen);
+    return ret == RUE_OK? RUE_OK : RUE_INVALID_PARAMETER;
+}
 
-    if (!dc || !data || !vid) return RUE_PARAMETER_NOT_SET;
+/*
+ * Stores data, fields or the ready cipherText, in which case data is
+ * optional and only written to the cache.
+ */
+static int32_t dvPost(dvCtx dc, const char* data,
+                      const struct dv_fields* fields, const char* cipherText,
+                      char** vid, ruList indexWords, const char* passwd,
+                      int durationDays) {
+
+    if (!dc || !(data || fields || cipherText) || !vid) {
+        return RUE_PARAMETER_NOT_SET;
+    }
     dvctx ctx = getDvCtx(dc);
     if (!ctx) return RUE_INVALID_PARAMETER;
 
     perm_chars op = "add";
     int32_t ret;
-    alloc_bytes key = ctx->key;
     perm_chars cs = ctx->appIdEnd;
-    uint8_t pubkey[32];
 
     // to free
-    ruJson jrq = NULL;
+    dvkey key = NULL;
+    struct dv_req rq;
     ruJson jsn = NULL;
-    dvKvList kvl = NULL;
     alloc_chars jsnData = NULL;
     alloc_chars response = NULL;
     alloc_chars cipher = NULL;
+    alloc_chars plain = NULL;
+    memset(&rq, 0, sizeof(rq));
+    scratchBegin();
 
     do {
         if (passwd) {
             if (durationDays < 1 || durationDays > 365) {
                 ruWarnLogf("Duration dayse must be between 1 and 365 but is %d",
                            durationDays);
-                return RUE_INVALID_PARAMETER;
+                ret = RUE_INVALID_PARAMETER;
+                break;
             }
             op = "publish";
             cs = "";
-            ret = mkKey(passwd, pubkey, NULL);
+            ret = getSecretKey(ctx, passwd, &key);
             if (ret != RUE_OK) {
                 ruCritLogf("failed deriving key from publish password. Ec: %d", ret);
                 break;
             }
-            key = pubkey;
+        } else if (!cipherText) {
+            ret = getKey(ctx, ctx->key, &key);
+            if (ret != RUE_OK) break;
         }
 
-        ret = dvAes256Enc(key, cs, data, &cipher);
-        if (ret != RUE_OK) {
-            ruCritLogf("failed to encrypt data. Ec: %d", ret);
-            break;
+        if (cipherText) {
+            ret = checkCipher(cipherText);
+            if (ret != RUE_OK) break;
+        } else {
+            ret = encryptPid(ctx, key, cs, data, fields, &cipher, &plain);
+            if (ret != RUE_OK) {
+                ruCritLogf("failed to encrypt data. Ec: %d", ret);
+                break;
+            }
+            if (plain) data = plain;
+            cipherText = cipher;
         }
 
-        jrq = ruJsonStart(true);
-        ruJsonSetKeyInt(jrq, "version", PROTO_VERSION);
-        ruJsonSetKeyStr(jrq, "op", op);
-        ruJsonSetKeyStr(jrq, "data", cipher);
+        newReq(ctx, &rq, op);
+        reqAddStr(&rq, "data", cipherText);
 
         if (passwd) {
-            ruJsonSetKeyInt(jrq, "duration", durationDays);
+            reqAddInt(&rq, "duration", durationDays);
         }
         if (indexWords) {
-            ret = encodeWordList(indexWords, jrq, "words");
+            ret = reqAddList(&rq, "words", indexWords);
             if (ret != RUE_OK) break;
         }
-        perm_chars str =  NULL;
-        ret = ruJsonWrite(jrq, &str);
-        if (ret != RUE_OK) break;
-
-        ret = newKvList(&kvl, JSON_FIELD, str, 0);
-        if (ret != RUE_OK) {
-            ruCritLogf("failed to create parameter list. Ec: %d", ret);
-            break;
-        }
-        ruVerbLogf("Do request: %s", str);
-        ret = doRequest(ctx, ctx->serviceUrl, kvl,
-                        &response, NULL);
+        ret = reqSend(ctx, &rq, &response, NULL);
         if (ret != RUE_OK) {
             ruCritLogf("failed to add data to %s. Ec: %d", ctx->serviceUrl, ret);
             break;
@@ -166,62 +203,95 @@ static int32_t dvPost(dvCtx dc, const char* data, char** vid, ruList indexWords,
         if (ret != RUE_OK) {
             break;
         }
-        ret = STORE(ctx, *vid, data);
+        if (data) ret = STORE(ctx, *vid, data);
 
     } while(0);
 
-    ruJsonFree(jrq);
+    putKey(ctx, key);
+    freeReq(ctx, &rq);
     ruJsonFree(jsn);
-    freeKvList(kvl);
-    ruFree(response);
+    scratchFree(response);
     ruFree(cipher);
+    ruFree(plain);
     ruFree(jsnData);
+    scratchEnd();
     return ret;
 }
 
-static int32_t doGet(dvCtx dc, ruList vids, ruMap* data, trans_chars passwd,
+/*
+ * Points an array at the entries of the given list. Free it with
+ * scratchFree.
+ */
+static int32_t listArray(ruList list, perm_chars** items, rusize* count) {
+    int32_t ret;
+    rusize size = ruListSize(list, &ret);
+    if (ret != RUE_OK) {
+        dvSetError("Failed getting list size ec:%d", ret);
+        return ret;
+    }
+    perm_chars* arr = scratchAlloc((size? size : 1) * sizeof(perm_chars));
+    rusize i = 0;
+    ruIterator li = ruListIter(list);
+    for (perm_chars item = ruIterNext(li, char*); item && i < size;
+         item = ruIterNext(li, char*)) {
+        arr[i++] = item;
+    }
+    *items = arr;
+    *count = i;
+    return RUE_OK;
+}
+
+/*
+ * Gets the given vids into the data map or, when given, the result set.
+ */
+static int32_t doGet(dvCtx dc, const char* const* vids, rusize count,
+                     ruMap* data, dvresults rs, trans_chars passwd,
                      bool recode) {
 
-    if (!dc || !vids || !data) return RUE_PARAMETER_NOT_SET;
+    if (!dc || !vids || !(data || rs)) return RUE_PARAMETER_NOT_SET;
     dvctx ctx = getDvCtx(dc);
     if (!ctx) return RUE_INVALID_PARAMETER;
 
     int32_t ret = RUE_OK;
-    alloc_bytes key = ctx->key;
-    uint8_t pubkey[32];
 
     // to free
-    char *response = NULL;
-    dvKvList kvl = NULL;
-    ruJson jsn = NULL;
-    ruJson jrq = NULL;
-    ruList getvids = NULL;
+    dvkey key = NULL;
+    struct dv_req rq;
+    perm_chars* getvids = NULL;
+    rusize getCount = 0;
+    struct dv_lazy_key* lazy = NULL;
+    dvVidScanner vs = NULL;
+    struct dv_req_io io;
+    memset(&io, 0, sizeof(io));
+    memset(&rq, 0, sizeof(rq));
+    scratchBegin();
 
     do {
-        if (!*data) {
+        if (!rs && !*data) {
             *data = ruMapNew(ruTypeStrFree(),
                                  ruTypePtr(freeGetRes));
         }
 
         // first check the cache
-        ruIterator li = ruListHead(vids, &ret);
-        if (ret != RUE_OK) {
-            dvSetError("Failed getting vid list iterator. ec: %d", ret);
-            break;
-        }
-        for (char* vid = ruIterNext(li, char*); vid;
-             vid = ruIterNext(li, char*)) {
+        for (rusize i = 0; i < count; i++) {
+            perm_chars vid = vids[i];
             char* dt = NULL;
             rusize len = 0;
             LOAD(ctx, vid, &dt, &len);
             if (!dt) {
                 if (!getvids) {
-                    getvids = ruListNew(NULL);
+                    getvids = scratchAlloc(count * sizeof(perm_chars));
                 }
-                ruListAppend(getvids, vid);
+                getvids[getCount++] = vid;
                 continue;
             }
             // we have it
+            if (rs) {
+                ret = resultSetPut(rs, vid, RUE_OK, dt);
+                ruFree(dt);
+                if (ret != RUE_OK) break;
+                continue;
+            }
             ret = ruMapPut(*data, ruStrDup(vid),
                            newGetRes(dt, RUE_OK));
             if (ret != RUE_OK) {
@@ -236,60 +306,75 @@ static int32_t doGet(dvCtx dc, ruList vids, ruMap* data, trans_chars passwd,
         const char *op = "get";
         if (passwd) {
             op = "getpublished";
-            ret = mkKey(passwd, pubkey, NULL);
+            ret = getSecretKey(ctx, passwd, &key);
             if (ret != RUE_OK) {
                 ruCritLogf("failed deriving key from publish password. Ec: %d", ret);
                 break;
             }
-            key = pubkey;
+        } else {
+            ret = getKey(ctx, ctx->key, &key);
+            if (ret != RUE_OK) break;
         }
 
-        jrq = ruJsonStart(true);
-        ruJsonSetKeyInt(jrq, "version", PROTO_VERSION);
-        ruJsonSetKeyStr(jrq, "op", op);
-
-        ret = encodeWordList(getvids, jrq, "vid");
-        if (ret != RUE_OK) break;
-        perm_chars str =  NULL;
-        ret = ruJsonWrite(jrq, &str);
-        if (ret != RUE_OK) break;
-
-        ret = newKvList(&kvl, JSON_FIELD, str, 0);
-        if (ret != RUE_OK) {
-            ruCritLogf("failed to create parameter list. Ec: %d", ret);
-            break;
+        probeProtocol(ctx);
+        newReq(ctx, &rq, op);
+        reqAddArray(&rq, "vid", getvids, getCount);
+        io.body = reqBody(&rq, &io.bodyLen);
+        // entries are decrypted as they arrive
+        if (ctx->lazyGet && !recode && !rs) {
+            lazy = newLazyKey(key, ctx->dicts);
         }
-        ruVerbLogf("Do request: %s", str);
-        ret = doRequest(ctx, ctx->serviceUrl, kvl,
-                        &response, NULL);
+        ret = newVidScanner(key, ctx->dicts, getvids, getCount, recode, lazy,
+                            data, rs, &vs);
+        if (ret != RUE_OK) break;
+        io.write = vidScannerWrite;
+        io.writeCtx = vs;
+        ruVerbLogf("Do request: %s", io.body);
+        ret = doStreamRequest(ctx, ctx->serviceUrl, NULL, &io, NULL, NULL);
+        ret = vidScannerFinish(vs, ret);
         if (ret != RUE_OK) {
             ruCritLogf("failed to get data from %s. Ec: %d",
                        ctx->serviceUrl, ret);
             break;
         }
-        // parse response
-        jsn = getJson(response);
-        ret = parseStatus(jsn, NULL);
-        if (ret != RUE_OK) {
-            break;
-        }
-        // load/decrypt
-        ret = parseVidData(key, jsn, getvids, recode, data);
     } while(0);
 
-    ruJsonFree(jrq);
-    ruJsonFree(jsn);
-    freeKvList(kvl);
-    ruFree(response);
-    ruListFree(getvids);
+    freeVidScanner(vs);
+    putLazyKey(lazy);
+    putKey(ctx, key);
+    freeReq(ctx, &rq);
+    scratchFree(getvids);
+    scratchEnd();
 
     return ret;
 }
 
+/*
+ * doGet with the vids of a list.
+ */
+static int32_t doGetList(dvCtx dc, ruList vids, ruMap* data,
+                         trans_chars passwd, bool recode) {
+    if (!dc || !vids || !data) return RUE_PARAMETER_NOT_SET;
+    perm_chars* arr = NULL;
+    rusize count = 0;
+    scratchBegin();
+    int32_t ret = listArray(vids, &arr, &count);
+    if (ret == RUE_OK) ret = doGet(dc, arr, count, data, NULL, passwd, recode);
+    scratchFree(arr);
+    scratchEnd();
+    return ret;
+}
+
+/*
+ * Updates with data, fields or the ready cipherText like dvPost.
+ */
 static int32_t doUpdate(dvCtx dc, const char* vid, const char* data,
+                        const struct dv_fields* fields, const char* cipherText,
                         ruList indexWords, const char* appid) {
 
-    if (!dc || !vid || !data) return RUE_PARAMETER_NOT_SET;
+    if (!dc || !vid || !(data || fields || cipherText)) {
+        return RUE_PARAMETER_NOT_SET;
+    }
     dvctx ctx = getDvCtx(dc);
     if (!ctx) return RUE_INVALID_PARAMETER;
 
@@ -300,51 +385,50 @@ static int32_t doUpdate(dvCtx dc, const char* vid, const char* data,
     alloc_chars jdata = NULL;
     alloc_chars response = NULL;
     alloc_chars cipher = NULL;
-    dvKvList kvl = NULL;
+    alloc_chars plain = NULL;
+    struct dv_req rq;
     ruJson jsn = NULL;
-    ruJson jrq = NULL;
-    uint8_t mykey[32];
-    alloc_bytes key = ctx->key;
+    dvkey key = NULL;
     char *appIdEnd = ctx->appIdEnd;
+    memset(&rq, 0, sizeof(rq));
+    scratchBegin();
 
     do {
-        ruVerbLogf("updating vid '%s' with '%s'", vid, data);
+        ruVerbLogf("updating vid '%s' with '%s'", vid,
+                   data? data : cipherText? cipherText : "fields");
 
-        if (appid) {
-            // use another app id
-            ret = mkKey(appid, mykey, &appIdEnd);
+        if (cipherText) {
+            ret = checkCipher(cipherText);
+            if (ret != RUE_OK) break;
+        } else {
+            if (appid) {
+                // use another app id
+                ret = getCs(appid, strlen(appid), &appIdEnd);
+                if (ret) break;
+                ret = getSecretKey(ctx, appid, &key);
+            } else {
+                ret = getKey(ctx, ctx->key, &key);
+            }
             if (ret) break;
-            key = &mykey[0];
-        }
 
-        ret = dvAes256Enc(key, appIdEnd, data,
-                          &cipher);
-        if (ret != RUE_OK) {
-            ruCritLogf("failed to encrypt data. Ec: %d", ret);
-            break;
+            ret = encryptPid(ctx, key, appIdEnd, data, fields, &cipher,
+                             &plain);
+            if (ret != RUE_OK) {
+                ruCritLogf("failed to encrypt data. Ec: %d", ret);
+                break;
+            }
+            if (plain) data = plain;
+            cipherText = cipher;
         }
 
-        jrq = ruJsonStart(true);
-        ruJsonSetKeyInt(jrq, "version", PROTO_VERSION);
-        ruJsonSetKeyStr(jrq, "op", "update");
-        ruJsonSetKeyStr(jrq, "vid", vid);
-        ruJsonSetKeyStr(jrq, "data", cipher);
+        newReq(ctx, &rq, "update");
+        reqAddStr(&rq, "vid", vid);
+        reqAddStr(&rq, "data", cipherText);
         if (indexWords) {
-            ret = encodeWordList(indexWords, jrq, "words");
+            ret = reqAddList(&rq, "words", indexWords);
             if (ret != RUE_OK) break;
         }
-        perm_chars str =  NULL;
-        ret = ruJsonWrite(jrq, &str);
-        if (ret != RUE_OK) break;
-
-        ret = newKvList(&kvl, JSON_FIELD, str, 0);
-        if (ret != RUE_OK) {
-            ruCritLogf("failed to create parameter list. Ec: %d", ret);
-            break;
-        }
-        ruVerbLogf("Do request: %s", str);
-        ret = doRequest(ctx, ctx->serviceUrl, kvl,
-                        &response, NULL);
+        ret = reqSend(ctx, &rq, &response, NULL);
         if (ret != RUE_OK) {
             ruCritLogf("failed to add data to %s. Ec: %d",
                        ctx->serviceUrl, ret);
@@ -356,18 +440,24 @@ static int32_t doUpdate(dvCtx dc, const char* vid, const char* data,
         if (ret != RUE_OK) {
             break;
         }
-        // update the cache
-        ret = STORE(ctx, vid, data);
+        // update the cache, drop what we can not update
+        if (data) {
+            ret = STORE(ctx, vid, data);
+        } else {
+            ret = ctx->store->set(ctx->store, vid, NULL, 0);
+        }
 
     } while(0);
 
-    jrq = ruJsonFree(jrq);
+    putKey(ctx, key);
+    freeReq(ctx, &rq);
     jsn = ruJsonFree(jsn);
-    freeKvList(kvl);
-    ruFree(response);
+    scratchFree(response);
     ruFree(jvid);
     ruFree(jdata);
     ruFree(cipher);
+    ruFree(plain);
+    scratchEnd();
 
     return ret;
 }
@@ -396,6 +486,9 @@ DVAPI int32_t dvNew(dvCtx* dc, const char* serviceUrl, const char* appId,
         ctx->type = dvctxType;
         ctx->appName = (char *) myName;
         ctx->appVersion = (char *) myVersion;
+        ctx->keys = ruMalloc0(KEY_CACHE_SIZE, struct dv_key);
+        ctx->keyMutex = ruMutexInit();
+        ctx->reqMutex = ruMutexInit();
 
         ret = setServiceUrl(ctx, serviceUrl);
         if (ret != RUE_OK) break;
@@ -448,6 +541,10 @@ DVAPI void dvFree(dvCtx dc) {
 
     if (ctx->appName != myName) ruFree(ctx->appName);
     if (ctx->appVersion != myVersion) ruFree(ctx->appVersion);
+    freeKeyCache(ctx);
+    freeDicts(ctx->dicts);
+    ruFree(ctx->reqBuf);
+    ctx->reqMutex = ruMutexFree(ctx->reqMutex);
     ruFree(ctx);
 }
 
@@ -487,112 +584,310 @@ DVAPI int32_t dvAddSearchWord(ruList* searchWords, const char* appId, const char
     return addSearchWord(searchWords, appId, word, false);
 }
 
+DVAPI int32_t dvAddIndexWords(ruList* indexWords, const char* appId,
+                              const char* const* words, size_t count) {
+    if (!appId || !indexWords || !words) return RUE_PARAMETER_NOT_SET;
+    if (!count) return RUE_OK;
+    int32_t ret;
+
+    char** terms = ruMalloc0(count, char*);
+    do {
+        ret = searchHashTerms(appId, words, count, terms, true);
+        if (ret != RUE_OK) break;
+
+        if (!*indexWords) {
+            *indexWords = ruListNew(ruTypeStrFree());
+        }
+        for (size_t i = 0; i < count; i++) {
+            ruVerbLogf("Adding term:'%s' for word:'%s' with appid:'%s'",
+                       terms[i], words[i], appId);
+            ret = ruListAppend(*indexWords, terms[i]);
+            if (ret != RUE_OK) {
+                dvSetError("failed adding term to search list. ec: %d", ret);
+                break;
+            }
+            terms[i] = NULL;
+        }
+    } while (false);
+
+    for (size_t i = 0; i < count; i++) {
+        ruFree(terms[i]);
+    }
+    ruFree(terms);
+
+    return ret;
+}
+
+DVAPI int32_t dvEncryptMany(dvCtx dc, const char* const* data, size_t count,
+                            char** cipherTexts) {
+    if (!dc || !data || !cipherTexts) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+    dvClearError();
+    return dvAes256EncMany(ctx->key, ctx->appIdEnd, data, count, ctx->recipe,
+                           ctx->codec, ctx->dict, cipherTexts);
+}
+
+DVAPI int32_t dvEncryptRecord(dvCtx dc, const char* data, char** cipherText) {
+    if (!dc || !data || !cipherText) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+    dvkey key = NULL;
+    int32_t ret = getKey(ctx, ctx->key, &key);
+    if (ret != RUE_OK) return ret;
+    ret = encryptPid(ctx, key, ctx->appIdEnd, data, NULL, cipherText, NULL);
+    putKey(ctx, key);
+    return ret;
+}
+
+DVAPI int32_t dvAddCipher(dvCtx dc, const char* cipherText, const char* data,
+                          ruList indexWords, char** vid) {
+    if (!cipherText) return RUE_PARAMETER_NOT_SET;
+    return dvPost(dc, data, NULL, cipherText, vid, indexWords, NULL, 0);
+}
+
 DVAPI int32_t dvAdd(dvCtx dc, const char* data, ruList indexWords, char** vid) {
-    return dvPost(dc, data, vid, indexWords, NULL, 0);
+    return dvPost(dc, data, NULL, NULL, vid, indexWords, NULL, 0);
+}
+
+DVAPI int32_t dvAddFields(dvCtx dc, const char* const* names,
+                          const char* const* values, size_t count,
+                          ruList indexWords, char** vid) {
+    if (!names || !values) return RUE_PARAMETER_NOT_SET;
+    struct dv_fields fields = {names, values, count};
+    return dvPost(dc, NULL, &fields, NULL, vid, indexWords, NULL, 0);
 }
 
 DVAPI int32_t dvPublish(dvCtx dc, const char* passwd, int durationDays,
                         const char* data, char** vid) {
     if (!passwd) return RUE_PARAMETER_NOT_SET;
-    return dvPost(dc, data, vid, NULL, passwd, durationDays);
+    return dvPost(dc, data, NULL, NULL, vid, NULL, passwd, durationDays);
 }
 
 DVAPI int32_t dvUpdate(dvCtx dc, const char* vid, const char* data,
                        ruList indexWords) {
-    return doUpdate(dc, vid, data, indexWords, NULL);
+    return doUpdate(dc, vid, data, NULL, NULL, indexWords, NULL);
+}
+
+DVAPI int32_t dvUpdateFields(dvCtx dc, const char* vid,
+                             const char* const* names,
+                             const char* const* values, size_t count,
+                             ruList indexWords) {
+    if (!names || !values) return RUE_PARAMETER_NOT_SET;
+    struct dv_fields fields = {names, values, count};
+    return doUpdate(dc, vid, NULL, &fields, NULL, indexWords, NULL);
+}
+
+DVAPI int32_t dvUpdateCipher(dvCtx dc, const char* vid,
+                             const char* cipherText, const char* data,
+                             ruList indexWords) {
+    if (!cipherText) return RUE_PARAMETER_NOT_SET;
+    return doUpdate(dc, vid, data, NULL, cipherText, indexWords, NULL);
 }
 
 DVAPI int32_t dvGet(dvCtx dc, ruList vids, ruMap* vidMap) {
-    return doGet(dc, vids, vidMap, NULL, false);
+    return doGetList(dc, vids, vidMap, NULL, false);
+}
+
+DVAPI int32_t dvGetCached(dvCtx dc, const char* vid, char* buf, size_t bufLen,
+                          size_t* len) {
+    if (!dc || !vid || !buf) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+    if (!bufLen) return RUE_INVALID_PARAMETER;
+
+    int32_t ret;
+    size_t plen = 0;
+    if (ctx->cacheRead) {
+        // keep room for the terminator
+        ret = ctx->cacheRead(ctx->cacheReadCtx, vid, buf, bufLen - 1, &plen);
+        if (ret == RUE_OK && plen >= bufLen) ret = RUE_OVERFLOW;
+    } else {
+        char* dt = NULL;
+        rusize dlen = 0;
+        LOAD(ctx, vid, &dt, &dlen);
+        ret = RUE_FILE_NOT_FOUND;
+        if (dt) {
+            plen = strlen(dt);
+            ret = plen < bufLen? RUE_OK : RUE_OVERFLOW;
+            if (ret == RUE_OK) memcpy(buf, dt, plen);
+            ruFree(dt);
+        }
+    }
+    if (ret == RUE_OK) buf[plen] = '\0';
+    if (len) *len = plen;
+    return ret;
+}
+
+DVAPI int32_t dvGetMany(dvCtx dc, const char* const* vids, size_t count,
+                        dvResultSet* rs) {
+    if (!dc || !vids || !rs) return RUE_PARAMETER_NOT_SET;
+    dvresults rr = NULL;
+    int32_t ret = newResultSet(vids, count, &rr);
+    if (ret != RUE_OK) return ret;
+    ret = doGet(dc, vids, count, NULL, rr, NULL, false);
+    if (ret != RUE_OK) {
+        dvResultSetFree(rr);
+        return ret;
+    }
+    *rs = rr;
+    return RUE_OK;
+}
+
+DVAPI int32_t dvGetSet(dvCtx dc, ruList vids, dvResultSet* rs) {
+    if (!dc || !vids || !rs) return RUE_PARAMETER_NOT_SET;
+    perm_chars* arr = NULL;
+    rusize count = 0;
+    scratchBegin();
+    int32_t ret = listArray(vids, &arr, &count);
+    if (ret == RUE_OK) ret = dvGetMany(dc, arr, count, rs);
+    scratchFree(arr);
+    scratchEnd();
+    return ret;
 }
 
 DVAPI int32_t dvGetPublished(dvCtx dc, const char* passwd, ruList vids,
                              ruMap* vidMap) {
     if (!passwd) return RUE_PARAMETER_NOT_SET;
-    return doGet(dc, vids, vidMap, passwd, false);
+    return doGetList(dc, vids, vidMap, passwd, false);
 }
 
-DVAPI int32_t dvSearch(dvCtx dc, ruList searchWords, ruList* vids) {
+/*
+ * Hands the vids of one search response to vidFn. Unescaped vids are
+ * terminated in place, the response is not used afterwards.
+ */
+static int32_t deliverVids(char* response, const struct dv_vault_resp* vr,
+                           dvVidFn vidFn, void* usrCtx) {
+    int32_t ret = RUE_OK;
+    for (rusize i = 0; i < vr->vidCount && ret == RUE_OK; i++) {
+        const struct dv_jstr* v = &vr->vids[i];
+        if (!v->esc) {
+            response[v->ptr - response + v->len] = '\0';
+            ret = vidFn(usrCtx, v->ptr);
+            continue;
+        }
+        alloc_chars vid = jstrScratch(v);
+        if (!vid) {
+            ruWarnLog("array entry was no valid string");
+            continue;
+        }
+        ret = vidFn(usrCtx, vid);
+        scratchFree(vid);
+    }
+    return ret;
+}
+
+DVAPI int32_t dvSearchEach(dvCtx dc, ruList searchWords, dvVidFn vidFn,
+                           void* usrCtx) {
     char *response = NULL;
-    dvKvList kvl = NULL;
-    ruJson jrq = NULL;
-    ruJson jsn = NULL;
+    struct dv_req rq;
+    struct dv_vault_resp vr;
     int32_t ret;
 
-    if (!dc || !searchWords || !vids) return RUE_PARAMETER_NOT_SET;
+    if (!dc || !searchWords || !vidFn) return RUE_PARAMETER_NOT_SET;
+    memset(&vr, 0, sizeof(vr));
+    memset(&rq, 0, sizeof(rq));
     dvctx ctx = getDvCtx(dc);
     if (!ctx) return RUE_INVALID_PARAMETER;
 
-    jrq = ruJsonStart(true);
-    ruJsonSetKeyInt(jrq, "version", PROTO_VERSION);
-    ruJsonSetKeyStr(jrq, "op", "search");
+    // to free
+    ruMap seen = NULL;
+    // owned by seen
+    perm_chars next = NULL;
+    rusize len = 0;
 
+    scratchBegin();
+    probeProtocol(ctx);
     do {
-        ret = encodeWordList(searchWords, jrq, "words");
-        if (ret != RUE_OK) break;
-        perm_chars str =  NULL;
-        ret = ruJsonWrite(jrq, &str);
+        newReq(ctx, &rq, "search");
+        ret = reqAddList(&rq, "words", searchWords);
         if (ret != RUE_OK) break;
-
-        ret = newKvList(&kvl, JSON_FIELD, str, 0);
-        if (ret != RUE_OK) {
-            ruCritLogf("failed to create parameter list. Ec: %d", ret);
-            break;
-        }
-        ruVerbLogf("Do request: %s", str);
-        ret = doRequest(ctx, ctx->serviceUrl, kvl,
-                        &response, NULL);
+        if (ctx->searchPage) reqAddInt(&rq, "limit", ctx->searchPage);
+        if (next) reqAddStr(&rq, "next", next);
+        ret = reqSend(ctx, &rq, &response, &len);
+        freeReq(ctx, &rq);
         if (ret != RUE_OK) {
             ruCritLogf("failed to search vids from %s. Ec: %d",
                        ctx->serviceUrl, ret);
             break;
         }
         // parse response
-        jsn = getJson(response);
-        ret = parseStatus(jsn, NULL);
+        ret = parseVaultResp(response, len, &vr);
+        if (ret != RUE_OK) break;
+        ret = vaultRespStatus(&vr, NULL);
         if (ret != RUE_OK) {
             break;
         }
-        ret = parseSearchData(jsn, vids);
-    } while(0);
+        if (!vr.hasVids) {
+            ruWarnLog("response did not include vids key");
+            ret = DVE_PROTOCOL_ERROR;
+            break;
+        }
+        ruVerbLogf("number of vids: %d" , (int)vr.vidCount);
+        alloc_chars token = vr.next.ptr? jstrDup(&vr.next) : NULL;
+        if (token) {
+            // a vault going back to an earlier page would never finish
+            if (!seen) seen = ruMapNew(ruTypeStrFree(), NULL);
+            if (ruMapHas(seen, token, NULL)) {
+                ruCritLog("search did not advance");
+                ruFree(token);
+                ret = DVE_PROTOCOL_ERROR;
+                break;
+            }
+            ret = ruMapPut(seen, token, NULL);
+            if (ret != RUE_OK) {
+                ruFree(token);
+                break;
+            }
+        }
+        next = token;
+        ret = deliverVids(response, &vr, vidFn, usrCtx);
+        freeVaultResp(&vr);
+        scratchFree(response);
+        response = NULL;
+    } while(ret == RUE_OK && next);
+
+    freeReq(ctx, &rq);
+    freeVaultResp(&vr);
+    scratchFree(response);
+    if (seen) ruMapFree(seen);
+    scratchEnd();
+    return ret;
+}
 
-    ruJsonFree(jrq);
-    ruJsonFree(jsn);
-    freeKvList(kvl);
-    ruFree(response);
+static int32_t appendVid(void* usrCtx, const char* vid) {
+    ruList* vids = usrCtx;
+    if (!*vids) {
+        *vids = ruListNew(ruTypeStrFree());
+    }
+    int32_t ret = ruListAppend(*vids, ruStrDup(vid));
+    if (ret != RUE_OK) {
+        ruCritLogf("failed adding entry '%s' to list", vid);
+    }
     return ret;
 }
 
-DVAPI int32_t dvDelete(dvCtx dc, ruList vids) {
+DVAPI int32_t dvSearch(dvCtx dc, ruList searchWords, ruList* vids) {
+    if (!vids) return RUE_PARAMETER_NOT_SET;
+    return dvSearchEach(dc, searchWords, appendVid, vids);
+}
+
+DVAPI int32_t dvDeleteMany(dvCtx dc, const char* const* vids, size_t count) {
     char *response = NULL;
-    dvKvList kvl = NULL;
-    ruJson jrq = NULL;
+    struct dv_req rq;
     ruJson jsn = NULL;
     int32_t ret;
 
-    if (!dc) return RUE_PARAMETER_NOT_SET;
+    if (!dc || !vids) return RUE_PARAMETER_NOT_SET;
     dvctx ctx = getDvCtx(dc);
     if (!ctx) return RUE_INVALID_PARAMETER;
 
-    jrq = ruJsonStart(true);
-    ruJsonSetKeyInt(jrq, "version", PROTO_VERSION);
-    ruJsonSetKeyStr(jrq, "op", "delete");
+    newReq(ctx, &rq, "delete");
+    scratchBegin();
 
     do {
-        ret = encodeWordList(vids, jrq, "vid");
-        if (ret != RUE_OK) break;
-        perm_chars str =  NULL;
-        ret = ruJsonWrite(jrq, &str);
-        if (ret != RUE_OK) break;
-
-        ret = newKvList(&kvl, JSON_FIELD, str, 0);
-        if (ret != RUE_OK) {
-            ruCritLogf("failed to create parameter list. Ec: %d", ret);
-            break;
-        }
-        ruVerbLogf("Do request: %s", str);
-        ret = doRequest(ctx, ctx->serviceUrl, kvl,
-                        &response, NULL);
+        reqAddArray(&rq, "vid", vids, count);
+        ret = reqSend(ctx, &rq, &response, NULL);
         if (ret != RUE_OK) {
             ruCritLogf("failed to get data from %s. Ec: %d",
                        ctx->serviceUrl, ret);
@@ -606,10 +901,37 @@ DVAPI int32_t dvDelete(dvCtx dc, ruList vids) {
         }
     } while(0);
 
-    ruJsonFree(jrq);
+    freeReq(ctx, &rq);
     ruJsonFree(jsn);
-    freeKvList(kvl);
-    ruFree(response);
+    scratchFree(response);
+    scratchEnd();
+    return ret;
+}
+
+DVAPI int32_t dvDelete(dvCtx dc, ruList vids) {
+    if (!dc) return RUE_PARAMETER_NOT_SET;
+    perm_chars* arr = NULL;
+    rusize count = 0;
+    scratchBegin();
+    int32_t ret = listArray(vids, &arr, &count);
+    if (ret == RUE_OK) ret = dvDeleteMany(dc, arr, count);
+    scratchFree(arr);
+    scratchEnd();
+    return ret;
+}
+
+DVAPI int32_t dvWipeMany(dvCtx dc, const char* const* vids, size_t count) {
+    if (!dc || !vids) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+
+    int32_t ret = RUE_OK;
+    for (rusize i = 0; i < count; i++) {
+        ret = ctx->store->set(ctx->store, vids[i], NULL, 0);
+        if (ret != RUE_OK) {
+            ruCritLogf("failed clearing '%s' ec: %d", vids[i], ret);
+        }
+    }
     return ret;
 }
 
@@ -627,19 +949,13 @@ DVAPI int32_t dvWipe(dvCtx dc, ruList vids) {
             ruCritLogf("failed getting vid list from store. ec: %d", ret);
             return ret;
         }
-    } else {
-        ruListSize(vids, &ret);
-        if (ret != RUE_OK) return ret;
     }
 
-    ruIterator li = ruListIter(myvids);
-    for (char* vid = ruIterNext(li, char*); vid;
-         vid = ruIterNext(li, char*)) {
-        ret = ctx->store->set(ctx->store, vid, NULL, 0);
-        if (ret != RUE_OK) {
-            ruCritLogf("failed clearing '%s' ec: %d", vid, ret);
-        }
-    }
+    perm_chars* arr = NULL;
+    rusize count = 0;
+    ret = listArray(myvids, &arr, &count);
+    if (ret == RUE_OK) ret = dvWipeMany(dc, arr, count);
+    scratchFree(arr);
     if (!vids) {
         // since we made these
         ruListFree(myvids);
@@ -647,6 +963,52 @@ DVAPI int32_t dvWipe(dvCtx dc, ruList vids) {
     return ret;
 }
 
+/*
+ * Re-encrypts an entry doGet fetched for recoding with the new app-id. The
+ * status of the entry becomes RUE_OK once it is migrated.
+ */
+static int32_t migrateEntry(dvCtx dc, const char* newId, perm_chars newCs,
+                            perm_chars vd, perm_chars data, int32_t* status,
+                            dvIndexCb indexCb, void* indexCtx) {
+    int32_t ret = RUE_OK;
+    if (*status == DVE_INVALID_CREDENTIALS) {
+        // we know it didn't match the old checksum
+        if (ruStrEquals(newCs, data)) {
+            // if it matched the new checksum then it's already handled
+            ruVerbLogf("Entry '%s' has already been migrated", vd);
+            *status = RUE_OK;
+        } else {
+            ruWarnLogf("Entry '%s' failed to decrypt", vd);
+        }
+        return RUE_OK;
+    }
+    if (*status == RUE_FILE_NOT_FOUND) {
+        ruVerbLogf("Entry '%s' no longer exists", vd);
+        return RUE_OK;
+    }
+    if (*status != RUE_OK) {
+        ret = *status;
+        dvSetError("Failed to get '%s' entry from vidMap map. EC: %d",
+                   vd, ret);
+        return ret;
+    }
+
+    ruList indexWords = NULL;
+    if (indexCb) {
+        ret = indexCb(indexCtx, vd, data, &indexWords);
+        if (ret != RUE_OK) {
+            ruCritLogf("Failed to get search words for '%s'. EC: %d",
+                       vd, ret);
+            return ret;
+        }
+    }
+    ret = doUpdate(dc, vd, data, NULL, NULL, indexWords, newId);
+    if (ret != RUE_OK) {
+        ruWarnLogf("Failed to update vidMap for '%s'. EC: %d", vd, ret);
+    }
+    return ret;
+}
+
 DVAPI int32_t dvChangeAppId(dvCtx dc, const char* newId, ruList vids,
                             ruMap* vidMap, dvIndexCb indexCb, void* indexCtx) {
     int32_t ret = RUE_GENERAL;
@@ -657,75 +1019,87 @@ DVAPI int32_t dvChangeAppId(dvCtx dc, const char* newId, ruList vids,
 
     ruVerbLogf("Starting conversion for %d items", ruListSize(vids, NULL));
 
+    char *newCs = NULL;
+    perm_chars* arr = NULL;
+    rusize count = 0;
     do {
-        char *newCs = NULL;
         ret = getCs(newId, strlen(newId), &newCs);
         if (ret != RUE_OK) break;
 
         ruVerbLogf("Migrating entries from checksum '%s' to '%s'",
                    ctx->appIdEnd, newCs);
 
-        ret = doGet(dc, vids, vidMap, NULL, true);
+        ret = listArray(vids, &arr, &count);
+        if (ret != RUE_OK) break;
+        ret = doGet(dc, arr, count, vidMap, NULL, NULL, true);
         if (ret != RUE_OK) {
             ruWarnLogf("get failed with %d", ret);
             break;
         }
-        ruIterator li = ruListIter(vids);
-        for (char *vd = ruIterNext(li, char*); li; vd = ruIterNext(li, char*)) {
-            if (!ruMapHas(*vidMap, vd, NULL)) {
-                dvSetError("No entry for vid '%s'", vd);
-                ret = DVE_PROTOCOL_ERROR;
-                break;
-            }
+        for (rusize i = 0; i < count; i++) {
+            perm_chars vd = arr[i];
             dvGetRes gr = NULL;
             ret = ruMapGet(*vidMap, vd, &gr);
-            if (ret != RUE_OK) {
-                dvSetError("Failed to get '%s' entry from vidMap map. EC: %d",
-                           vd, ret);
-                break;
-            }
-            if (gr->status == DVE_INVALID_CREDENTIALS) {
-                // we know it didn't match the old checksum
-                if (ruStrEquals(newCs, gr->data)) {
-                    // if it matched the new checksum then it's already handled
-                    ruVerbLogf("Entry '%s' has already been migrated", vd);
-                    gr->status = RUE_OK;
-                    ruFree(gr->data);
-                } else {
-                    ruWarnLogf("Entry '%s' failed to decrypt", vd);
-                }
-                continue;
-            }
-            if (gr->status == RUE_FILE_NOT_FOUND) {
-                ruVerbLogf("Entry '%s' no longer exists", vd);
-                continue;
-            }
-            if (gr->status != RUE_OK) {
-                ret = gr->status;
-                dvSetError("Failed to get '%s' entry from vidMap map. EC: %d",
-                           vd, ret);
+            if (ret != RUE_OK || !gr) {
+                dvSetError("No entry for vid '%s'", vd);
+                ret = DVE_PROTOCOL_ERROR;
                 break;
             }
+            ret = migrateEntry(dc, newId, newCs, vd, gr->data, &gr->status,
+                               indexCb, indexCtx);
+            if (ret != RUE_OK) break;
+            if (gr->status == RUE_OK) ruFree(gr->data);
+        }
+    } while(false);
 
-            ruList indexWords = NULL;
-            if (indexCb) {
-                ret = indexCb(indexCtx, vd, gr->data, &indexWords);
-                if (ret != RUE_OK) {
-                    ruCritLogf("Failed to get search words for '%s'. EC: %d",
-                               vd, ret);
-                    break;
-                }
-            }
-            ret = doUpdate(dc, vd, gr->data, indexWords, newId);
-            if (ret != RUE_OK) {
-                ruWarnLogf("Failed to update vidMap for '%s'. EC: %d", vd, ret);
-                break;
+    scratchFree(arr);
+    ruFree(newCs);
+    return ret;
+}
+
+DVAPI int32_t dvChangeAppIdMany(dvCtx dc, const char* newId,
+                                const char* const* vids, size_t count,
+                                int32_t* stati, dvIndexCb indexCb,
+                                void* indexCtx) {
+    if (!dc || !newId || !vids || !stati) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+
+    ruVerbLogf("Starting conversion for %d items", (int)count);
+
+    char *newCs = NULL;
+    dvresults rr = NULL;
+    int32_t ret;
+    do {
+        ret = getCs(newId, strlen(newId), &newCs);
+        if (ret != RUE_OK) break;
+
+        ruVerbLogf("Migrating entries from checksum '%s' to '%s'",
+                   ctx->appIdEnd, newCs);
+
+        ret = newResultSet(vids, count, &rr);
+        if (ret != RUE_OK) break;
+        ret = doGet(dc, vids, count, NULL, rr, NULL, true);
+        if (ret != RUE_OK) {
+            ruWarnLogf("get failed with %d", ret);
+            break;
+        }
+        for (rusize i = 0; i < count; i++) {
+            struct dv_result* r = &rr->results[i];
+            if (r->first != i) {
+                // a repeated vid is only migrated once
+                stati[i] = stati[r->first];
+                continue;
             }
-            gr->status = ret;
-            ruFree(gr->data);
+            stati[i] = r->status;
+            ret = migrateEntry(dc, newId, newCs, r->vid, r->data, &stati[i],
+                               indexCb, indexCtx);
+            if (ret != RUE_OK) break;
         }
     } while(false);
 
+    dvResultSetFree(rr);
+    ruFree(newCs);
     return ret;
 }
 
@@ -738,6 +1112,15 @@ DVAPI int32_t dvSetHeaderCb(dvCtx dc, dvHeaderCb callback, void* cbCtx) {
     return RUE_OK;
 }
 
+DVAPI int32_t dvSetCacheReader(dvCtx dc, dvCacheReadFn readFn, void* readCtx) {
+    if (!dc) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+    ctx->cacheRead = readFn;
+    ctx->cacheReadCtx = readCtx;
+    return RUE_OK;
+}
+
 DVAPI int32_t dvSetPostCb(dvCtx dc, dvPostCb callback, void* cbCtx) {
     if (!dc) return RUE_PARAMETER_NOT_SET;
     dvctx ctx = getDvCtx(dc);
@@ -776,6 +1159,10 @@ DVAPI int dvSetProp(dvCtx dc, enum dvCtxOpt opt, const char* value) {
             break;
         case DV_SERVICE_URL:
             ret = setServiceUrl(ctx, value);
+            // another vault may answer differently
+            ruMutexLock(ctx->reqMutex);
+            ctx->proto = PROTO_UNKNOWN;
+            ruMutexUnlock(ctx->reqMutex);
             break;
         case DV_APP_ID:
             ruFree(ctx->appId);
@@ -825,6 +1212,47 @@ DVAPI int dvSetProp(dvCtx dc, enum dvCtxOpt opt, const char* value) {
                 ctx->skipCertCheck = true;
             }
             break;
+        case DV_CIPHER_RECIPE:
+            if (!value) {
+                ctx->recipe = RECIPE_AES_CBC;
+                break;
+            }
+            ret = findRecipe(value, strlen(value), &ctx->recipe);
+            if (ret != RUE_OK) {
+                dvSetError("unknown cipher recipe '%s'", value);
+            }
+            break;
+        case DV_COMPRESSION:
+            if (!value || ruStrEquals(value, "0")) {
+                ctx->codec = CODEC_PLAIN;
+            } else if (ruStrEquals(value, "deflate")) {
+                ctx->codec = CODEC_DEFLATE;
+            } else {
+                dvSetError("unknown compression '%s'", value);
+                ret = RUE_INVALID_PARAMETER;
+            }
+            break;
+        case DV_LAZY_DECRYPT:
+            ctx->lazyGet = value && !ruStrEquals(value, "0");
+            break;
+        case DV_SEARCH_PAGE_SIZE:
+            if (!value) {
+                ctx->searchPage = 0;
+                break;
+            }
+            num = strtoll(value, NULL, 10);
+            if (num < 0 || num > UINT32_MAX) {
+                ret = RUE_INVALID_PARAMETER;
+                break;
+            }
+            ctx->searchPage = (uint32_t)num;
+            break;
+        case DV_BINARY_PROTOCOL:
+            ruMutexLock(ctx->reqMutex);
+            ctx->binaryProto = value && !ruStrEquals(value, "0");
+            ctx->proto = PROTO_UNKNOWN;
+            ruMutexUnlock(ctx->reqMutex);
+            break;
         case DV_CURL_LOGGING:
             if (!value || ruStrEquals(value, "0")) {
                 ruVerbLog("Disabling curl logging");
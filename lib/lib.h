@@ -28,6 +28,25 @@
 #include <string.h>
 #define CURL_DISABLE_TYPECHECK
 #include "curl/curl.h"
+#include <mbedtls/aes.h>
+#include <mbedtls/gcm.h>
+#ifdef _WIN32
+#include <windows.h>
+typedef INIT_ONCE dvOnceFlag;
+#define DV_ONCE_INIT INIT_ONCE_STATIC_INIT
+#else
+#include <pthread.h>
+typedef pthread_once_t dvOnceFlag;
+#define DV_ONCE_INIT PTHREAD_ONCE_INIT
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DV_X86_SIMD 1
+#define DV_TARGET(t) __attribute__((target(t)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define DV_X86_SIMD 1
+#define DV_TARGET(t)
+#endif
 
 #ifndef uint
 typedef unsigned int uint;
@@ -35,6 +54,10 @@ typedef unsigned int uint;
 
 // vault protocol version for the requests
 #define PROTO_VERSION 2
+// version answering get and search with MessagePack
+#define PROTO_BINARY_VERSION 3
+// format name a vault lists in its check response to offer it
+#define PROTO_MSGPACK_NAME "msgpack"
 
 /* service provider stati */
 #define STATUS "status"
@@ -50,6 +73,8 @@ typedef unsigned int uint;
 // must be multiple of BLOCKSIZE
 #define MACSIZE 32
 #define KEYBITS 256
+#define GCM_IVSIZE 12
+#define GCM_TAGSIZE 16
 
 #ifdef __cplusplus
 extern "C" {
@@ -61,10 +86,45 @@ extern "C" {
 extern const char *myName;
 extern const char *myVersion;
 
+/**
+ * The cipher recipes data can be encrypted with
+ */
+enum dvRecipe {
+    RECIPE_AES_CBC = 0,     /* aes-256-cbc with encrypted sha256 mac */
+    RECIPE_AES_GCM          /* aes-256-gcm with 16 byte tag */
+};
+
+/**
+ * How the text is encoded before it is encrypted
+ */
+enum dvCodec {
+    CODEC_PLAIN = 0,        /* b: the text as it is */
+    CODEC_DEFLATE           /* z: zlib compressed text */
+};
+
+/**
+ * The format the vault answers get and search requests in
+ */
+enum dvProto {
+    PROTO_UNKNOWN = 0,      /* not probed yet */
+    PROTO_JSON,             /* version 2 JSON */
+    PROTO_MSGPACK           /* version 3 MessagePack */
+};
+
+struct z_stream_s;
+
 typedef struct dv_ctx *dvctx;
 typedef struct dv_get_result *dvGetRes;
 typedef struct dv_hdr_ctx *dvHdrCtx;
 typedef struct dv_kvList *dvKvList;
+typedef struct dv_search_hasher *dvSearchHasher;
+typedef struct dv_aes_key *dvAesKey;
+typedef struct dv_key *dvkey;
+typedef struct dv_dict *dvdict;
+typedef struct dv_crypt_stream *dvcrypt;
+typedef struct dv_search_session *dvsession;
+typedef struct dv_vid_scanner *dvVidScanner;
+typedef struct dv_result_set *dvresults;
 
 /**
  * Holds the current context
@@ -76,10 +136,16 @@ struct dv_ctx {
     char *appId;        /* the app-id */
     char *appIdEnd;     /* the last 2 chars of the appId, the checksum part. */
     uint8_t key[32];      /* the encryption key derived from appId */
+    enum dvRecipe recipe; /* the recipe new and updated data is encrypted with */
+    enum dvCodec codec;   /* whether new and updated data is compressed */
+    dvdict dicts;         /* compression dictionaries for decrypting */
+    dvdict dict;          /* the one new and updated data is compressed with */
 
     // storage
     KvStore *store;     /* Where cached data will be stored. */
     bool ownStore;      /* Whether store must be freed with this context */
+    dvCacheReadFn cacheRead;    /* reads store without allocating */
+    void *cacheReadCtx;
 
     // proxy
     char *proxy;        /* proxy URL */
@@ -101,6 +167,20 @@ struct dv_ctx {
     uint curlTimeout;       /* timeout for curl calls. */
     bool curlDebug;         /* whether curl debugging is done */
     bool skipCertCheck;           /* development mode, doesn't verify SSL certs */
+    bool lazyGet;           /* get results are decrypted on access */
+    uint32_t searchPage;    /* vids per search response, 0 for all */
+    bool binaryProto;       /* offer the vault MessagePack responses */
+    enum dvProto proto;     /* what the vault agreed to, under reqMutex */
+
+    // derived keys
+    dvkey keys;             /* KEY_CACHE_SIZE keys with prepared schedules */
+    uint64_t keyTick;       /* use counter to evict the least recently used */
+    ruMutex keyMutex;
+
+    // request bodies
+    alloc_chars reqBuf;     /* kept for the next request */
+    rusize reqCap;
+    ruMutex reqMutex;
 };
 
 /**
@@ -109,6 +189,55 @@ struct dv_ctx {
 struct dv_get_result {
     char* data;         // the data or checksum on DVE_INVALID_CREDENTIALS
     int32_t status;     // the associated status usually RUE_OK
+    char* recipe;       // lazy results, the recipe to decrypt on access
+    struct dv_lazy_key* lazy;
+    ruMap fields;       // values handed out by dvGetField
+};
+
+/**
+ * The named fields of a record stored as field envelope
+ */
+struct dv_fields {
+    const char* const* names;
+    const char* const* values;
+    rusize count;
+};
+
+/**
+ * A string of a parsed vault response pointing into the response
+ */
+struct dv_jstr {
+    perm_chars ptr;
+    rusize len;
+    bool esc;           /* contains escapes, use jstrDup */
+};
+
+/**
+ * An entry of the data object of a get response
+ */
+struct dv_vault_entry {
+    struct dv_jstr vid;
+    struct dv_jstr status;
+    struct dv_jstr data;
+    bool raw;           /* data is a recipe with a binary payload */
+};
+
+/**
+ * The parts of a vault response the library looks at
+ */
+struct dv_vault_resp {
+    struct dv_jstr status;
+    struct dv_jstr desc;
+    int64_t code;
+    bool hasCode;
+    struct dv_jstr data;    /* data given as string */
+    bool hasData;           /* data given as object */
+    struct dv_vault_entry* entries;
+    rusize entryCount;
+    struct dv_jstr* vids;
+    rusize vidCount;
+    bool hasVids;
+    struct dv_jstr next;    /* continuation token of a paged search */
 };
 
 /**
@@ -121,6 +250,15 @@ struct dv_hdr_ctx {
     ruList headers;
 };
 
+/**
+ * A request body in its url encoded wire form
+ */
+struct dv_req {
+    alloc_chars buf;
+    rusize len;
+    rusize cap;
+};
+
 /**
  * Holds a key value pair
  */
@@ -133,33 +271,412 @@ struct dv_kvList {
     dvKvList next;
 };
 
+/**
+ * Holds the reusable message of a search term hash chain for one key.
+ * Every chain step hashes a character, the hex encoded previous hash and the
+ * terminated key. Only the first 65 bytes change so the key and the sha256 padding are
+ * laid out once.
+ */
+#define SEARCH_HASHER_LOCAL 256
+struct dv_search_hasher {
+    alloc_bytes msg;        /* char + hex hash + key + \0 + sha256 padding */
+    rusize blocks;          /* number of 64 byte blocks in msg */
+    uint8_t local[SEARCH_HASHER_LOCAL]; /* msg storage for regular key sizes */
+};
+
+/**
+ * Holds the search hash chain of the last term of a type-ahead search and the
+ * vault results of every search word seen so far.
+ */
+#define dvSessionType 0x21ff55ff
+struct dv_search_session {
+    uint32_t type;          /* magic identification number (ptr type check)*/
+    dvctx ctx;              /* the context to search with */
+    struct dv_search_hasher sh;
+    char *term;             /* the lower cased term the chain is at */
+    rusize len;             /* number of chain steps in term */
+    rusize cap;             /* number of steps term, chain and hash can hold */
+    alloc_bytes chain;      /* the 64 byte encoded hash after every step */
+    char *hash;             /* the search word of term, 2 chars per step */
+    ruMap results;          /* search word -> ruList of vids */
+};
+
+/**
+ * One entry of a result set, the strings are in the arena of the set
+ */
+struct dv_result {
+    perm_chars vid;
+    perm_chars data;        /* the data or checksum on DVE_INVALID_CREDENTIALS */
+    int32_t status;
+    uint32_t first;         /* index of the entry holding the outcome */
+};
+
+/**
+ * A block of bump allocated memory, the memory follows the header
+ */
+struct dv_arena_block {
+    struct dv_arena_block* next;
+    rusize size;
+    rusize used;
+    rusize live;            /* allocations not freed yet, scratch.c only */
+};
+
+/**
+ * Holds the get results of a list of vids in one arena
+ */
+#define dvResultSetType 0x21ff77ff
+struct dv_result_set {
+    uint32_t type;          /* magic identification number (ptr type check)*/
+    rusize count;
+    struct dv_result* results;  /* in the order the vids were requested */
+    uint32_t* slots;        /* open addressing vid index, result index + 1 */
+    uint32_t mask;          /* number of slots - 1 */
+    struct dv_arena_block* arena;   /* the newest block */
+};
+
+/**
+ * Holds the expanded key of an AES-256 cipher for one direction
+ */
+struct dv_aes_key {
+    mbedtls_aes_context ac;     /* used by the reference implementation */
+    uint8_t rk[15 * 16];        /* round keys of the AES-NI implementation */
+};
+
+// number of derived keys a context keeps prepared
+#define KEY_CACHE_SIZE 8
+
+/**
+ * A derived key with its AES schedules. Keys of the context cache have both
+ * schedules prepared up front and are only read while in use.
+ */
+struct dv_key {
+    uint8_t key[32];            /* sha256 of the secret */
+    struct dv_aes_key enc;
+    struct dv_aes_key dec;
+    bool encReady;
+    bool decReady;
+    bool cached;                /* owned by the context cache */
+    uint32_t refs;              /* users of a cached key */
+    uint64_t lastUse;
+};
+
+/**
+ * A compression dictionary of the context
+ */
+struct dv_dict {
+    uint32_t id;            /* adler32 of the data, as zlib identifies it */
+    alloc_bytes data;
+    rusize len;
+    dvdict next;
+};
+
+/**
+ * The key the entries of a lazy get result are decrypted with on access
+ */
+struct dv_lazy_key {
+    uint32_t refs;          /* entries still to decrypt and the creator */
+    struct dv_key key;
+    dvdict dicts;           /* of the context */
+};
+
+/**
+ * One CBC message for the multi-stream kernels, encrypted in place
+ */
+struct dv_cbc_stream {
+    alloc_bytes iv;     /* running IV, holds the last cipher block when done */
+    alloc_bytes data;
+    rusize len;         /* multiple of BLOCKSIZE */
+};
+
+/**
+ * Incremental sha256 on the selected compression function
+ */
+struct dv_sha256 {
+    uint32_t state[8];
+    uint8_t buf[64];
+    uint64_t len;
+};
+
+// codec name z.[hex dictionary id] and the terminator
+#define CODEC_NAME_SIZE 11
+// recipe:cs:iv:encoding: of aes-256-cbc:dd:[hex iv]:[codec]: and the terminator
+#define RECIPE_HEAD_SIZE (17 + BLOCKSIZE*2 + CODEC_NAME_SIZE)
+// plaintext or cipher bytes processed per step of a crypt stream
+#define STREAM_CHUNK (16 * 1024)
+
+#define dvStreamType 0x21ff66ff
+/**
+ * Encrypts to or decrypts from a cipher recipe in chunks
+ */
+struct dv_crypt_stream {
+    int32_t type;
+    bool encrypt;
+    bool started;           /* recipe head written or parsed */
+    bool done;              /* finished or failed, no more data taken */
+    enum dvRecipe recipe;
+    enum dvCodec codec;     /* decrypting, the text is inflated by zs */
+    struct z_stream_s* zs;
+    dvdict dicts;           /* the context dictionaries zs may need */
+    uint8_t key[32];
+    char cs[3];
+    uint8_t iv[BLOCKSIZE];
+    struct dv_aes_key ak;   /* cbc */
+    struct dv_sha256 mac;   /* cbc */
+    mbedtls_gcm_context gc; /* gcm */
+    dvWriteFn writer;
+    void* writeCtx;
+    char head[RECIPE_HEAD_SIZE];    /* recipe head being parsed */
+    rusize headLen;
+    uint8_t carry[4];       /* cipher bytes / base64 chars short of a quantum */
+    rusize carryLen;
+    alloc_bytes pend;       /* data held back until a block or the end */
+    rusize pendLen;
+    alloc_bytes work;       /* STREAM_CHUNK scratch */
+    char* text;             /* base64 output */
+};
+
+/**
+ * Streams the body of a request or the response instead of holding it in
+ * memory
+ */
+struct dv_req_io {
+    perm_chars field;       /* form field whose value comes from read */
+    /* fills buf with up to size raw bytes of the field value, returns the
+     * count, 0 at the end or CURL_READFUNC_ABORT */
+    rusize (*read)(void* ctx, char* buf, rusize size);
+    void* readCtx;
+    /* receives the response body instead of the result buffer */
+    rusize (*write)(char* ptr, rusize size, rusize nmemb, void* ctx);
+    void* writeCtx;
+    /* an url encoded body posted as is, before the post data */
+    perm_chars body;
+    rusize bodyLen;
+};
+
+/**
+ * The crypto primitives in use. The reference implementations are Mbed TLS,
+ * others are picked at runtime depending on the CPU.
+ */
+struct dv_crypto_provider {
+    const char* aesName;
+    int32_t (*aesSetKey)(dvAesKey ak, trans_bytes key, int mode);
+    int32_t (*aesCbc)(dvAesKey ak, int mode, rusize len, alloc_bytes iv,
+                      trans_bytes in, alloc_bytes out);
+    int32_t (*aesCbcEncMany)(dvAesKey ak, struct dv_cbc_stream* streams,
+                             size_t count);
+    void (*aesFree)(dvAesKey ak);
+    const char* shaName;
+    void (*sha256)(trans_bytes data, rusize len, alloc_bytes digest);
+    void (*sha256Blocks)(uint32_t* state, trans_bytes data, rusize blocks);
+    void (*sha256Lanes)(uint32_t* states, trans_bytes* data, int lanes,
+                        rusize blocks);
+    const char* b64Name;
+    int (*b64Encode)(alloc_bytes dst, size_t dlen, size_t* olen,
+                     trans_bytes src, size_t slen);
+    int (*b64Decode)(alloc_bytes dst, size_t dlen, size_t* olen,
+                     trans_bytes src, size_t slen);
+};
+
+// lib.c
+int32_t encodeWordList(ruList wordLst, ruJson jsn, trans_chars key);
+
 // curl.c
 int32_t newKvList(dvKvList *kvl, const char *key, const char *value, rusize len);
 int32_t freeKvList(dvKvList kvl);
+int32_t kvListToString(dvKvList kvl, char** postData);
 int32_t doRequest(dvctx ctx, const char *url, dvKvList postData, char **result,
                   rusize *resultLen);
+int32_t doStreamRequest(dvctx ctx, const char* url, dvKvList postData,
+                        struct dv_req_io* io, char** result, rusize* resultLen);
+
+// request.c
+void newReq(dvctx ctx, struct dv_req* rq, perm_chars op);
+void newJsonReq(dvctx ctx, struct dv_req* rq, perm_chars op);
+void reqAddStr(struct dv_req* rq, perm_chars key, perm_chars value);
+void reqAddInt(struct dv_req* rq, perm_chars key, int64_t value);
+int32_t reqAddList(struct dv_req* rq, perm_chars key, ruList list);
+void reqAddArray(struct dv_req* rq, perm_chars key, const char* const* items,
+                 rusize count);
+perm_chars reqBody(struct dv_req* rq, rusize* len);
+int32_t reqSend(dvctx ctx, struct dv_req* rq, char** result,
+                rusize* resultLen);
+void probeProtocol(dvctx ctx);
+void freeReq(dvctx ctx, struct dv_req* rq);
 
 // misc.c
 dvctx getDvCtx(dvCtx pCtx);
 dvGetRes newGetRes(char* data, int32_t status);
 ptr freeGetRes(ptr in);
+struct dv_lazy_key* newLazyKey(dvkey key, dvdict dicts);
+void putLazyKey(struct dv_lazy_key* lk);
 void dvClearError(void);
 void dvSetError(const char *format, ...);
 void dvCleanerAdd(const char *secret);
+void dvOnce(dvOnceFlag* flag, void (*fn)(void));
 
 // json.c
 ruJson getJson(trans_chars json);
 int32_t parseStatus(ruJson jsn, bool *invalidRequest);
-int32_t parseVidData(alloc_bytes key, ruJson jsn, ruList vids, bool recode,
-                     ruMap *data);
-int32_t parseSearchData(ruJson jsn, ruList *vids);
+int32_t vaultRespStatus(const struct dv_vault_resp* vr, bool* invalidRequest);
+int32_t parseVidData(dvkey key, dvdict dicts, trans_chars response,
+                     rusize len, const char* const* vids, rusize count,
+                     bool recode, struct dv_lazy_key* lazy, ruMap *data);
+int32_t newVidScanner(dvkey key, dvdict dicts, const char* const* vids,
+                      rusize count, bool recode, struct dv_lazy_key* lazy,
+                      ruMap* data, dvresults rs, dvVidScanner* scanner);
+int32_t vidScannerFeed(dvVidScanner vs, trans_chars ptr, rusize len);
+rusize vidScannerWrite(char* ptr, rusize size, rusize nmemb, void* userdata);
+int32_t vidScannerFinish(dvVidScanner vs, int32_t ret);
+void freeVidScanner(dvVidScanner vs);
+
+// vaultjson.c
+perm_chars selectJsonScanner(bool accelerated);
+int32_t parseVaultResp(trans_chars json, rusize len, struct dv_vault_resp* vr);
+void freeVaultResp(struct dv_vault_resp* vr);
+alloc_chars jstrDup(const struct dv_jstr* s);
+alloc_chars jstrScratch(const struct dv_jstr* s);
+bool jstrEquals(const struct dv_jstr* s, const char* str);
+
+// msgpack.c
+bool isMsgpack(trans_chars resp, rusize len);
+int32_t parseVaultMsgpack(trans_chars resp, rusize len,
+                          struct dv_vault_resp* vr);
+
+// scratch.c
+void scratchBegin(void);
+void scratchEnd(void);
+void* scratchAlloc(rusize len);
+void* scratchRealloc(void* ptr, rusize oldLen, rusize len);
+void scratchFree(void* ptr);
+
+// resultset.c
+dvresults getDvResultSet(dvResultSet rs);
+int32_t newResultSet(const char* const* vids, rusize count, dvresults* rs);
+int32_t resultSetPut(dvresults rr, trans_chars vid, int32_t status,
+                     trans_chars data);
+
+// search.c
+dvsession getDvSession(dvSearchSession ss);
+int32_t searchSessionHash(dvsession sn, const char* word, perm_chars* hash);
+
+// provider.c
+#define CPU_AESNI   0x01
+#define CPU_SHANI   0x02
+#define CPU_AVX2    0x04
+uint32_t cpuFeatures(void);
+const struct dv_crypto_provider* cryptoProvider(void);
+void selectCryptoProvider(bool accelerated);
+
+// aesni.c
+#ifdef DV_X86_SIMD
+int32_t aesniSetKey(dvAesKey ak, trans_bytes key, int mode);
+int32_t aesniCbc(dvAesKey ak, int mode, rusize len, alloc_bytes iv,
+                 trans_bytes in, alloc_bytes out);
+int32_t aesniCbcEncMany(dvAesKey ak, struct dv_cbc_stream* streams,
+                        size_t count);
+void aesniFree(dvAesKey ak);
+#endif
+
+// base64.c
+int b64Encode(alloc_bytes dst, size_t dlen, size_t* olen, trans_bytes src,
+              size_t slen);
+int b64Decode(alloc_bytes dst, size_t dlen, size_t* olen, trans_bytes src,
+              size_t slen);
+
+// sha256.c
+#define SHA256_LANES 8
+extern const uint32_t sha256H0[8];
+void sha256BlocksC(uint32_t* state, trans_bytes data, rusize blocks);
+#ifdef DV_X86_SIMD
+void sha256BlocksShani(uint32_t* state, trans_bytes data, rusize blocks);
+void sha256LanesAvx2(uint32_t* states, trans_bytes* data, int lanes,
+                     rusize blocks);
+#endif
+void sha256Blocks(uint32_t* state, trans_bytes data, rusize blocks);
+void sha256StateDigest(const uint32_t* state, alloc_bytes digest);
+void sha256Digest(trans_bytes data, rusize len, alloc_bytes digest);
+void sha256Start(struct dv_sha256* sc);
+void sha256Update(struct dv_sha256* sc, trans_bytes data, rusize len);
+void sha256Finish(struct dv_sha256* sc, alloc_bytes digest);
+void sha256BlocksLanes(uint32_t* states, trans_bytes* data, int lanes,
+                       rusize blocks);
+
+// keys.c
+void initKey(dvkey k, trans_bytes key);
+dvAesKey keySchedule(dvkey k, int mode);
+void clearKey(dvkey k);
+int32_t getKey(dvctx ctx, trans_bytes key, dvkey* k);
+int32_t getSecretKey(dvctx ctx, const char* secret, dvkey* k);
+void putKey(dvctx ctx, dvkey k);
+void freeKeyCache(dvctx ctx);
+
+// stream.c
+int32_t newCryptStream(trans_bytes key, const char* cs, enum dvRecipe recipe,
+                       bool encrypt, dvWriteFn writer, void* writeCtx,
+                       dvcrypt* stream);
+int32_t cryptStreamUpdate(dvcrypt cs, trans_bytes data, rusize len);
+int32_t cryptStreamFinish(dvcrypt cs);
+void freeCryptStream(dvcrypt cs);
+
+// compress.c
+rusize codecName(enum dvCodec codec, uint32_t dictId, char* out);
+int32_t findCodec(const char* name, rusize len, enum dvCodec* codec,
+                  uint32_t* dictId);
+dvdict findDict(dvdict dicts, uint32_t id);
+void freeDicts(dvdict dicts);
+int32_t deflateText(const char* str, rusize len, dvdict dict,
+                    alloc_bytes* out, rusize* outLen);
+int32_t newInflater(dvdict dict, struct z_stream_s** zs);
+int32_t inflateChunk(struct z_stream_s* zs, trans_bytes data, rusize len,
+                     dvWriteFn writer, void* writeCtx, bool last);
+void freeInflater(struct z_stream_s* zs);
+int32_t inflateText(trans_bytes data, rusize len, dvdict dict, char** text);
+
+// fields.c
+bool isEnvelope(const char* cipherRecipe);
+int32_t encodeFields(dvkey key, const char* cs, const struct dv_fields* fields,
+                     enum dvRecipe recipe, enum dvCodec codec, dvdict dict,
+                     char** envelope, char** plain);
+int32_t decryptEnvelopeField(dvkey key, dvdict dicts, const char* envelope,
+                             const char* name, char** value);
+int32_t decryptEnvelope(dvkey key, dvdict dicts, const char* envelope,
+                        char** data, char* cs);
 
 // crypto.c
 int32_t dvSearchHash(const char* term, const char* key, char** hash, bool indexing);
+int32_t initSearchHasher(dvSearchHasher sh, const char* key);
+void searchHashStep(dvSearchHasher sh, uint8_t c, alloc_bytes digest);
+void searchHashResume(dvSearchHasher sh, trans_bytes prev);
+int32_t searchHashTerm(dvSearchHasher sh, const char* term, char** hash,
+                       bool indexing);
+void freeSearchHasher(dvSearchHasher sh);
+int32_t searchHashTerms(const char* key, const char* const* terms, rusize count,
+                        char** hashes, bool indexing);
 int32_t getCs(const char* appId, rusize idLen, char** csStart);
 int32_t mkKey(const char* appId, alloc_bytes key, char** csStart);
+int32_t findRecipe(const char* name, rusize len, enum dvRecipe* recipe);
+int32_t dvAes256EncKey(dvkey key, const char* cs, const char* str,
+                       enum dvRecipe recipe, enum dvCodec codec,
+                       dvdict dict, char** cipherText);
 int32_t dvAes256Enc(trans_bytes key, const char* cs, const char* str,
-                    char** cipherText);
+                    enum dvRecipe recipe, char** cipherText);
+int32_t dvAes256EncMany(trans_bytes key, const char* cs,
+                        const char* const* strs, size_t count,
+                        enum dvRecipe recipe, enum dvCodec codec,
+                        dvdict dict, char** cipherTexts);
+bool macEquals(trans_bytes a, trans_bytes b, rusize len);
+void freeThreadIvPool(void);
+int32_t mkIv(alloc_bytes iv, rusize len);
+void hexify(trans_bytes ibuf, int ilen, alloc_bytes obuf);
+rusize recipeHead(enum dvRecipe recipe, enum dvCodec codec, uint32_t dictId,
+                  const char* cs, trans_bytes iv, char* out);
+int32_t parseRecipe(const char* cipherRecipe, enum dvRecipe* recipe,
+                    alloc_bytes iv, char* cs, enum dvCodec* codec,
+                    uint32_t* dictId, perm_chars* payload, rusize* payloadLen);
+int32_t dvAes256DecKey(dvkey key, dvdict dicts, const char* cipherRecipe,
+                       char** data, char* cs);
+int32_t dvAes256DecRaw(dvkey key, dvdict dicts, trans_bytes recipe,
+                       rusize len, char** data, char* cs);
 int32_t dvAes256Dec(trans_bytes key, const char* cipherRecipe, char** data, char* cs);
 
 #ifdef __cplusplus
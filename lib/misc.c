@@ -79,24 +79,105 @@ dvGetRes newGetRes(char* data, int32_t status) {
     return out;
 }
 
+/**
+ * Copies the key for the entries of a lazy get result.
+ * @param key The key the entries are encrypted with.
+ * @param dicts The compression dictionaries of the context.
+ * @return The new key held once by the caller. Release with \ref putLazyKey.
+ */
+struct dv_lazy_key* newLazyKey(dvkey key, dvdict dicts) {
+    struct dv_lazy_key* lk = ruMalloc0(1, struct dv_lazy_key);
+    lk->refs = 1;
+    initKey(&lk->key, key->key);
+    lk->dicts = dicts;
+    return lk;
+}
+
+void putLazyKey(struct dv_lazy_key* lk) {
+    if (!lk || --lk->refs) return;
+    clearKey(&lk->key);
+    ruFree(lk);
+}
+
 ptr freeGetRes(ptr in) {
     dvGetRes gr = (dvGetRes) in;
     if (!gr) return NULL;
     ruFree(gr->data);
+    ruFree(gr->recipe);
+    putLazyKey(gr->lazy);
+    if (gr->fields) ruMapFree(gr->fields);
     return ruClear(gr);
 }
 
+/*
+ * Decrypts the recipe of a lazy result once.
+ */
+static void decryptGetRes(dvGetRes gr) {
+    char* msg = NULL;
+    int32_t ret = dvAes256DecKey(&gr->lazy->key, gr->lazy->dicts, gr->recipe,
+                                 &msg, NULL);
+    if (ret == RUE_OK) {
+        gr->data = msg;
+    } else {
+        ruWarnLogf("failed decrypting entry ec: %d", ret);
+    }
+    gr->status = ret;
+    ruFree(gr->recipe);
+    putLazyKey(gr->lazy);
+    gr->lazy = NULL;
+}
+
 DVAPI int32_t dvGetVid(ruMap vidMap, const char* vid, char** pid) {
     if (!vidMap || !vid) return RUE_PARAMETER_NOT_SET;
     dvGetRes gr = NULL;
     int32_t ret = ruMapGet(vidMap, vid, &gr);
     if (ret == RUE_OK && gr) {
+        if (gr->recipe) decryptGetRes(gr);
         if (pid) *pid = gr->data;
         ret = gr->status;
     }
     return ret;
 }
 
+DVAPI int32_t dvGetField(ruMap vidMap, const char* vid, const char* name,
+                         char** value) {
+    if (!vidMap || !vid || !name || !value) return RUE_PARAMETER_NOT_SET;
+    dvGetRes gr = NULL;
+    alloc_chars val = NULL;
+    int32_t ret = ruMapGet(vidMap, vid, &gr);
+    if (ret != RUE_OK || !gr) return ret;
+    if (gr->fields && ruMapGet(gr->fields, name, value) == RUE_OK) {
+        return RUE_OK;
+    }
+    if (gr->recipe && isEnvelope(gr->recipe)) {
+        // decrypt just this field
+        ret = decryptEnvelopeField(&gr->lazy->key, gr->lazy->dicts,
+                                   gr->recipe, name, &val);
+    } else {
+        if (gr->recipe) decryptGetRes(gr);
+        ret = gr->status;
+        if (ret != RUE_OK) return ret;
+        ruJson jsn = ruJsonParse(gr->data, &ret);
+        if (ret == RUE_OK) {
+            val = ruJsonKeyStrDup(jsn, name, &ret);
+            if (ret != RUE_OK) ret = RUE_FILE_NOT_FOUND;
+        } else {
+            dvSetError("the data of '%s' is not a JSON object", vid);
+            ret = RUE_INVALID_PARAMETER;
+        }
+        ruJsonFree(jsn);
+    }
+    if (ret != RUE_OK) return ret;
+    if (!gr->fields) gr->fields = ruMapNew(ruTypeStrFree(), ruTypeStrFree());
+    ret = ruMapPut(gr->fields, ruStrDup(name), val);
+    if (ret != RUE_OK) {
+        ruFree(val);
+        return ret;
+    }
+    *value = val;
+    return RUE_OK;
+}
+
 /******************************************************************************/
 /*                          CLEAN LOGGER                                      */
 /******************************************************************************/
@@ -104,3 +185,24 @@ void dvCleanerAdd(trans_chars secret) {
     ruCleanAdd(ruGetCleaner(), secret, dvDefaultSecretPlaceHolder);
 }
 
+/******************************************************************************/
+/*                          ONE TIME SETUP                                    */
+/******************************************************************************/
+#ifdef _WIN32
+static BOOL CALLBACK runOnce(PINIT_ONCE flag, PVOID fn, PVOID* ctx) {
+    ((void (*)(void))fn)();
+    return TRUE;
+}
+#endif
+
+/**
+ * Runs fn once for the flag. Concurrent callers wait until it is done.
+ */
+void dvOnce(dvOnceFlag* flag, void (*fn)(void)) {
+#ifdef _WIN32
+    InitOnceExecuteOnce(flag, runOnce, (PVOID)fn, NULL);
+#else
+    pthread_once(flag, fn);
+#endif
+}
+
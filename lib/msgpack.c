@@ -0,0 +1,331 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+
+/*
+ * A reader for vault responses of protocol version 3, which come as
+ * MessagePack instead of JSON. They have the same keys as their JSON
+ * counterparts, so they are read into the same views. Strings need no
+ * unescaping and recipes may carry their payload as raw bytes in a bin.
+ */
+
+// nesting levels skipped values may have
+#define MP_DEPTH 32
+
+enum mpKind {
+    MP_NIL, MP_BOOL, MP_INT, MP_FLOAT, MP_STR, MP_BIN, MP_ARRAY, MP_MAP, MP_EXT
+};
+
+struct mp_item {
+    enum mpKind kind;
+    uint64_t num;           /* int value, element count or byte length */
+    trans_bytes ptr;        /* start of str, bin and ext data */
+};
+
+struct mp_cursor {
+    trans_bytes buf;
+    rusize len;
+    rusize pos;
+};
+
+bool isMsgpack(trans_chars resp, rusize len) {
+    if (!resp || !len) return false;
+    uint8_t c = (uint8_t) resp[0];
+    // a map, no JSON text starts with these
+    return (c >= 0x80 && c <= 0x8f) || c == 0xde || c == 0xdf;
+}
+
+static bool mpTake(struct mp_cursor* mc, rusize n, trans_bytes* at) {
+    if (mc->len - mc->pos < n) return false;
+    *at = mc->buf + mc->pos;
+    mc->pos += n;
+    return true;
+}
+
+static bool mpUint(struct mp_cursor* mc, int size, uint64_t* out) {
+    trans_bytes p;
+    if (!mpTake(mc, (rusize)size, &p)) return false;
+    uint64_t v = 0;
+    for (int i = 0; i < size; i++) v = v << 8 | p[i];
+    *out = v;
+    return true;
+}
+
+/*
+ * Reads the head of the next item. The data of str, bin and ext is passed
+ * over, the elements of arrays and maps follow.
+ */
+static int32_t mpNext(struct mp_cursor* mc, struct mp_item* it) {
+    trans_bytes p;
+    if (!mpTake(mc, 1, &p)) return DVE_PROTOCOL_ERROR;
+    uint8_t c = *p;
+    int size = 0;
+    bool ok = true;
+    memset(it, 0, sizeof(*it));
+    if (c <= 0x7f || c >= 0xe0) {
+        it->kind = MP_INT;
+        it->num = c <= 0x7f? c : (uint64_t)(int64_t)(int8_t)c;
+        return RUE_OK;
+    }
+    if (c <= 0x8f) {
+        it->kind = MP_MAP;
+        it->num = c & 0x0f;
+        return RUE_OK;
+    }
+    if (c <= 0x9f) {
+        it->kind = MP_ARRAY;
+        it->num = c & 0x0f;
+        return RUE_OK;
+    }
+    if (c <= 0xbf) {
+        it->kind = MP_STR;
+        it->num = c & 0x1f;
+    } else {
+        switch (c) {
+            case 0xc0: it->kind = MP_NIL; return RUE_OK;
+            case 0xc2: case 0xc3:
+                it->kind = MP_BOOL;
+                it->num = c & 1;
+                return RUE_OK;
+            case 0xc4: case 0xc5: case 0xc6:
+                it->kind = MP_BIN;
+                ok = mpUint(mc, 1 << (c - 0xc4), &it->num);
+                break;
+            case 0xc7: case 0xc8: case 0xc9:
+                // the length, then the type byte is part of the data
+                it->kind = MP_EXT;
+                ok = mpUint(mc, 1 << (c - 0xc7), &it->num);
+                it->num++;
+                break;
+            case 0xca: case 0xcb:
+                it->kind = MP_FLOAT;
+                return mpTake(mc, c == 0xca? 4 : 8, &p)? RUE_OK :
+                       DVE_PROTOCOL_ERROR;
+            case 0xcc: case 0xcd: case 0xce: case 0xcf:
+                it->kind = MP_INT;
+                ok = mpUint(mc, 1 << (c - 0xcc), &it->num);
+                return ok? RUE_OK : DVE_PROTOCOL_ERROR;
+            case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+                it->kind = MP_INT;
+                size = 1 << (c - 0xd0);
+                ok = mpUint(mc, size, &it->num);
+                if (ok && size < 8 && it->num >> (size * 8 - 1)) {
+                    // sign extend
+                    it->num |= ~(uint64_t)0 << (size * 8);
+                }
+                return ok? RUE_OK : DVE_PROTOCOL_ERROR;
+            case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+                it->kind = MP_EXT;
+                it->num = (uint64_t)1 + (1 << (c - 0xd4));
+                break;
+            case 0xd9: case 0xda: case 0xdb:
+                it->kind = MP_STR;
+                ok = mpUint(mc, 1 << (c - 0xd9), &it->num);
+                break;
+            case 0xdc: case 0xdd:
+                it->kind = MP_ARRAY;
+                ok = mpUint(mc, c == 0xdc? 2 : 4, &it->num);
+                return ok? RUE_OK : DVE_PROTOCOL_ERROR;
+            case 0xde: case 0xdf:
+                it->kind = MP_MAP;
+                ok = mpUint(mc, c == 0xde? 2 : 4, &it->num);
+                return ok? RUE_OK : DVE_PROTOCOL_ERROR;
+            default:
+                // 0xc1 is never used
+                return DVE_PROTOCOL_ERROR;
+        }
+    }
+    if (!ok || it->num > mc->len - mc->pos) return DVE_PROTOCOL_ERROR;
+    mpTake(mc, (rusize)it->num, &it->ptr);
+    return RUE_OK;
+}
+
+static int32_t mpSkipRest(struct mp_cursor* mc, const struct mp_item* it,
+                          int depth) {
+    if (it->kind != MP_ARRAY && it->kind != MP_MAP) return RUE_OK;
+    if (depth >= MP_DEPTH) return DVE_PROTOCOL_ERROR;
+    uint64_t n = it->kind == MP_MAP? it->num * 2 : it->num;
+    // every element takes at least a byte
+    if (n > mc->len - mc->pos) return DVE_PROTOCOL_ERROR;
+    for (uint64_t i = 0; i < n; i++) {
+        struct mp_item el;
+        int32_t ret = mpNext(mc, &el);
+        if (ret == RUE_OK) ret = mpSkipRest(mc, &el, depth + 1);
+        if (ret != RUE_OK) return ret;
+    }
+    return RUE_OK;
+}
+
+static bool mpIs(const struct mp_item* it, const char* name) {
+    return it->kind == MP_STR && it->num == strlen(name) &&
+           !memcmp(it->ptr, name, (rusize)it->num);
+}
+
+static void mpStr(const struct mp_item* it, struct dv_jstr* out) {
+    out->ptr = (perm_chars)it->ptr;
+    out->len = (rusize)it->num;
+    out->esc = false;
+}
+
+/*
+ * Reads the key of a map entry. Keys need not be strings, the children of an
+ * array or map key are skipped so the value follows.
+ */
+static int32_t mpKey(struct mp_cursor* mc, struct mp_item* key, int depth) {
+    int32_t ret = mpNext(mc, key);
+    if (ret != RUE_OK) return ret;
+    return mpSkipRest(mc, key, depth);
+}
+
+/*
+ * Reads a str into out or skips whatever else the value is.
+ */
+static int32_t mpStrValue(struct mp_cursor* mc, struct dv_jstr* out) {
+    struct mp_item it;
+    int32_t ret = mpNext(mc, &it);
+    if (ret != RUE_OK) return ret;
+    if (it.kind == MP_STR) {
+        mpStr(&it, out);
+        return RUE_OK;
+    }
+    return mpSkipRest(mc, &it, 1);
+}
+
+static int32_t mpEntry(struct mp_cursor* mc, const struct mp_item* map,
+                       struct dv_vault_entry* e) {
+    int32_t ret = RUE_OK;
+    for (uint64_t i = 0; i < map->num && ret == RUE_OK; i++) {
+        struct mp_item key, v;
+        ret = mpKey(mc, &key, 2);
+        if (ret != RUE_OK) break;
+        if (mpIs(&key, STATUS)) {
+            ret = mpStrValue(mc, &e->status);
+            continue;
+        }
+        ret = mpNext(mc, &v);
+        if (ret != RUE_OK) break;
+        if (mpIs(&key, "data") && (v.kind == MP_STR || v.kind == MP_BIN)) {
+            mpStr(&v, &e->data);
+            e->raw = v.kind == MP_BIN;
+        } else {
+            ret = mpSkipRest(mc, &v, 2);
+        }
+    }
+    return ret;
+}
+
+static int32_t mpEntries(struct mp_cursor* mc, const struct mp_item* map,
+                         struct dv_vault_resp* vr) {
+    int32_t ret = RUE_OK;
+    // a repeated key would overrun the entries
+    if (vr->hasData) return DVE_PROTOCOL_ERROR;
+    vr->hasData = true;
+    if (map->num > mc->len - mc->pos) return DVE_PROTOCOL_ERROR;
+    if (map->num) {
+        vr->entries = scratchAlloc((rusize)map->num *
+                                   sizeof(struct dv_vault_entry));
+    }
+    for (uint64_t i = 0; i < map->num && ret == RUE_OK; i++) {
+        struct mp_item key, v;
+        ret = mpKey(mc, &key, 1);
+        if (ret == RUE_OK) ret = mpNext(mc, &v);
+        if (ret != RUE_OK) break;
+        if (key.kind == MP_STR && v.kind == MP_MAP) {
+            struct dv_vault_entry* e = &vr->entries[vr->entryCount++];
+            mpStr(&key, &e->vid);
+            ret = mpEntry(mc, &v, e);
+        } else {
+            ret = mpSkipRest(mc, &v, 1);
+        }
+    }
+    return ret;
+}
+
+static int32_t mpVids(struct mp_cursor* mc, const struct mp_item* arr,
+                      struct dv_vault_resp* vr) {
+    int32_t ret = RUE_OK;
+    if (vr->hasVids) return DVE_PROTOCOL_ERROR;
+    vr->hasVids = true;
+    if (arr->num > mc->len - mc->pos) return DVE_PROTOCOL_ERROR;
+    if (arr->num) {
+        vr->vids = scratchAlloc((rusize)arr->num * sizeof(struct dv_jstr));
+    }
+    for (uint64_t i = 0; i < arr->num && ret == RUE_OK; i++) {
+        struct mp_item v;
+        ret = mpNext(mc, &v);
+        if (ret != RUE_OK) break;
+        if (v.kind == MP_STR) {
+            mpStr(&v, &vr->vids[vr->vidCount++]);
+        } else {
+            ret = mpSkipRest(mc, &v, 1);
+        }
+    }
+    return ret;
+}
+
+/**
+ * Like #parseVaultResp for a MessagePack response.
+ * @param resp The response, it must outlive the result.
+ * @param len Length of the response.
+ * @param vr Where the result will be stored. Free it with #freeVaultResp.
+ * @return RUE_OK on success, DVE_PROTOCOL_ERROR if the response is no
+ *         MessagePack map.
+ */
+int32_t parseVaultMsgpack(trans_chars resp, rusize len,
+                          struct dv_vault_resp* vr) {
+    if (!resp || !vr) return RUE_PARAMETER_NOT_SET;
+    memset(vr, 0, sizeof(*vr));
+    struct mp_cursor mc = {(trans_bytes)resp, len, 0};
+    struct mp_item top;
+    int32_t ret = mpNext(&mc, &top);
+    if (ret == RUE_OK && top.kind != MP_MAP) ret = DVE_PROTOCOL_ERROR;
+    for (uint64_t i = 0; ret == RUE_OK && i < top.num; i++) {
+        struct mp_item key, v;
+        ret = mpKey(&mc, &key, 1);
+        if (ret == RUE_OK) ret = mpNext(&mc, &v);
+        if (ret != RUE_OK) break;
+        if (mpIs(&key, STATUS) && v.kind == MP_STR) {
+            mpStr(&v, &vr->status);
+        } else if (mpIs(&key, "desc") && v.kind == MP_STR) {
+            mpStr(&v, &vr->desc);
+        } else if (mpIs(&key, "code") && v.kind == MP_INT) {
+            vr->code = (int64_t)v.num;
+            vr->hasCode = true;
+        } else if (mpIs(&key, "data") && v.kind == MP_MAP) {
+            ret = mpEntries(&mc, &v, vr);
+        } else if (mpIs(&key, "data") && v.kind == MP_STR) {
+            mpStr(&v, &vr->data);
+        } else if (mpIs(&key, "vids") && v.kind == MP_ARRAY) {
+            ret = mpVids(&mc, &v, vr);
+        } else if (mpIs(&key, "next") && v.kind == MP_STR) {
+            mpStr(&v, &vr->next);
+        } else {
+            ret = mpSkipRest(&mc, &v, 1);
+        }
+    }
+    if (ret == RUE_OK && mc.pos != len) ret = DVE_PROTOCOL_ERROR;
+    if (ret != RUE_OK) {
+        dvSetError("Failed parsing the response");
+        freeVaultResp(vr);
+    }
+    return ret;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+#include <mbedtls/sha256.h>
+#include <mbedtls/base64.h>
+
+#ifdef DV_X86_SIMD
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#define CPU_SSSE3   0x10
+#define CPU_SSE41   0x20
+
+static void cpuid(uint32_t leaf, uint32_t* r) {
+#ifdef _MSC_VER
+    __cpuidex((int*)r, (int)leaf, 0);
+#else
+    __cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+static uint64_t xcr0(void) {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (uint64_t)hi << 32 | lo;
+#endif
+}
+
+static uint32_t detectCpu(void) {
+    uint32_t r[4], max, ssse3 = 0, feat = 0;
+    cpuid(0, r);
+    max = r[0];
+    if (max < 1) return 0;
+    cpuid(1, r);
+    if (r[2] & (1u << 9)) ssse3 |= CPU_SSSE3;
+    if (r[2] & (1u << 19)) ssse3 |= CPU_SSE41;
+    if (r[2] & (1u << 25)) feat |= CPU_AESNI;
+    // AVX needs the OS to save the ymm registers
+    bool ymm = (r[2] & (1u << 27)) && (r[2] & (1u << 28)) &&
+            (xcr0() & 6) == 6;
+    if (max >= 7) {
+        cpuid(7, r);
+        if (ymm && (r[1] & (1u << 5))) feat |= CPU_AVX2;
+        if ((r[1] & (1u << 29)) && ssse3 == (CPU_SSSE3 | CPU_SSE41)) {
+            feat |= CPU_SHANI;
+        }
+    }
+    return feat;
+}
+#endif
+
+/**
+ * Returns the CPU_* flags of the crypto extensions this CPU supports.
+ */
+static uint32_t cpuFeat = 0;
+static dvOnceFlag cpuOnce = DV_ONCE_INIT;
+
+static void detectFeatures(void) {
+#ifdef DV_X86_SIMD
+    cpuFeat = detectCpu();
+#endif
+}
+
+uint32_t cpuFeatures(void) {
+    dvOnce(&cpuOnce, detectFeatures);
+    return cpuFeat;
+}
+
+static int32_t refAesSetKey(dvAesKey ak, trans_bytes key, int mode) {
+    mbedtls_aes_init(&ak->ac);
+    if (mode == MBEDTLS_AES_ENCRYPT) {
+        return mbedtls_aes_setkey_enc(&ak->ac, key, KEYBITS);
+    }
+    return mbedtls_aes_setkey_dec(&ak->ac, key, KEYBITS);
+}
+
+static int32_t refAesCbc(dvAesKey ak, int mode, rusize len, alloc_bytes iv,
+                         trans_bytes in, alloc_bytes out) {
+    return mbedtls_aes_crypt_cbc(&ak->ac, mode, len, iv, in, out);
+}
+
+static int32_t refAesCbcEncMany(dvAesKey ak, struct dv_cbc_stream* streams,
+                                size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int32_t r = mbedtls_aes_crypt_cbc(&ak->ac, MBEDTLS_AES_ENCRYPT,
+                                          streams[i].len, streams[i].iv,
+                                          streams[i].data, streams[i].data);
+        if (r) return r;
+    }
+    return 0;
+}
+
+static void refAesFree(dvAesKey ak) {
+    mbedtls_aes_free(&ak->ac);
+}
+
+static void refSha256(trans_bytes data, rusize len, alloc_bytes digest) {
+    mbedtls_sha256(data, len, digest, 0);
+}
+
+static const struct dv_crypto_provider refProvider = {
+    "mbedtls", refAesSetKey, refAesCbc, refAesCbcEncMany, refAesFree,
+    "mbedtls", refSha256, sha256BlocksC, NULL,
+    "mbedtls", mbedtls_base64_encode, mbedtls_base64_decode
+};
+
+static struct dv_crypto_provider fastProvider;
+static const struct dv_crypto_provider* provider = NULL;
+static char providerInfo[128];
+static dvOnceFlag providerOnce = DV_ONCE_INIT;
+
+static void pickCryptoProvider(bool accelerated) {
+    struct dv_crypto_provider cp = refProvider;
+    uint32_t feat = cpuFeatures();
+    if (accelerated) {
+#ifdef DV_X86_SIMD
+        if (feat & CPU_AESNI) {
+            cp.aesName = "aes-ni";
+            cp.aesSetKey = aesniSetKey;
+            cp.aesCbc = aesniCbc;
+            cp.aesCbcEncMany = aesniCbcEncMany;
+            cp.aesFree = aesniFree;
+        }
+        if (feat & CPU_SHANI) {
+            cp.shaName = "sha-ni";
+            cp.sha256 = sha256Digest;
+            cp.sha256Blocks = sha256BlocksShani;
+        } else if (feat & CPU_AVX2) {
+            cp.shaName = "avx2";
+            cp.sha256Lanes = sha256LanesAvx2;
+        }
+#endif
+        cp.b64Name = "table";
+        cp.b64Encode = b64Encode;
+        cp.b64Decode = b64Decode;
+    }
+    fastProvider = cp;
+    char cpu[32] = "";
+    if (feat & CPU_AESNI) strcat(cpu, ",aes-ni");
+    if (feat & CPU_SHANI) strcat(cpu, ",sha-ni");
+    if (feat & CPU_AVX2) strcat(cpu, ",avx2");
+    snprintf(providerInfo, sizeof(providerInfo),
+             "aes-cbc=%s sha256=%s base64=%s cpu=%s", cp.aesName, cp.shaName,
+             cp.b64Name, *cpu? cpu + 1 : "generic");
+    provider = &fastProvider;
+}
+
+static void pickFastest(void) {
+    pickCryptoProvider(true);
+}
+
+/**
+ * Picks the crypto implementations to use from here on. Meant for tests and
+ * benchmarks, other threads must not use the library meanwhile.
+ * @param accelerated false to use the Mbed TLS reference implementation only,
+ *                    true to use the fastest one the CPU supports.
+ */
+void selectCryptoProvider(bool accelerated) {
+    // so that the first use does not undo the choice
+    dvOnce(&providerOnce, pickFastest);
+    pickCryptoProvider(accelerated);
+}
+
+/**
+ * Returns the crypto implementations in use. The fastest ones are selected
+ * once on first use, threads arriving meanwhile wait for the selection.
+ */
+const struct dv_crypto_provider* cryptoProvider(void) {
+    dvOnce(&providerOnce, pickFastest);
+    return provider;
+}
+
+DVAPI const char* dvCryptoInfo(void) {
+    cryptoProvider();
+    return providerInfo;
+}
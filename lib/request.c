@@ -0,0 +1,381 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+
+/*
+ * Request bodies are written once in their url encoded wire form, the JSON
+ * punctuation already encoded, into a buffer the context keeps between
+ * requests.
+ */
+
+#define REQ_STR2(x) #x
+#define REQ_STR(x) REQ_STR2(x)
+#define REQ_HEAD(ver, op) JSON_FIELD "=%7B%22version%22%3A" REQ_STR(ver) \
+                          "%2C%22op%22%3A%22" op "%22"
+#define REQ_HEADS(op) REQ_HEAD(PROTO_VERSION, op), \
+                      REQ_HEAD(PROTO_BINARY_VERSION, op)
+
+// buffers above this size are not kept for the next request
+#define REQ_KEEP (1024 * 1024)
+// first size of a response collected by reqSend
+#define RESP_START (4 * 1024)
+
+/*
+ * head3 is set for the ops a vault may answer with MessagePack once it
+ * agreed to it in the check response.
+ */
+static const struct {
+    perm_chars op;
+    perm_chars head;
+    perm_chars head3;
+} heads[] = {
+        {"add", REQ_HEAD(PROTO_VERSION, "add"), NULL},
+        {"publish", REQ_HEAD(PROTO_VERSION, "publish"), NULL},
+        {"update", REQ_HEAD(PROTO_VERSION, "update"), NULL},
+        {"get", REQ_HEADS("get")},
+        {"getpublished", REQ_HEADS("getpublished")},
+        {"search", REQ_HEADS("search")},
+        {"delete", REQ_HEAD(PROTO_VERSION, "delete"), NULL},
+        {"check", REQ_HEADS("check")},
+        {NULL, NULL, NULL}
+};
+
+// ALPHA DIGIT - . _ ~ go as they are
+static const uint32_t unreserved[8] = {
+        0, 0x03ff6000, 0x87fffffe, 0x47fffffe, 0, 0, 0, 0
+};
+
+static bool isUnreserved(uint8_t c) {
+    return unreserved[c >> 5] >> (c & 31) & 1;
+}
+
+static void reqReserve(struct dv_req* rq, rusize len) {
+    if (rq->len + len < rq->cap) return;
+    rusize cap = rq->cap? rq->cap : 1024;
+    while (cap <= rq->len + len) cap *= 2;
+    rq->buf = ruRealloc(rq->buf, cap, char);
+    rq->cap = cap;
+}
+
+static void putRaw(struct dv_req* rq, perm_chars s) {
+    rusize len = strlen(s);
+    reqReserve(rq, len);
+    memcpy(rq->buf + rq->len, s, len);
+    rq->len += len;
+}
+
+/*
+ * The length of s as url encoded JSON string content.
+ */
+static rusize escapedLen(trans_chars s, rusize len) {
+    rusize out = 0;
+    for (rusize i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)s[i];
+        if (isUnreserved(c)) {
+            out++;
+        } else if (c == '"' || c == '\\') {
+            out += 6;
+        } else if (c < 0x20) {
+            out += 8;
+        } else {
+            out += 3;
+        }
+    }
+    return out;
+}
+
+static void putEscaped(struct dv_req* rq, trans_chars s, rusize len) {
+    static const char hex[] = "0123456789ABCDEF";
+    reqReserve(rq, escapedLen(s, len));
+    char* o = rq->buf + rq->len;
+    for (rusize i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)s[i];
+        if (isUnreserved(c)) {
+            *o++ = (char)c;
+            continue;
+        }
+        if (c < 0x20) {
+            memcpy(o, "%5Cu00", 6);
+            o += 6;
+            *o++ = hex[c >> 4];
+            *o++ = hex[c & 0xf];
+            continue;
+        }
+        if (c == '"' || c == '\\') {
+            memcpy(o, "%5C", 3);
+            o += 3;
+        }
+        *o++ = '%';
+        *o++ = hex[c >> 4];
+        *o++ = hex[c & 0xf];
+    }
+    rq->len = (rusize)(o - rq->buf);
+}
+
+static void putKeyName(struct dv_req* rq, perm_chars key) {
+    putRaw(rq, "%2C%22");
+    putEscaped(rq, key, strlen(key));
+    putRaw(rq, "%22%3A");
+}
+
+/*
+ * Starts a request in the given protocol, PROTO_UNKNOWN takes the one the
+ * vault was found to answer in.
+ */
+static void startReq(dvctx ctx, struct dv_req* rq, perm_chars op,
+                     enum dvProto proto) {
+    memset(rq, 0, sizeof(*rq));
+    if (ctx) {
+        ruMutexLock(ctx->reqMutex);
+        rq->buf = ctx->reqBuf;
+        rq->cap = ctx->reqCap;
+        ctx->reqBuf = NULL;
+        ctx->reqCap = 0;
+        if (proto == PROTO_UNKNOWN) proto = ctx->proto;
+        ruMutexUnlock(ctx->reqMutex);
+    }
+    bool binary = proto == PROTO_MSGPACK;
+    for (int i = 0; heads[i].op; i++) {
+        if (ruStrEquals(heads[i].op, op)) {
+            putRaw(rq, binary && heads[i].head3?
+                       heads[i].head3 : heads[i].head);
+            return;
+        }
+    }
+    putRaw(rq, REQ_HEAD(PROTO_VERSION, ""));
+    // op goes before the closing quote
+    rq->len -= 3;
+    putEscaped(rq, op, strlen(op));
+    putRaw(rq, "%22");
+}
+
+/**
+ * Starts the body of a request, taking over the buffer of the context.
+ * @param ctx The context to work with.
+ * @param rq The request to start. Release it with \ref freeReq.
+ * @param op The operation of the request.
+ */
+void newReq(dvctx ctx, struct dv_req* rq, perm_chars op) {
+    startReq(ctx, rq, op, PROTO_UNKNOWN);
+}
+
+/**
+ * Like \ref newReq but always asks for a version 2 JSON response, for
+ * callers that can only read that.
+ */
+void newJsonReq(dvctx ctx, struct dv_req* rq, perm_chars op) {
+    startReq(ctx, rq, op, PROTO_JSON);
+}
+
+void reqAddStr(struct dv_req* rq, perm_chars key, perm_chars value) {
+    if (!rq || !key || !value) return;
+    putKeyName(rq, key);
+    putRaw(rq, "%22");
+    putEscaped(rq, value, strlen(value));
+    putRaw(rq, "%22");
+}
+
+void reqAddInt(struct dv_req* rq, perm_chars key, int64_t value) {
+    if (!rq || !key) return;
+    char num[24];
+    putKeyName(rq, key);
+    snprintf(num, sizeof(num), "%lld", (long long)value);
+    putRaw(rq, num);
+}
+
+/**
+ * Adds the strings of the list as array, nothing if the list is empty.
+ * Like \ref encodeWordList the list ends at its first NULL entry.
+ */
+int32_t reqAddList(struct dv_req* rq, perm_chars key, ruList list) {
+    if (!rq || !key) return RUE_PARAMETER_NOT_SET;
+    int32_t ret;
+    ruIterator li = ruListHead(list, &ret);
+    if (ret != RUE_OK) {
+        dvSetError("Failed getting list iterator ec:%d", ret);
+        return ret;
+    }
+    bool started = false;
+    for (perm_chars item = ruIterNext(li, char*); item;
+         item = ruIterNext(li, char*)) {
+        if (!started) {
+            putKeyName(rq, key);
+            putRaw(rq, "%5B%22");
+            started = true;
+        } else {
+            putRaw(rq, "%22%2C%22");
+        }
+        putEscaped(rq, item, strlen(item));
+    }
+    if (started) putRaw(rq, "%22%5D");
+    return RUE_OK;
+}
+
+void reqAddArray(struct dv_req* rq, perm_chars key, const char* const* items,
+                 rusize count) {
+    if (!rq || !key || !count) return;
+    putKeyName(rq, key);
+    putRaw(rq, "%5B%22");
+    for (rusize i = 0; i < count; i++) {
+        if (i) putRaw(rq, "%22%2C%22");
+        putEscaped(rq, items[i], strlen(items[i]));
+    }
+    putRaw(rq, "%22%5D");
+}
+
+/**
+ * Closes the body of the request.
+ * @param rq The request.
+ * @param len Optional. Where the length of the body will be stored.
+ * @return The terminated body, owned by the request.
+ */
+perm_chars reqBody(struct dv_req* rq, rusize* len) {
+    putRaw(rq, "%7D");
+    reqReserve(rq, 0);
+    rq->buf[rq->len] = '\0';
+    if (len) *len = rq->len;
+    return rq->buf;
+}
+
+/*
+ * A response collected into scratch memory, kept terminated.
+ */
+struct dv_resp {
+    char* data;
+    rusize len;
+    rusize cap;
+};
+
+static rusize respWriter(char* ptr, rusize size, rusize nmemb, void* ctx) {
+    struct dv_resp* rp = ctx;
+    rusize len = size * nmemb;
+    if (rp->len + len >= rp->cap) {
+        rusize cap = rp->cap? rp->cap : RESP_START;
+        while (rp->len + len >= cap) cap *= 2;
+        // added bytes come zeroed, which keeps the terminator
+        rp->data = scratchRealloc(rp->data, rp->cap, cap);
+        rp->cap = cap;
+    }
+    memcpy(rp->data + rp->len, ptr, len);
+    rp->len += len;
+    return len;
+}
+
+/**
+ * Closes the body and posts it to the service.
+ * @param ctx The context to work with.
+ * @param rq The request.
+ * @param result The body of the response. Must be freed with
+ *        \ref scratchFree by the caller.
+ * @param resultLen Optional. Where the length of the response will be
+ *        stored, binary responses may contain null bytes.
+ * @return A \ref rferrors status of the operation.
+ */
+int32_t reqSend(dvctx ctx, struct dv_req* rq, char** result,
+                rusize* resultLen) {
+    if (!result) return RUE_PARAMETER_NOT_SET;
+    struct dv_req_io io;
+    struct dv_resp rp;
+    memset(&io, 0, sizeof(io));
+    memset(&rp, 0, sizeof(rp));
+    io.body = reqBody(rq, &io.bodyLen);
+    io.write = respWriter;
+    io.writeCtx = &rp;
+    ruVerbLogf("Do request: %s", io.body);
+    int32_t ret = doStreamRequest(ctx, ctx->serviceUrl, NULL, &io, NULL,
+                                  NULL);
+    if (!rp.data) rp.data = scratchAlloc(1);
+    ruVerbLogf("Got response: %s", rp.data);
+    *result = rp.data;
+    if (resultLen) *resultLen = rp.len;
+    return ret;
+}
+
+/*
+ * Whether the check response lists MessagePack among its formats.
+ */
+static bool offersMsgpack(trans_chars resp) {
+    int32_t ret;
+    bool found = false;
+    ruJson jsn = getJson(resp);
+    if (parseStatus(jsn, NULL) == RUE_OK) {
+        ruJson formats = ruJsonKeyArray(jsn, "formats", &ret);
+        rusize count = ret == RUE_OK? ruJsonArrayLen(formats, &ret) : 0;
+        for (rusize i = 0; i < count && !found; i++) {
+            perm_chars name = ruJsonIdxStr(formats, i, &ret);
+            found = ret == RUE_OK && ruStrEquals(name, PROTO_MSGPACK_NAME);
+        }
+    }
+    ruJsonFree(jsn);
+    return found;
+}
+
+/**
+ * Asks the vault once whether it answers get and search requests with
+ * MessagePack when \ref DV_BINARY_PROTOCOL is set. Vaults that don't know
+ * the check or don't list the format keep getting version 2 requests.
+ * Transfer failures leave it to the next request to ask again.
+ * @param ctx The context to work with.
+ */
+void probeProtocol(dvctx ctx) {
+    if (!ctx) return;
+    ruMutexLock(ctx->reqMutex);
+    bool known = !ctx->binaryProto || ctx->proto != PROTO_UNKNOWN;
+    ruMutexUnlock(ctx->reqMutex);
+    if (known) return;
+
+    struct dv_req rq;
+    char* result = NULL;
+    startReq(ctx, &rq, "check", PROTO_MSGPACK);
+    int32_t ret = reqSend(ctx, &rq, &result, NULL);
+    freeReq(ctx, &rq);
+    if (ret != RUE_OK) {
+        ruVerbLogf("protocol check failed ec:%d", ret);
+        scratchFree(result);
+        return;
+    }
+    enum dvProto proto = offersMsgpack(result)? PROTO_MSGPACK : PROTO_JSON;
+    scratchFree(result);
+    ruVerbLogf("vault answers in %s",
+               proto == PROTO_MSGPACK? PROTO_MSGPACK_NAME : "json");
+    ruMutexLock(ctx->reqMutex);
+    if (ctx->binaryProto) ctx->proto = proto;
+    ruMutexUnlock(ctx->reqMutex);
+}
+
+/**
+ * Hands the buffer of the request back to the context.
+ */
+void freeReq(dvctx ctx, struct dv_req* rq) {
+    if (!rq) return;
+    if (ctx && rq->buf && rq->cap <= REQ_KEEP) {
+        ruMutexLock(ctx->reqMutex);
+        if (!ctx->reqBuf) {
+            ctx->reqBuf = rq->buf;
+            ctx->reqCap = rq->cap;
+            rq->buf = NULL;
+        }
+        ruMutexUnlock(ctx->reqMutex);
+    }
+    ruFree(rq->buf);
+    memset(rq, 0, sizeof(*rq));
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+
+// plaintext bytes the first arena block reserves per entry
+#define RESULT_DATA_GUESS 256
+
+dvresults getDvResultSet(dvResultSet rs) {
+    dvresults rr = (dvresults) rs;
+    if (!rr || dvResultSetType != rr->type ) return NULL;
+    return rr;
+}
+
+static struct dv_arena_block* newArenaBlock(rusize size) {
+    struct dv_arena_block* ab = (struct dv_arena_block*) ruMalloc0(
+            sizeof(struct dv_arena_block) + size, char);
+    ab->size = size;
+    return ab;
+}
+
+/*
+ * Bump allocates len bytes aligned to align from the arena of the set.
+ */
+static void* arenaAlloc(dvresults rr, rusize len, rusize align) {
+    struct dv_arena_block* ab = rr->arena;
+    rusize off = (ab->used + align - 1) & ~(align - 1);
+    if (off + len > ab->size) {
+        rusize size = ab->size * 2;
+        if (size < len) size = len;
+        ab = newArenaBlock(size);
+        ab->next = rr->arena;
+        rr->arena = ab;
+        off = 0;
+    }
+    ab->used = off + len;
+    return (char*)(ab + 1) + off;
+}
+
+static perm_chars arenaStrDup(dvresults rr, trans_chars str) {
+    rusize len = strlen(str) + 1;
+    char* dup = arenaAlloc(rr, len, 1);
+    memcpy(dup, str, len);
+    return dup;
+}
+
+static uint32_t vidHash(trans_chars vid) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *vid; vid++) {
+        h = (h ^ (uint8_t)*vid) * 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Returns the index slot of the given vid, which is 0 when the vid is not in
+ * the set.
+ */
+static uint32_t* resultSlot(dvresults rr, trans_chars vid) {
+    uint32_t i = vidHash(vid) & rr->mask;
+    while (rr->slots[i] &&
+           !ruStrEquals(rr->results[rr->slots[i] - 1].vid, vid)) {
+        i = (i + 1) & rr->mask;
+    }
+    return &rr->slots[i];
+}
+
+int32_t newResultSet(const char* const* vids, rusize count, dvresults* rs) {
+    if (!vids || !rs) return RUE_PARAMETER_NOT_SET;
+    if (count > UINT32_MAX / 4) {
+        dvSetError("too many vids for a result set");
+        return RUE_INVALID_PARAMETER;
+    }
+    // at most half of the index slots are used
+    uint32_t slots = 8;
+    while (slots < count * 2) slots *= 2;
+
+    rusize size = count * sizeof(struct dv_result) + slots * sizeof(uint32_t);
+    for (rusize i = 0; i < count; i++) {
+        size += strlen(vids[i]) + 1 + RESULT_DATA_GUESS;
+    }
+
+    dvresults rr = ruMalloc0(1, struct dv_result_set);
+    rr->type = dvResultSetType;
+    rr->arena = newArenaBlock(size);
+    rr->results = arenaAlloc(rr, count * sizeof(struct dv_result),
+                             sizeof(void*));
+    rr->slots = arenaAlloc(rr, slots * sizeof(uint32_t), sizeof(uint32_t));
+    rr->mask = slots - 1;
+
+    for (rusize i = 0; i < count; i++) {
+        struct dv_result* r = &rr->results[i];
+        uint32_t* slot = resultSlot(rr, vids[i]);
+        if (*slot) {
+            // a repeated vid shares the entry of its first occurrence
+            r->vid = rr->results[*slot - 1].vid;
+            r->first = *slot - 1;
+        } else {
+            r->vid = arenaStrDup(rr, vids[i]);
+            r->first = (uint32_t) rr->count;
+            *slot = r->first + 1;
+        }
+        r->status = RUE_FILE_NOT_FOUND;
+        rr->count++;
+    }
+    *rs = rr;
+    return RUE_OK;
+}
+
+/*
+ * Stores the outcome of the given vid in the set, data is copied.
+ */
+int32_t resultSetPut(dvresults rr, trans_chars vid, int32_t status,
+                     trans_chars data) {
+    if (!rr || !vid) return RUE_PARAMETER_NOT_SET;
+    uint32_t* slot = resultSlot(rr, vid);
+    if (!*slot) {
+        ruWarnLogf("entry '%s' is not part of the result set", vid);
+        return RUE_OK;
+    }
+    struct dv_result* r = &rr->results[*slot - 1];
+    r->status = status;
+    r->data = data? arenaStrDup(rr, data) : NULL;
+    return RUE_OK;
+}
+
+DVAPI size_t dvResultSetSize(dvResultSet rs) {
+    dvresults rr = getDvResultSet(rs);
+    if (!rr) return 0;
+    return rr->count;
+}
+
+DVAPI int32_t dvResultSetAt(dvResultSet rs, size_t idx, const char** vid,
+                            const char** pid) {
+    dvresults rr = getDvResultSet(rs);
+    if (!rr) return RUE_PARAMETER_NOT_SET;
+    if (idx >= rr->count) return RUE_INVALID_PARAMETER;
+    struct dv_result* r = &rr->results[idx];
+    if (vid) *vid = r->vid;
+    r = &rr->results[r->first];
+    if (pid) *pid = r->data;
+    return r->status;
+}
+
+DVAPI int32_t dvResultSetGet(dvResultSet rs, const char* vid,
+                             const char** pid) {
+    dvresults rr = getDvResultSet(rs);
+    if (!rr || !vid) return RUE_PARAMETER_NOT_SET;
+    uint32_t* slot = resultSlot(rr, vid);
+    if (!*slot) return RUE_FILE_NOT_FOUND;
+    struct dv_result* r = &rr->results[*slot - 1];
+    if (pid) *pid = r->data;
+    return r->status;
+}
+
+DVAPI void dvResultSetFree(dvResultSet rs) {
+    dvresults rr = getDvResultSet(rs);
+    if (!rr) return;
+    while (rr->arena) {
+        struct dv_arena_block* ab = rr->arena;
+        rr->arena = ab->next;
+        // the decrypted data
+        memset(ab + 1, 0, ab->used);
+        ruFree(ab);
+    }
+    ruFree(rr);
+}
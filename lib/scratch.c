@@ -0,0 +1,207 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+
+/*
+ * A bump arena for the temporaries of an operation. Every thread has its
+ * own. The first call to scratchBegin opens it, the matching scratchEnd
+ * wipes and frees everything it handed out, so the temporaries of a request
+ * cost one allocation instead of one each. Outside of an operation the
+ * functions fall back to the heap, which lets the same code run either way.
+ * Nothing handed out from here may be returned to the caller of the library.
+ */
+
+// most operations fit into one block
+#define SCRATCH_BLOCK (16 * 1024)
+#define SCRATCH_ALIGN 16
+// no allocation left in the newest block to pop back to
+#define SCRATCH_NONE ((rusize)-1)
+
+struct dv_scratch {
+    struct dv_arena_block* blocks;  /* the newest one first */
+    rusize last;                    /* offset of the last allocation */
+    uint32_t depth;                 /* nested operations */
+};
+
+// precedes every allocation in the slot of one alignment
+struct dv_scratch_hdr {
+    rusize prev;                    /* offset of the allocation before */
+    bool freed;
+};
+
+static RU_THREAD_LOCAL struct dv_scratch scratch;
+
+static char* blockMem(struct dv_arena_block* ab) {
+    return (char*)(ab + 1);
+}
+
+static struct dv_scratch_hdr* hdrOf(const void* ptr) {
+    return (struct dv_scratch_hdr*)((char*)ptr - SCRATCH_ALIGN);
+}
+
+// where the next allocation starts, behind its header
+static rusize nextOffset(struct dv_arena_block* ab) {
+    uintptr_t at = (uintptr_t)(blockMem(ab) + ab->used);
+    at = (at + SCRATCH_ALIGN - 1) & ~(uintptr_t)(SCRATCH_ALIGN - 1);
+    return (rusize)(at - (uintptr_t)blockMem(ab)) + SCRATCH_ALIGN;
+}
+
+// the block ptr was handed out from or NULL for heap memory
+static struct dv_arena_block* ownBlock(const void* ptr) {
+    const char* p = ptr;
+    for (struct dv_arena_block* ab = scratch.blocks; ab; ab = ab->next) {
+        if (p >= blockMem(ab) && p < blockMem(ab) + ab->size) return ab;
+    }
+    return NULL;
+}
+
+static bool isLast(struct dv_arena_block* ab, const void* ptr) {
+    return ab == scratch.blocks && scratch.last != SCRATCH_NONE &&
+           (const char*)ptr == blockMem(ab) + scratch.last;
+}
+
+// wipes and frees an older block nothing in it is used anymore
+static void dropBlock(struct dv_arena_block* ab) {
+    struct dv_arena_block** at = &scratch.blocks;
+    while (*at != ab) at = &(*at)->next;
+    *at = ab->next;
+    memset(blockMem(ab), 0, ab->used);
+    ruFree(ab);
+}
+
+/**
+ * Opens an operation. Calls may nest, only the outermost one counts.
+ */
+void scratchBegin(void) {
+    scratch.depth++;
+}
+
+/**
+ * Closes an operation, the outermost one releases what it handed out.
+ */
+void scratchEnd(void) {
+    if (!scratch.depth || --scratch.depth) return;
+    struct dv_arena_block* ab = scratch.blocks;
+    while (ab) {
+        struct dv_arena_block* next = ab->next;
+        // temporaries may hold plaintext
+        memset(blockMem(ab), 0, ab->used);
+        ruFree(ab);
+        ab = next;
+    }
+    scratch.blocks = NULL;
+    scratch.last = SCRATCH_NONE;
+}
+
+/**
+ * Returns len zeroed bytes that live until the operation ends or they are
+ * given to #scratchFree.
+ */
+void* scratchAlloc(rusize len) {
+    if (!scratch.depth) return ruMalloc0(len, char);
+    if (!len) len = 1;
+    struct dv_arena_block* ab = scratch.blocks;
+    rusize off = ab? nextOffset(ab) : 0;
+    rusize prev = scratch.last;
+    if (!ab || off + len > ab->size) {
+        rusize size = SCRATCH_BLOCK;
+        while (size < len + 2 * SCRATCH_ALIGN) size *= 2;
+        ab = (struct dv_arena_block*) ruMalloc0(
+                sizeof(struct dv_arena_block) + size, char);
+        ab->size = size;
+        ab->next = scratch.blocks;
+        scratch.blocks = ab;
+        off = nextOffset(ab);
+        prev = SCRATCH_NONE;
+    }
+    char* ptr = blockMem(ab) + off;
+    // the slot may hold the header of an allocation popped before
+    struct dv_scratch_hdr* hdr = hdrOf(ptr);
+    hdr->prev = prev;
+    hdr->freed = false;
+    ab->live++;
+    ab->used = off + len;
+    scratch.last = off;
+    return ptr;
+}
+
+/**
+ * Resizes memory from #scratchAlloc, which may be NULL. The last allocation
+ * grows in place when there is room. Added bytes are zeroed.
+ * @param ptr The memory to resize.
+ * @param oldLen The size it was allocated with.
+ * @param len The new size.
+ */
+void* scratchRealloc(void* ptr, rusize oldLen, rusize len) {
+    if (!ptr) return scratchAlloc(len);
+    struct dv_arena_block* ab = ownBlock(ptr);
+    if (!ab) {
+        char* grown = ruRealloc(ptr, len, char);
+        if (len > oldLen) memset(grown + oldLen, 0, len - oldLen);
+        return grown;
+    }
+    if (isLast(ab, ptr) && scratch.last + len <= ab->size) {
+        if (len < oldLen) memset((char*)ptr + len, 0, oldLen - len);
+        ab->used = scratch.last + (len? len : 1);
+        return ptr;
+    }
+    void* grown = scratchAlloc(len);
+    memcpy(grown, ptr, oldLen < len? oldLen : len);
+    scratchFree(ptr);
+    return grown;
+}
+
+/**
+ * Releases memory from #scratchAlloc. The arena takes memory back from its
+ * end, so temporaries freed in reverse order are reused right away. An
+ * older block goes once all of its allocations are freed, so a buffer that
+ * outgrew its block does not keep the copies it left behind. The rest waits
+ * for the operation to end.
+ */
+void scratchFree(void* ptr) {
+    if (!ptr) return;
+    struct dv_arena_block* ab = ownBlock(ptr);
+    if (!ab) {
+        ruFree(ptr);
+        return;
+    }
+    struct dv_scratch_hdr* freed = hdrOf(ptr);
+    // already freed, or taken back from the end
+    if (freed->freed || (rusize)((char*)ptr - blockMem(ab)) >= ab->used) {
+        return;
+    }
+    freed->freed = true;
+    ab->live--;
+    if (ab != scratch.blocks) {
+        if (!ab->live) dropBlock(ab);
+        return;
+    }
+    while (scratch.last != SCRATCH_NONE) {
+        char* last = blockMem(ab) + scratch.last;
+        struct dv_scratch_hdr* hdr = hdrOf(last);
+        if (!hdr->freed) break;
+        rusize end = ab->used;
+        scratch.last = hdr->prev;
+        ab->used = (rusize)((char*)hdr - blockMem(ab));
+        memset(hdr, 0, end - ab->used);
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+
+dvsession getDvSession(dvSearchSession ss) {
+    dvsession sn = (dvsession) ss;
+    if (!sn || dvSessionType != sn->type ) return NULL;
+    return sn;
+}
+
+static void growSession(dvsession sn, rusize steps) {
+    rusize cap = sn->cap? sn->cap * 2 : 32;
+    if (cap < steps) cap = steps;
+    sn->term = ruRealloc(sn->term, cap + 1, char);
+    sn->chain = ruRealloc(sn->chain, cap * 64, uint8_t);
+    sn->hash = ruRealloc(sn->hash, (cap * 2) + 1, char);
+    sn->cap = cap;
+}
+
+int32_t searchSessionHash(dvsession sn, const char* word, perm_chars* hash) {
+    if (!sn || !word || !hash) return RUE_PARAMETER_NOT_SET;
+    uint8_t digest[32];
+    alloc_chars term = ruUtf8ToLower(word);
+    rusize len = term? strlen(term) : 0;
+    if (!len) {
+        ruFree(term);
+        return RUE_INVALID_PARAMETER;
+    }
+    if (len > sn->cap) growSession(sn, len);
+
+    // the steps of the common prefix are still valid
+    rusize c = 0;
+    while (c < sn->len && c < len && sn->term[c] == term[c]) c++;
+    searchHashResume(&sn->sh, c? &sn->chain[(c - 1) * 64] : NULL);
+    for (; c < len; c++) {
+        searchHashStep(&sn->sh, (uint8_t)term[c], digest);
+        memcpy(&sn->chain[c * 64], sn->sh.msg + 1, 64);
+        sn->hash[c * 2] = (char)sn->sh.msg[1];
+        sn->hash[c * 2 + 1] = (char)sn->sh.msg[2];
+        sn->term[c] = term[c];
+    }
+    sn->len = len;
+    sn->term[len] = '\0';
+    sn->hash[len * 2] = '\0';
+    ruFree(term);
+
+    *hash = sn->hash;
+    return RUE_OK;
+}
+
+/*
+ * A search word only finds index words it is the start of, so when a shorter
+ * prefix had no results neither will the current term.
+ */
+static bool emptyPrefix(dvsession sn) {
+    bool empty = false;
+    for (rusize c = 1; c < sn->len && !empty; c++) {
+        ruList found = NULL;
+        char save = sn->hash[c * 2];
+        sn->hash[c * 2] = '\0';
+        if (ruMapGet(sn->results, sn->hash, &found) == RUE_OK && found) {
+            empty = ruListSize(found, NULL) == 0;
+        }
+        sn->hash[c * 2] = save;
+    }
+    return empty;
+}
+
+static int32_t copyVids(ruList found, ruList* vids) {
+    int32_t ret;
+    ruIterator li = ruListHead(found, &ret);
+    if (ret != RUE_OK) return ret;
+    for (char* vid = ruIterNext(li, char*); vid; vid = ruIterNext(li, char*)) {
+        if (!*vids) {
+            *vids = ruListNew(ruTypeStrFree());
+        }
+        ret = ruListAppend(*vids, ruStrDup(vid));
+        if (ret != RUE_OK) {
+            ruCritLogf("failed adding entry '%s' to list", vid);
+            break;
+        }
+    }
+    return ret;
+}
+
+DVAPI int32_t dvSearchSessionNew(dvCtx dc, dvSearchSession* ss) {
+    if (!dc || !ss) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+    if (!ctx->appId) {
+        dvSetError("Searching requires a context with an app-id");
+        return RUE_INVALID_PARAMETER;
+    }
+
+    dvsession sn = ruMalloc0(1, struct dv_search_session);
+    sn->type = dvSessionType;
+    sn->ctx = ctx;
+    int32_t ret = initSearchHasher(&sn->sh, ctx->appId);
+    if (ret != RUE_OK) {
+        ruFree(sn);
+        return ret;
+    }
+    sn->results = ruMapNew(ruTypeStrFree(), ruTypePtr(ruListFree));
+    *ss = sn;
+    return RUE_OK;
+}
+
+DVAPI int32_t dvSearchSessionFind(dvSearchSession ss, const char* word,
+                                  ruList* vids) {
+    if (!ss || !word || !vids) return RUE_PARAMETER_NOT_SET;
+    dvsession sn = getDvSession(ss);
+    if (!sn) return RUE_INVALID_PARAMETER;
+
+    perm_chars swd = NULL;
+    ruList found = NULL;
+    ruList words = NULL;
+    int32_t ret = searchSessionHash(sn, word, &swd);
+    if (ret != RUE_OK) return ret;
+
+    do {
+        if (ruMapHas(sn->results, swd, NULL)) {
+            ruVerbLogf("serving search word '%s' locally", swd);
+            ruMapGet(sn->results, swd, &found);
+            break;
+        }
+        if (!emptyPrefix(sn)) {
+            words = ruListNew(NULL);
+            ruListAppend(words, swd);
+            ret = dvSearch(sn->ctx, words, &found);
+            if (ret != RUE_OK) {
+                ruListFree(found);
+                found = NULL;
+                break;
+            }
+        }
+        // no results are remembered as an empty list
+        if (!found) found = ruListNew(ruTypeStrFree());
+        ret = ruMapPut(sn->results, ruStrDup(swd), found);
+        if (ret != RUE_OK) {
+            ruCritLogf("failed caching results of '%s'", swd);
+            ruListFree(found);
+            found = NULL;
+        }
+    } while(0);
+
+    if (found) {
+        ret = copyVids(found, vids);
+    }
+    ruListFree(words);
+    return ret;
+}
+
+DVAPI void dvSearchSessionFree(dvSearchSession ss) {
+    dvsession sn = getDvSession(ss);
+    if (!sn) return;
+    freeSearchHasher(&sn->sh);
+    if (sn->term) {
+        // what the user typed
+        memset(sn->term, 0, sn->cap + 1);
+        ruFree(sn->term);
+    }
+    ruFree(sn->chain);
+    ruFree(sn->hash);
+    ruMapFree(sn->results);
+    ruFree(sn);
+}
@@ -0,0 +1,338 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+
+// sha256 initial chaining values
+const uint32_t sha256H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// sha256 round constants
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define BSIG0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BSIG1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SSIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, i) \
+    t1 = h + BSIG1(e) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i]; \
+    t2 = BSIG0(a) + ((a & b) ^ (a & c) ^ (b & c)); \
+    d += t1; \
+    h = t1 + t2;
+
+static uint32_t be32(trans_bytes p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+           (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+/*
+ * The portable compression function, used when the CPU lacks SHA extensions.
+ */
+void sha256BlocksC(uint32_t* state, trans_bytes data, rusize blocks) {
+    uint32_t w[64];
+    uint32_t v[8];
+    uint32_t t1, t2;
+    int i;
+
+    while (blocks--) {
+        for (i = 0; i < 16; i++) {
+            w[i] = be32(data + i*4);
+        }
+        for (i = 16; i < 64; i++) {
+            w[i] = SSIG1(w[i-2]) + w[i-7] + SSIG0(w[i-15]) + w[i-16];
+        }
+        memcpy(v, state, sizeof(v));
+        // 8 rounds per pass so the working variables rotate in place
+        for (i = 0; i < 64; i += 8) {
+            SHA256_ROUND(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], i);
+            SHA256_ROUND(v[7], v[0], v[1], v[2], v[3], v[4], v[5], v[6], i+1);
+            SHA256_ROUND(v[6], v[7], v[0], v[1], v[2], v[3], v[4], v[5], i+2);
+            SHA256_ROUND(v[5], v[6], v[7], v[0], v[1], v[2], v[3], v[4], i+3);
+            SHA256_ROUND(v[4], v[5], v[6], v[7], v[0], v[1], v[2], v[3], i+4);
+            SHA256_ROUND(v[3], v[4], v[5], v[6], v[7], v[0], v[1], v[2], i+5);
+            SHA256_ROUND(v[2], v[3], v[4], v[5], v[6], v[7], v[0], v[1], i+6);
+            SHA256_ROUND(v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[0], i+7);
+        }
+        for (i = 0; i < 8; i++) {
+            state[i] += v[i];
+        }
+        data += 64;
+    }
+}
+
+
+#ifdef DV_X86_SIMD
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+/*
+ * The compression function on the SHA extensions. The state is kept in the
+ * ABEF/CDGH register layout sha256rnds2 works on.
+ */
+DV_TARGET("sha,sse4.1")
+void sha256BlocksShani(uint32_t* state, trans_bytes data, rusize blocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                         0x0405060700010203ULL);
+    __m128i m[4], msg, abef, cdgh;
+    __m128i tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+    __m128i st1 = _mm_loadu_si128((const __m128i*)&state[4]);
+    int i;
+
+    tmp = _mm_shuffle_epi32(tmp, 0xb1);
+    st1 = _mm_shuffle_epi32(st1, 0x1b);
+    __m128i st0 = _mm_alignr_epi8(tmp, st1, 8);
+    st1 = _mm_blend_epi16(st1, tmp, 0xf0);
+
+    while (blocks--) {
+        abef = st0;
+        cdgh = st1;
+        for (i = 0; i < 4; i++) {
+            m[i] = _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i*)(data + i*16)), bswap);
+        }
+        // 4 rounds per pass, scheduling the words of the pass 4 ahead
+        for (i = 0; i < 16; i++) {
+            msg = _mm_add_epi32(m[i & 3],
+                    _mm_loadu_si128((const __m128i*)&sha256K[i*4]));
+            st1 = _mm_sha256rnds2_epu32(st1, st0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0e);
+            st0 = _mm_sha256rnds2_epu32(st0, st1, msg);
+            if (i < 12) {
+                msg = _mm_sha256msg1_epu32(m[i & 3], m[(i+1) & 3]);
+                msg = _mm_add_epi32(msg, _mm_alignr_epi8(m[(i+3) & 3],
+                                                         m[(i+2) & 3], 4));
+                m[i & 3] = _mm_sha256msg2_epu32(msg, m[(i+3) & 3]);
+            }
+        }
+        st0 = _mm_add_epi32(st0, abef);
+        st1 = _mm_add_epi32(st1, cdgh);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(st0, 0x1b);
+    st1 = _mm_shuffle_epi32(st1, 0xb1);
+    st0 = _mm_blend_epi16(tmp, st1, 0xf0);
+    st1 = _mm_alignr_epi8(st1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&state[0], st0);
+    _mm_storeu_si128((__m128i*)&state[4], st1);
+}
+
+#define X8_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), \
+                                      _mm256_slli_epi32(x, 32 - (n)))
+#define X8_ADD(a, b) _mm256_add_epi32(a, b)
+#define X8_XOR3(a, b, c) _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+#define X8_BSIG0(x) X8_XOR3(X8_ROTR(x, 2), X8_ROTR(x, 13), X8_ROTR(x, 22))
+#define X8_BSIG1(x) X8_XOR3(X8_ROTR(x, 6), X8_ROTR(x, 11), X8_ROTR(x, 25))
+#define X8_SSIG0(x) X8_XOR3(X8_ROTR(x, 7), X8_ROTR(x, 18), _mm256_srli_epi32(x, 3))
+#define X8_SSIG1(x) X8_XOR3(X8_ROTR(x, 17), X8_ROTR(x, 19), _mm256_srli_epi32(x, 10))
+#define X8_CH(e, f, g) _mm256_xor_si256(_mm256_and_si256(e, f), \
+                                        _mm256_andnot_si256(e, g))
+#define X8_MAJ(a, b, c) _mm256_or_si256(_mm256_and_si256(a, b), \
+                        _mm256_and_si256(c, _mm256_or_si256(a, b)))
+#define X8_ROUND(a, b, c, d, e, f, g, h, i) \
+    t1 = X8_ADD(X8_ADD(X8_ADD(h, X8_BSIG1(e)), X8_CH(e, f, g)), \
+                X8_ADD(_mm256_set1_epi32((int)sha256K[i]), w[i])); \
+    t2 = X8_ADD(X8_BSIG0(a), X8_MAJ(a, b, c)); \
+    d = X8_ADD(d, t1); \
+    h = X8_ADD(t1, t2);
+
+/*
+ * Advances 8 independent sha256 messages of equal block count in lockstep,
+ * one message per 32 bit lane.
+ */
+DV_TARGET("avx2")
+static void sha256BlocksAvx2(uint32_t* states, trans_bytes* data,
+                             rusize blocks) {
+    __m256i w[64];
+    __m256i s[8], v[8];
+    __m256i t1, t2;
+    uint32_t out[8];
+    rusize off = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        s[i] = _mm256_setr_epi32(
+                (int)states[i], (int)states[8+i], (int)states[16+i],
+                (int)states[24+i], (int)states[32+i], (int)states[40+i],
+                (int)states[48+i], (int)states[56+i]);
+    }
+    while (blocks--) {
+        for (i = 0; i < 16; i++) {
+            w[i] = _mm256_setr_epi32(
+                    (int)be32(data[0] + off + i*4), (int)be32(data[1] + off + i*4),
+                    (int)be32(data[2] + off + i*4), (int)be32(data[3] + off + i*4),
+                    (int)be32(data[4] + off + i*4), (int)be32(data[5] + off + i*4),
+                    (int)be32(data[6] + off + i*4), (int)be32(data[7] + off + i*4));
+        }
+        for (i = 16; i < 64; i++) {
+            w[i] = X8_ADD(X8_ADD(X8_SSIG1(w[i-2]), w[i-7]),
+                          X8_ADD(X8_SSIG0(w[i-15]), w[i-16]));
+        }
+        memcpy(v, s, sizeof(v));
+        for (i = 0; i < 64; i += 8) {
+            X8_ROUND(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], i);
+            X8_ROUND(v[7], v[0], v[1], v[2], v[3], v[4], v[5], v[6], i+1);
+            X8_ROUND(v[6], v[7], v[0], v[1], v[2], v[3], v[4], v[5], i+2);
+            X8_ROUND(v[5], v[6], v[7], v[0], v[1], v[2], v[3], v[4], i+3);
+            X8_ROUND(v[4], v[5], v[6], v[7], v[0], v[1], v[2], v[3], i+4);
+            X8_ROUND(v[3], v[4], v[5], v[6], v[7], v[0], v[1], v[2], i+5);
+            X8_ROUND(v[2], v[3], v[4], v[5], v[6], v[7], v[0], v[1], i+6);
+            X8_ROUND(v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[0], i+7);
+        }
+        for (i = 0; i < 8; i++) {
+            s[i] = X8_ADD(s[i], v[i]);
+        }
+        off += 64;
+    }
+    for (i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)&out[0], s[i]);
+        for (int l = 0; l < 8; l++) {
+            states[l*8 + i] = out[l];
+        }
+    }
+}
+
+/*
+ * Hashes up to 8 lanes on AVX2, idle lanes are padded out.
+ */
+void sha256LanesAvx2(uint32_t* states, trans_bytes* data, int lanes,
+                     rusize blocks) {
+    uint32_t all[SHA256_LANES * 8] = {0};
+    trans_bytes full[SHA256_LANES];
+    rusize used = lanes * 8 * sizeof(uint32_t);
+    // idle lanes hash a copy of the first message into the void
+    for (int l = 0; l < SHA256_LANES; l++) {
+        full[l] = data[l < lanes? l : 0];
+    }
+    memcpy(all, states, used);
+    sha256BlocksAvx2(all, full, blocks);
+    memcpy(states, all, used);
+}
+#endif
+
+/**
+ * Runs the sha256 compression function over the given, already padded blocks.
+ * @param state The 8 word chaining state to update.
+ * @param data Start of the 64 byte blocks to process.
+ * @param blocks Number of blocks to process.
+ */
+void sha256Blocks(uint32_t* state, trans_bytes data, rusize blocks) {
+    cryptoProvider()->sha256Blocks(state, data, blocks);
+}
+
+void sha256BlocksLanes(uint32_t* states, trans_bytes* data, int lanes,
+                       rusize blocks) {
+    const struct dv_crypto_provider* cp = cryptoProvider();
+    if (lanes > 1 && cp->sha256Lanes) {
+        cp->sha256Lanes(states, data, lanes, blocks);
+        return;
+    }
+    for (int l = 0; l < lanes; l++) {
+        sha256Blocks(&states[l*8], data[l], blocks);
+    }
+}
+
+void sha256StateDigest(const uint32_t* state, alloc_bytes digest) {
+    for (int i = 0; i < 8; i++) {
+        *digest++ = (uint8_t)(state[i] >> 24);
+        *digest++ = (uint8_t)(state[i] >> 16);
+        *digest++ = (uint8_t)(state[i] >> 8);
+        *digest++ = (uint8_t)state[i];
+    }
+}
+
+void sha256Start(struct dv_sha256* sc) {
+    memcpy(sc->state, sha256H0, sizeof(sc->state));
+    sc->len = 0;
+}
+
+void sha256Update(struct dv_sha256* sc, trans_bytes data, rusize len) {
+    rusize used = (rusize)(sc->len % 64);
+    sc->len += len;
+    if (used) {
+        rusize fill = 64 - used;
+        if (len < fill) {
+            memcpy(sc->buf + used, data, len);
+            return;
+        }
+        memcpy(sc->buf + used, data, fill);
+        sha256Blocks(sc->state, sc->buf, 1);
+        data += fill;
+        len -= fill;
+    }
+    if (len >= 64) {
+        sha256Blocks(sc->state, data, len / 64);
+        data += len - len % 64;
+        len %= 64;
+    }
+    memcpy(sc->buf, data, len);
+}
+
+void sha256Finish(struct dv_sha256* sc, alloc_bytes digest) {
+    uint8_t tail[128];
+    rusize rest = (rusize)(sc->len % 64);
+    rusize tlen = rest < 56? 64 : 128;
+    uint64_t bits = sc->len * 8;
+
+    memset(tail, 0, tlen);
+    memcpy(tail, sc->buf, rest);
+    tail[rest] = 0x80;
+    for (int i = 0; i < 8; i++) {
+        tail[tlen - 1 - i] = (uint8_t)(bits >> (i * 8));
+    }
+    sha256Blocks(sc->state, tail, tlen / 64);
+    sha256StateDigest(sc->state, digest);
+}
+
+/**
+ * Computes the sha256 digest of the given data.
+ * @param data The data to hash.
+ * @param len Length of the data.
+ * @param digest 32 byte buffer receiving the digest.
+ */
+void sha256Digest(trans_bytes data, rusize len, alloc_bytes digest) {
+    struct dv_sha256 sc;
+    sha256Start(&sc);
+    sha256Update(&sc, data, len);
+    sha256Finish(&sc, digest);
+}
@@ -0,0 +1,840 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+#include <mbedtls/platform_util.h>
+#include <mbedtls/version.h>
+
+// cbc keeps the padded block and the mac back until the end
+#define CBC_HOLD (BLOCKSIZE + MACSIZE)
+// base64 chars decoded per step, STREAM_CHUNK - 1 bytes at most
+#define B64_STEP (STREAM_CHUNK / 3 * 4)
+
+/*
+ * The GCM streaming calls changed their signature with Mbed TLS 3.
+ */
+static int gcmStart(dvcrypt cs, int mode) {
+#if MBEDTLS_VERSION_MAJOR < 3
+    return mbedtls_gcm_starts(&cs->gc, mode, cs->iv, GCM_IVSIZE, NULL, 0);
+#else
+    return mbedtls_gcm_starts(&cs->gc, mode, cs->iv, GCM_IVSIZE);
+#endif
+}
+
+// all but the last call must be given multiples of BLOCKSIZE
+static int gcmUpdate(dvcrypt cs, rusize len, trans_bytes in, alloc_bytes out) {
+#if MBEDTLS_VERSION_MAJOR < 3
+    return mbedtls_gcm_update(&cs->gc, len, in, out);
+#else
+    size_t olen;
+    return mbedtls_gcm_update(&cs->gc, in, len, out, len, &olen);
+#endif
+}
+
+static int gcmFinish(dvcrypt cs, alloc_bytes tag) {
+#if MBEDTLS_VERSION_MAJOR < 3
+    return mbedtls_gcm_finish(&cs->gc, tag, GCM_TAGSIZE);
+#else
+    size_t olen;
+    return mbedtls_gcm_finish(&cs->gc, NULL, 0, &olen, tag, GCM_TAGSIZE);
+#endif
+}
+
+static int32_t emit(dvcrypt cs, const void* data, rusize len) {
+    if (!len) return RUE_OK;
+    int32_t ret = cs->writer(cs->writeCtx, data, len);
+    if (ret != RUE_OK) {
+        dvSetError("Stream writer failed with %d", ret);
+    }
+    return ret;
+}
+
+/*
+ * Passes decrypted bytes on to the writer, inflating them first if the recipe
+ * says so. last marks the end of the text.
+ */
+static int32_t emitText(dvcrypt cs, trans_bytes data, rusize len, bool last) {
+    if (cs->codec != CODEC_DEFLATE) return emit(cs, data, len);
+    return inflateChunk(cs->zs, data, len, cs->writer, cs->writeCtx, last);
+}
+
+/*
+ * Sets up the cipher once the recipe and the IV are known.
+ */
+static int32_t startCipher(dvcrypt cs) {
+    const struct dv_crypto_provider* cp = cryptoProvider();
+    int r;
+    if (cs->recipe == RECIPE_AES_GCM) {
+        r = mbedtls_gcm_setkey(&cs->gc, MBEDTLS_CIPHER_ID_AES, cs->key,
+                               KEYBITS);
+        if (!r) r = gcmStart(cs, cs->encrypt? MBEDTLS_GCM_ENCRYPT :
+                                              MBEDTLS_GCM_DECRYPT);
+    } else {
+        r = cp->aesSetKey(&cs->ak, cs->key, cs->encrypt? MBEDTLS_AES_ENCRYPT :
+                                                         MBEDTLS_AES_DECRYPT);
+        sha256Start(&cs->mac);
+    }
+    if (r) {
+        dvSetError("Failed setting crypto key. EC: %d", r);
+        return RUE_GENERAL;
+    }
+    return RUE_OK;
+}
+
+/*
+ * Base64 encodes cipher bytes to the writer, carrying what is short of a
+ * 3 byte quantum over to the next call.
+ */
+static int32_t emitCipher(dvcrypt cs, trans_bytes data, rusize len) {
+    const struct dv_crypto_provider* cp = cryptoProvider();
+    rusize tlen = 0, olen = 0;
+    if (cs->carryLen) {
+        while (cs->carryLen < 3 && len) {
+            cs->carry[cs->carryLen++] = *data++;
+            len--;
+        }
+        if (cs->carryLen < 3) return RUE_OK;
+        cp->b64Encode((alloc_bytes)cs->text, 5, &olen, cs->carry, 3);
+        tlen = olen;
+        cs->carryLen = 0;
+    }
+    rusize full = len - len % 3;
+    if (full) {
+        cp->b64Encode((alloc_bytes)cs->text + tlen, full / 3 * 4 + 1, &olen,
+                      data, full);
+        tlen += olen;
+    }
+    cs->carryLen = len - full;
+    if (cs->carryLen) memcpy(cs->carry, data + full, cs->carryLen);
+    return emit(cs, cs->text, tlen);
+}
+
+static int32_t encryptBlocks(dvcrypt cs, trans_bytes data, rusize len) {
+    int r;
+    if (cs->recipe == RECIPE_AES_GCM) {
+        r = gcmUpdate(cs, len, data, cs->work);
+    } else {
+        r = cryptoProvider()->aesCbc(&cs->ak, MBEDTLS_AES_ENCRYPT, len, cs->iv,
+                                     data, cs->work);
+    }
+    if (r) {
+        dvSetError("Failed encrypting the payload. EC: %d", r);
+        return RUE_GENERAL;
+    }
+    return emitCipher(cs, cs->work, len);
+}
+
+static int32_t encryptStart(dvcrypt cs) {
+    if (cs->started) return RUE_OK;
+    cs->started = true;
+    return emit(cs, cs->head, recipeHead(cs->recipe, CODEC_PLAIN, 0, cs->cs,
+                                         cs->iv, cs->head));
+}
+
+static int32_t encryptUpdate(dvcrypt cs, trans_bytes data, rusize len) {
+    int32_t ret = encryptStart(cs);
+    if (ret != RUE_OK || !len) return ret;
+    if (cs->recipe != RECIPE_AES_GCM) {
+        sha256Update(&cs->mac, data, len);
+    }
+    while (len) {
+        rusize take = STREAM_CHUNK - cs->pendLen;
+        if (take > len) take = len;
+        memcpy(cs->pend + cs->pendLen, data, take);
+        cs->pendLen += take;
+        data += take;
+        len -= take;
+        rusize blocks = cs->pendLen - cs->pendLen % BLOCKSIZE;
+        if (!blocks) continue;
+        ret = encryptBlocks(cs, cs->pend, blocks);
+        if (ret != RUE_OK) return ret;
+        cs->pendLen -= blocks;
+        memmove(cs->pend, cs->pend + blocks, cs->pendLen);
+    }
+    return RUE_OK;
+}
+
+static int32_t encryptFinish(dvcrypt cs) {
+    int32_t ret = encryptStart(cs);
+    if (ret != RUE_OK) return ret;
+
+    if (cs->recipe == RECIPE_AES_GCM) {
+        // the partial block and the tag
+        uint8_t tag[GCM_TAGSIZE];
+        if (cs->pendLen) {
+            ret = encryptBlocks(cs, cs->pend, cs->pendLen);
+            if (ret != RUE_OK) return ret;
+        }
+        int r = gcmFinish(cs, tag);
+        if (r) {
+            dvSetError("Failed finishing the payload. EC: %d", r);
+            return RUE_GENERAL;
+        }
+        ret = emitCipher(cs, tag, GCM_TAGSIZE);
+    } else {
+        // pkcs7 padding and the mac of the text, just as cbcPlain does
+        uint8_t pad = (uint8_t)(BLOCKSIZE - cs->pendLen);
+        memset(cs->pend + cs->pendLen, pad, pad);
+        sha256Finish(&cs->mac, cs->pend + BLOCKSIZE);
+        ret = encryptBlocks(cs, cs->pend, CBC_HOLD);
+    }
+    if (ret != RUE_OK) return ret;
+
+    // the final quantum with its padding
+    if (!cs->carryLen) return RUE_OK;
+    rusize olen = 0;
+    cryptoProvider()->b64Encode((alloc_bytes)cs->text, 5, &olen,
+                                cs->carry, cs->carryLen);
+    cs->carryLen = 0;
+    return emit(cs, cs->text, olen);
+}
+
+/*
+ * Collects the recipe:cs:iv:encoding: head and sets up the cipher from it.
+ * Stores the number of chars consumed in used.
+ */
+static int32_t parseHead(dvcrypt cs, trans_chars data, rusize len,
+                         rusize* used) {
+    rusize i = 0;
+    while (i < len) {
+        char c = data[i++];
+        if (cs->headLen == RECIPE_HEAD_SIZE - 1) {
+            dvSetError("Cipher recipe has no valid head");
+            return DVE_PROTOCOL_ERROR;
+        }
+        cs->head[cs->headLen++] = c;
+        if (c != ':') continue;
+        rusize colons = 0;
+        for (rusize j = 0; j < cs->headLen; j++) {
+            if (cs->head[j] == ':') colons++;
+        }
+        if (colons < 4) continue;
+
+        // the payload starts here
+        perm_chars payload = NULL;
+        rusize payloadLen = 0;
+        uint32_t dictId = 0;
+        cs->head[cs->headLen] = '\0';
+        int32_t ret = parseRecipe(cs->head, &cs->recipe, cs->iv, cs->cs,
+                                  &cs->codec, &dictId, &payload, &payloadLen);
+        if (ret != RUE_OK) return ret;
+        if (cs->codec == CODEC_DEFLATE) {
+            dvdict dict = NULL;
+            if (dictId) {
+                dict = findDict(cs->dicts, dictId);
+                if (!dict) {
+                    dvSetError("Dictionary %08x is not registered", dictId);
+                    return RUE_FILE_NOT_FOUND;
+                }
+            }
+            ret = newInflater(dict, &cs->zs);
+            if (ret != RUE_OK) return ret;
+        }
+        ret = startCipher(cs);
+        if (ret != RUE_OK) return ret;
+        cs->started = true;
+        break;
+    }
+    *used = i;
+    return RUE_OK;
+}
+
+/*
+ * Decrypts up to STREAM_CHUNK cipher bytes, holding back what is needed to
+ * check the data at the end.
+ */
+static int32_t decryptBytes(dvcrypt cs, trans_bytes data, rusize len) {
+    rusize hold = cs->recipe == RECIPE_AES_GCM? GCM_TAGSIZE : CBC_HOLD;
+    int r;
+    memcpy(cs->pend + cs->pendLen, data, len);
+    cs->pendLen += len;
+    if (cs->pendLen <= hold) return RUE_OK;
+    rusize blocks = cs->pendLen - hold;
+    blocks -= blocks % BLOCKSIZE;
+    if (!blocks) return RUE_OK;
+    if (cs->recipe == RECIPE_AES_GCM) {
+        r = gcmUpdate(cs, blocks, cs->pend, cs->work);
+    } else {
+        r = cryptoProvider()->aesCbc(&cs->ak, MBEDTLS_AES_DECRYPT, blocks,
+                                     cs->iv, cs->pend, cs->work);
+        sha256Update(&cs->mac, cs->work, blocks);
+    }
+    if (r) {
+        dvSetError("Failed decrypting the payload. EC: %d", r);
+        return RUE_GENERAL;
+    }
+    cs->pendLen -= blocks;
+    memmove(cs->pend, cs->pend + blocks, cs->pendLen);
+    return emitText(cs, cs->work, blocks, false);
+}
+
+/*
+ * Decodes base64 chars, carrying what is short of a 4 char quantum over to
+ * the next call.
+ */
+static int32_t decodeChars(dvcrypt cs, trans_chars data, rusize len) {
+    const struct dv_crypto_provider* cp = cryptoProvider();
+    rusize olen = 0;
+    int32_t ret;
+    if (cs->carryLen) {
+        while (cs->carryLen < 4 && len) {
+            cs->carry[cs->carryLen++] = (uint8_t)*data++;
+            len--;
+        }
+        if (cs->carryLen < 4) return RUE_OK;
+        cs->carryLen = 0;
+        if (cp->b64Decode(cs->work, 3, &olen, cs->carry, 4)) {
+            dvSetError("Failed decoding the payload");
+            return DVE_PROTOCOL_ERROR;
+        }
+        ret = decryptBytes(cs, cs->work, olen);
+        if (ret != RUE_OK) return ret;
+    }
+    while (len >= 4) {
+        rusize step = len < B64_STEP? len - len % 4 : B64_STEP;
+        if (cp->b64Decode(cs->work, STREAM_CHUNK, &olen, (trans_bytes)data,
+                          step)) {
+            dvSetError("Failed decoding the payload");
+            return DVE_PROTOCOL_ERROR;
+        }
+        ret = decryptBytes(cs, cs->work, olen);
+        if (ret != RUE_OK) return ret;
+        data += step;
+        len -= step;
+    }
+    if (len) memcpy(cs->carry, data, len);
+    cs->carryLen = len;
+    return RUE_OK;
+}
+
+static int32_t decryptUpdate(dvcrypt cs, trans_chars data, rusize len) {
+    if (!cs->started) {
+        rusize used = 0;
+        int32_t ret = parseHead(cs, data, len, &used);
+        if (ret != RUE_OK) return ret;
+        data += used;
+        len -= used;
+    }
+    return decodeChars(cs, data, len);
+}
+
+static int32_t decryptFinish(dvcrypt cs) {
+    int r;
+    if (!cs->started || cs->carryLen) {
+        dvSetError("Cipher recipe is incomplete");
+        return DVE_PROTOCOL_ERROR;
+    }
+    if (cs->recipe == RECIPE_AES_GCM) {
+        uint8_t tag[GCM_TAGSIZE];
+        if (cs->pendLen < GCM_TAGSIZE) {
+            dvSetError("Payload is shorter than the tag");
+            return DVE_PROTOCOL_ERROR;
+        }
+        rusize len = cs->pendLen - GCM_TAGSIZE;
+        r = gcmUpdate(cs, len, cs->pend, cs->work);
+        if (!r) r = gcmFinish(cs, tag);
+        if (r) {
+            dvSetError("Failed decrypting the payload. EC: %d", r);
+            return RUE_GENERAL;
+        }
+        if (!macEquals(tag, cs->pend + len, GCM_TAGSIZE)) {
+            dvSetError("Tag mismatch");
+            return DVE_INVALID_CREDENTIALS;
+        }
+        return emitText(cs, cs->work, len, true);
+    }
+
+    uint8_t digest[MACSIZE];
+    if (cs->pendLen != CBC_HOLD) {
+        dvSetError("Payload size is not valid");
+        return DVE_PROTOCOL_ERROR;
+    }
+    r = cryptoProvider()->aesCbc(&cs->ak, MBEDTLS_AES_DECRYPT, CBC_HOLD,
+                                 cs->iv, cs->pend, cs->work);
+    if (r) {
+        dvSetError("Failed decrypting the payload. EC: %d", r);
+        return RUE_GENERAL;
+    }
+    uint8_t pad = cs->work[BLOCKSIZE - 1];
+    if (!pad || pad > BLOCKSIZE) {
+        dvSetError("Invalid padding");
+        return DVE_INVALID_CREDENTIALS;
+    }
+    rusize len = BLOCKSIZE - pad;
+    sha256Update(&cs->mac, cs->work, len);
+    sha256Finish(&cs->mac, digest);
+    if (!macEquals(digest, cs->work + BLOCKSIZE, MACSIZE)) {
+        dvSetError("Mac mismatch");
+        return DVE_INVALID_CREDENTIALS;
+    }
+    return emitText(cs, cs->work, len, true);
+}
+
+int32_t newCryptStream(trans_bytes key, const char* cs, enum dvRecipe recipe,
+                       bool encrypt, dvWriteFn writer, void* writeCtx,
+                       dvcrypt* stream) {
+    if (!key || !writer || !stream) return RUE_PARAMETER_NOT_SET;
+
+    dvcrypt st = ruMalloc0(1, struct dv_crypt_stream);
+    st->type = dvStreamType;
+    st->encrypt = encrypt;
+    st->recipe = recipe;
+    memcpy(st->key, key, sizeof(st->key));
+    for (int i = 0; cs && i < 2 && cs[i]; i++) st->cs[i] = cs[i];
+    st->writer = writer;
+    st->writeCtx = writeCtx;
+    mbedtls_gcm_init(&st->gc);
+    // room for a chunk next to what is held back
+    st->pend = ruMalloc0(STREAM_CHUNK + 2 * CBC_HOLD, uint8_t);
+    st->work = ruMalloc0(STREAM_CHUNK + 2 * CBC_HOLD, uint8_t);
+    st->text = ruMalloc0(STREAM_CHUNK / 3 * 4 + 16, char);
+
+    int32_t ret = RUE_OK;
+    if (encrypt) {
+        // the recipe is known, so is the IV
+        ret = mkIv(st->iv, BLOCKSIZE);
+        if (ret == RUE_OK) ret = startCipher(st);
+    }
+    if (ret != RUE_OK) {
+        freeCryptStream(st);
+        return ret;
+    }
+    *stream = st;
+    return RUE_OK;
+}
+
+int32_t cryptStreamUpdate(dvcrypt cs, trans_bytes data, rusize len) {
+    if (!cs || (!data && len)) return RUE_PARAMETER_NOT_SET;
+    if (cs->done) {
+        dvSetError("Stream is finished");
+        return RUE_INVALID_PARAMETER;
+    }
+    int32_t ret = cs->encrypt? encryptUpdate(cs, data, len) :
+                  decryptUpdate(cs, (trans_chars)data, len);
+    if (ret != RUE_OK) cs->done = true;
+    return ret;
+}
+
+int32_t cryptStreamFinish(dvcrypt cs) {
+    if (!cs) return RUE_PARAMETER_NOT_SET;
+    if (cs->done) {
+        dvSetError("Stream is finished");
+        return RUE_INVALID_PARAMETER;
+    }
+    cs->done = true;
+    int32_t ret = cs->encrypt? encryptFinish(cs) : decryptFinish(cs);
+    // nothing of the text stays around
+    mbedtls_platform_zeroize(cs->pend, STREAM_CHUNK + 2 * CBC_HOLD);
+    mbedtls_platform_zeroize(cs->work, STREAM_CHUNK + 2 * CBC_HOLD);
+    return ret;
+}
+
+void freeCryptStream(dvcrypt cs) {
+    if (!cs) return;
+    cryptoProvider()->aesFree(&cs->ak);
+    mbedtls_gcm_free(&cs->gc);
+    freeInflater(cs->zs);
+    if (cs->pend) mbedtls_platform_zeroize(cs->pend, STREAM_CHUNK + 2 * CBC_HOLD);
+    if (cs->work) mbedtls_platform_zeroize(cs->work, STREAM_CHUNK + 2 * CBC_HOLD);
+    ruFree(cs->pend);
+    ruFree(cs->work);
+    ruFree(cs->text);
+    mbedtls_platform_zeroize(cs, sizeof(struct dv_crypt_stream));
+    ruFree(cs);
+}
+
+static dvcrypt getCryptStream(dvCryptStream cs) {
+    dvcrypt st = (dvcrypt) cs;
+    if (!st || dvStreamType != st->type) return NULL;
+    return st;
+}
+
+static int32_t newCtxStream(dvCtx dc, bool encrypt, dvWriteFn writer,
+                            void* writeCtx, dvCryptStream* cs) {
+    if (!dc || !writer || !cs) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+    dvcrypt st = NULL;
+    int32_t ret = newCryptStream(ctx->key, ctx->appIdEnd, ctx->recipe, encrypt,
+                                 writer, writeCtx, &st);
+    if (ret != RUE_OK) return ret;
+    st->dicts = ctx->dicts;
+    *cs = st;
+    return ret;
+}
+
+DVAPI int32_t dvEncryptStreamNew(dvCtx dc, dvWriteFn writer, void* writeCtx,
+                                 dvCryptStream* cs) {
+    return newCtxStream(dc, true, writer, writeCtx, cs);
+}
+
+DVAPI int32_t dvDecryptStreamNew(dvCtx dc, dvWriteFn writer, void* writeCtx,
+                                 dvCryptStream* cs) {
+    return newCtxStream(dc, false, writer, writeCtx, cs);
+}
+
+DVAPI int32_t dvCryptStreamUpdate(dvCryptStream cs, const void* data,
+                                  size_t len) {
+    if (!cs) return RUE_PARAMETER_NOT_SET;
+    dvcrypt st = getCryptStream(cs);
+    if (!st) return RUE_INVALID_PARAMETER;
+    return cryptStreamUpdate(st, data, len);
+}
+
+DVAPI int32_t dvCryptStreamFinish(dvCryptStream cs) {
+    if (!cs) return RUE_PARAMETER_NOT_SET;
+    dvcrypt st = getCryptStream(cs);
+    if (!st) return RUE_INVALID_PARAMETER;
+    return cryptStreamFinish(st);
+}
+
+DVAPI void dvCryptStreamFree(dvCryptStream cs) {
+    freeCryptStream(getCryptStream(cs));
+}
+
+/*
+ * Holds the request body of dvAddStream, the json with the cipher recipe
+ * encrypted as the reader delivers the data.
+ */
+struct add_upload {
+    dvReadFn reader;
+    void* readCtx;
+    dvcrypt cs;
+    alloc_bytes in;     /* STREAM_CHUNK of pid data */
+    alloc_chars out;    /* pending body bytes */
+    rusize outPos;
+    rusize outLen;
+    rusize outCap;
+    bool done;          /* body is complete */
+    int32_t ret;        /* why the upload was aborted */
+};
+
+static int32_t uploadWriter(void* ctx, const void* data, size_t len) {
+    struct add_upload* au = ctx;
+    if (au->outLen + len > au->outCap) {
+        au->outCap = (au->outLen + len) * 2;
+        au->out = ruRealloc(au->out, au->outCap, char);
+    }
+    memcpy(au->out + au->outLen, data, len);
+    au->outLen += len;
+    return RUE_OK;
+}
+
+static int32_t fillUpload(struct add_upload* au) {
+    au->outPos = au->outLen = 0;
+    while (!au->outLen && !au->done) {
+        size_t got = 0;
+        int32_t ret = au->reader(au->readCtx, au->in, STREAM_CHUNK, &got);
+        if (ret != RUE_OK) {
+            dvSetError("Stream reader failed with %d", ret);
+            return ret;
+        }
+        if (got) {
+            ret = cryptStreamUpdate(au->cs, au->in, got > STREAM_CHUNK?
+                                                    STREAM_CHUNK : got);
+            if (ret != RUE_OK) return ret;
+            continue;
+        }
+        ret = cryptStreamFinish(au->cs);
+        if (ret != RUE_OK) return ret;
+        // close the data string and the request
+        uploadWriter(au, "\"}", 2);
+        au->done = true;
+    }
+    return RUE_OK;
+}
+
+static rusize uploadRead(void* ctx, char* buf, rusize size) {
+    struct add_upload* au = ctx;
+    if (au->outPos == au->outLen) {
+        au->ret = fillUpload(au);
+        if (au->ret != RUE_OK) return CURL_READFUNC_ABORT;
+    }
+    rusize len = au->outLen - au->outPos;
+    if (len > size) len = size;
+    memcpy(buf, au->out + au->outPos, len);
+    au->outPos += len;
+    return len;
+}
+
+DVAPI int32_t dvAddStream(dvCtx dc, dvReadFn reader, void* readCtx,
+                          ruList indexWords, char** vid) {
+    if (!dc || !reader || !vid) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+
+    int32_t ret;
+    struct add_upload au;
+    struct dv_req_io io;
+    memset(&au, 0, sizeof(au));
+    memset(&io, 0, sizeof(io));
+
+    // to free
+    ruJson jrq = NULL;
+    ruJson jsn = NULL;
+    alloc_chars response = NULL;
+
+    do {
+        ret = newCryptStream(ctx->key, ctx->appIdEnd, ctx->recipe, true,
+                             uploadWriter, &au, &au.cs);
+        if (ret != RUE_OK) break;
+
+        jrq = ruJsonStart(true);
+        ruJsonSetKeyInt(jrq, "version", PROTO_VERSION);
+        ruJsonSetKeyStr(jrq, "op", "add");
+        if (indexWords) {
+            ret = encodeWordList(indexWords, jrq, "words");
+            if (ret != RUE_OK) break;
+        }
+        perm_chars str =  NULL;
+        ret = ruJsonWrite(jrq, &str);
+        if (ret != RUE_OK) break;
+        // reopen the object for the data the stream delivers
+        perm_chars end = strrchr(str, '}');
+        if (!end) {
+            ret = RUE_GENERAL;
+            break;
+        }
+        uploadWriter(&au, str, (rusize)(end - str));
+        uploadWriter(&au, ",\"data\":\"", 9);
+
+        au.reader = reader;
+        au.readCtx = readCtx;
+        au.in = ruMalloc0(STREAM_CHUNK, uint8_t);
+        io.field = JSON_FIELD;
+        io.read = uploadRead;
+        io.readCtx = &au;
+        ret = doStreamRequest(ctx, ctx->serviceUrl, NULL, &io, &response, NULL);
+        if (au.ret != RUE_OK) ret = au.ret;
+        if (ret != RUE_OK) {
+            ruCritLogf("failed to add data to %s. Ec: %d", ctx->serviceUrl, ret);
+            break;
+        }
+        // parse response
+        jsn = getJson(response);
+        ret = parseStatus(jsn, NULL);
+        if (ret != RUE_OK) break;
+        *vid = ruJsonKeyStrDup(jsn, "vid", &ret);
+    } while(0);
+
+    freeCryptStream(au.cs);
+    ruFree(au.in);
+    ruFree(au.out);
+    ruJsonFree(jrq);
+    ruJsonFree(jsn);
+    ruFree(response);
+    return ret;
+}
+
+/*
+ * Splits the response of dvGetStream into the cipher recipe, which goes to
+ * a decrypt stream, and the rest of the json, which is small and parsed
+ * once it is complete.
+ */
+struct get_download {
+    dvcrypt cs;
+    ruString skeleton;      /* the response without the recipe */
+    char str[8];            /* start of the last string outside the recipe */
+    rusize strLen;
+    bool inStr;
+    bool escaped;
+    bool inData;            /* within the recipe string */
+    bool gotData;
+    char lastToken;         /* last structural char outside of strings */
+    char dec[STREAM_CHUNK]; /* unescaped recipe chunk */
+    int32_t ret;            /* why the download was aborted */
+};
+
+static int32_t scanRecipe(struct get_download* gd, trans_chars ptr,
+                          rusize len, rusize* used) {
+    rusize i = 0, n = 0;
+    int32_t ret = RUE_OK;
+    for (; i < len; i++) {
+        char c = ptr[i];
+        if (gd->escaped) {
+            gd->escaped = false;
+            if (c != '/' && c != '\\' && c != '"') {
+                dvSetError("Unexpected escape in cipher recipe");
+                return DVE_PROTOCOL_ERROR;
+            }
+        } else if (c == '\\') {
+            gd->escaped = true;
+            continue;
+        } else if (c == '"') {
+            gd->inData = false;
+            gd->gotData = true;
+            i++;
+            break;
+        }
+        gd->dec[n++] = c;
+        if (n == STREAM_CHUNK) {
+            ret = cryptStreamUpdate(gd->cs, (trans_bytes)gd->dec, n);
+            if (ret != RUE_OK) return ret;
+            n = 0;
+        }
+    }
+    *used = i;
+    if (!n) return RUE_OK;
+    return cryptStreamUpdate(gd->cs, (trans_bytes)gd->dec, n);
+}
+
+static rusize downloadWriter(char* ptr, rusize size, rusize nmemb,
+                             void* userdata) {
+    struct get_download* gd = userdata;
+    rusize len = size * nmemb;
+    rusize i = 0, start = 0;
+    while (i < len) {
+        if (gd->inData) {
+            rusize used = 0;
+            gd->ret = scanRecipe(gd, ptr + i, len - i, &used);
+            if (gd->ret != RUE_OK) return 0;
+            i += used;
+            // an empty string stands in for the recipe
+            if (!gd->inData) ruStringAppend(gd->skeleton, "\"");
+            start = i;
+            continue;
+        }
+        char c = ptr[i++];
+        if (gd->inStr) {
+            if (gd->escaped) {
+                gd->escaped = false;
+            } else if (c == '\\') {
+                gd->escaped = true;
+            } else if (c == '"') {
+                gd->inStr = false;
+            } else if (gd->strLen < sizeof(gd->str)) {
+                gd->str[gd->strLen++] = c;
+            }
+            continue;
+        }
+        if (c != '"') {
+            if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+                gd->lastToken = c;
+            }
+            continue;
+        }
+        if (gd->lastToken == ':' && gd->strLen == 4 &&
+            !memcmp(gd->str, "data", 4)) {
+            if (gd->gotData) {
+                dvSetError("Response holds more than one cipher recipe");
+                gd->ret = DVE_PROTOCOL_ERROR;
+                return 0;
+            }
+            ruStringAppendn(gd->skeleton, ptr + start, i - start);
+            gd->inData = true;
+            gd->lastToken = '"';
+            continue;
+        }
+        gd->inStr = true;
+        gd->strLen = 0;
+        gd->lastToken = '"';
+    }
+    ruStringAppendn(gd->skeleton, ptr + start, i - start);
+    return len;
+}
+
+DVAPI int32_t dvGetStream(dvCtx dc, const char* vid, dvWriteFn writer,
+                          void* writeCtx) {
+    if (!dc || !vid || !writer) return RUE_PARAMETER_NOT_SET;
+    dvctx ctx = getDvCtx(dc);
+    if (!ctx) return RUE_INVALID_PARAMETER;
+
+    int32_t ret;
+    struct dv_req_io io;
+    memset(&io, 0, sizeof(io));
+
+    // to free
+    struct get_download* gd = NULL;
+    ruList vids = NULL;
+    struct dv_req rq;
+    ruJson jsn = NULL;
+    char* dt = NULL;
+    memset(&rq, 0, sizeof(rq));
+
+    do {
+        // first check the cache
+        rusize len = 0;
+        LOAD(ctx, vid, &dt, &len);
+        if (dt) {
+            ret = writer(writeCtx, dt, len);
+            break;
+        }
+
+        // the download writer only reads JSON
+        newJsonReq(ctx, &rq, "get");
+        vids = ruListNew(NULL);
+        ruListAppend(vids, vid);
+        ret = reqAddList(&rq, "vid", vids);
+        if (ret != RUE_OK) break;
+        io.body = reqBody(&rq, &io.bodyLen);
+
+        gd = ruMalloc0(1, struct get_download);
+        gd->skeleton = ruStringNew("");
+        ret = newCryptStream(ctx->key, NULL, ctx->recipe, false, writer,
+                             writeCtx, &gd->cs);
+        if (ret != RUE_OK) break;
+        gd->cs->dicts = ctx->dicts;
+        io.write = downloadWriter;
+        io.writeCtx = gd;
+        ruVerbLogf("Do request: %s", io.body);
+        ret = doStreamRequest(ctx, ctx->serviceUrl, NULL, &io, NULL, NULL);
+        if (gd->ret != RUE_OK) ret = gd->ret;
+        if (ret != RUE_OK) {
+            ruCritLogf("failed to get data from %s. Ec: %d",
+                       ctx->serviceUrl, ret);
+            break;
+        }
+        // parse what is left of the response
+        jsn = getJson(ruStringGetCString(gd->skeleton));
+        ret = parseStatus(jsn, NULL);
+        if (ret != RUE_OK) break;
+        ruJson jdat = ruJsonKeyMap(jsn, "data", NULL);
+        ruJson jvd = jdat? ruJsonKeyMap(jdat, vid, NULL) : NULL;
+        perm_chars status = jvd? ruJsonKeyStr(jvd, STATUS, NULL) : NULL;
+        if (!status) {
+            ruCritLogf("no status specified for entry '%s'", vid);
+            ret = DVE_PROTOCOL_ERROR;
+            break;
+        }
+        if (ruStrEquals(STATUS_NOT_FOUND, status)) {
+            ruVerbLogf("status for entry '%s' id not found", vid);
+            ret = RUE_FILE_NOT_FOUND;
+            break;
+        }
+        if (!ruStrEquals(STATUS_OK, status) || !gd->gotData) {
+            ruWarnLogf("status for entry '%s' was '%s'", vid, status);
+            ret = DVE_PROTOCOL_ERROR;
+            break;
+        }
+        ret = cryptStreamFinish(gd->cs);
+    } while(0);
+
+    if (gd) {
+        freeCryptStream(gd->cs);
+        ruStringFree(gd->skeleton, false);
+        ruFree(gd);
+    }
+    ruListFree(vids);
+    freeReq(ctx, &rq);
+    ruJsonFree(jsn);
+    ruFree(dt);
+    return ret;
+}
@@ -0,0 +1,609 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lib.h"
+
+#ifdef DV_X86_SIMD
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+/*
+ * A parser for the few fixed shapes of vault responses. The structural
+ * characters are located a block of 64 bytes at a time, vectorized where the
+ * CPU allows, so that the long base64 strings of the recipes are skipped
+ * without looking at each of their characters. Strings are returned as views
+ * into the response.
+ */
+
+// structural positions indexed ahead of the parser
+#define JSON_INDEX 1024
+#define JSON_BLOCK 64
+#define JSON_END ((rusize)-1)
+
+static const uint8_t structural[256] = {
+    ['"'] = 1, ['\\'] = 1, ['{'] = 1, ['}'] = 1,
+    ['['] = 1, [']'] = 1, [':'] = 1, [','] = 1
+};
+
+typedef uint64_t (*blockMaskFn) (trans_chars p);
+
+static uint64_t maskScalar(trans_chars p, rusize len) {
+    uint64_t m = 0;
+    for (rusize i = 0; i < len; i++) {
+        if (structural[(uint8_t)p[i]]) m |= (uint64_t)1 << i;
+    }
+    return m;
+}
+
+static uint64_t maskBlock(trans_chars p) {
+    return maskScalar(p, JSON_BLOCK);
+}
+
+#ifdef DV_X86_SIMD
+/*
+ * {[ and }] differ from each other by 0x20 only, so they are found with two
+ * compares on the input or'ed with 0x20.
+ */
+DV_TARGET("sse2")
+static uint64_t maskSse2(trans_chars p) {
+    const __m128i lc = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    uint64_t m = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i * 16));
+        __m128i b = _mm_or_si128(v, lc);
+        __m128i r = _mm_or_si128(_mm_cmpeq_epi8(b, open),
+                                 _mm_cmpeq_epi8(b, close));
+        r = _mm_or_si128(r, _mm_or_si128(_mm_cmpeq_epi8(v, colon),
+                                         _mm_cmpeq_epi8(v, comma)));
+        r = _mm_or_si128(r, _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                         _mm_cmpeq_epi8(v, bslash)));
+        m |= (uint64_t)(uint32_t)_mm_movemask_epi8(r) << (i * 16);
+    }
+    return m;
+}
+
+DV_TARGET("avx2")
+static uint64_t maskAvx2(trans_chars p) {
+    const __m256i lc = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i bslash = _mm256_set1_epi8('\\');
+    uint64_t m = 0;
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i * 32));
+        __m256i b = _mm256_or_si256(v, lc);
+        __m256i r = _mm256_or_si256(_mm256_cmpeq_epi8(b, open),
+                                    _mm256_cmpeq_epi8(b, close));
+        r = _mm256_or_si256(r, _mm256_or_si256(_mm256_cmpeq_epi8(v, colon),
+                                               _mm256_cmpeq_epi8(v, comma)));
+        r = _mm256_or_si256(r, _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                               _mm256_cmpeq_epi8(v, bslash)));
+        m |= (uint64_t)(uint32_t)_mm256_movemask_epi8(r) << (i * 32);
+    }
+    return m;
+}
+#endif
+
+static blockMaskFn blockMask = maskBlock;
+static perm_chars blockMaskName = "scalar";
+static dvOnceFlag scannerOnce = DV_ONCE_INIT;
+
+static void pickJsonScanner(bool accelerated) {
+    blockMask = maskBlock;
+    blockMaskName = "scalar";
+#ifdef DV_X86_SIMD
+    if (accelerated) {
+        if (cpuFeatures() & CPU_AVX2) {
+            blockMask = maskAvx2;
+            blockMaskName = "avx2";
+        } else {
+            blockMask = maskSse2;
+            blockMaskName = "sse2";
+        }
+    }
+#endif
+}
+
+static void pickFastestScanner(void) {
+    pickJsonScanner(true);
+}
+
+/**
+ * Picks the structural scanner of the vault response parser. Meant for
+ * tests and benchmarks, other threads must not parse meanwhile.
+ * @param accelerated false for the scalar one, true for the fastest one the
+ *                    CPU supports.
+ * @return The name of the scanner in use.
+ */
+perm_chars selectJsonScanner(bool accelerated) {
+    dvOnce(&scannerOnce, pickFastestScanner);
+    pickJsonScanner(accelerated);
+    return blockMaskName;
+}
+
+static int lowBit(uint64_t m) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, m);
+    return (int)i;
+#else
+    return __builtin_ctzll(m);
+#endif
+}
+
+struct json_cursor {
+    trans_chars buf;
+    rusize len;
+    rusize scanned;         /* bytes indexed so far */
+    rusize idx[JSON_INDEX];
+    rusize n;
+    rusize at;
+};
+
+static void indexMore(struct json_cursor* jc) {
+    jc->n = jc->at = 0;
+    while (jc->scanned < jc->len && jc->n <= JSON_INDEX - JSON_BLOCK) {
+        rusize base = jc->scanned;
+        uint64_t m;
+        if (jc->len - base >= JSON_BLOCK) {
+            m = blockMask(jc->buf + base);
+            jc->scanned += JSON_BLOCK;
+        } else {
+            m = maskScalar(jc->buf + base, jc->len - base);
+            jc->scanned = jc->len;
+        }
+        while (m) {
+            jc->idx[jc->n++] = base + (rusize)lowBit(m);
+            m &= m - 1;
+        }
+    }
+}
+
+static rusize peekTok(struct json_cursor* jc) {
+    if (jc->at == jc->n) indexMore(jc);
+    return jc->at < jc->n? jc->idx[jc->at] : JSON_END;
+}
+
+static rusize nextTok(struct json_cursor* jc) {
+    rusize t = peekTok(jc);
+    if (t != JSON_END) jc->at++;
+    return t;
+}
+
+static bool isWs(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static rusize skipWs(struct json_cursor* jc, rusize from) {
+    while (from < jc->len && isWs(jc->buf[from])) from++;
+    return from;
+}
+
+/*
+ * Reads the string whose opening quote is at open.
+ */
+static int32_t scanString(struct json_cursor* jc, rusize open,
+                          struct dv_jstr* out) {
+    bool esc = false;
+    for (;;) {
+        rusize t = nextTok(jc);
+        if (t == JSON_END) return DVE_PROTOCOL_ERROR;
+        char c = jc->buf[t];
+        if (c == '\\') {
+            esc = true;
+            // the escaped char may be structural itself
+            if (peekTok(jc) == t + 1) nextTok(jc);
+        } else if (c == '"') {
+            out->ptr = jc->buf + open + 1;
+            out->len = t - open - 1;
+            out->esc = esc;
+            return RUE_OK;
+        }
+    }
+}
+
+/*
+ * Finds the value following the structural char at prev. Strings and
+ * containers are consumed up to their opening char, literals not at all.
+ */
+static int32_t valueAt(struct json_cursor* jc, rusize prev, rusize* pos) {
+    rusize v = skipWs(jc, prev + 1);
+    if (v >= jc->len) return DVE_PROTOCOL_ERROR;
+    char c = jc->buf[v];
+    if (structural[(uint8_t)c]) {
+        if (nextTok(jc) != v) return DVE_PROTOCOL_ERROR;
+        if (c != '"' && c != '{' && c != '[') return DVE_PROTOCOL_ERROR;
+    }
+    *pos = v;
+    return RUE_OK;
+}
+
+static int32_t skipValue(struct json_cursor* jc, rusize v) {
+    struct dv_jstr s;
+    char c = jc->buf[v];
+    if (c == '"') return scanString(jc, v, &s);
+    if (c != '{' && c != '[') return RUE_OK;
+    uint32_t depth = 1;
+    while (depth) {
+        rusize t = nextTok(jc);
+        if (t == JSON_END) return DVE_PROTOCOL_ERROR;
+        c = jc->buf[t];
+        if (c == '"') {
+            int32_t ret = scanString(jc, t, &s);
+            if (ret != RUE_OK) return ret;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            depth--;
+        }
+    }
+    return RUE_OK;
+}
+
+/*
+ * Steps to the next member of the object whose '{' or ',' is at *prev and
+ * returns its key and where its value starts. done is set at the '}'.
+ */
+static int32_t nextMember(struct json_cursor* jc, rusize* prev,
+                          struct dv_jstr* key, rusize* value, bool* done) {
+    rusize t = nextTok(jc);
+    if (t == JSON_END) return DVE_PROTOCOL_ERROR;
+    if (jc->buf[t] == '}' && jc->buf[*prev] == '{') {
+        *done = true;
+        return RUE_OK;
+    }
+    if (jc->buf[t] != '"') return DVE_PROTOCOL_ERROR;
+    int32_t ret = scanString(jc, t, key);
+    if (ret != RUE_OK) return ret;
+    t = nextTok(jc);
+    if (t == JSON_END || jc->buf[t] != ':') return DVE_PROTOCOL_ERROR;
+    return valueAt(jc, t, value);
+}
+
+/*
+ * Consumes the ',' or '}' after a member value.
+ */
+static int32_t endMember(struct json_cursor* jc, rusize* prev, bool* done) {
+    rusize t = nextTok(jc);
+    if (t == JSON_END) return DVE_PROTOCOL_ERROR;
+    if (jc->buf[t] == '}') {
+        *done = true;
+    } else if (jc->buf[t] != ',') {
+        return DVE_PROTOCOL_ERROR;
+    }
+    *prev = t;
+    return RUE_OK;
+}
+
+static bool keyIs(const struct dv_jstr* key, const char* name) {
+    return !key->esc && key->len == strlen(name) &&
+           !memcmp(key->ptr, name, key->len);
+}
+
+static int32_t stringValue(struct json_cursor* jc, rusize v,
+                           struct dv_jstr* out) {
+    if (jc->buf[v] != '"') return skipValue(jc, v);
+    return scanString(jc, v, out);
+}
+
+static int32_t parseEntry(struct json_cursor* jc, rusize open,
+                          struct dv_vault_entry* e) {
+    rusize prev = open, v = 0;
+    struct dv_jstr key;
+    bool done = false;
+    int32_t ret = RUE_OK;
+    while (ret == RUE_OK && !done) {
+        ret = nextMember(jc, &prev, &key, &v, &done);
+        if (ret != RUE_OK || done) break;
+        if (keyIs(&key, STATUS)) {
+            ret = stringValue(jc, v, &e->status);
+        } else if (keyIs(&key, "data")) {
+            ret = stringValue(jc, v, &e->data);
+        } else {
+            ret = skipValue(jc, v);
+        }
+        if (ret == RUE_OK) ret = endMember(jc, &prev, &done);
+    }
+    return ret;
+}
+
+static int32_t parseEntries(struct json_cursor* jc, rusize open,
+                            struct dv_vault_resp* vr) {
+    rusize prev = open, v = 0, cap = 0;
+    struct dv_jstr key;
+    bool done = false;
+    int32_t ret = RUE_OK;
+    // a repeated key would overrun the entries
+    if (vr->hasData) return DVE_PROTOCOL_ERROR;
+    vr->hasData = true;
+    while (ret == RUE_OK && !done) {
+        ret = nextMember(jc, &prev, &key, &v, &done);
+        if (ret != RUE_OK || done) break;
+        if (jc->buf[v] == '{') {
+            if (vr->entryCount == cap) {
+                rusize size = cap * sizeof(struct dv_vault_entry);
+                cap = cap? cap * 2 : 16;
+                vr->entries = scratchRealloc(vr->entries, size,
+                        cap * sizeof(struct dv_vault_entry));
+            }
+            struct dv_vault_entry* e = &vr->entries[vr->entryCount++];
+            memset(e, 0, sizeof(*e));
+            e->vid = key;
+            ret = parseEntry(jc, v, e);
+        } else {
+            ret = skipValue(jc, v);
+        }
+        if (ret == RUE_OK) ret = endMember(jc, &prev, &done);
+    }
+    return ret;
+}
+
+static int32_t parseVids(struct json_cursor* jc, rusize open,
+                         struct dv_vault_resp* vr) {
+    rusize prev = open, v = 0, cap = 0;
+    int32_t ret = RUE_OK;
+    if (vr->hasVids) return DVE_PROTOCOL_ERROR;
+    vr->hasVids = true;
+    v = skipWs(jc, open + 1);
+    if (v < jc->len && jc->buf[v] == ']') {
+        nextTok(jc);
+        return RUE_OK;
+    }
+    for (;;) {
+        ret = valueAt(jc, prev, &v);
+        if (ret != RUE_OK) break;
+        if (jc->buf[v] == '"') {
+            if (vr->vidCount == cap) {
+                rusize size = cap * sizeof(struct dv_jstr);
+                cap = cap? cap * 2 : 16;
+                vr->vids = scratchRealloc(vr->vids, size,
+                                          cap * sizeof(struct dv_jstr));
+            }
+            ret = scanString(jc, v, &vr->vids[vr->vidCount++]);
+        } else {
+            ret = skipValue(jc, v);
+        }
+        if (ret != RUE_OK) break;
+        prev = nextTok(jc);
+        if (prev == JSON_END) return DVE_PROTOCOL_ERROR;
+        if (jc->buf[prev] == ']') break;
+        if (jc->buf[prev] != ',') return DVE_PROTOCOL_ERROR;
+    }
+    return ret;
+}
+
+static int32_t parseCode(struct json_cursor* jc, rusize v,
+                         struct dv_vault_resp* vr) {
+    char num[24];
+    rusize end = peekTok(jc);
+    if (end == JSON_END) end = jc->len;
+    while (end > v && isWs(jc->buf[end - 1])) end--;
+    if (jc->buf[v] == '"' || end == v || end - v >= sizeof(num)) {
+        return skipValue(jc, v);
+    }
+    memcpy(num, jc->buf + v, end - v);
+    num[end - v] = '\0';
+    char* stop = NULL;
+    int64_t code = strtoll(num, &stop, 10);
+    if (stop != num + (end - v)) return RUE_OK;
+    vr->code = code;
+    vr->hasCode = true;
+    return RUE_OK;
+}
+
+/**
+ * Parses a vault response, or one entry of its data object, into views of
+ * the response. MessagePack responses go to #parseVaultMsgpack.
+ * @param json The response, it must outlive the result.
+ * @param len Length of the response.
+ * @param vr Where the result will be stored. Free it with #freeVaultResp.
+ * @return RUE_OK on success, DVE_PROTOCOL_ERROR if the response is no JSON
+ *         object.
+ */
+int32_t parseVaultResp(trans_chars json, rusize len, struct dv_vault_resp* vr) {
+    if (!json || !vr) return RUE_PARAMETER_NOT_SET;
+    if (isMsgpack(json, len)) return parseVaultMsgpack(json, len, vr);
+    memset(vr, 0, sizeof(*vr));
+    dvOnce(&scannerOnce, pickFastestScanner);
+
+    struct json_cursor* jc = scratchAlloc(sizeof(struct json_cursor));
+    jc->buf = json;
+    jc->len = len;
+    rusize prev = skipWs(jc, 0), v = 0;
+    struct dv_jstr key;
+    bool done = false;
+    int32_t ret = RUE_OK;
+    if (prev >= len || json[prev] != '{' || nextTok(jc) != prev) {
+        ret = DVE_PROTOCOL_ERROR;
+    }
+    while (ret == RUE_OK && !done) {
+        ret = nextMember(jc, &prev, &key, &v, &done);
+        if (ret != RUE_OK || done) break;
+        if (keyIs(&key, STATUS)) {
+            ret = stringValue(jc, v, &vr->status);
+        } else if (keyIs(&key, "desc")) {
+            ret = stringValue(jc, v, &vr->desc);
+        } else if (keyIs(&key, "code")) {
+            ret = parseCode(jc, v, vr);
+        } else if (keyIs(&key, "data") && json[v] == '{') {
+            ret = parseEntries(jc, v, vr);
+        } else if (keyIs(&key, "data")) {
+            ret = stringValue(jc, v, &vr->data);
+        } else if (keyIs(&key, "vids") && json[v] == '[') {
+            ret = parseVids(jc, v, vr);
+        } else if (keyIs(&key, "next")) {
+            ret = stringValue(jc, v, &vr->next);
+        } else {
+            ret = skipValue(jc, v);
+        }
+        if (ret == RUE_OK) ret = endMember(jc, &prev, &done);
+    }
+    if (ret == RUE_OK && (peekTok(jc) != JSON_END ||
+                          skipWs(jc, prev + 1) != len)) {
+        ret = DVE_PROTOCOL_ERROR;
+    }
+    scratchFree(jc);
+    if (ret != RUE_OK) {
+        dvSetError("Failed parsing the response");
+        freeVaultResp(vr);
+    }
+    return ret;
+}
+
+void freeVaultResp(struct dv_vault_resp* vr) {
+    if (!vr) return;
+    scratchFree(vr->entries);
+    scratchFree(vr->vids);
+    memset(vr, 0, sizeof(*vr));
+}
+
+static int hexVal(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int32_t hex4(trans_chars p, rusize left, uint32_t* cp) {
+    if (left < 4) return DVE_PROTOCOL_ERROR;
+    *cp = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = hexVal(p[i]);
+        if (h < 0) return DVE_PROTOCOL_ERROR;
+        *cp = *cp << 4 | (uint32_t)h;
+    }
+    return RUE_OK;
+}
+
+static rusize putUtf8(uint32_t cp, char* out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xc0 | cp >> 6);
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | cp >> 12);
+        out[1] = (char)(0x80 | (cp >> 6 & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | cp >> 18);
+    out[1] = (char)(0x80 | (cp >> 12 & 0x3f));
+    out[2] = (char)(0x80 | (cp >> 6 & 0x3f));
+    out[3] = (char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+static alloc_chars jstrCopy(const struct dv_jstr* s, bool scratch) {
+    if (!s || !s->ptr) return NULL;
+    // escapes never grow the text
+    alloc_chars out = scratch? scratchAlloc(s->len + 1) :
+                      ruMalloc0(s->len + 1, char);
+    if (!s->esc) {
+        memcpy(out, s->ptr, s->len);
+        return out;
+    }
+    rusize i = 0, o = 0;
+    while (i < s->len) {
+        // copy up to the next escape in one go
+        perm_chars bs = memchr(s->ptr + i, '\\', s->len - i);
+        rusize run = bs? (rusize)(bs - s->ptr) - i : s->len - i;
+        memcpy(out + o, s->ptr + i, run);
+        o += run;
+        i += run + 1;
+        if (i >= s->len) break;
+        char c = s->ptr[i++];
+        switch (c) {
+            case 'b': out[o++] = '\b'; break;
+            case 'f': out[o++] = '\f'; break;
+            case 'n': out[o++] = '\n'; break;
+            case 'r': out[o++] = '\r'; break;
+            case 't': out[o++] = '\t'; break;
+            case '"': case '\\': case '/': out[o++] = c; break;
+            case 'u': {
+                uint32_t cp, lo;
+                if (hex4(s->ptr + i, s->len - i, &cp) != RUE_OK) goto bad;
+                i += 4;
+                if (cp >= 0xd800 && cp < 0xdc00 && i + 6 <= s->len &&
+                    s->ptr[i] == '\\' && s->ptr[i + 1] == 'u' &&
+                    hex4(s->ptr + i + 2, 4, &lo) == RUE_OK &&
+                    lo >= 0xdc00 && lo < 0xe000) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    i += 6;
+                }
+                o += putUtf8(cp, out + o);
+                break;
+            }
+            default:
+                goto bad;
+        }
+    }
+    out[o] = '\0';
+    return out;
+bad:
+    scratchFree(out);
+    return NULL;
+}
+
+/**
+ * Copies a string view resolving its escapes.
+ * @param s The view.
+ * @return The new string to be freed by the caller or NULL if it has an
+ *         invalid escape.
+ */
+alloc_chars jstrDup(const struct dv_jstr* s) {
+    return jstrCopy(s, false);
+}
+
+/**
+ * Like #jstrDup for a temporary, free it with #scratchFree.
+ */
+alloc_chars jstrScratch(const struct dv_jstr* s) {
+    return jstrCopy(s, true);
+}
+
+/**
+ * Compares a string view to a string.
+ */
+bool jstrEquals(const struct dv_jstr* s, const char* str) {
+    if (!s || !s->ptr || !str) return false;
+    if (!s->esc) return s->len == strlen(str) && !memcmp(s->ptr, str, s->len);
+    alloc_chars d = jstrScratch(s);
+    bool same = ruStrEquals(d, str);
+    scratchFree(d);
+    return same;
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "tests.h"
+
+#ifdef DV_WRAP_ALLOC
+// heap allocations of the statically linked code, see tests/CMakeLists.txt
+static uint32_t allocCount = 0;
+static uint32_t freeCount = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+    allocCount++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    allocCount++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    allocCount++;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr) freeCount++;
+    __real_free(ptr);
+}
+
+// a cache with a fixed set of entries, read without allocating
+static const char* cacheVids[] = {"vid1", "vid2"};
+static const char* cachePids[] = {"{\"name\":\"Jane\"}", "{\"name\":\"John\"}"};
+
+static int32_t readCache(void* readCtx, const char* vid, char* buf,
+                         size_t bufLen, size_t* len) {
+    uint32_t* reads = readCtx;
+    (*reads)++;
+    for (int i = 0; i < 2; i++) {
+        if (strcmp(vid, cacheVids[i])) continue;
+        *len = strlen(cachePids[i]);
+        if (*len > bufLen) return RUE_OVERFLOW;
+        memcpy(buf, cachePids[i], *len);
+        return RUE_OK;
+    }
+    return RUE_FILE_NOT_FOUND;
+}
+#endif
+
+START_TEST ( run ) {
+#ifdef DV_WRAP_ALLOC
+    int32_t ret, exp = RUE_OK;
+    const char *test;
+    const char *retText = "%s failed wanted ret %d but got %d";
+    const char *allocText = "%s made %d allocations instead of %d";
+    const char *freeText = "%s made %d frees instead of %d";
+    uint8_t key[32];
+    char *cs = NULL, *out = NULL, *msg = NULL;
+    const char *str = "{\"name\":\"Müller\",\"city\":\"München\"}";
+
+    // verbose logging would allocate
+    ruSetLogger(ruStdErrLogSink, RU_LOG_INFO, NULL, false, false);
+
+    test = "mkKey";
+    ret = mkKey(APPID, key, &cs);
+    fail_unless(exp == ret, retText, test, exp, ret);
+
+    test = "dvAes256Enc";
+    ret = dvAes256Enc(key, cs, str, RECIPE_AES_CBC, &out);
+    fail_unless(exp == ret, retText, test, exp, ret);
+
+    // only the plaintext gets allocated
+    test = "dvAes256Dec";
+    allocCount = 0;
+    ret = dvAes256Dec(key, out, &msg, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(1 == allocCount, allocText, test, allocCount, 1);
+    ck_assert_str_eq(str, msg);
+    ruFree(msg);
+    ruFree(out);
+
+    // the temporaries of an operation share one block
+    test = "scratchAlloc";
+    char* tmps[100];
+    allocCount = 0;
+    scratchBegin();
+    for (int i = 0; i < 100; i++) {
+        tmps[i] = scratchAlloc(64);
+        memset(tmps[i], 'x', 64);
+    }
+    tmps[99] = scratchRealloc(tmps[99], 64, 1024);
+    fail_unless(0 == tmps[99][1023], retText, test, 0, tmps[99][1023]);
+    for (int i = 99; i >= 0; i--) scratchFree(tmps[i]);
+    fail_unless(1 == allocCount, allocText, test, allocCount, 1);
+
+    // freed in reverse order it is handed out again
+    char* first = scratchAlloc(16);
+    fail_unless(first == tmps[0], retText, test, 0, 1);
+    fail_unless(0 == first[0], retText, test, 0, first[0]);
+    scratchBegin();
+    scratchFree(scratchAlloc(32));
+    scratchEnd();
+    scratchFree(first);
+
+    // a slot freed twice does not take the next one with it
+    scratchFree(first);
+    char* live = scratchAlloc(64);
+    scratchFree(scratchAlloc(64));
+    fail_unless(live != scratchAlloc(64), retText, test, 0, 1);
+    scratchEnd();
+    fail_unless(1 == allocCount, allocText, test, allocCount, 1);
+
+    // a buffer outgrowing its blocks does not keep the old ones
+    scratchBegin();
+    char* keep = scratchAlloc(16);
+    char* grow = NULL;
+    rusize glen = 0;
+    allocCount = 0;
+    freeCount = 0;
+    for (rusize n = 1024; n <= 1024 * 1024; n *= 2) {
+        grow = scratchRealloc(grow, glen, n);
+        grow[n - 1] = 'x';
+        glen = n;
+    }
+    fail_unless(7 == allocCount, allocText, test, allocCount, 7);
+    fail_unless(6 == freeCount, freeText, test, freeCount, 6);
+    scratchFree(grow);
+    scratchFree(keep);
+    scratchEnd();
+
+    // outside of an operation it is the heap
+    allocCount = 0;
+    first = scratchAlloc(16);
+    scratchFree(first);
+    fail_unless(1 == allocCount, allocText, test, allocCount, 1);
+
+    // cache hits are served without allocating
+    dvCtx dc = NULL;
+    char buf[64];
+    size_t len = 0;
+    uint32_t reads = 0;
+    ret = dvNew(&dc, "https://localhost/", APPID, NULL);
+    fail_unless(exp == ret, retText, "dvNew", exp, ret);
+
+    test = "dvSetCacheReader";
+    exp = RUE_PARAMETER_NOT_SET;
+    ret = dvSetCacheReader(NULL, readCache, &reads);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = RUE_OK;
+    ret = dvSetCacheReader(dc, readCache, &reads);
+    fail_unless(exp == ret, retText, test, exp, ret);
+
+    test = "dvGetCached";
+    exp = RUE_PARAMETER_NOT_SET;
+    ret = dvGetCached(NULL, "vid1", buf, sizeof(buf), &len);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = dvGetCached(dc, NULL, buf, sizeof(buf), &len);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = dvGetCached(dc, "vid1", NULL, sizeof(buf), &len);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = RUE_INVALID_PARAMETER;
+    ret = dvGetCached(dc, "vid1", buf, 0, &len);
+    fail_unless(exp == ret, retText, test, exp, ret);
+
+    allocCount = 0;
+    exp = RUE_OK;
+    for (int i = 0; i < 1000; i++) {
+        ret = dvGetCached(dc, cacheVids[i % 2], buf, sizeof(buf), &len);
+        if (ret != exp) break;
+    }
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(0 == allocCount, allocText, test, allocCount, 0);
+    fail_unless(1000 == reads, retText, test, 1000, reads);
+    ck_assert_str_eq(cachePids[1], buf);
+    fail_unless(strlen(cachePids[1]) == len, retText, test,
+                (int)strlen(cachePids[1]), (int)len);
+
+    // neither do misses and short buffers
+    exp = RUE_FILE_NOT_FOUND;
+    ret = dvGetCached(dc, "vid3", buf, sizeof(buf), &len);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = RUE_OVERFLOW;
+    ret = dvGetCached(dc, "vid1", buf, strlen(cachePids[0]), &len);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(strlen(cachePids[0]) == len, retText, test,
+                (int)strlen(cachePids[0]), (int)len);
+    fail_unless(0 == allocCount, allocText, test, allocCount, 0);
+
+    // without a reader the store is read
+    exp = RUE_OK;
+    ret = dvSetCacheReader(dc, NULL, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = RUE_FILE_NOT_FOUND;
+    ret = dvGetCached(dc, "vid1", buf, sizeof(buf), &len);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    dvFree(dc);
+#endif
+}
+END_TEST
+
+TCase* allocTests (void) {
+    TCase *tcase = tcase_create("alloc");
+    tcase_add_test(tcase, run);
+    return tcase;
+}
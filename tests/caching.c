@@ -54,8 +54,8 @@ START_TEST ( run ) {
     KvStore *kvs = NULL;
     dvCtx dc = NULL;
     const char *foo = "foo", *bar = "bar";
-    char *fovid = NULL, *bavid = NULL;
-    ruList vids = NULL, fovids = NULL;
+    char *fovid = NULL, *bavid = NULL, *civid = NULL, *cipher = NULL;
+    ruList vids = NULL, fovids = NULL, civids = NULL;
     ruMap data = NULL;
 
     do {
@@ -160,6 +160,59 @@ START_TEST ( run ) {
         fail_unless(exp == ret, retText, test, exp, ret);
         data = verifyMapSize(data);
 
+        // decrypt on access
+        test = "dvSetProp";
+        ret = dvSetProp(dc, DV_LAZY_DECRYPT, "1");
+        fail_unless(exp == ret, retText, test, exp, ret);
+        test = "dvGet";
+        ret = dvGet(dc, vids, &data);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        test = "dvGetVid";
+        for (int i = 0; i < 2; i++) {
+            char* pid = NULL;
+            ret = dvGetVid(data, bavid, &pid);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ck_assert_str_eq(bar, pid);
+        }
+        data = verifyMapSize(data);
+        ret = dvSetProp(dc, DV_LAZY_DECRYPT, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        // add with a recipe encrypted up front
+        test = "dvEncryptRecord";
+        ret = dvEncryptRecord(dc, foo, &cipher);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        test = "dvAddCipher";
+        ret = dvAddCipher(dc, cipher, foo, NULL, &civid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        verifyCacheSize(kvs, 1);
+        ruFree(cipher);
+
+        // no plain text drops the cache entry
+        test = "dvEncryptRecord";
+        ret = dvEncryptRecord(dc, bar, &cipher);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        test = "dvUpdateCipher";
+        ret = dvUpdateCipher(dc, civid, cipher, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        verifyCacheSize(kvs, 0);
+
+        civids = ruListNew(NULL);
+        ruListAppend(civids, civid);
+        test = "dvGet";
+        ret = dvGet(dc, civids, &data);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        test = "dvGetVid";
+        char* pid = NULL;
+        ret = dvGetVid(data, civid, &pid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(bar, pid);
+        ruMapFree(data);
+        data = NULL;
+        test = "dvDelete";
+        ret = dvDelete(dc, civids);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
         // clean up
         test = "dvDelete";
         ret = dvDelete(dc, vids);
@@ -174,6 +227,9 @@ START_TEST ( run ) {
     if (bavid) free(bavid);
     if (vids) ruListFree(vids);
     if (fovids) ruListFree(fovids);
+    if (civids) ruListFree(civids);
+    ruFree(civid);
+    ruFree(cipher);
     if (data) ruMapFree(data);
     if (dc) dvFree(dc);
     if (kvs) ruFreeStore(kvs);
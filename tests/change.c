@@ -45,6 +45,7 @@ START_TEST ( api ) {
     dvCtx dc = NULL;
     ruList vids = NULL;
     ruMap vidMap = NULL;
+    int32_t stati[1];
 
     do {
         // setup
@@ -65,6 +66,15 @@ START_TEST ( api ) {
                             indexCb, APPID);
         fail_unless(exp == ret, retText, test, exp, ret);
 
+        test = "dvChangeAppIdMany";
+        ret = dvChangeAppIdMany(NULL, APPID, &test, 1, stati, indexCb, APPID);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvChangeAppIdMany(dc, APPID, NULL, 1, stati, indexCb, APPID);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvChangeAppIdMany(dc, APPID, &test, 1, NULL, indexCb, APPID);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        test = "dvChangeAppId";
+
         // test search API
         exp = RUE_OK;
         vids = ruListNew(NULL);
@@ -197,6 +207,28 @@ void dochange(dvCtx dc, const char* appId, ruList vids, rusize cnt, const char*
     vidMap = NULL;
 }
 
+void dochangeMany(dvCtx dc, const char* appId, const char* const* vids,
+                  rusize cnt, const char* misvid, int line) {
+    int32_t exp = RUE_OK, ret;
+    const char *test;
+    const char *retText = "%s failed wanted ret %d but got %d";
+    int32_t stati[8];
+    ruVerbLogf("appId:'%s' cnt:%d mis:'%s' line:%d",
+               appId, cnt, misvid, line);
+
+    // swap ids
+    test = "dvChangeAppIdMany";
+    ret = dvChangeAppIdMany(dc, appId, vids, cnt, stati,
+                            indexCb, (void*)appId);
+    fail_unless(exp == ret, retText, test, exp, ret);
+
+    for (rusize i = 0; i < cnt; i++) {
+        ruVerbLogf("vid: '%s' status: %d", vids[i], stati[i]);
+        exp = ruStrEquals(misvid, vids[i])? DVE_INVALID_CREDENTIALS : RUE_OK;
+        fail_unless(exp == stati[i], retText, test, exp, stati[i]);
+    }
+}
+
 void getdata(dvCtx dc, const char* vid, const char* pid) {
     int32_t exp = RUE_OK, ret;
     const char *test;
@@ -310,8 +342,9 @@ START_TEST ( change ) {
     ret = dvSetProp(dc, DV_APP_ID, oldId);
     fail_unless(exp == ret, retText, test, exp, ret);
 
-    // 2 should work
-    dochange(dc, APPID, vids, 3, misvid, __LINE__);
+    // 2 should work, this time from an array
+    const char* avids[] = {fovid, bavid, misvid};
+    dochangeMany(dc, APPID, avids, 3, misvid, __LINE__);
 
     // update the appid
     exp = RUE_OK;
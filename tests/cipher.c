@@ -20,6 +20,38 @@
  * SOFTWARE.
  */
 #include "tests.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+static int32_t strWriter(void* ctx, const void* data, size_t len) {
+    return ruStringAppendn((ruString)ctx, (const char*)data, len);
+}
+
+#ifndef _WIN32
+// more than fit into one fill of an IV pool
+#define IV_DRAWS 200
+#define IV_THREADS 4
+
+struct iv_draw {
+    pthread_t thread;
+    alloc_bytes ivs;
+    int32_t ret;
+};
+
+static void* drawIvs(void* arg) {
+    struct iv_draw* d = arg;
+    for (int i = 0; i < IV_DRAWS && d->ret == RUE_OK; i++) {
+        d->ret = mkIv(d->ivs + i * BLOCKSIZE, BLOCKSIZE);
+    }
+    return NULL;
+}
+
+static int cmpIv(const void* a, const void* b) {
+    return memcmp(a, b, BLOCKSIZE);
+}
+#endif
 
 START_TEST ( run ) {
 
@@ -73,7 +105,7 @@ START_TEST ( run ) {
 
     str = "123";
     test = "dvAes256Enc";
-    ret = dvAes256Enc(key, cs, str, &out);
+    ret = dvAes256Enc(key, cs, str, RECIPE_AES_CBC, &out);
     fail_unless(exp == ret, retText, test, exp, ret);
 
     char *msg = NULL;
@@ -85,6 +117,126 @@ START_TEST ( run ) {
     ruFree(msg);
     ruFree(out);
 
+    // IVs keep changing across refills of the IV pool
+    char *prev = NULL;
+    for (int i = 0; i < 100; i++) {
+        ret = dvAes256Enc(key, cs, str, RECIPE_AES_CBC, &out);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        if (prev) ck_assert_str_ne(prev, out);
+        ruFree(prev);
+        prev = out;
+    }
+    ruFree(prev);
+
+#ifndef _WIN32
+    // no IV repeats across reseeds or threads, whose pools go on exit
+    test = "mkIv";
+    struct iv_draw draws[IV_THREADS + 2];
+    uint8_t* drawn = ruMalloc0((IV_THREADS + 2) * IV_DRAWS * BLOCKSIZE,
+                               uint8_t);
+    memset(draws, 0, sizeof(draws));
+    for (int t = 0; t < IV_THREADS + 2; t++) {
+        draws[t].ivs = drawn + t * IV_DRAWS * BLOCKSIZE;
+    }
+    drawIvs(&draws[0]);
+    freeThreadIvPool();
+    drawIvs(&draws[1]);
+    for (int t = 2; t < IV_THREADS + 2; t++) {
+        ret = pthread_create(&draws[t].thread, NULL, drawIvs, &draws[t]);
+        fail_unless(0 == ret, retText, test, 0, ret);
+    }
+    for (int t = 0; t < IV_THREADS + 2; t++) {
+        if (t > 1) pthread_join(draws[t].thread, NULL);
+        fail_unless(exp == draws[t].ret, retText, test, exp, draws[t].ret);
+    }
+    qsort(drawn, (IV_THREADS + 2) * IV_DRAWS, BLOCKSIZE, cmpIv);
+    for (int i = 1; i < (IV_THREADS + 2) * IV_DRAWS; i++) {
+        ret = cmpIv(drawn + (i - 1) * BLOCKSIZE, drawn + i * BLOCKSIZE);
+        fail_unless(0 != ret, retText, test, 1, ret);
+    }
+    ruFree(drawn);
+
+    // a forked child does not go on with the pool of its parent
+    int fds[2];
+    uint8_t parentIv[BLOCKSIZE], childIv[BLOCKSIZE];
+    ret = pipe(fds);
+    fail_unless(0 == ret, retText, test, 0, ret);
+    pid_t child = fork();
+    if (!child) {
+        if (mkIv(childIv, BLOCKSIZE) == RUE_OK &&
+            write(fds[1], childIv, BLOCKSIZE) == BLOCKSIZE) _exit(0);
+        _exit(1);
+    }
+    fail_unless(0 < child, retText, test, 1, (int)child);
+    ret = mkIv(parentIv, BLOCKSIZE);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = (int32_t)read(fds[0], childIv, BLOCKSIZE);
+    waitpid(child, NULL, 0);
+    close(fds[0]);
+    close(fds[1]);
+    fail_unless(BLOCKSIZE == ret, retText, test, BLOCKSIZE, ret);
+    ret = memcmp(parentIv, childIv, BLOCKSIZE);
+    fail_unless(0 != ret, retText, test, 1, ret);
+#endif
+
+    // gcm recipe
+    test = "dvAes256Enc";
+    ret = dvAes256Enc(key, cs, str, RECIPE_AES_GCM, &out);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(ruStrStartsWith(out, "aes-256-gcm:", NULL), retText, test,
+                true, false);
+    test = "dvAes256Dec";
+    ret = dvAes256Dec(key, out, &msg, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ck_assert_str_eq(str, msg);
+    ruFree(msg);
+
+    // a flipped bit fails the tag
+    char* payload = strstr(out, ":b:") + 3;
+    *payload = *payload == 'A'? 'B' : 'A';
+    exp = DVE_INVALID_CREDENTIALS;
+    ret = dvAes256Dec(key, out, &msg, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ruFree(out);
+
+    exp = RUE_OK;
+    test = "dvAes256Enc";
+    ret = dvAes256Enc(key, cs, "", RECIPE_AES_GCM, &out);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    test = "dvAes256Dec";
+    ret = dvAes256Dec(key, out, &msg, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ck_assert_str_eq("", msg);
+    ruFree(msg);
+    ruFree(out);
+
+    // a padding of 0 is not pkcs#7 even with a matching mac
+    test = "aesDec";
+    const struct dv_crypto_provider* cp = cryptoProvider();
+    struct dv_aes_key zk;
+    uint8_t zplain[BLOCKSIZE + MACSIZE], ziv[BLOCKSIZE], zcbc[BLOCKSIZE];
+    char zrecipe[160];
+    size_t zlen = 0;
+    memcpy(zplain, "0123456789abcde", BLOCKSIZE);
+    cp->sha256(zplain, BLOCKSIZE, zplain + BLOCKSIZE);
+    memset(ziv, 7, BLOCKSIZE);
+    rusize zoff = recipeHead(RECIPE_AES_CBC, CODEC_PLAIN, 0, cs, ziv, zrecipe);
+    memcpy(zcbc, ziv, BLOCKSIZE);
+    ret = cp->aesSetKey(&zk, key, MBEDTLS_AES_ENCRYPT);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = cp->aesCbc(&zk, MBEDTLS_AES_ENCRYPT, sizeof(zplain), zcbc, zplain,
+                     zplain);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    cp->aesFree(&zk);
+    ret = cp->b64Encode((alloc_bytes)zrecipe + zoff, sizeof(zrecipe) - zoff,
+                        &zlen, zplain, sizeof(zplain));
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = DVE_INVALID_CREDENTIALS;
+    ret = dvAes256Dec(key, zrecipe, &msg, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(NULL == msg, retText, test, 0, 1);
+    exp = RUE_OK;
+
     // publish
     cs = NULL;
     test = "mkKey";
@@ -92,7 +244,7 @@ START_TEST ( run ) {
     fail_unless(exp == ret, retText, test, exp, ret);
 
     test = "dvAes256Enc";
-    ret = dvAes256Enc(key, cs, str, &out);
+    ret = dvAes256Enc(key, cs, str, RECIPE_AES_CBC, &out);
     fail_unless(exp == ret, retText, test, exp, ret);
 //    ruVerbLogf("recipe: '%s'", out);
 
@@ -165,6 +317,747 @@ START_TEST ( run ) {
     ruFree(iwd);
     ruFree(swd);
 
+    // the batch hashes more terms than there are lanes and must match above
+    const char* terms[] = {"123", "1234567890123456", "12345678901234567",
+                           "a", "B", "ab", "abc", "Äbc", "123", "xyz"};
+    rusize count = sizeof(terms) / sizeof(terms[0]);
+    char* hashes[sizeof(terms) / sizeof(terms[0])];
+    test = "searchHashTerms";
+    for (int idx = 0; idx < 2; idx++) {
+        indexing = idx;
+        ret = searchHashTerms(appId, terms, count, hashes, indexing);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        for (rusize i = 0; i < count; i++) {
+            ret = dvSearchHash(terms[i], appId, &iwd, indexing);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ck_assert_str_eq(iwd, hashes[i]);
+            ruFree(iwd);
+            ruFree(hashes[i]);
+        }
+    }
+
+    // the selected primitives match the Mbed TLS reference
+    test = "cryptoProvider";
+    uint8_t plain[200], enc[2][208], dig[2][32], ivs[2][BLOCKSIZE];
+    uint8_t b64[2][280];
+    size_t olen[2];
+    for (int i = 0; i < (int)sizeof(plain); i++) plain[i] = (uint8_t)(i * 7 + 3);
+    for (rusize len = 0; len <= sizeof(plain); len++) {
+        for (int a = 0; a < 2; a++) {
+            selectCryptoProvider(a);
+            const struct dv_crypto_provider* cp = cryptoProvider();
+            struct dv_aes_key ak;
+            rusize clen = len - len % BLOCKSIZE;
+            memset(ivs[a], 0x5a, BLOCKSIZE);
+            ret = cp->aesSetKey(&ak, key, MBEDTLS_AES_ENCRYPT);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ret = cp->aesCbc(&ak, MBEDTLS_AES_ENCRYPT, clen, ivs[a], plain,
+                             enc[a]);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            cp->aesFree(&ak);
+            cp->sha256(plain, len, dig[a]);
+            ret = cp->b64Encode(b64[a], sizeof(b64[a]), &olen[a], plain, len);
+            fail_unless(exp == ret, retText, test, exp, ret);
+        }
+        rusize clen = len - len % BLOCKSIZE;
+        fail_unless(0 == memcmp(enc[0], enc[1], clen), retText, test, 0, 1);
+        fail_unless(0 == memcmp(ivs[0], ivs[1], BLOCKSIZE), retText, test, 0, 1);
+        fail_unless(0 == memcmp(dig[0], dig[1], 32), retText, test, 0, 1);
+        ck_assert_int_eq(olen[0], olen[1]);
+        fail_unless(0 == memcmp(b64[0], b64[1], olen[0]), retText, test, 0, 1);
+
+        // and back again, the reference decoding the accelerated output
+        size_t blen = olen[0];
+        for (int a = 0; a < 2; a++) {
+            selectCryptoProvider(!a);
+            const struct dv_crypto_provider* cp = cryptoProvider();
+            struct dv_aes_key ak;
+            uint8_t dec[208];
+            memset(ivs[a], 0x5a, BLOCKSIZE);
+            ret = cp->aesSetKey(&ak, key, MBEDTLS_AES_DECRYPT);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ret = cp->aesCbc(&ak, MBEDTLS_AES_DECRYPT, clen, ivs[a], enc[a],
+                             enc[a]);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            cp->aesFree(&ak);
+            fail_unless(0 == memcmp(enc[a], plain, clen), retText, test, 0, 1);
+            ret = cp->b64Decode(dec, sizeof(dec), &olen[a], b64[a], blen);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ck_assert_int_eq(len, olen[a]);
+            fail_unless(0 == memcmp(dec, plain, len), retText, test, 0, 1);
+        }
+    }
+    // interleaved CBC matches one message at a time
+    test = "aesCbcEncMany";
+    struct dv_cbc_stream streams[13];
+    uint8_t many[13][208], manyIv[13][BLOCKSIZE];
+    selectCryptoProvider(true);
+    for (int i = 0; i < 13; i++) {
+        streams[i].iv = manyIv[i];
+        streams[i].data = many[i];
+        streams[i].len = (rusize)(i * 7 % 13) * BLOCKSIZE;
+        memset(manyIv[i], i, BLOCKSIZE);
+        memcpy(many[i], plain, streams[i].len);
+    }
+    struct dv_aes_key ak;
+    ret = cryptoProvider()->aesSetKey(&ak, key, MBEDTLS_AES_ENCRYPT);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = cryptoProvider()->aesCbcEncMany(&ak, streams, 13);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    cryptoProvider()->aesFree(&ak);
+    selectCryptoProvider(false);
+    ret = cryptoProvider()->aesSetKey(&ak, key, MBEDTLS_AES_ENCRYPT);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    for (int i = 0; i < 13; i++) {
+        memset(ivs[0], i, BLOCKSIZE);
+        ret = cryptoProvider()->aesCbc(&ak, MBEDTLS_AES_ENCRYPT,
+                                       streams[i].len, ivs[0], plain, enc[0]);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        fail_unless(0 == memcmp(enc[0], many[i], streams[i].len), retText,
+                    test, 0, 1);
+        fail_unless(0 == memcmp(ivs[0], manyIv[i], BLOCKSIZE), retText,
+                    test, 0, 1);
+    }
+    cryptoProvider()->aesFree(&ak);
+
+    selectCryptoProvider(true);
+    fail_unless(ruStrStartsWith(dvCryptoInfo(), "aes-cbc=", NULL), retText,
+                test, true, false);
+
+    // batches decrypt like single records
+    test = "dvAes256EncMany";
+    for (int r = 0; r < 2; r++) {
+        ret = dvAes256EncMany(key, cs, terms, count, (enum dvRecipe)r,
+                              CODEC_PLAIN, NULL, hashes);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        for (rusize i = 0; i < count; i++) {
+            ret = dvAes256Dec(key, hashes[i], &msg, NULL);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ck_assert_str_eq(terms[i], msg);
+            ruFree(msg);
+            ruFree(hashes[i]);
+        }
+    }
+
+    // streams in odd chunks match the one-shot recipes both ways
+    test = "cryptStream";
+    char big[5000];
+    for (rusize i = 0; i < sizeof(big); i++) big[i] = (char)('a' + i % 26);
+    rusize sizes[] = {0, 1, 15, 16, 17, 48, sizeof(big) - 1};
+    for (int r = 0; r < 2; r++) {
+        for (rusize s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            rusize sz = sizes[s], off, n;
+            dvcrypt cst = NULL;
+            big[sz] = '\0';
+            ruString rcp = ruStringNew("");
+            ret = newCryptStream(key, "42", (enum dvRecipe)r, true, strWriter,
+                                 rcp, &cst);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            for (off = 0; off < sz; off += n) {
+                n = sz - off < 7? sz - off : 7;
+                ret = cryptStreamUpdate(cst, (trans_bytes)big + off, n);
+                fail_unless(exp == ret, retText, test, exp, ret);
+            }
+            ret = cryptStreamFinish(cst);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            freeCryptStream(cst);
+            char rcs[3] = {0};
+            ret = dvAes256Dec(key, ruStringGetCString(rcp), &msg, rcs);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ck_assert_str_eq(big, msg);
+            ck_assert_str_eq("42", rcs);
+            ruFree(msg);
+            ruStringFree(rcp, false);
+
+            ret = dvAes256Enc(key, "42", big, (enum dvRecipe)r, &out);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            rusize olen = strlen(out);
+            for (int tamper = 0; tamper < 2; tamper++) {
+                if (tamper) out[olen - 10] = out[olen - 10] == 'A'? 'B' : 'A';
+                ruString txt = ruStringNew("");
+                ret = newCryptStream(key, NULL, RECIPE_AES_CBC, false,
+                                     strWriter, txt, &cst);
+                fail_unless(exp == ret, retText, test, exp, ret);
+                for (off = 0; off < olen; off += n) {
+                    n = olen - off < 5? olen - off : 5;
+                    ret = cryptStreamUpdate(cst, (trans_bytes)out + off, n);
+                    fail_unless(exp == ret, retText, test, exp, ret);
+                }
+                ret = cryptStreamFinish(cst);
+                if (tamper) {
+                    fail_unless(DVE_INVALID_CREDENTIALS == ret, retText, test,
+                                DVE_INVALID_CREDENTIALS, ret);
+                } else {
+                    fail_unless(exp == ret, retText, test, exp, ret);
+                    ck_assert_str_eq(big, ruStringGetCString(txt));
+                }
+                // finished streams take nothing more
+                ret = cryptStreamUpdate(cst, (trans_bytes)"a", 1);
+                fail_unless(RUE_INVALID_PARAMETER == ret, retText, test,
+                            RUE_INVALID_PARAMETER, ret);
+                freeCryptStream(cst);
+                ruStringFree(txt, false);
+            }
+            ruFree(out);
+            big[sz] = 'x';
+        }
+    }
+
+    // compressible text is deflated, the rest stays as it is
+    test = "deflate";
+    struct dv_key dk;
+    uint8_t noise[12 * BLOCKSIZE + 1];
+    initKey(&dk, key);
+    for (rusize i = 0; i < sizeof(noise) - 1; i += BLOCKSIZE) {
+        ret = mkIv(noise + i, BLOCKSIZE);
+        fail_unless(exp == ret, retText, test, exp, ret);
+    }
+    for (rusize i = 0; i < sizeof(noise) - 1; i++) {
+        if (!noise[i]) noise[i] = 1;
+    }
+    noise[sizeof(noise) - 1] = 0;
+    big[sizeof(big) - 1] = '\0';
+    const char* texts[] = {big, "abc", (const char*)noise};
+    const char* codecs[] = {":z:", ":b:", ":b:"};
+    for (int r = 0; r < 2; r++) {
+        for (int t = 0; t < 3; t++) {
+            ret = dvAes256EncKey(&dk, "42", texts[t], (enum dvRecipe)r,
+                                 CODEC_DEFLATE, NULL, &out);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            fail_unless(NULL != strstr(out, codecs[t]), retText, test, t, r);
+            ret = dvAes256Dec(key, out, &msg, NULL);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ck_assert_str_eq(texts[t], msg);
+            ruFree(msg);
+            if (t) {
+                ruFree(out);
+                continue;
+            }
+            fail_unless(strlen(out) < strlen(big) / 4, retText, test, 0, 1);
+            rusize olen = strlen(out), off, n;
+            for (int tamper = 0; tamper < 2; tamper++) {
+                dvcrypt cst = NULL;
+                if (tamper) out[olen - 10] = out[olen - 10] == 'A'? 'B' : 'A';
+                ruString txt = ruStringNew("");
+                ret = newCryptStream(key, NULL, RECIPE_AES_CBC, false,
+                                     strWriter, txt, &cst);
+                fail_unless(exp == ret, retText, test, exp, ret);
+                for (off = 0; off < olen && ret == RUE_OK; off += n) {
+                    n = olen - off < 5? olen - off : 5;
+                    ret = cryptStreamUpdate(cst, (trans_bytes)out + off, n);
+                }
+                if (ret == RUE_OK) ret = cryptStreamFinish(cst);
+                if (tamper) {
+                    fail_unless(RUE_OK != ret, retText, test, -1, ret);
+                    ret = dvAes256Dec(key, out, &msg, NULL);
+                    fail_unless(DVE_INVALID_CREDENTIALS == ret, retText, test,
+                                DVE_INVALID_CREDENTIALS, ret);
+                } else {
+                    fail_unless(exp == ret, retText, test, exp, ret);
+                    ck_assert_str_eq(big, ruStringGetCString(txt));
+                }
+                freeCryptStream(cst);
+                ruStringFree(txt, false);
+            }
+            ruFree(out);
+        }
+    }
+    clearKey(&dk);
+
+    // type-ahead keeps the chain of the common prefix
+    dvCtx dc = NULL;
+    dvSearchSession ss = NULL;
+    perm_chars swd2 = NULL;
+    test = "searchSessionHash";
+    ret = dvNew(&dc, PROVIDER_URL, appId, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = dvSearchSessionNew(dc, &ss);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    const char* typed[] = {"1", "12", "123", "12", "1X", "1x4", "1234567890123456",
+                           "12345678901234567", "a", NULL};
+    for (const char** w = &typed[0]; *w; w++) {
+        ret = searchSessionHash(getDvSession(ss), *w, &swd2);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvSearchHash(*w, appId, &swd, false);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(swd, swd2);
+        ruFree(swd);
+    }
+    dvSearchSessionFree(ss);
+
+    // derived keys are prepared once per context and evicted by age
+    test = "getSecretKey";
+    dvctx ctx = getDvCtx(dc);
+    dvkey keys[KEY_CACHE_SIZE + 1];
+    char secret[16];
+    for (int i = 0; i <= KEY_CACHE_SIZE; i++) {
+        snprintf(secret, sizeof(secret), "secret %d", i);
+        ret = getSecretKey(ctx, secret, &keys[i]);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = mkKey(secret, key, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        fail_unless(0 == memcmp(key, keys[i]->key, 32), retText, test, 0, 1);
+    }
+    // all slots are in use, so the last one is a key of its own
+    fail_unless(!keys[KEY_CACHE_SIZE]->cached, retText, test, false, true);
+    for (int i = 0; i <= KEY_CACHE_SIZE; i++) putKey(ctx, keys[i]);
+    dvkey again = NULL;
+    ret = getSecretKey(ctx, "secret 3", &again);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(again == keys[3], retText, test, 0, 1);
+    // keys from the cache decrypt what raw keys encrypt and vice versa
+    ret = dvAes256EncKey(again, "42", str, RECIPE_AES_CBC, CODEC_PLAIN,
+                         NULL, &out);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = mkKey("secret 3", key, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = dvAes256Dec(key, out, &msg, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ck_assert_str_eq(str, msg);
+    ruFree(msg);
+    ruFree(out);
+    putKey(ctx, again);
+    // the least recently used one makes room
+    ret = getSecretKey(ctx, "secret 9", &again);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(again == keys[0], retText, test, 0, 1);
+    putKey(ctx, again);
+
+    test = "DV_COMPRESSION";
+    ret = dvSetProp(dc, DV_COMPRESSION, "deflate");
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(CODEC_DEFLATE == ctx->codec, retText, test, CODEC_DEFLATE,
+                ctx->codec);
+    ret = dvSetProp(dc, DV_COMPRESSION, "lz4");
+    fail_unless(RUE_INVALID_PARAMETER == ret, retText, test,
+                RUE_INVALID_PARAMETER, ret);
+    ret = dvSetProp(dc, DV_COMPRESSION, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(CODEC_PLAIN == ctx->codec, retText, test, CODEC_PLAIN,
+                ctx->codec);
+
+    // records of the same shape shrink with a dictionary
+    test = "dvTrainDictionary";
+    char* samples[40];
+    for (int i = 0; i < 40; i++) {
+        samples[i] = ruDupPrintf("{\"firstname\":\"Name%d\",\"lastname\":"
+                "\"Surname%d\",\"street\":\"Main street %d\",\"city\":"
+                "\"Town %d\",\"email\":\"name%d@example.com\"}", i, i * 7,
+                i * 3, i % 5, i);
+    }
+    void* dict = NULL;
+    size_t dictLen = 0;
+    uint32_t id = 0, id2 = 0;
+    ret = dvTrainDictionary((const char* const*)samples, 1, 1024, &dict,
+                            &dictLen);
+    fail_unless(RUE_INVALID_PARAMETER == ret, retText, test,
+                RUE_INVALID_PARAMETER, ret);
+    ret = dvTrainDictionary((const char* const*)samples, 30, 1024, &dict,
+                            &dictLen);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(dictLen > 0 && dictLen <= 1024, retText, test, 1024, dictLen);
+
+    test = "dvAddDictionary";
+    ret = dvUseDictionary(dc, 1234);
+    fail_unless(RUE_INVALID_PARAMETER == ret, retText, test,
+                RUE_INVALID_PARAMETER, ret);
+    ret = dvAddDictionary(dc, dict, dictLen, &id);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = dvAddDictionary(dc, dict, dictLen, &id2);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(id == id2 && !ctx->dicts->next, retText, test, id, id2);
+    ret = dvUseDictionary(dc, id);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(ctx->dict == ctx->dicts, retText, test, 0, 1);
+
+    test = "dictionary";
+    char dictCodec[CODEC_NAME_SIZE];
+    char* bare = NULL;
+    codecName(CODEC_DEFLATE, id, dictCodec);
+    initKey(&dk, key);
+    for (int i = 30; i < 40; i++) {
+        ret = dvAes256EncKey(&dk, "42", samples[i], RECIPE_AES_GCM,
+                             CODEC_DEFLATE, ctx->dict, &out);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        fail_unless(NULL != strstr(out, dictCodec), retText, test, i, 0);
+        // without a dictionary, these are too short to be compressed
+        ret = dvAes256EncKey(&dk, "42", samples[i], RECIPE_AES_GCM,
+                             CODEC_DEFLATE, NULL, &bare);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        fail_unless(strlen(out) < strlen(bare), retText, test, i, 1);
+        ruFree(bare);
+        ret = dvAes256DecKey(&dk, ctx->dicts, out, &msg, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(samples[i], msg);
+        ruFree(msg);
+        ret = dvAes256Dec(key, out, &msg, NULL);
+        fail_unless(RUE_FILE_NOT_FOUND == ret, retText, test,
+                    RUE_FILE_NOT_FOUND, ret);
+        // streams find it in the context
+        dvcrypt cst = NULL;
+        ruString txt = ruStringNew("");
+        ret = newCryptStream(key, NULL, RECIPE_AES_CBC, false, strWriter, txt,
+                             &cst);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        cst->dicts = ctx->dicts;
+        ret = cryptStreamUpdate(cst, (trans_bytes)out, strlen(out));
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = cryptStreamFinish(cst);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(samples[i], ruStringGetCString(txt));
+        freeCryptStream(cst);
+        ruStringFree(txt, false);
+        ruFree(out);
+    }
+    clearKey(&dk);
+
+    // batches are compressed like single records, with both recipes
+    test = "dvEncryptMany";
+    char* batch[10];
+    initKey(&dk, ctx->key);
+    ret = dvSetProp(dc, DV_COMPRESSION, "deflate");
+    fail_unless(exp == ret, retText, test, exp, ret);
+    for (int r = 0; r < 2; r++) {
+        ret = dvSetProp(dc, DV_CIPHER_RECIPE, r? "aes-256-gcm" : "aes-256-cbc");
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvEncryptMany(dc, (const char* const*)samples + 30, 10, batch);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        for (int i = 0; i < 10; i++) {
+            fail_unless(NULL != strstr(batch[i], dictCodec), retText, test,
+                        i, 0);
+            ret = dvAes256DecKey(&dk, ctx->dicts, batch[i], &msg, NULL);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ck_assert_str_eq(samples[30 + i], msg);
+            ruFree(msg);
+            ruFree(batch[i]);
+        }
+    }
+    ret = dvSetProp(dc, DV_CIPHER_RECIPE, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = dvSetProp(dc, DV_COMPRESSION, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    clearKey(&dk);
+    ruFree(dict);
+    for (int i = 0; i < 40; i++) ruFree(samples[i]);
+
+    // lazy results keep the recipe until dvGetVid decrypts it
+    test = "parseVidData";
+    ret = dvAes256Enc(key, "42", str, RECIPE_AES_CBC, &out);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    char* resp = ruDupPrintf("{\"status\":\"OK\",\"data\":{"
+            "\"v1\":{\"status\":\"OK\",\"data\":\"%s\"},"
+            "\"v2\":{\"status\":\"OK\",\"data\":\"%s\"},"
+            "\"v4\":{\"status\":\"OK\",\"data\":\"%s\"},"
+            "\"v3\":{\"status\":\"NOTFOUND\"},"
+            "\"v1\":{\"status\":\"OK\",\"data\":\"%s\"}}}",
+            out, out, out, out);
+    perm_chars lvids[] = {"v1", "v2", "v3", "v5"};
+    ruMap lmap = NULL;
+    initKey(&dk, key);
+    struct dv_lazy_key* lazy = newLazyKey(&dk, NULL);
+    ret = parseVidData(&dk, NULL, resp, strlen(resp), lvids, 4, false, lazy,
+                       &lmap);
+    putLazyKey(lazy);
+    clearKey(&dk);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    // unrequested v4 and the repeated v1 are skipped, v5 is missing
+    fail_unless(3 == ruMapSize(lmap, NULL), retText, test, 3,
+                ruMapSize(lmap, NULL));
+    dvGetRes lgr = NULL;
+    ret = ruMapGet(lmap, "v1", &lgr);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ck_assert_str_eq(out, lgr->recipe);
+    fail_unless(NULL == lgr->data, retText, test, 0, 1);
+    fail_unless(2 == lazy->refs, retText, test, 2, lazy->refs);
+    for (int i = 0; i < 2; i++) {
+        ret = dvGetVid(lmap, "v1", &msg);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(str, msg);
+    }
+    fail_unless(NULL == lgr->recipe && 1 == lazy->refs, retText, test, 1,
+                lazy->refs);
+    ret = dvGetVid(lmap, "v3", &msg);
+    fail_unless(RUE_FILE_NOT_FOUND == ret, retText, test, RUE_FILE_NOT_FOUND,
+                ret);
+    // v2 is never looked at
+    ruMapFree(lmap);
+    ruFree(resp);
+    ruFree(out);
+
+    // field envelopes
+    const char* fnames[] = {"name", "email", "note"};
+    const char* fvalues[] = {"Max", "max@example.com", "a=b,c:d"};
+    struct dv_fields flds = {fnames, fvalues, 3};
+    char *fplain = NULL, *val = NULL;
+    initKey(&dk, key);
+    test = "encodeFields";
+    exp = RUE_INVALID_PARAMETER;
+    const char* badNames[] = {"name", "e=mail", "note"};
+    struct dv_fields bad = {badNames, fvalues, 3};
+    ret = encodeFields(&dk, "42", &bad, RECIPE_AES_CBC, CODEC_PLAIN, NULL,
+                       &out, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    badNames[1] = "name";
+    ret = encodeFields(&dk, "42", &bad, RECIPE_AES_CBC, CODEC_PLAIN, NULL,
+                       &out, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = RUE_OK;
+    ret = encodeFields(&dk, "42", &flds, RECIPE_AES_CBC, CODEC_PLAIN, NULL,
+                       &out, &fplain);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(isEnvelope(out), retText, test, 1, 0);
+
+    test = "decryptEnvelopeField";
+    for (int i = 0; i < 3; i++) {
+        ret = decryptEnvelopeField(&dk, NULL, out, fnames[i], &val);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(fvalues[i], val);
+        ruFree(val);
+    }
+    exp = RUE_FILE_NOT_FOUND;
+    ret = decryptEnvelopeField(&dk, NULL, out, "nam", &val);
+    fail_unless(exp == ret, retText, test, exp, ret);
+
+    test = "dvAes256DecKey";
+    exp = RUE_OK;
+    char ecs[3] = {0};
+    ret = dvAes256DecKey(&dk, NULL, out, &msg, ecs);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ck_assert_str_eq(fplain, msg);
+    ck_assert_str_eq("42", ecs);
+    ruFree(msg);
+
+    // the vault does not see the names
+    test = "encodeFields";
+    fail_unless(!strstr(out, "email"), retText, test, 0, 1);
+
+    // fields moved, dropped or taken from another envelope are rejected
+    char* other = NULL;
+    ret = encodeFields(&dk, "42", &flds, RECIPE_AES_CBC, CODEC_PLAIN, NULL,
+                       &other, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    // the separators in front of name, email and note
+    char* c1 = strchr(out, ',');
+    char* c2 = strchr(c1 + 1, ',');
+    char* c3 = strchr(c2 + 1, ',');
+    char* o2 = strchr(strchr(other, ',') + 1, ',');
+    char* o3 = strchr(o2 + 1, ',');
+    char* forged[3];
+    forged[0] = ruDupPrintf("%.*s%.*s%.*s%s", (int)(c1 - out), out,
+                            (int)(c3 - c2), c2, (int)(c2 - c1), c1, c3);
+    forged[1] = ruDupPrintf("%.*s", (int)(c3 - out), out);
+    forged[2] = ruDupPrintf("%.*s%.*s%s", (int)(c2 - out), out,
+                            (int)(o3 - o2), o2, c3);
+    exp = DVE_PROTOCOL_ERROR;
+    for (int i = 0; i < 3; i++) {
+        test = "decryptEnvelopeField";
+        ret = decryptEnvelopeField(&dk, NULL, forged[i], "email", &val);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        test = "dvAes256DecKey";
+        ret = dvAes256DecKey(&dk, NULL, forged[i], &msg, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ruFree(forged[i]);
+    }
+    ruFree(other);
+    exp = RUE_OK;
+
+    // dvGetField on a lazy result decrypts just the field
+    test = "dvGetField";
+    resp = ruDupPrintf("{\"status\":\"OK\",\"data\":{"
+            "\"v1\":{\"status\":\"OK\",\"data\":\"%s\"}}}", out);
+    lmap = NULL;
+    lazy = newLazyKey(&dk, NULL);
+    exp = RUE_OK;
+    ret = parseVidData(&dk, NULL, resp, strlen(resp), lvids, 1, false, lazy,
+                       &lmap);
+    putLazyKey(lazy);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = dvGetField(lmap, "v1", "email", &val);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ck_assert_str_eq("max@example.com", val);
+    ret = ruMapGet(lmap, "v1", &lgr);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(lgr->recipe && !lgr->data, retText, test, 1, 0);
+    exp = RUE_FILE_NOT_FOUND;
+    ret = dvGetField(lmap, "v1", "phone", &val);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = RUE_OK;
+    ret = dvGetVid(lmap, "v1", &msg);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ck_assert_str_eq(fplain, msg);
+    // now taken from the JSON object
+    ret = dvGetField(lmap, "v1", "note", &val);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ck_assert_str_eq("a=b,c:d", val);
+    ruMapFree(lmap);
+    ruFree(resp);
+    ruFree(fplain);
+    ruFree(out);
+
+    // a get response fed in pieces of any size
+    test = "vidScannerFeed";
+    ret = dvAes256Enc(key, "42", str, RECIPE_AES_CBC, &out);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    resp = ruDupPrintf("{\"status\": \"OK\", \"data\": {"
+            "\"v1\": {\"status\": \"OK\", \"data\": \"%s\"},"
+            "\"v4\": {\"status\": \"OK\", \"data\": \"%s\"},"
+            "\"v2\": {\"data\": \"%s\", \"status\": \"OK\"},"
+            "\"v3\": {\"status\": \"NOTFOUND\"}}, \"uid\": \"{[\\\"\"}",
+            out, out, out);
+    rusize chunks[] = {1, 3, 64, strlen(resp)};
+    for (int c = 0; c < 4; c++) {
+        dvVidScanner vs = NULL;
+        lmap = NULL;
+        ret = newVidScanner(&dk, NULL, lvids, 3, false, NULL, &lmap, NULL,
+                            &vs);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        for (rusize at = 0; at < strlen(resp) && ret == RUE_OK;
+             at += chunks[c]) {
+            rusize n = strlen(resp) - at;
+            ret = vidScannerFeed(vs, resp + at, n < chunks[c]? n : chunks[c]);
+        }
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = vidScannerFinish(vs, RUE_OK);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        freeVidScanner(vs);
+        fail_unless(3 == ruMapSize(lmap, NULL), retText, test, 3,
+                    ruMapSize(lmap, NULL));
+        for (int v = 0; v < 2; v++) {
+            ret = dvGetVid(lmap, v? "v2" : "v1", &msg);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            ck_assert_str_eq(str, msg);
+        }
+        ret = dvGetVid(lmap, "v3", &msg);
+        fail_unless(RUE_FILE_NOT_FOUND == ret, retText, test,
+                    RUE_FILE_NOT_FOUND, ret);
+        ruMapFree(lmap);
+    }
+    ruFree(resp);
+
+    // a failed status or a truncated response drops the entries
+    exp = 4711;
+    resp = ruDupPrintf("{\"data\": {\"v1\": {\"status\": \"OK\", "
+            "\"data\": \"%s\"}}, \"status\": \"ERROR\", \"code\": 4711}",
+            out);
+    for (int c = 0; c < 2; c++) {
+        dvVidScanner vs = NULL;
+        lmap = NULL;
+        ret = newVidScanner(&dk, NULL, lvids, 3, false, NULL, &lmap, NULL,
+                            &vs);
+        ret = vidScannerFeed(vs, resp, strlen(resp) - c * 3);
+        fail_unless(RUE_OK == ret, retText, test, RUE_OK, ret);
+        ret = vidScannerFinish(vs, RUE_OK);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        fail_unless(NULL == lmap, retText, test, 0, 1);
+        freeVidScanner(vs);
+        exp = DVE_PROTOCOL_ERROR;
+    }
+    ruFree(resp);
+
+    // the same response into a result set in request order
+    test = "resultSet";
+    exp = RUE_OK;
+    resp = ruDupPrintf("{\"status\": \"OK\", \"data\": {"
+            "\"v1\": {\"status\": \"OK\", \"data\": \"%s\"},"
+            "\"v2\": {\"data\": \"%s\", \"status\": \"OK\"},"
+            "\"v3\": {\"status\": \"NOTFOUND\"}}}", out, out);
+    perm_chars rvids[] = {"v3", "v1", "v2", "v1", "v5"};
+    dvresults rs = NULL;
+    ret = newResultSet(rvids, 5, &rs);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    dvVidScanner vs = NULL;
+    ret = newVidScanner(&dk, NULL, rvids, 5, false, NULL, NULL, rs, &vs);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = vidScannerFeed(vs, resp, strlen(resp));
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = vidScannerFinish(vs, RUE_OK);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    freeVidScanner(vs);
+    fail_unless(5 == dvResultSetSize(rs), retText, test, 5,
+                dvResultSetSize(rs));
+    int32_t rstats[] = {RUE_FILE_NOT_FOUND, RUE_OK, RUE_OK, RUE_OK,
+                        RUE_FILE_NOT_FOUND};
+    for (int i = 0; i < 5; i++) {
+        const char* rvid = NULL;
+        const char* rpid = NULL;
+        exp = rstats[i];
+        ret = dvResultSetAt(rs, i, &rvid, &rpid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(rvids[i], rvid);
+        if (exp == RUE_OK) {
+            ck_assert_str_eq(str, rpid);
+        } else {
+            fail_unless(NULL == rpid, retText, test, 0, 1);
+        }
+        ret = dvResultSetGet(rs, rvids[i], &rpid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+    }
+    exp = RUE_INVALID_PARAMETER;
+    ret = dvResultSetAt(rs, 5, NULL, NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = RUE_FILE_NOT_FOUND;
+    ret = dvResultSetGet(rs, "v4", NULL);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    dvResultSetFree(rs);
+    ruFree(resp);
+    ruFree(out);
+
+    // vault responses with both structural scanners
+    test = "parseVaultResp";
+    struct dv_vault_resp vr;
+    exp = RUE_PARAMETER_NOT_SET;
+    ret = parseVaultResp(NULL, 0, &vr);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    perm_chars vresp = "{ \"extra\": {\"a\": [1, {\"b\": \"}]\\\"\"}, []], \"c\": null},"
+           " \"status\" : \"INVALID\", \"code\": 4711 ,"
+           " \"desc\": \"\\\"q\\\" a\\/b \\u00e9\\ud83d\\ude00\","
+           " \"vids\": [\"v1\", 7, \"v\\\\2\"],"
+           " \"data\": {\"v1\": {\"status\": \"OK\", \"data\": \"r:c\"},"
+           " \"v2\": \"skip\", \"v3\": {\"x\": {}, \"status\": \"NOTFOUND\"}}}\n";
+    for (int c = 0; c < 2; c++) {
+        selectJsonScanner(c);
+        exp = RUE_OK;
+        ret = parseVaultResp(vresp, strlen(vresp), &vr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        fail_unless(jstrEquals(&vr.status, STATUS_INVALID), retText, test,
+                    1, 0);
+        fail_unless(vr.hasCode && 4711 == vr.code, retText, test, 4711,
+                    (int32_t)vr.code);
+        fail_unless(vr.desc.esc, retText, test, 1, 0);
+        msg = jstrDup(&vr.desc);
+        ck_assert_str_eq("\"q\" a/b \xc3\xa9\xf0\x9f\x98\x80", msg);
+        ruFree(msg);
+        fail_unless(2 == vr.vidCount, retText, test, 2, (int32_t)vr.vidCount);
+        fail_unless(jstrEquals(&vr.vids[0], "v1"), retText, test, 1, 0);
+        fail_unless(jstrEquals(&vr.vids[1], "v\\2"), retText, test, 1, 0);
+        fail_unless(vr.hasData && 2 == vr.entryCount, retText, test, 2,
+                    (int32_t)vr.entryCount);
+        fail_unless(jstrEquals(&vr.entries[0].vid, "v1") &&
+                    jstrEquals(&vr.entries[0].status, STATUS_OK) &&
+                    jstrEquals(&vr.entries[0].data, "r:c"), retText, test,
+                    1, 0);
+        fail_unless(jstrEquals(&vr.entries[1].status, STATUS_NOT_FOUND) &&
+                    !vr.entries[1].data.ptr, retText, test, 1, 0);
+        exp = 4711;
+        ret = vaultRespStatus(&vr, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        freeVaultResp(&vr);
+
+        perm_chars bad[] = {"", "[]", "{\"status\": \"OK\"", "{\"a\" 1}",
+                            "{\"a\": }", "{\"a\": \"b}", "{} {}",
+                            "{\"a\": [1, 2}",
+                            "{\"vids\": [\"a\"], \"vids\": []}",
+                            "{\"data\": {}, \"data\": {\"a\": {}}}"};
+        exp = DVE_PROTOCOL_ERROR;
+        for (int b = 0; b < 10; b++) {
+            ret = parseVaultResp(bad[b], strlen(bad[b]), &vr);
+            fail_unless(exp == ret, retText, test, exp, ret);
+        }
+    }
+    selectJsonScanner(true);
+
+    clearKey(&dk);
+    dvFree(dc);
 }
 END_TEST
 
@@ -0,0 +1,396 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "tests.h"
+
+#ifdef DV_STANDIN_SERVER
+/*
+ * A stand-in vault that keeps what is added and answers gets of version 3
+ * in MessagePack when it offers the format.
+ */
+struct proto_vault {
+    bool offer;             /* list msgpack in the check response */
+    uint32_t checks;
+    uint32_t binaryGets;
+    uint32_t jsonGets;
+    uint32_t vids;
+    ruMap store;            /* vid to recipe */
+};
+
+struct mp_out {
+    alloc_chars buf;
+    rusize len;
+    rusize cap;
+};
+
+static void mpPut(struct mp_out* mo, const void* data, rusize len) {
+    if (mo->len + len > mo->cap) {
+        while (mo->len + len > mo->cap) mo->cap = mo->cap? mo->cap * 2 : 256;
+        mo->buf = ruRealloc(mo->buf, mo->cap, char);
+    }
+    memcpy(mo->buf + mo->len, data, len);
+    mo->len += len;
+}
+
+static void mpSized(struct mp_out* mo, uint8_t fix, uint8_t fixMax,
+                    uint8_t big, uint32_t n) {
+    uint8_t h[5];
+    if (n <= fixMax && fix) {
+        h[0] = (uint8_t)(fix | n);
+        mpPut(mo, h, 1);
+        return;
+    }
+    // the 32 bit variant keeps it simple
+    h[0] = big;
+    h[1] = (uint8_t)(n >> 24);
+    h[2] = (uint8_t)(n >> 16);
+    h[3] = (uint8_t)(n >> 8);
+    h[4] = (uint8_t)n;
+    mpPut(mo, h, 5);
+}
+
+static void mpMap(struct mp_out* mo, uint32_t n) {
+    mpSized(mo, 0x80, 15, 0xdf, n);
+}
+
+static void mpStr(struct mp_out* mo, const char* s) {
+    mpSized(mo, 0xa0, 31, 0xdb, (uint32_t)strlen(s));
+    mpPut(mo, s, strlen(s));
+}
+
+/*
+ * The recipe as bin, its base64 payload decoded.
+ */
+static void mpRecipe(struct mp_out* mo, const char* recipe) {
+    const char* p = recipe;
+    for (int i = 0; i < 4 && p; i++) {
+        p = strchr(p, ':');
+        if (p) p++;
+    }
+    rusize head = (rusize)(p - recipe), plen = strlen(p);
+    size_t olen = 0;
+    b64Decode(NULL, 0, &olen, (trans_bytes)p, plen);
+    alloc_bytes raw = ruMalloc0(olen + 1, uint8_t);
+    b64Decode(raw, olen, &olen, (trans_bytes)p, plen);
+    mpSized(mo, 0, 0, 0xc6, (uint32_t)(head + olen));
+    mpPut(mo, recipe, head);
+    mpPut(mo, raw, olen);
+    ruFree(raw);
+}
+
+static alloc_chars getAnswer(struct proto_vault* pv, ruJson jsn,
+                             rusize* len) {
+    ruJson vids = ruJsonKeyArray(jsn, "vid", NULL);
+    rusize count = ruJsonArrayLen(vids, NULL);
+    if (ruJsonKeyInt(jsn, "version", NULL) == PROTO_BINARY_VERSION) {
+        struct mp_out mo;
+        memset(&mo, 0, sizeof(mo));
+        pv->binaryGets++;
+        mpMap(&mo, 2);
+        mpStr(&mo, "status");
+        mpStr(&mo, "OK");
+        mpStr(&mo, "data");
+        mpMap(&mo, (uint32_t)count);
+        for (rusize i = 0; i < count; i++) {
+            perm_chars vid = ruJsonIdxStr(vids, i, NULL);
+            perm_chars recipe = NULL;
+            ruMapGet(pv->store, vid, &recipe);
+            mpStr(&mo, vid);
+            mpMap(&mo, recipe? 2 : 1);
+            mpStr(&mo, "status");
+            mpStr(&mo, recipe? "OK" : "NOTFOUND");
+            if (!recipe) continue;
+            mpStr(&mo, "data");
+            mpRecipe(&mo, recipe);
+        }
+        *len = mo.len;
+        return mo.buf;
+    }
+    pv->jsonGets++;
+    ruString out = ruStringNew("{\"status\": \"OK\", \"data\": {");
+    for (rusize i = 0; i < count; i++) {
+        perm_chars vid = ruJsonIdxStr(vids, i, NULL);
+        perm_chars recipe = NULL;
+        ruMapGet(pv->store, vid, &recipe);
+        ruStringAppendf(out, "%s\"%s\": {\"status\": \"%s\"", i? ", " : "",
+                        vid, recipe? "OK" : "NOTFOUND");
+        if (recipe) ruStringAppendf(out, ", \"data\": \"%s\"", recipe);
+        ruStringAppend(out, "}");
+    }
+    ruStringAppend(out, "}}");
+    alloc_chars answer = ruStringGetCString(out);
+    *len = ruStringLen(out, NULL);
+    ruStringFree(out, true);
+    return answer;
+}
+
+static alloc_chars protoAnswer(void* ctx, const char* body, rusize* len) {
+    struct proto_vault* pv = ctx;
+    alloc_chars js = formValue(body, JSON_FIELD);
+    ruJson jsn = js? getJson(js) : NULL;
+    perm_chars op = jsn? ruJsonKeyStr(jsn, "op", NULL) : NULL;
+    alloc_chars answer = NULL;
+    if (ruStrEquals(op, "check")) {
+        pv->checks++;
+        answer = ruStrDup(pv->offer?
+                "{\"status\": \"OK\", \"formats\": [\"json\", \"msgpack\"]}" :
+                "{\"status\": \"INVALID\", \"code\": 4711}");
+    } else if (ruStrEquals(op, "add")) {
+        alloc_chars vid = ruDupPrintf("v%u", ++pv->vids);
+        answer = ruDupPrintf("{\"status\": \"OK\", \"vid\": \"%s\"}", vid);
+        ruMapPut(pv->store, vid, ruJsonKeyStrDup(jsn, "data", NULL));
+    } else if (ruStrEquals(op, "get")) {
+        answer = getAnswer(pv, jsn, len);
+    } else {
+        answer = ruStrDup("{\"status\": \"INVALID\", \"code\": 4711}");
+    }
+    if (!*len) *len = strlen(answer);
+    ruJsonFree(jsn);
+    ruFree(js);
+    return answer;
+}
+
+static const char* records[] = {
+        "{\"name\": \"Jane Doe\", \"note\": \"quotes \\\" and \\\\\"}",
+        "{\"name\": \"J\xc3\xb6rg M\xc3\xbcller\", \"city\": \"K\xc3\xb6ln\"}",
+        "{\"name\": \"John Doe\", \"address\": \"Main Street 1\"}",
+};
+#define RECORDS (sizeof(records) / sizeof(records[0]))
+
+static int32_t streamWriter(void* ctx, const void* data, size_t len) {
+    return ruStringAppendn((ruString)ctx, (const char*)data, len);
+}
+
+struct text_reader {
+    const char* text;
+    rusize len;
+    rusize pos;
+};
+
+static int32_t textReader(void* ctx, void* buf, size_t size, size_t* len) {
+    struct text_reader* tr = ctx;
+    // odd sizes cross the chunk and block boundaries
+    *len = tr->len - tr->pos;
+    if (*len > size) *len = size;
+    if (*len > 1000) *len = 1000;
+    memcpy(buf, tr->text + tr->pos, *len);
+    tr->pos += *len;
+    return RUE_OK;
+}
+
+static void checkGet(dvCtx dc, const char* const* vids, const char* test) {
+    const char *retText = "%s failed wanted ret %d but got %d";
+    int32_t ret, exp = RUE_OK;
+    ruList vl = ruListNew(NULL);
+    ruMap data = NULL;
+    for (rusize i = 0; i < RECORDS; i++) ruListAppend(vl, vids[i]);
+    ruListAppend(vl, "nosuchvid");
+    ret = dvGet(dc, vl, &data);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    for (rusize i = 0; i < RECORDS; i++) {
+        char* pid = NULL;
+        ret = dvGetVid(data, vids[i], &pid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(records[i], pid);
+    }
+    char* pid = NULL;
+    exp = RUE_FILE_NOT_FOUND;
+    ret = dvGetVid(data, "nosuchvid", &pid);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ruMapFree(data);
+    ruListFree(vl);
+}
+#endif
+
+START_TEST ( run ) {
+#ifdef DV_STANDIN_SERVER
+    int32_t ret, exp;
+    const char *test;
+    const char *retText = "%s failed wanted ret %d but got %d";
+    struct standin st;
+    struct proto_vault pv;
+    dvCtx dc = NULL;
+    char* vids[RECORDS];
+
+    test = "parseVaultResp";
+    // a map of one status entry, truncated and complete
+    const char resp[] = "\x81\xa6status\xa2OK";
+    struct dv_vault_resp vr;
+    exp = DVE_PROTOCOL_ERROR;
+    ret = parseVaultResp(resp, sizeof(resp) - 2, &vr);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = RUE_OK;
+    ret = parseVaultResp(resp, sizeof(resp) - 1, &vr);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(jstrEquals(&vr.status, "OK"), retText, test, 1, 0);
+    freeVaultResp(&vr);
+
+    // repeated vids or data keys are refused
+    const char twice[] = "\x82\xa4vids\x92\xa1" "a\xa1" "b"
+                         "\xa4vids\x91\xa1" "c";
+    const char twiceData[] = "\x82\xa4" "data\x81\xa1" "a\x80"
+                             "\xa4" "data\x82\xa1" "b\x80\xa1" "c\x80";
+    exp = DVE_PROTOCOL_ERROR;
+    ret = parseVaultResp(twice, sizeof(twice) - 1, &vr);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = parseVaultResp(twiceData, sizeof(twiceData) - 1, &vr);
+    fail_unless(exp == ret, retText, test, exp, ret);
+
+    // keys that are maps or arrays are skipped along with their value
+    const char mapKeys[] = "\x83\x81\xa1k\xa1v\x92\x01\x02"
+                           "\xa4" "data\x82\x91\xa1x\xa1y"
+                           "\xa1" "a\x82\x81\x01\x02\x01"
+                           "\xa4" "data\xa3" "abc"
+                           "\xa6status\xa2OK";
+    exp = RUE_OK;
+    ret = parseVaultResp(mapKeys, sizeof(mapKeys) - 1, &vr);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(jstrEquals(&vr.status, "OK"), retText, test, 1, 0);
+    fail_unless(1 == vr.entryCount, retText, test, 1, (int)vr.entryCount);
+    fail_unless(jstrEquals(&vr.entries[0].vid, "a"), retText, test, 1, 0);
+    fail_unless(jstrEquals(&vr.entries[0].data, "abc"), retText, test, 1, 0);
+    freeVaultResp(&vr);
+
+    memset(&pv, 0, sizeof(pv));
+    pv.offer = true;
+    pv.store = ruMapNew(ruTypeStrFree(), ruTypeStrFree());
+    fail_unless(startStandin(&st, protoAnswer, &pv), "%s failed",
+                "startStandin");
+    char* url = ruDupPrintf("http://127.0.0.1:%d/", (int)st.port);
+    exp = RUE_OK;
+    ret = dvNew(&dc, url, APPID, NULL);
+    fail_unless(exp == ret, retText, "dvNew", exp, ret);
+    ret = dvSetProp(dc, DV_COMPRESSION, "deflate");
+    fail_unless(exp == ret, retText, "dvSetProp", exp, ret);
+    for (rusize i = 0; i < RECORDS; i++) {
+        ret = dvAdd(dc, records[i], NULL, &vids[i]);
+        fail_unless(exp == ret, retText, "dvAdd", exp, ret);
+    }
+
+    // not asked for, the vault is not asked
+    test = "json";
+    checkGet(dc, (const char* const*)vids, test);
+    fail_unless(0 == pv.checks, retText, test, 0, pv.checks);
+    fail_unless(1 == pv.jsonGets, retText, test, 1, pv.jsonGets);
+
+    // the vault is asked once and answers in MessagePack
+    test = "msgpack";
+    ret = dvSetProp(dc, DV_BINARY_PROTOCOL, "1");
+    fail_unless(exp == ret, retText, test, exp, ret);
+    checkGet(dc, (const char* const*)vids, test);
+    checkGet(dc, (const char* const*)vids, test);
+    fail_unless(1 == pv.checks, retText, test, 1, pv.checks);
+    fail_unless(2 == pv.binaryGets, retText, test, 2, pv.binaryGets);
+
+    // binary entries are decrypted right away
+    test = "lazy msgpack";
+    ret = dvSetProp(dc, DV_LAZY_DECRYPT, "1");
+    fail_unless(exp == ret, retText, test, exp, ret);
+    checkGet(dc, (const char* const*)vids, test);
+    fail_unless(3 == pv.binaryGets, retText, test, 3, pv.binaryGets);
+
+    // and go to result sets too
+    test = "dvGetMany";
+    dvResultSet rs = NULL;
+    ret = dvGetMany(dc, (const char* const*)vids, RECORDS, &rs);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    for (rusize i = 0; i < RECORDS; i++) {
+        const char* pid = NULL;
+        ret = dvResultSetGet(rs, vids[i], &pid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(records[i], pid);
+    }
+    dvResultSetFree(rs);
+    fail_unless(4 == pv.binaryGets, retText, test, 4, pv.binaryGets);
+
+    // streamed downloads keep asking for JSON
+    test = "dvGetStream";
+    ruString streamed = ruStringNew("");
+    ret = dvGetStream(dc, vids[1], streamWriter, streamed);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ck_assert_str_eq(records[1], ruStringGetCString(streamed));
+    ruStringFree(streamed, false);
+    fail_unless(2 == pv.jsonGets, retText, test, 2, pv.jsonGets);
+    fail_unless(4 == pv.binaryGets, retText, test, 4, pv.binaryGets);
+
+    // a vault that does not offer it keeps getting JSON
+    test = "fallback";
+    pv.offer = false;
+    ret = dvSetProp(dc, DV_BINARY_PROTOCOL, "1");
+    fail_unless(exp == ret, retText, test, exp, ret);
+    checkGet(dc, (const char* const*)vids, test);
+    checkGet(dc, (const char* const*)vids, test);
+    fail_unless(2 == pv.checks, retText, test, 2, pv.checks);
+    fail_unless(4 == pv.jsonGets, retText, test, 4, pv.jsonGets);
+    fail_unless(4 == pv.binaryGets, retText, test, 4, pv.binaryGets);
+
+    // streams are uploaded in chunks and decrypted as they come back
+    const char* recipes[] = {"aes-256-cbc", "aes-256-gcm"};
+    rusize bigLen = 100000;
+    alloc_chars big = ruMalloc0(bigLen + 1, char);
+    for (rusize i = 0; i < bigLen; i++) big[i] = (char)('a' + i % 26);
+    for (int r = 0; r < 2; r++) {
+        test = "dvAddStream";
+        struct text_reader tr = {big, bigLen, 0};
+        char* svid = NULL;
+        ret = dvSetProp(dc, DV_CIPHER_RECIPE, recipes[r]);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvAddStream(dc, textReader, &tr, NULL, &svid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        perm_chars stored = NULL;
+        ruMapGet(pv.store, svid, &stored);
+        fail_unless(ruStrStartsWith(stored, recipes[r], NULL), retText,
+                    test, 1, 0);
+
+        test = "dvGetStream";
+        ruString got = ruStringNew("");
+        ret = dvGetStream(dc, svid, streamWriter, got);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(big, ruStringGetCString(got));
+        ruStringFree(got, false);
+
+        // a changed payload fails the mac or the tag
+        char* payload = strstr(stored, ":b:") + 3 + 1000;
+        *payload = *payload == 'A'? 'B' : 'A';
+        got = ruStringNew("");
+        exp = DVE_INVALID_CREDENTIALS;
+        ret = dvGetStream(dc, svid, streamWriter, got);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_OK;
+        ruStringFree(got, false);
+        ruFree(svid);
+    }
+    ruFree(big);
+
+    for (rusize i = 0; i < RECORDS; i++) ruFree(vids[i]);
+    dvFree(dc);
+    ruFree(url);
+    stopStandin(&st);
+    ruMapFree(pv.store);
+#endif
+}
+END_TEST
+
+TCase* protoTests (void) {
+    TCase *tcase = tcase_create("proto");
+    tcase_add_test(tcase, run);
+    return tcase;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "tests.h"
+
+#ifdef DV_STANDIN_SERVER
+/*
+ * The stand-in vault answers search requests. It knows STANDIN_VIDS vids
+ * and pages them by the limit and next the request gives.
+ */
+#define STANDIN_VIDS 2500
+
+static alloc_chars searchAnswer(void* ctx, const char* body, rusize* len) {
+    alloc_chars js = formValue(body, JSON_FIELD);
+    ruJson jsn = js? getJson(js) : NULL;
+    ruString out = ruStringNew("");
+    perm_chars op = jsn? ruJsonKeyStr(jsn, "op", NULL) : NULL;
+    ruJson words = jsn? ruJsonKeyArray(jsn, "words", NULL) : NULL;
+    if (!ruStrEquals(op, "search") || !words) {
+        ruStringAppend(out, "{\"status\": \"INVALID\", \"code\": 4711}");
+    } else {
+        perm_chars word = ruJsonIdxStr(words, 0, NULL);
+        int64_t limit = ruJsonKeyInt(jsn, "limit", NULL);
+        perm_chars next = ruJsonKeyStr(jsn, "next", NULL);
+        int64_t from = next? strtoll(next, NULL, 10) : 0;
+        int64_t to = STANDIN_VIDS;
+        if (limit > 0 && from + limit < to) to = from + limit;
+        ruStringAppend(out, "{\"status\": \"OK\", \"vids\": [");
+        for (int64_t i = from; i < to; i++) {
+            // one vid needs unescaping
+            ruStringAppendf(out, "%s\"v%s%04d\"", i == from? "" : ", ",
+                            i == 7? "\\/" : "", (int)i);
+        }
+        ruStringAppend(out, "]");
+        if (ruStrEquals(word, "loop")) {
+            // a broken vault handing out the same page again
+            ruStringAppend(out, ", \"next\": \"1\"");
+        } else if (ruStrEquals(word, "cycle")) {
+            // or going back to an earlier one
+            ruStringAppendf(out, ", \"next\": \"%d\"", from == 1? 2 : 1);
+        } else if (to < STANDIN_VIDS) {
+            ruStringAppendf(out, ", \"next\": \"%d\"", (int)to);
+        }
+        ruStringAppend(out, "}");
+    }
+    ruJsonFree(jsn);
+    ruFree(js);
+    alloc_chars answer = ruStringGetCString(out);
+    *len = ruStringLen(out, NULL);
+    ruStringFree(out, true);
+    return answer;
+}
+
+struct vid_count {
+    uint32_t count;
+    bool ordered;
+    bool unescaped;
+    uint32_t stopAt;
+};
+
+static int32_t countVid(void* usrCtx, const char* vid) {
+    struct vid_count* vc = usrCtx;
+    char want[16];
+    snprintf(want, sizeof(want), "v%s%04u", vc->count == 7? "/" : "",
+             vc->count);
+    if (!ruStrEquals(want, vid)) vc->ordered = false;
+    if (vc->count == 7 && ruStrEquals(vid, "v/0007")) vc->unescaped = true;
+    if (++vc->count == vc->stopAt) return 4711;
+    return RUE_OK;
+}
+#endif
+
+START_TEST ( run ) {
+#ifdef DV_STANDIN_SERVER
+    int32_t ret, exp;
+    const char *test;
+    const char *retText = "%s failed wanted ret %d but got %d";
+    struct standin st;
+    struct vid_count vc;
+    dvCtx dc = NULL;
+    ruList words = ruListNew(NULL), vids = NULL;
+    ruListAppend(words, "someword");
+
+    fail_unless(startStandin(&st, searchAnswer, NULL), "%s failed", "startStandin");
+    char* url = ruDupPrintf("http://127.0.0.1:%d/", (int)st.port);
+    exp = RUE_OK;
+    ret = dvNew(&dc, url, APPID, NULL);
+    fail_unless(exp == ret, retText, "dvNew", exp, ret);
+
+    test = "dvSearchEach";
+    exp = RUE_PARAMETER_NOT_SET;
+    ret = dvSearchEach(NULL, words, countVid, &vc);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = dvSearchEach(dc, NULL, countVid, &vc);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    ret = dvSearchEach(dc, words, NULL, &vc);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    exp = RUE_INVALID_PARAMETER;
+    ret = dvSetProp(dc, DV_SEARCH_PAGE_SIZE, "-1");
+    fail_unless(exp == ret, retText, test, exp, ret);
+
+    // all at once
+    exp = RUE_OK;
+    memset(&vc, 0, sizeof(vc));
+    vc.ordered = true;
+    ret = dvSearchEach(dc, words, countVid, &vc);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(STANDIN_VIDS == vc.count, retText, test, STANDIN_VIDS,
+                vc.count);
+    fail_unless(vc.ordered && vc.unescaped, retText, test, 1, 0);
+    fail_unless(1 == st.requests, retText, test, 1, st.requests);
+
+    // in pages of 1000
+    ret = dvSetProp(dc, DV_SEARCH_PAGE_SIZE, "1000");
+    fail_unless(exp == ret, retText, test, exp, ret);
+    memset(&vc, 0, sizeof(vc));
+    vc.ordered = true;
+    ret = dvSearchEach(dc, words, countVid, &vc);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(STANDIN_VIDS == vc.count, retText, test, STANDIN_VIDS,
+                vc.count);
+    fail_unless(vc.ordered && vc.unescaped, retText, test, 1, 0);
+    fail_unless(4 == st.requests, retText, test, 4, st.requests);
+
+    // the function stops the search
+    memset(&vc, 0, sizeof(vc));
+    vc.stopAt = 10;
+    exp = 4711;
+    ret = dvSearchEach(dc, words, countVid, &vc);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(10 == vc.count, retText, test, 10, vc.count);
+    fail_unless(5 == st.requests, retText, test, 5, st.requests);
+
+    // a page that does not advance
+    ruListFree(words);
+    words = ruListNew(NULL);
+    ruListAppend(words, "loop");
+    memset(&vc, 0, sizeof(vc));
+    exp = DVE_PROTOCOL_ERROR;
+    ret = dvSearchEach(dc, words, countVid, &vc);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(7 == st.requests, retText, test, 7, st.requests);
+
+    // nor does one that comes back to an earlier page
+    ruListFree(words);
+    words = ruListNew(NULL);
+    ruListAppend(words, "cycle");
+    memset(&vc, 0, sizeof(vc));
+    ret = dvSearchEach(dc, words, countVid, &vc);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(10 == st.requests, retText, test, 10, st.requests);
+
+    // dvSearch collects the pages
+    test = "dvSearch";
+    exp = RUE_OK;
+    ruListFree(words);
+    words = ruListNew(NULL);
+    ruListAppend(words, "someword");
+    ret = dvSearch(dc, words, &vids);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    fail_unless(STANDIN_VIDS == ruListSize(vids, NULL), retText, test,
+                STANDIN_VIDS, ruListSize(vids, NULL));
+    ruIterator li = ruListIter(vids);
+    perm_chars vid = ruIterNext(li, char*);
+    for (int i = 0; i < 7; i++) vid = ruIterNext(li, char*);
+    ck_assert_str_eq("v/0007", vid);
+
+    ruListFree(vids);
+    ruListFree(words);
+    dvFree(dc);
+    ruFree(url);
+    stopStandin(&st);
+#endif
+}
+END_TEST
+
+TCase* searchTests (void) {
+    TCase *tcase = tcase_create("search");
+    tcase_add_test(tcase, run);
+    return tcase;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright DataVaccinator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "tests.h"
+
+#ifdef DV_STANDIN_SERVER
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/*
+ * A stand-in vault answering over plain HTTP on a local socket, one request
+ * per connection. The tests give the function that answers the requests.
+ */
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return 0;
+}
+
+alloc_chars formValue(const char* body, const char* field) {
+    rusize flen = strlen(field);
+    if (strncmp(body, field, flen) || body[flen] != '=') return NULL;
+    const char* in = body + flen + 1;
+    rusize len = strcspn(in, "&"), o = 0;
+    alloc_chars out = ruMalloc0(len + 1, char);
+    for (rusize i = 0; i < len; i++) {
+        if (in[i] == '%' && i + 2 < len + 1) {
+            out[o++] = (char)(hexDigit(in[i + 1]) << 4 | hexDigit(in[i + 2]));
+            i += 2;
+        } else {
+            out[o++] = in[i] == '+'? ' ' : in[i];
+        }
+    }
+    return out;
+}
+
+// joins the chunks of a chunked request body
+static alloc_chars unchunk(perm_chars in) {
+    ruString out = ruStringNew("");
+    while (in) {
+        char* end = NULL;
+        unsigned long n = strtoul(in, &end, 16);
+        if (!n) break;
+        in = strstr(end, "\r\n");
+        if (!in) break;
+        ruStringAppendn(out, in + 2, n);
+        in += 2 + n + 2;
+    }
+    alloc_chars body = ruStringGetCString(out);
+    ruStringFree(out, true);
+    return body;
+}
+
+static bool complete(ruString req, rusize bodyAt, rusize bodyLen,
+                     bool chunked) {
+    if (!bodyAt) return false;
+    if (!chunked) return ruStringLen(req, NULL) >= bodyAt + bodyLen;
+    perm_chars body = ruStringGetCString(req) + bodyAt;
+    return ruStrStartsWith(body, "0\r\n\r\n", NULL) ||
+           strstr(body, "\r\n0\r\n\r\n");
+}
+
+static void serve(struct standin* st, int fd) {
+    ruString req = ruStringNew("");
+    char buf[4096];
+    rusize bodyAt = 0, bodyLen = 0;
+    bool chunked = false;
+    while (!complete(req, bodyAt, bodyLen, chunked)) {
+        ssize_t got = recv(fd, buf, sizeof(buf), 0);
+        if (got <= 0) break;
+        ruStringAppendn(req, buf, (rusize)got);
+        perm_chars txt = ruStringGetCString(req);
+        perm_chars end = strstr(txt, "\r\n\r\n");
+        if (!bodyAt && end) {
+            bodyAt = (rusize)(end - txt) + 4;
+            perm_chars cl = strstr(txt, "Content-Length: ");
+            if (cl && cl < end) bodyLen = strtoul(cl + 16, NULL, 10);
+            perm_chars te = strstr(txt, "Transfer-Encoding: chunked");
+            chunked = te && te < end;
+            if (strstr(txt, "100-continue")) {
+                perm_chars cont = "HTTP/1.1 100 Continue\r\n\r\n";
+                send(fd, cont, strlen(cont), 0);
+            }
+        }
+    }
+    if (bodyAt) {
+        rusize len = 0;
+        perm_chars body = ruStringGetCString(req) + bodyAt;
+        alloc_chars joined = chunked? unchunk(body) : NULL;
+        alloc_chars answer = st->answer(st->answerCtx,
+                                        joined? joined : body, &len);
+        ruFree(joined);
+        alloc_chars head = ruDupPrintf("HTTP/1.1 200 OK\r\n"
+                                       "Content-Type: %s\r\n"
+                                       "Content-Length: %lu\r\n"
+                                       "Connection: close\r\n\r\n",
+                                       isMsgpack(answer, len)?
+                                       "application/msgpack" :
+                                       "application/json",
+                                       (unsigned long)len);
+        send(fd, head, strlen(head), 0);
+        send(fd, answer, len, 0);
+        ruFree(head);
+        ruFree(answer);
+    }
+    ruStringFree(req, false);
+}
+
+static void* standinLoop(void* arg) {
+    struct standin* st = arg;
+    while (!st->stop) {
+        int fd = accept(st->fd, NULL, NULL);
+        if (fd < 0) break;
+        if (!st->stop) {
+            st->requests++;
+            serve(st, fd);
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+bool startStandin(struct standin* st, standinFn answer, void* answerCtx) {
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    memset(st, 0, sizeof(*st));
+    st->answer = answer;
+    st->answerCtx = answerCtx;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    st->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (st->fd < 0) return false;
+    if (bind(st->fd, (struct sockaddr*)&addr, sizeof(addr)) ||
+        listen(st->fd, 4) ||
+        getsockname(st->fd, (struct sockaddr*)&addr, &alen)) {
+        close(st->fd);
+        return false;
+    }
+    st->port = ntohs(addr.sin_port);
+    return !pthread_create(&st->thread, NULL, standinLoop, st);
+}
+
+void stopStandin(struct standin* st) {
+    struct sockaddr_in addr;
+    st->stop = true;
+    // wake up accept
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(st->port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0) {
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+        close(fd);
+    }
+    pthread_join(st->thread, NULL);
+    close(st->fd);
+}
+#endif
@@ -33,6 +33,9 @@ int main ( int argc, char **argv ) {
     suite_add_tcase(suite, vaccTests());
     suite_add_tcase(suite, cacheTests());
     suite_add_tcase(suite, changeTests());
+    suite_add_tcase(suite, allocTests());
+    suite_add_tcase(suite, searchTests());
+    suite_add_tcase(suite, protoTests());
     SRunner *runner = srunner_create(suite);
     srunner_run_all(runner, CK_NORMAL);
     number_failed = srunner_ntests_failed(runner);
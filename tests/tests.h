@@ -50,6 +50,31 @@ int32_t getIv();
 int32_t dvSha256(const char* str, char** hash);
 void getPaddedEnd(const char* str, alloc_bytes last, rusize lastLen);
 
+#ifdef DV_STANDIN_SERVER
+#include <pthread.h>
+
+// standin.c
+/*
+ * Answers the url encoded body of a request to the stand-in vault with a
+ * response of len bytes.
+ */
+typedef alloc_chars (*standinFn)(void* ctx, const char* body, rusize* len);
+
+struct standin {
+    int fd;
+    uint16_t port;
+    uint32_t requests;
+    volatile bool stop;
+    pthread_t thread;
+    standinFn answer;
+    void* answerCtx;
+};
+
+bool startStandin(struct standin* st, standinFn answer, void* answerCtx);
+void stopStandin(struct standin* st);
+alloc_chars formValue(const char* body, const char* field);
+#endif
+
 
 
 /* Only need to export C interface if used by C++ source code */
@@ -61,6 +86,9 @@ TCase* cipherTests (void);
 TCase* vaccTests (void);
 TCase* cacheTests(void);
 TCase* changeTests (void);
+TCase* allocTests (void);
+TCase* searchTests (void);
+TCase* protoTests (void);
 
 #ifdef __cplusplus
 }   /* extern "C" */
@@ -21,6 +21,15 @@
  */
 #include "tests.h"
 
+int32_t nullWriter(void* usrCtx, const void* data, size_t len) {
+    return RUE_OK;
+}
+
+int32_t nullReader(void* usrCtx, void* buf, size_t size, size_t* len) {
+    *len = 0;
+    return RUE_OK;
+}
+
 START_TEST ( api ) {
 
     int32_t exp, ret;
@@ -31,6 +40,8 @@ START_TEST ( api ) {
     char *strptr = NULL;
     ruList list = ruListNew(NULL);
     ruMap map = NULL;
+    dvSearchSession ss = NULL;
+    dvResultSet rs = NULL;
 
     do {
 
@@ -93,6 +104,14 @@ START_TEST ( api ) {
         fail_unless(exp == ret, retText, test, exp, ret);
         ret = dvSetProp((dvCtx)string, 99999, NULL);
         fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvSetProp(dc, DV_CIPHER_RECIPE, "aes-128-ecb");
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_OK;
+        ret = dvSetProp(dc, DV_CIPHER_RECIPE, "aes-256-gcm");
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvSetProp(dc, DV_CIPHER_RECIPE, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
 
 
         test = "dvAdd";
@@ -123,6 +142,77 @@ START_TEST ( api ) {
         ret = dvUpdate((dvCtx)string, string, string, NULL);
         fail_unless(exp == ret, retText, test, exp, ret);
 
+        test = "dvAddFields";
+        const char* names[] = {"name"};
+        const char* values[] = {string};
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvAddFields(NULL, names, values, 1, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvAddFields(dc, NULL, values, 1, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvAddFields(dc, names, NULL, 1, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvAddFields(dc, names, values, 1, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvAddFields((dvCtx)string, names, values, 1, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvAddFields(dc, names, values, 0, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvEncryptRecord";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvEncryptRecord(NULL, string, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvEncryptRecord(dc, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvEncryptRecord(dc, string, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvEncryptRecord((dvCtx)string, string, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvAddCipher";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvAddCipher(NULL, string, NULL, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvAddCipher(dc, NULL, string, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvAddCipher(dc, string, NULL, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvAddCipher((dvCtx)string, string, NULL, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        // not a cipher recipe
+        ret = dvAddCipher(dc, string, NULL, NULL, &strptr);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvUpdateCipher";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvUpdateCipher(NULL, string, string, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvUpdateCipher(dc, NULL, string, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvUpdateCipher(dc, string, NULL, string, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvUpdateCipher(dc, string, string, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvUpdateFields";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvUpdateFields(NULL, string, names, values, 1, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvUpdateFields(dc, NULL, names, values, 1, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvUpdateFields(dc, string, NULL, values, 1, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvUpdateFields((dvCtx)string, string, names, values, 1, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
         test = "dvGet";
         exp = RUE_PARAMETER_NOT_SET;
         ret = dvGet(NULL, list, &map);
@@ -138,6 +228,27 @@ START_TEST ( api ) {
         ret = dvGet(dc, (ruList)string, &map);
         fail_unless(exp == ret, retText, test, exp, ret);
 
+        test = "dvGetMany";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvGetMany(NULL, &string, 1, &rs);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvGetMany(dc, NULL, 1, &rs);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvGetMany(dc, &string, 1, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvGetMany((dvCtx)string, &string, 1, &rs);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvResultSetAt";
+        ret = dvResultSetAt((dvResultSet)string, 0, NULL, NULL);
+        fail_unless(RUE_PARAMETER_NOT_SET == ret, retText, test,
+                    RUE_PARAMETER_NOT_SET, ret);
+        fail_unless(0 == dvResultSetSize((dvResultSet)string), retText, test,
+                    0, dvResultSetSize((dvResultSet)string));
+        dvResultSetFree((dvResultSet)string);
+
         test = "dvSearch";
         exp = RUE_PARAMETER_NOT_SET;
         ret = dvSearch(NULL, list, &list);
@@ -166,6 +277,17 @@ START_TEST ( api ) {
         ret = dvDelete(dc, (ruList)string);
         fail_unless(exp == ret, retText, test, exp, ret);
 
+        test = "dvDeleteMany";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvDeleteMany(NULL, &string, 1);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvDeleteMany(dc, NULL, 1);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvDeleteMany((dvCtx)string, &string, 1);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
         test = "dvWipe";
         exp = RUE_PARAMETER_NOT_SET;
         ret = dvWipe(NULL, NULL);
@@ -177,12 +299,169 @@ START_TEST ( api ) {
         ret = dvWipe(dc, (ruList)string);
         fail_unless(exp == ret, retText, test, exp, ret);
 
+        test = "dvWipeMany";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvWipeMany(NULL, &string, 1);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvWipeMany(dc, NULL, 1);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvWipeMany((dvCtx)string, &string, 1);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvSearchSessionNew";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvSearchSessionNew(NULL, &ss);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvSearchSessionNew(dc, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvSearchSessionNew((dvCtx)string, &ss);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_OK;
+        ret = dvSearchSessionNew(dc, &ss);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvSearchSessionFind";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvSearchSessionFind(NULL, string, &list);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvSearchSessionFind(ss, NULL, &list);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvSearchSessionFind(ss, string, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvSearchSessionFind((dvSearchSession)string, string, &list);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvSearchSessionFind(ss, "", &list);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        const char* records[] = {string, string};
+        char* ciphers[2];
+        test = "dvEncryptMany";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvEncryptMany(NULL, records, 2, ciphers);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvEncryptMany(dc, NULL, 2, ciphers);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvEncryptMany(dc, records, 2, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvEncryptMany((dvCtx)string, records, 2, ciphers);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        exp = RUE_OK;
+        ret = dvEncryptMany(dc, records, 0, ciphers);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        dvCryptStream cst = NULL;
+        test = "dvEncryptStreamNew";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvEncryptStreamNew(NULL, nullWriter, NULL, &cst);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvEncryptStreamNew(dc, NULL, NULL, &cst);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvEncryptStreamNew(dc, nullWriter, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvEncryptStreamNew((dvCtx)string, nullWriter, NULL, &cst);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvDecryptStreamNew";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvDecryptStreamNew(NULL, nullWriter, NULL, &cst);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvDecryptStreamNew(dc, NULL, NULL, &cst);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvDecryptStreamNew(dc, nullWriter, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_OK;
+        ret = dvDecryptStreamNew(dc, nullWriter, NULL, &cst);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvCryptStreamUpdate";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvCryptStreamUpdate(NULL, string, 1);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvCryptStreamUpdate(cst, NULL, 1);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvCryptStreamUpdate((dvCryptStream)string, string, 1);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvCryptStreamFinish";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvCryptStreamFinish(NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvCryptStreamFinish((dvCryptStream)string);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        // nothing was given to decrypt
+        exp = DVE_PROTOCOL_ERROR;
+        ret = dvCryptStreamFinish(cst);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        dvCryptStreamFree(cst);
+        dvCryptStreamFree(NULL);
+
+        char* svid = NULL;
+        test = "dvAddStream";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvAddStream(NULL, nullReader, NULL, NULL, &svid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvAddStream(dc, NULL, NULL, NULL, &svid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvAddStream(dc, nullReader, NULL, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvAddStream((dvCtx)string, nullReader, NULL, NULL, &svid);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        test = "dvGetStream";
+        exp = RUE_PARAMETER_NOT_SET;
+        ret = dvGetStream(NULL, string, nullWriter, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvGetStream(dc, NULL, nullWriter, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ret = dvGetStream(dc, string, NULL, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        exp = RUE_INVALID_PARAMETER;
+        ret = dvGetStream((dvCtx)string, string, nullWriter, NULL);
+        fail_unless(exp == ret, retText, test, exp, ret);
+
+        // request bodies are written in their wire form
+        test = "newReq";
+        struct dv_req rq;
+        ruList rvids = ruListNew(NULL);
+        ruListAppend(rvids, "a1");
+        ruListAppend(rvids, "x\"\\/ \n");
+        for (int i = 0; i < 2; i++) {
+            newReq(getDvCtx(dc), &rq, i? "foo" : "get");
+            exp = RUE_OK;
+            ret = reqAddList(&rq, "vid", rvids);
+            fail_unless(exp == ret, retText, test, exp, ret);
+            reqAddInt(&rq, "duration", 7);
+            ck_assert_str_eq(i?
+                "json=%7B%22version%22%3A2%2C%22op%22%3A%22foo%22"
+                "%2C%22vid%22%3A%5B%22a1%22%2C%22x%5C%22%5C%5C%2F%20%5Cu000A"
+                "%22%5D%2C%22duration%22%3A7%7D" :
+                "json=%7B%22version%22%3A2%2C%22op%22%3A%22get%22"
+                "%2C%22vid%22%3A%5B%22a1%22%2C%22x%5C%22%5C%5C%2F%20%5Cu000A"
+                "%22%5D%2C%22duration%22%3A7%7D", reqBody(&rq, NULL));
+            freeReq(getDvCtx(dc), &rq);
+        }
+        ruListFree(rvids);
 
     } while (false);
 
     if (strptr) free(strptr);
     if (list) ruListFree(list);
     if (map) ruMapFree(map);
+    if (ss) dvSearchSessionFree(ss);
     if (dc) dvFree(dc);
 
 }
@@ -210,8 +489,9 @@ START_TEST ( run ) {
     const char *foo = "foo", *bar = "bar", *passwd = "mysecret";
     char *fovid = NULL, *bavid = NULL;
     ruList vids = NULL, indexTerms = NULL, searchTerms = NULL,
-        fndVids = NULL, fndVids2 = NULL;
+        fndVids = NULL, fndVids2 = NULL, fndVids3 = NULL;
     ruMap data = NULL;
+    dvSearchSession ss = NULL;
 
     ck_assert_str_eq(myVersion, dvVersion());
 
@@ -271,6 +551,22 @@ START_TEST ( run ) {
     ruMapFree(data);
     data = NULL;
 
+    // the same from an array into a result set
+    test = "dvGetMany";
+    const char* avids[] = {bavid, fovid};
+    dvResultSet rs = NULL;
+    ret = dvGetMany(dc, avids, 2, &rs);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    test = "dvResultSetAt";
+    for (size_t i = 0; i < 2; i++) {
+        const char *vd = NULL, *out = NULL;
+        ret = dvResultSetAt(rs, i, &vd, &out);
+        fail_unless(exp == ret, retText, test, exp, ret);
+        ck_assert_str_eq(avids[i], vd);
+        ck_assert_str_eq(i? foo : bar, out);
+    }
+    dvResultSetFree(rs);
+
     // search data
     test = "dvAddSearchWord";
     ret = dvAddSearchWord(&searchTerms, APPID, "ba");
@@ -316,10 +612,33 @@ START_TEST ( run ) {
     }
     fail_unless(true == found, retText, test, true, found);
 
+    // type-ahead search with retyping
+    test = "dvSearchSessionNew";
+    ret = dvSearchSessionNew(dc, &ss);
+    fail_unless(exp == ret, retText, test, exp, ret);
+    const char* typed[] = {"b", "ba", "b", "ba", "bar", "ba", NULL};
+    test = "dvSearchSessionFind";
+    for (const char** w = &typed[0]; *w; w++) {
+        ruListFree(fndVids3);
+        fndVids3 = NULL;
+        ret = dvSearchSessionFind(ss, *w, &fndVids3);
+        fail_unless(exp == ret, retText, test, exp, ret);
+    }
+    li = ruListIter(fndVids3);
+    found = false;
+    for(char* vd = ruIterNext(li, char*); vd; vd = ruIterNext(li, char*)) {
+        if (ruStrEquals(bavid, vd)) found = true;
+    }
+    fail_unless(true == found, retText, test, true, found);
+    dvSearchSessionFree(ss);
+
     // wipe cache
     test = "dvWipe";
     ret = dvWipe(dc, vids);
     fail_unless(exp == ret, retText, test, exp, ret);
+    test = "dvWipeMany";
+    ret = dvWipeMany(dc, avids, 2);
+    fail_unless(exp == ret, retText, test, exp, ret);
 
     // delete data
     test = "dvDelete";
@@ -340,6 +659,7 @@ START_TEST ( run ) {
     if (indexTerms) ruListFree(indexTerms);
     if (fndVids) ruListFree(fndVids);
     if (fndVids2) ruListFree(fndVids2);
+    if (fndVids3) ruListFree(fndVids3);
     if (data) ruMapFree(data);
     if (dc) dvFree(dc);
 